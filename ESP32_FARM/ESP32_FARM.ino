@@ -22,10 +22,14 @@
 // ==========================================
 
 #include "config.h"
+#include "diagnostics.h"
 #include "gsm_manager.h"
+#include "heap_trace.h"
 #include "keypad_manager.h"
 #include "lcd_manager.h"
+#include "pipeline.h"
 #include "rtc_manager.h"
+#include "scheduler.h"
 #include "sd_manager.h"
 #include "sensor_manager.h"
 #include "wifi_sync.h"
@@ -33,28 +37,397 @@
 // ==========================================
 //  STATE MACHINE
 // ==========================================
+// The UI is one scheduler task. Each state handler runs its entry action
+// once (enteringState()), then on every tick reacts to queued keys, timers
+// and worker replies and returns straight away. SD, WiFi/sync and GSM work
+// happen on the other core (see pipeline.h), so e.g. the next farmer ID can
+// be keyed in while an SMS is still going out.
 enum SystemState {
   STATE_BOOT,
   STATE_WIFI_CHECK,
   STATE_SYNC_PROMPT,
   STATE_SYNCING,
   STATE_MAIN_MENU,
+  STATE_SYNC_MENU,
   STATE_ENTER_ID,
   STATE_FARMER_FOUND,
   STATE_NEW_FARMER,
   STATE_READING_SOIL,
+  STATE_SENSOR_ERROR,
   STATE_SHOW_RESULTS,
   STATE_SAVE_PROMPT,
   STATE_DATA_SAVED
 };
 
+const char *const STATE_NAMES[] = {
+    "BOOT",         "WIFI_CHECK",   "SYNC_PROMPT",   "SYNCING",
+    "MAIN_MENU",    "SYNC_MENU",    "ENTER_ID",      "FARMER_FOUND",
+    "NEW_FARMER",   "READING_SOIL", "SENSOR_ERROR",  "SHOW_RESULTS",
+    "SAVE_PROMPT",  "DATA_SAVED"};
+
 SystemState currentState = STATE_BOOT;
+bool stateEntered = false; // entry action of currentState has run
+int statePhase = 0;        // step within a multi-screen state
+SchedTimer stateTimer;     // splash screens within a state
 
 // Current session variables
-String currentFarmerID = "";
-String currentPhone = "";
-SoilData currentReading;
-int resultPage = 0;
+FarmerId currentFarmerID;
+FixedString<PIPE_PHONE_MAX> currentPhone;
+PipeHistory currentHistory; // the looked-up farmer's last visits
+SoilData currentReadings[SENSOR_MAX_PROBES]; // valid results, one per probe
+int currentReadingCount = 0;
+int resultPage = 0; // two pages per probe
+NumericInput currentInput;
+LcdLine menuShown; // main menu status line currently on the LCD
+uint8_t savedFlags = 0; // reply flags of the last save (SMS outcome)
+
+// One task table per worker; the UI table runs on the loop task
+Scheduler uiSched;
+Scheduler ioSched;
+Scheduler netSched;
+Scheduler gsmSched;
+bool ioOnLoop = true; // worker not started, run its table from loop()
+bool netOnLoop = true;
+bool gsmOnLoop = true;
+
+void setState(SystemState state) {
+  heapTraceTransition(STATE_NAMES[currentState], STATE_NAMES[state]);
+  diagSample(STATE_NAMES[currentState], STATE_NAMES[state]);
+  currentState = state;
+  stateEntered = false;
+  statePhase = 0;
+  timerStop(stateTimer);
+}
+
+// True on the first tick in a state
+bool enteringState() {
+  if (stateEntered)
+    return false;
+  stateEntered = true;
+  return true;
+}
+
+// ==========================================
+//  PIPELINE - UI SIDE
+// ==========================================
+
+// What the UI knows about the workers, kept current by uiInboxTask()
+struct UiView {
+  int farmers = 0;
+  int logs = 0;
+  int nextId = 1;
+  bool syncing = false;
+  int smsPending = 0; // outbox
+  int smsFailed = 0;
+};
+
+UiView view;
+uint8_t uiAwaiting = MSG_NONE; // reply type the current state waits for
+PipeMsg uiReply;
+bool uiReplyReady = false;
+
+// Send a request to the worker that handles it (WiFi and sync go to the
+// net worker, the rest to the io worker); its reply shows up via
+// uiTakeReply(). A request that cannot be queued is answered at once with
+// an empty (failed) reply.
+bool uiRequest(const PipeMsg &msg, uint8_t replyType) {
+  uiReplyReady = false;
+  uiAwaiting = replyType;
+  bool net = (msg.type == MSG_WIFI_CONNECT || msg.type == MSG_SYNC_START);
+  if (pipePush(net ? uiToNet : uiToIo, msg))
+    return true;
+
+  logLine("Pipeline: %s queue full, request dropped", net ? "net" : "io");
+  uiReply = pipeMsg(replyType);
+  uiReplyReady = true;
+  uiAwaiting = MSG_NONE;
+  return false;
+}
+
+// True once (per reply) the awaited reply is in uiReply
+bool uiTakeReply() {
+  if (!uiReplyReady)
+    return false;
+  uiReplyReady = false;
+  return true;
+}
+
+// Take one message from a worker into the view or the reply slot
+void uiHandle(const PipeMsg &msg) {
+  switch (msg.type) {
+  case MSG_STATUS:
+    view.farmers = msg.status.farmers;
+    view.logs = msg.status.logs;
+    view.nextId = msg.status.nextId;
+    view.smsPending = msg.status.smsPending;
+    view.smsFailed = msg.status.smsFailed;
+    break;
+  case MSG_SYNC_STATE:
+    view.syncing = msg.value != 0;
+    break;
+  case MSG_SET_TIME:
+    // The RTC shares I2C with the LCD, so it is set from this core
+    rtcSetTime(msg.time.year, msg.time.month, msg.time.day, msg.time.hour,
+               msg.time.minute, msg.time.second);
+    break;
+  default:
+    // Replies nobody waits for any more (e.g. a backgrounded sync) drop
+    if (msg.type == uiAwaiting) {
+      uiReply = msg;
+      uiReplyReady = true;
+      uiAwaiting = MSG_NONE;
+    }
+    break;
+  }
+}
+
+// Drain the worker queues
+void uiInboxTask() {
+  PipeMsg msg;
+  while (pipePop(ioToUi, msg))
+    uiHandle(msg);
+  while (pipePop(netToUi, msg))
+    uiHandle(msg);
+}
+
+// Sensor task: advance an averaged reading while one is running
+void sensorTask() {
+  if (sampler.active)
+    samplerPoll();
+}
+
+// ==========================================
+//  PIPELINE - STORAGE WORKER
+// ==========================================
+// Owns the SD card (including the SMS outbox); lends it to the net worker
+// under the card lock
+
+bool ioSaveOk = true;     // every reading of the current save written
+SoilData ioReportReading; // first probe's reading, for the SMS
+PipeMsg ioLastStatus;     // last MSG_STATUS sent
+
+void ioReply(const PipeMsg &msg) {
+  if (!pipePush(ioToUi, msg))
+    Serial.println("Pipeline: ui queue full, reply dropped");
+}
+
+// Build the farmer's SMS (the template lives here) and store it in the
+// outbox; returns the PIPE_SMS_* flag for the save reply
+uint8_t ioQueueReport(const PipeMsg &last) {
+  if (!isSmsEnabled() || last.phone[0] == '\0')
+    return 0;
+
+  // The report uses the first (lowest-address) probe
+  char text[PIPE_TEXT_MAX];
+  int segments;
+  renderSmsMessage(last.farmerId, ioReportReading, last.timestamp, text,
+                   sizeof(text), segments);
+  if (segments > SMS_MAX_SEGMENTS)
+    logLine("GSM: Report needs %d SMS, only the first %d are sent", segments,
+            SMS_MAX_SEGMENTS);
+
+  return outboxAdd(last.phone, text) ? PIPE_SMS_QUEUED : PIPE_SMS_FAILED;
+}
+
+void ioHandle(const PipeMsg &msg) {
+  switch (msg.type) {
+  case MSG_LOOKUP_FARMER: {
+    PipeMsg reply = pipeMsg(MSG_FARMER_INFO, PIPE_OK);
+    if (farmerExists(msg.farmerId)) {
+      reply.flags |= PIPE_FOUND;
+      pipeCopy(reply.phone, sizeof(reply.phone),
+               getFarmerPhone(msg.farmerId));
+
+      FarmerHistory h;
+      PipeHistory &out = reply.history;
+      out.count = historyLoad(msg.farmerId, h) < 2 ? h.count : 2;
+      if (out.count > 0) {
+        out.lastEpoch = h.visits[0].reading.epoch;
+        unpackLogRecord(h.visits[0].reading, out.last);
+      }
+      if (out.count > 1) {
+        out.previousEpoch = h.visits[1].reading.epoch;
+        unpackLogRecord(h.visits[1].reading, out.previous);
+      }
+    }
+    ioReply(reply);
+    break;
+  }
+
+  case MSG_ADD_FARMER: {
+    bool ok = addFarmer(msg.farmerId, msg.phone, msg.timestamp) &&
+              journalCommit();
+    ioReply(pipeMsg(MSG_FARMER_ADDED, ok ? PIPE_OK : 0));
+    break;
+  }
+
+  case MSG_SAVE_READING: {
+    // One datalog row per probe; a single reply after the last one
+    if (msg.flags & PIPE_FIRST) {
+      ioSaveOk = true;
+      ioReportReading = msg.reading;
+    }
+    if (ioSaveOk)
+      ioSaveOk =
+          saveReading(msg.farmerId, msg.timestamp, msg.epoch, msg.reading);
+    if (msg.flags & PIPE_LAST) {
+      if (ioSaveOk)
+        ioSaveOk = journalCommit();
+      uint8_t flags = ioSaveOk ? PIPE_OK | ioQueueReport(msg) : 0;
+      ioReply(pipeMsg(MSG_READING_SAVED, flags));
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+void ioInboxTask() {
+  PipeMsg msg;
+  while (pipePop(uiToIo, msg)) {
+    SdGuard card;
+    ioHandle(msg);
+  }
+  while (pipePop(gsmToIo, msg)) {
+    SdGuard card;
+    if (msg.type == MSG_SMS_RESULT)
+      outboxResult(msg.ref, msg.flags & PIPE_OK);
+  }
+}
+
+// Hand the next due outbox SMS to the GSM worker (one in flight at a time)
+void ioOutboxTask() {
+  if (!gsmIsReady() || pipeSpace(ioToGsm) == 0)
+    return;
+
+  SdGuard card;
+  OutboxRecord rec;
+  uint32_t index;
+  if (!outboxNext(rec, index))
+    return;
+
+  PipeMsg msg = pipeMsg(MSG_SEND_SMS);
+  msg.ref = index;
+  pipeCopy(msg.phone, sizeof(msg.phone), rec.phone);
+  pipeCopy(msg.text, sizeof(msg.text), rec.text);
+  pipePush(ioToGsm, msg);
+}
+
+// Send a status snapshot whenever it changes
+void ioStatusTask() {
+  SdGuard card; // the counters move with a checkpoint
+  PipeMsg status = pipeMsg(MSG_STATUS);
+  status.status.farmers = getFarmerCount();
+  status.status.nextId = getNextFarmerID();
+  status.status.logs = getLogCount();
+  status.status.smsPending = outboxPendingCount;
+  status.status.smsFailed = outboxFailedCount;
+  if (ioLastStatus.type == MSG_STATUS &&
+      memcmp(&status.status, &ioLastStatus.status, sizeof(status.status)) == 0)
+    return;
+  if (pipePush(ioToUi, status))
+    ioLastStatus = status;
+}
+
+// ==========================================
+//  PIPELINE - NETWORK WORKER
+// ==========================================
+// Owns WiFi and the sync job. An upload blocks for up to a whole HTTP
+// timeout, longer over GPRS, so it has a worker of its own and the io
+// worker keeps answering lookups and saves meanwhile.
+
+bool netWifiPending = false; // a MSG_WIFI_CONNECT awaits its outcome
+bool netSyncing = false;     // last sync state sent (MSG_SYNC_STATE)
+
+void netReply(const PipeMsg &msg) {
+  if (!pipePush(netToUi, msg))
+    Serial.println("Pipeline: ui queue full, reply dropped");
+}
+
+// syncDoneHandler: a sync job finished (or could not start)
+void netSyncDone(bool success) {
+  netReply(pipeMsg(MSG_SYNC_RESULT, success ? PIPE_OK : 0));
+}
+
+// syncTimeHandler: pass the server time to the UI core
+void netSetTime(int year, int month, int day, int hour, int minute,
+                int second) {
+  PipeMsg msg = pipeMsg(MSG_SET_TIME);
+  msg.time.year = year;
+  msg.time.month = month;
+  msg.time.day = day;
+  msg.time.hour = hour;
+  msg.time.minute = minute;
+  msg.time.second = second;
+  netReply(msg);
+}
+
+void netInboxTask() {
+  PipeMsg msg;
+  while (pipePop(uiToNet, msg)) {
+    switch (msg.type) {
+    case MSG_WIFI_CONNECT:
+      wifiBegin();
+      netWifiPending = true; // answered by netStatusTask()
+      break;
+
+    case MSG_SYNC_START:
+      // A sync already running answers when it finishes
+      if (!syncStart() && !syncRunning())
+        netSyncDone(false);
+      break;
+
+    default:
+      break;
+    }
+  }
+}
+
+// Report WiFi outcomes, and whether a sync runs whenever that changes
+void netStatusTask() {
+  if (netWifiPending && wifiState != WIFI_CONNECTING) {
+    PipeMsg msg = pipeMsg(MSG_WIFI_STATUS);
+    msg.value = wifiState;
+    if (wifiState == WIFI_FAILED && gprsAvailable())
+      msg.flags |= PIPE_GPRS;
+    netReply(msg);
+    netWifiPending = false;
+  }
+
+  bool syncing = syncRunning();
+  if (syncing == netSyncing)
+    return;
+  PipeMsg msg = pipeMsg(MSG_SYNC_STATE);
+  msg.value = syncing;
+  if (pipePush(netToUi, msg))
+    netSyncing = syncing;
+}
+
+// ==========================================
+//  PIPELINE - GSM WORKER
+// ==========================================
+// Owns the SIM800L
+
+// Move SMS from the io worker into the modem queue while it has room
+void gsmInboxTask() {
+  PipeMsg msg;
+  while (smsQueueCount < SMS_QUEUE_SIZE && pipePop(ioToGsm, msg)) {
+    if (msg.type == MSG_SEND_SMS)
+      queueSMS(msg.phone, msg.text, msg.ref);
+  }
+}
+
+// smsDoneHandler: report an outbox SMS's delivery back to the io worker
+void gsmSmsDone(int32_t ref, bool sent) {
+  PipeMsg msg = pipeMsg(MSG_SMS_RESULT, sent ? PIPE_OK : 0);
+  msg.ref = ref;
+  if (!pipePush(gsmToIo, msg))
+    Serial.println("Pipeline: io queue full, SMS result dropped");
+}
+
+void uiTask();
 
 // ==========================================
 //  SETUP
@@ -72,58 +445,143 @@ void setup() {
 
   // Show boot screen
   lcdShowBoot();
+  lcdFlush();
   delay(2000);
 
   // Initialize SD card
   if (!sdInit()) {
     lcdShowSDError();
+    lcdFlush();
     Serial.println("CRITICAL: SD Card failed! Waiting for retry...");
     delay(3000);
     // Try once more
     if (!sdInit()) {
       lcdShowMessage("SD CARD FAIL!", "Insert & reset");
+      lcdFlush();
       while (true) {
         delay(1000);
       } // Halt
     }
   }
 
-  Serial.println("SD Card initialized. Farmers: " + String(getFarmerCount()) +
-                 ", Logs: " + String(getLogCount()));
+  logLine("SD Card initialized. Farmers: %d, Logs: %d", getFarmerCount(),
+          getLogCount());
+  diagInit();
 
   // Initialize GSM module and load SMS config from SD
   gsmInit();
   loadSmsConfig();
+  outboxInit();
 
   // Show GSM connection status on LCD
   lcdShowGsmStatus(gsmIsReady());
+  lcdFlush();
   delay(1500);
 
+  // Sync results travel through the pipeline: the RTC belongs to the UI
+  syncTimeHandler = netSetTime;
+  syncDoneHandler = netSyncDone;
+  smsDoneHandler = gsmSmsDone;
+
+  // Counts for the first menu, before the io worker reports
+  view.farmers = getFarmerCount();
+  view.logs = getLogCount();
+  view.nextId = getNextFarmerID();
+  view.smsPending = outboxPendingCount;
+  view.smsFailed = outboxFailedCount;
+
+  // Register the cooperative tasks
+  schedulerAdd(uiSched, "keypad", keypadTask, KEYPAD_SCAN_MS);
+  schedulerAdd(uiSched, "inbox", uiInboxTask, 0);
+  schedulerAdd(uiSched, "ui", uiTask, 0);
+  schedulerAdd(uiSched, "sensor", sensorTask, 0);
+  schedulerAdd(uiSched, "lcd", lcdFlush, LCD_FRAME_MS);
+
+  schedulerAdd(ioSched, "inbox", ioInboxTask, 0);
+  schedulerAdd(ioSched, "status", ioStatusTask, 100);
+  schedulerAdd(ioSched, "outbox", ioOutboxTask, 500);
+  schedulerAdd(ioSched, "sd", sdFlush, SD_FLUSH_MS);
+  schedulerAdd(ioSched, "diag", diagTask, DIAG_FLUSH_MS);
+
+  schedulerAdd(netSched, "inbox", netInboxTask, 0);
+  schedulerAdd(netSched, "wifi", wifiTask, 100);
+  schedulerAdd(netSched, "status", netStatusTask, 100);
+  schedulerAdd(netSched, "sync", syncTask, 0);
+
+  schedulerAdd(gsmSched, "inbox", gsmInboxTask, 50);
+  schedulerAdd(gsmSched, "gsm", gsmTask, 0);
+
+#if PIPELINE_DUAL_CORE
+  // Hardware is handed over here: from now on only the owning task touches it
+  TaskHandle_t ioWorker = nullptr;
+  TaskHandle_t netWorker = nullptr;
+  TaskHandle_t gsmWorker = nullptr;
+  ioOnLoop = !pipeStartWorker("io", ioSched, PIPE_IO_STACK, &ioWorker);
+  netOnLoop = !pipeStartWorker("net", netSched, PIPE_NET_STACK, &netWorker);
+  gsmOnLoop = !pipeStartWorker("gsm", gsmSched, PIPE_GSM_STACK, &gsmWorker);
+  diagSetTask(DIAG_IO, ioWorker);
+  diagSetTask(DIAG_NET, netWorker);
+  diagSetTask(DIAG_GSM, gsmWorker);
+#endif
+
+  // Boot allocations are done; count from here on
+  heapTraceBegin();
+
   // Move to WiFi check state
-  currentState = STATE_WIFI_CHECK;
+  setState(STATE_WIFI_CHECK);
 }
 
 // ==========================================
-//  MAIN LOOP - STATE MACHINE
+//  MAIN LOOP
 // ==========================================
 void loop() {
+  diagLoopTick();
+  schedulerRun(uiSched);
+  if (ioOnLoop)
+    schedulerRun(ioSched);
+  if (netOnLoop)
+    schedulerRun(netSched);
+  if (gsmOnLoop)
+    schedulerRun(gsmSched);
+
+  // Yield to the idle task (keeps the watchdog fed)
+  delay(1);
+}
+
+// ==========================================
+//  UI TASK - STATE HANDLERS
+// ==========================================
+void uiTask() {
   switch (currentState) {
 
   // ------------------------------------------
   //  WIFI CHECK - Try to connect
   // ------------------------------------------
   case STATE_WIFI_CHECK: {
-    lcdShowWiFiConnecting();
+    if (enteringState()) {
+      lcdShowWiFiConnecting();
+      uiRequest(pipeMsg(MSG_WIFI_CONNECT), MSG_WIFI_STATUS);
+    }
 
-    if (connectWiFi()) {
-      // WiFi connected - always offer sync (for data, SMS settings, and time)
-      lcdShowWiFiConnected();
-      currentState = STATE_SYNC_PROMPT;
-    } else {
-      // No WiFi - skip to main menu
-      lcdShowNoWiFi();
-      delay(2000);
-      currentState = STATE_MAIN_MENU;
+    if (statePhase == 0) {
+      if (!uiTakeReply())
+        break;
+      if (uiReply.value == WIFI_UP) {
+        // WiFi connected - always offer sync (for data, SMS settings, and time)
+        lcdShowWiFiConnected();
+        setState(STATE_SYNC_PROMPT);
+      } else if (uiReply.flags & PIPE_GPRS) {
+        // No WiFi, but the modem can carry the sync
+        lcdShowGprsSync();
+        setState(STATE_SYNC_PROMPT);
+      } else {
+        // No WiFi - skip to main menu
+        lcdShowNoWiFi();
+        timerStart(stateTimer, 2000);
+        statePhase = 1;
+      }
+    } else if (timerExpired(stateTimer)) {
+      setState(STATE_MAIN_MENU);
     }
     break;
   }
@@ -132,45 +590,47 @@ void loop() {
   //  SYNC PROMPT - Ask user to sync
   // ------------------------------------------
   case STATE_SYNC_PROMPT: {
-    char key = waitForConfirmOrCancel();
+    enteringState();
+    char key = keyPop();
     if (key == '*') {
-      currentState = STATE_SYNCING;
-    } else {
-      currentState = STATE_MAIN_MENU;
+      setState(STATE_SYNCING);
+    } else if (key == '#') {
+      setState(STATE_MAIN_MENU);
     }
     break;
   }
 
   // ------------------------------------------
   //  SYNCING - Upload data to server
+  //  The upload runs on the net worker; # leaves it running in the background
   // ------------------------------------------
   case STATE_SYNCING: {
-    lcdShowSyncing();
+    if (enteringState()) {
+      lcdShowSyncing();
 
-    // Read file contents
-    String farmersData = readFileContent(FARMERS_FILE);
-    String datalogData = readFileContent(DATALOG_FILE);
+      logLine("Syncing %d farmers + %lu readings", view.farmers,
+              (unsigned long)view.logs);
 
-    Serial.println("Syncing " + String(farmersData.length()) +
-                   " bytes farmers + " + String(datalogData.length()) +
-                   " bytes datalog");
-
-    // Attempt sync
-    bool success = syncToServer(farmersData, datalogData);
-
-    if (success) {
-      // Server confirmed - clear data logs (keep farmers!)
-      clearDataLogs();
-      lcdShowSyncSuccess();
-      notifySyncComplete(true);
-      delay(2500);
-    } else {
-      lcdShowSyncFail();
-      notifySyncComplete(false);
-      delay(2500);
+      // Files are streamed from SD, not loaded into RAM
+      uiRequest(pipeMsg(MSG_SYNC_START), MSG_SYNC_RESULT);
     }
 
-    currentState = STATE_MAIN_MENU;
+    if (statePhase == 0) {
+      if (keyPop() == '#') {
+        Serial.println("Sync continues in the background");
+        setState(STATE_MAIN_MENU);
+      } else if (uiTakeReply()) {
+        if (uiReply.flags & PIPE_OK) {
+          lcdShowSyncSuccess();
+        } else {
+          lcdShowSyncFail();
+        }
+        timerStart(stateTimer, 2500);
+        statePhase = 1;
+      }
+    } else if (timerExpired(stateTimer)) {
+      setState(STATE_MAIN_MENU);
+    }
     break;
   }
 
@@ -178,30 +638,51 @@ void loop() {
   //  MAIN MENU - Enter Farmer ID
   // ------------------------------------------
   case STATE_MAIN_MENU: {
-    currentFarmerID = "";
-    currentPhone = "";
-    resultPage = 0;
-
-    // Show stats + hint to press A for sync
-    lcd.clear();
-    String gsmTag = gsmIsReady() ? "G" : "";
-    lcdPrint(0, 0,
-             "F:" + String(getFarmerCount()) + " L:" + String(getLogCount()) +
-                 " " + gsmTag);
-    lcdPrint(0, 1, "A:Sync  *:Start");
+    if (enteringState()) {
+      currentFarmerID.clear();
+      currentPhone.clear();
+      resultPage = 0;
+      menuShown.clear();
+    }
+
+    // Show stats + hint to press A for sync; redrawn when they change
+    // (background sync, outbox). G3!1 = 3 SMS pending, 1 failed
+    LcdLine status;
+    status.appendf("F:%d L:%lu ", view.farmers, (unsigned long)view.logs);
+    if (gsmIsReady())
+      status += 'G';
+    if (view.smsPending > 0)
+      status.appendf("%d", view.smsPending);
+    if (view.smsFailed > 0)
+      status.appendf("!%d", view.smsFailed);
+    if (view.syncing)
+      status += 'S';
+    if (status != menuShown) {
+      lcdClear();
+      lcdPrint(0, 0, status);
+      lcdPrint(0, 1, "A:Sync  *:Start");
+      menuShown = status;
+    }
 
     // Wait for key: A=sync, anything else=enter farmer ID
-    char menuKey = waitForAnyKey();
+    char menuKey = keyPop();
     if (menuKey == 'A') {
+      setState(STATE_SYNC_MENU);
+    } else if (menuKey != '\0') {
+      setState(STATE_ENTER_ID);
+    }
+    break;
+  }
+
+  case STATE_SYNC_MENU: {
+    if (enteringState())
       lcdShowSyncMenu();
-      char syncKey = waitForConfirmOrCancel();
-      if (syncKey == '*') {
-        currentState = STATE_WIFI_CHECK;
-      } else {
-        currentState = STATE_MAIN_MENU; // Back to this menu
-      }
-    } else {
-      currentState = STATE_ENTER_ID;
+
+    char syncKey = keyPop();
+    if (syncKey == '*') {
+      setState(STATE_WIFI_CHECK);
+    } else if (syncKey == '#') {
+      setState(STATE_MAIN_MENU); // Back to the menu
     }
     break;
   }
@@ -210,50 +691,108 @@ void loop() {
   //  ENTER FARMER ID
   // ------------------------------------------
   case STATE_ENTER_ID: {
-    lcdShowEnterID();
-
-    // Show next available ID as hint
-    String nextID = getNextFarmerID();
-    Serial.println("Next available ID: " + nextID);
+    if (enteringState()) {
+      lcdShowEnterID();
 
-    bool confirmed;
-    currentFarmerID =
-        collectFarmerID(confirmed, [](String input) { lcdShowIDInput(input); });
+      // Show next available ID as hint
+      logLine("Next available ID: %04d", view.nextId);
 
-    if (confirmed && currentFarmerID.length() == FARMER_ID_LENGTH) {
-      Serial.println("Entered Farmer ID: " + currentFarmerID);
+      inputBegin(currentInput, FARMER_ID_LENGTH, lcdShowIDInput);
+    }
 
-      if (farmerExists(currentFarmerID)) {
+    if (statePhase == 1) {
+      // Waiting for the registry lookup
+      if (!uiTakeReply())
+        break;
+      if (!(uiReply.flags & PIPE_OK)) {
+        lcdShowSDError();
+        timerStart(stateTimer, 2000);
+        statePhase = 2;
+      } else if (uiReply.flags & PIPE_FOUND) {
         // Farmer found!
-        currentPhone = getFarmerPhone(currentFarmerID);
-        currentState = STATE_FARMER_FOUND;
+        currentPhone = uiReply.phone;
+        currentHistory = uiReply.history;
+        setState(STATE_FARMER_FOUND);
       } else {
         // New farmer
-        currentState = STATE_NEW_FARMER;
+        setState(STATE_NEW_FARMER);
       }
-    } else {
-      // Cancelled or invalid - stay at main menu
-      currentState = STATE_MAIN_MENU;
+      break;
+    }
+    if (statePhase == 2) {
+      // Lookup error splash
+      if (timerExpired(stateTimer))
+        setState(STATE_MAIN_MENU);
+      break;
+    }
+
+    char key = keyPop();
+    if (key == '\0')
+      break;
+
+    InputResult result = inputFeed(currentInput, key);
+    if (result == INPUT_CONFIRMED) {
+      currentFarmerID = padFarmerID(currentInput.text);
+      logLine("Entered Farmer ID: %s", currentFarmerID.c_str());
+
+      PipeMsg lookup = pipeMsg(MSG_LOOKUP_FARMER);
+      pipeCopy(lookup.farmerId, sizeof(lookup.farmerId), currentFarmerID);
+      uiRequest(lookup, MSG_FARMER_INFO);
+      statePhase = 1;
+    } else if (result == INPUT_CANCELLED) {
+      // Cancelled - back to main menu
+      setState(STATE_MAIN_MENU);
     }
     break;
   }
 
   // ------------------------------------------
-  //  FARMER FOUND - Show data and options
+  //  FARMER FOUND - Show data, last visits and options
   // ------------------------------------------
   case STATE_FARMER_FOUND: {
-    lcdShowFarmerFound(currentFarmerID, currentPhone);
-    delay(2000);
+    if (enteringState()) {
+      lcdShowFarmerFound(currentFarmerID, currentPhone);
+      timerStart(stateTimer, 2000);
+    }
 
-    lcdShowFarmerOptions();
+    if (statePhase < 3) {
+      // Splash, then the last visit and the trend if on record; a key
+      // skips ahead to the options
+      if (statePhase > 0 && keyPop() != '\0')
+        statePhase = 2;
+      else if (!timerExpired(stateTimer))
+        break;
 
-    char key = waitForConfirmOrCancel();
+      const PipeHistory &h = currentHistory;
+      char date[6];
+      if (statePhase == 0 && h.count > 0) {
+        formatEpochDay(h.lastEpoch, date, sizeof(date));
+        lcdShowLastVisit(date, h.last.ph, h.last.nitrogen, h.last.phosphorus,
+                         h.last.potassium);
+        timerStart(stateTimer, 3000);
+        statePhase = 1;
+      } else if (statePhase <= 1 && h.count > 1) {
+        formatEpochDay(h.previousEpoch, date, sizeof(date));
+        lcdShowTrend(date, lroundf((h.last.ph - h.previous.ph) * 10) / 10.0f,
+                     (int)h.last.nitrogen - (int)h.previous.nitrogen,
+                     (int)h.last.phosphorus - (int)h.previous.phosphorus,
+                     (int)h.last.potassium - (int)h.previous.potassium);
+        timerStart(stateTimer, 3000);
+        statePhase = 2;
+      } else {
+        lcdShowFarmerOptions();
+        statePhase = 3;
+      }
+      break;
+    }
+
+    char key = keyPop();
     if (key == '*') {
       // Take new reading
-      currentState = STATE_READING_SOIL;
-    } else {
+      setState(STATE_READING_SOIL);
+    } else if (key == '#') {
       // Back to menu
-      currentState = STATE_MAIN_MENU;
+      setState(STATE_MAIN_MENU);
     }
     break;
   }
@@ -262,58 +801,116 @@ void loop() {
   //  NEW FARMER - Register with phone number
   // ------------------------------------------
   case STATE_NEW_FARMER: {
-    lcdShowNewFarmer();
-
-    bool confirmed;
-    currentPhone = collectPhoneNumber(
-        confirmed, [](String input) { lcdShowPhoneInput(input); });
+    if (enteringState()) {
+      lcdShowNewFarmer();
+      inputBegin(currentInput, PIPE_PHONE_MAX - 1, lcdShowPhoneInput);
+    }
 
-    if (confirmed && currentPhone.length() > 0) {
-      // Save new farmer
-      String timestamp = getTimestamp();
-      if (addFarmer(currentFarmerID, currentPhone, timestamp)) {
+    if (statePhase == 1) {
+      // "Farmer saved" splash, then proceed to soil reading
+      if (timerExpired(stateTimer))
+        setState(STATE_READING_SOIL);
+      break;
+    }
+    if (statePhase == 2) {
+      // SD error splash
+      if (timerExpired(stateTimer))
+        setState(STATE_MAIN_MENU);
+      break;
+    }
+    if (statePhase == 3) {
+      // Waiting for the io worker to write the farmer
+      if (!uiTakeReply())
+        break;
+      if (uiReply.flags & PIPE_OK) {
         lcdShowFarmerSaved(currentFarmerID);
-        delay(2000);
-        // Proceed to soil reading
-        currentState = STATE_READING_SOIL;
+        statePhase = 1;
       } else {
         lcdShowSDError();
-        delay(2000);
-        currentState = STATE_MAIN_MENU;
+        statePhase = 2;
       }
-    } else {
-      // Cancelled
-      currentState = STATE_MAIN_MENU;
+      timerStart(stateTimer, 2000);
+      break;
+    }
+
+    char key = keyPop();
+    if (key == '\0')
+      break;
+
+    InputResult result = inputFeed(currentInput, key);
+    if (result == INPUT_CONFIRMED) {
+      // Save new farmer
+      currentPhone = currentInput.text;
+      PipeMsg farmer = pipeMsg(MSG_ADD_FARMER);
+      pipeCopy(farmer.farmerId, sizeof(farmer.farmerId), currentFarmerID);
+      pipeCopy(farmer.phone, sizeof(farmer.phone), currentPhone);
+      pipeCopy(farmer.timestamp, sizeof(farmer.timestamp), getTimestamp());
+      uiRequest(farmer, MSG_FARMER_ADDED);
+      statePhase = 3;
+    } else if (result == INPUT_CANCELLED) {
+      setState(STATE_MAIN_MENU);
     }
     break;
   }
 
   // ------------------------------------------
-  //  READING SOIL - Take 5 measurements
+  //  READING SOIL - Sample until stable
+  //  The sampler runs in sensorTask; # cancels
   // ------------------------------------------
   case STATE_READING_SOIL: {
-    Serial.println("Starting soil reading for farmer " + currentFarmerID);
+    if (enteringState()) {
+      logLine("Starting soil reading for farmer %s", currentFarmerID.c_str());
+
+      samplerStart(NUM_SAMPLES, [](int current, int total) {
+        lcdShowReadingProgress(current, total);
+      });
+    }
+
+    if (keyPop() == '#') {
+      samplerCancel();
+      Serial.println("Soil reading cancelled");
+      setState(STATE_MAIN_MENU);
+      break;
+    }
+    if (sampler.active)
+      break;
 
-    currentReading =
-        takeAveragedReading(NUM_SAMPLES, [](int current, int total) {
-          lcdShowReadingProgress(current, total);
-        });
+    // Keep the probes that produced a reading
+    currentReadingCount = 0;
+    for (int i = 0; i < sampler.resultCount; i++) {
+      if (sampler.result[i].valid)
+        currentReadings[currentReadingCount++] = sampler.result[i];
+    }
 
-    if (currentReading.valid) {
+    if (currentReadingCount > 0) {
       resultPage = 0;
-      currentState = STATE_SHOW_RESULTS;
+      setState(STATE_SHOW_RESULTS);
     } else {
+      setState(STATE_SENSOR_ERROR);
+    }
+    break;
+  }
+
+  case STATE_SENSOR_ERROR: {
+    if (enteringState()) {
       lcdShowSensorError();
-      delay(3000);
+      timerStart(stateTimer, 3000);
+    }
 
-      // Ask retry or back
-      lcdShowMessage("*:Retry", "#:Back to Menu");
-      char key = waitForConfirmOrCancel();
-      if (key == '*') {
-        currentState = STATE_READING_SOIL; // Retry
-      } else {
-        currentState = STATE_MAIN_MENU;
+    if (statePhase == 0) {
+      if (timerExpired(stateTimer)) {
+        // Ask retry or back
+        lcdShowMessage("*:Retry", "#:Back to Menu");
+        statePhase = 1;
       }
+      break;
+    }
+
+    char key = keyPop();
+    if (key == '*') {
+      setState(STATE_READING_SOIL); // Retry
+    } else if (key == '#') {
+      setState(STATE_MAIN_MENU);
     }
     break;
   }
@@ -322,23 +919,26 @@ void loop() {
   //  SHOW RESULTS - Display averaged readings
   // ------------------------------------------
   case STATE_SHOW_RESULTS: {
-    lcdShowResults(currentReading.humidity, currentReading.temperature,
-                   currentReading.ec, currentReading.ph,
-                   currentReading.nitrogen, currentReading.phosphorus,
-                   currentReading.potassium, resultPage);
-
-    // Wait for keypress to navigate pages or proceed
-    char key = waitForAnyKey();
-
-    if (key == 'A' || key == 'B') {
-      // Next page
-      resultPage = (resultPage + 1) % 2;
-    } else if (key == '*' || key == '#') {
+    if (enteringState() || statePhase != resultPage) {
+      const SoilData &shown = currentReadings[resultPage / 2];
+      lcdShowResults(shown.humidity, shown.temperature, shown.ec, shown.ph,
+                     shown.nitrogen, shown.phosphorus, shown.potassium,
+                     resultPage % 2,
+                     currentReadingCount > 1 ? resultPage / 2 + 1 : 0);
+      statePhase = resultPage; // page on the LCD
+    }
+
+    // Keys navigate pages or proceed
+    char key = keyPop();
+    if (key == '\0')
+      break;
+
+    if (key == '*' || key == '#') {
       // Go to save prompt
-      currentState = STATE_SAVE_PROMPT;
+      setState(STATE_SAVE_PROMPT);
     } else {
-      // Toggle page on any other key
-      resultPage = (resultPage + 1) % 2;
+      // Next page on A/B or any other key
+      resultPage = (resultPage + 1) % (2 * currentReadingCount);
     }
     break;
   }
@@ -347,60 +947,89 @@ void loop() {
   //  SAVE PROMPT - Save or retake
   // ------------------------------------------
   case STATE_SAVE_PROMPT: {
-    lcdShowSavePrompt();
+    if (enteringState())
+      lcdShowSavePrompt();
 
-    char key = waitForConfirmOrCancel();
-    if (key == '*') {
-      // Save the reading
-      String timestamp = getTimestamp();
-      if (saveReading(currentFarmerID, timestamp, currentReading)) {
-        currentState = STATE_DATA_SAVED;
+    if (statePhase == 1) {
+      // SD error splash
+      if (timerExpired(stateTimer))
+        setState(STATE_MAIN_MENU);
+      break;
+    }
+    if (statePhase == 2) {
+      // Waiting for the io worker to write the rows
+      if (!uiTakeReply())
+        break;
+      if (uiReply.flags & PIPE_OK) {
+        savedFlags = uiReply.flags;
+        setState(STATE_DATA_SAVED);
       } else {
         lcdShowSDError();
-        delay(2000);
-        currentState = STATE_MAIN_MENU;
+        timerStart(stateTimer, 2000);
+        statePhase = 1;
       }
-    } else {
+      break;
+    }
+
+    char key = keyPop();
+    if (key == '*') {
+      // Save the reading, one datalog row per probe. All rows go in one
+      // go, so only queue them if they fit.
+      if (pipeSpace(uiToIo) < (uint32_t)currentReadingCount) {
+        lcdShowSDError();
+        timerStart(stateTimer, 2000);
+        statePhase = 1;
+        break;
+      }
+
+      // The io worker stamps the rows with this; it cannot read the RTC
+      uint32_t epoch = getEpoch();
+      Timestamp timestamp = epochTimestamp(epoch);
+      for (int i = 0; i < currentReadingCount; i++) {
+        PipeMsg row = pipeMsg(MSG_SAVE_READING);
+        if (i == 0)
+          row.flags |= PIPE_FIRST;
+        pipeCopy(row.farmerId, sizeof(row.farmerId), currentFarmerID);
+        pipeCopy(row.phone, sizeof(row.phone), currentPhone);
+        pipeCopy(row.timestamp, sizeof(row.timestamp), timestamp);
+        row.epoch = epoch;
+        row.reading = currentReadings[i];
+        if (i == currentReadingCount - 1) {
+          row.flags |= PIPE_LAST;
+          uiRequest(row, MSG_READING_SAVED);
+        } else {
+          pipePush(uiToIo, row);
+        }
+      }
+      statePhase = 2;
+    } else if (key == '#') {
       // Retake - go back to reading
-      currentState = STATE_READING_SOIL;
+      setState(STATE_READING_SOIL);
     }
     break;
   }
 
   // ------------------------------------------
   //  DATA SAVED - Confirmation + SMS
+  //  The SMS goes out from the GSM worker in the background
   // ------------------------------------------
   case STATE_DATA_SAVED: {
-    lcdShowDataSaved();
-
-    // Send SMS to farmer if enabled
-    if (isSmsEnabled() && currentPhone.length() > 0) {
-      lcdShowMessage("Sending SMS...", currentPhone.c_str());
-
-      String timestamp = getTimestamp();
-      String smsMsg = buildSmsMessage(
-          smsTemplate, currentFarmerID, currentReading.humidity,
-          currentReading.temperature, currentReading.ec, currentReading.ph,
-          currentReading.nitrogen, currentReading.phosphorus,
-          currentReading.potassium, timestamp);
-
-      if (sendSMS(currentPhone, smsMsg)) {
-        lcdShowMessage("SMS Sent!", "Press any key...");
-      } else {
-        lcdShowMessage("SMS Failed!", "Press any key...");
-      }
+    if (enteringState()) {
+      if (savedFlags & PIPE_SMS_QUEUED)
+        lcdShowDataSaved("SMS queued");
+      else if (savedFlags & PIPE_SMS_FAILED)
+        lcdShowDataSaved("SMS Failed!");
+      else
+        lcdShowDataSaved("Press any key...");
     }
 
-    waitForAnyKey();
-    currentState = STATE_MAIN_MENU;
+    if (keyPop() != '\0')
+      setState(STATE_MAIN_MENU);
     break;
   }
 
   default:
-    currentState = STATE_MAIN_MENU;
+    setState(STATE_MAIN_MENU);
     break;
   }
-
-  // Small delay to prevent CPU hogging
-  delay(10);
 }
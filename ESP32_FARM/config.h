@@ -14,6 +14,11 @@
 // ---------- Server URL (XAMPP) ----------
 #define SERVER_URL "http://192.168.1.66/esp32_farm/web/api/sync.php"
 #define SYNC_CHECK_URL "http://192.168.1.66/esp32_farm/web/api/trigger_sync.php"
+#define SYNC_BLOCK_SIZE 512 // bytes read from SD per upload block
+#define SYNC_BATCH_RECORDS 50 // datalog records per acknowledged batch
+#define SYNC_BATCH_RETRIES 2  // extra attempts per batch before giving up
+#define SYNC_COMPRESS 1          // deflate sync bodies (Content-Encoding)
+#define SYNC_DEFLATE_WINDOW 1024 // compressor history window (power of 2)
 
 // ---------- I2C LCD (16x2) ----------
 #define LCD_ADDR 0x27 // I2C address (try 0x3F if 0x27 doesn't work)
@@ -44,17 +49,73 @@ const char KEYPAD_KEYS[KEYPAD_ROWS][KEYPAD_COLS] = {{'1', '2', '3', 'A'},
 #define RS485_BAUD 4800
 
 // ---------- Soil Sensor (Modbus RTU) ----------
-#define SENSOR_ADDR 0x01
+#define SENSOR_ADDR 0x01 // used when the bus scan finds no probe
 #define SENSOR_NUM_REGS 7      // 7 parameters to read
-#define SENSOR_TIMEOUT_MS 1500 // timeout waiting for response
-#define NUM_SAMPLES 5          // samples to average
+#define SENSOR_TIMEOUT_MS 1500 // max wait for a reply to complete
+#define NUM_SAMPLES 8          // most samples per reading (cap)
+#define SENSOR_MIN_SAMPLES 2   // samples before an early stop is allowed
+
+// Aggregation of the samples behind one reading
+#define AGG_MEAN 0         // Welford running mean
+#define AGG_MEDIAN 1       // median of the samples
+#define AGG_TRIMMED_MEAN 2 // mean without the top and bottom quarter
+#define SENSOR_AGGREGATOR AGG_TRIMMED_MEAN
+
+// Stop sampling once the 95% confidence half-width of every parameter is
+// below its limit. Order: humidity, temperature, EC, pH, N, P, K.
+const float SENSOR_CI_LIMIT[7] = {0.5, 0.3, 10, 0.1, 3, 3, 3};
+#define MODBUS_RX_MAX 64       // longest reply frame kept
+#define SENSOR_MAX_PROBES 4    // probes sharing the RS485 bus
+#define SENSOR_SCAN_FIRST 1    // slave addresses tried at boot
+#define SENSOR_SCAN_LAST 8
+#define SENSOR_SCAN_TIMEOUT_MS 100 // reply wait per address while scanning
+#define MODBUS_TX_GUARD_US 500 // extra DE hold after the last TX bit
 
 // ---------- SD Card File Paths ----------
 #define FARMERS_FILE "/farmers.csv"
+#define COUNTERS_FILE "/counters.dat" // record counts + byte sizes
+
+// Segmented datalog: readings go to numbered segment files in LOG_DIR; a
+// full segment is sealed and deleted once synced (see sd_manager.h)
+#define LOG_DIR "/log"
+#define LOG_MANIFEST_FILE "/log/manifest.dat"
+#define LOG_SEGMENT_BYTES 65536UL     // a segment is sealed past this size
+#define LOG_SEGMENTS_MAX 32           // segments kept on the card
+#define LOG_RETAIN_BYTES 0UL          // cap on log bytes kept; 0 = none
+#define LOG_MIN_FREE_BYTES 1048576UL  // free card space kept for new segments
+
+// Binary datalog: fixed 44-byte records in .bin segments instead of CSV
+// lines in .csv segments. CSV is rendered on demand when syncing.
+#define DATALOG_BINARY 0
+// Single-file datalog of older firmware, moved to the first segment
 #define DATALOG_FILE "/datalog.csv"
+#define DATALOG_BIN_FILE "/datalog.bin"
+#define DATALOG_TMP_FILE "/datalog.tmp" // its unsynced tail while compacting
+#define SD_SCAN_BLOCK 512 // bytes read per SD access when scanning CSVs
+#define SD_LINE_MAX 128   // longest CSV line kept when scanning
+
+// Write-ahead journal: farmers and readings go to JOURNAL_FILE first and
+// reach the files above in batches (see sd_manager.h)
+#define JOURNAL_FILE "/journal.dat"
+#define JOURNAL_SIZE 16384UL            // preallocated once, never grows
+#define JOURNAL_BUFFER 512              // RAM collecting entries per write
+#define JOURNAL_FLUSH_RECORDS 8         // entries waiting before a flush
+#define JOURNAL_CHECKPOINT_BYTES 8192UL // copied into the files past this
+// 1 = a save is flushed before the LCD says so; 0 = within SD_FLUSH_MS
+#define JOURNAL_FLUSH_ON_SAVE 1
+
+// Reading history: each farmer's last visits, shown when the ID is looked
+// up (see sd_manager.h)
+#define HISTORY_FILE "/history.dat"
+#define HISTORY_INDEX_FILE "/history.idx" // farmer ID -> slot in HISTORY_FILE
+#define HISTORY_INDEX_TMP "/history.idt"  // an index being built
+#define HISTORY_DEPTH 4        // visits kept per farmer, 48 bytes each
+#define HISTORY_PENDING_MAX 8  // visits journaled before a checkpoint
 
 // ---------- Farmer ID ----------
 #define FARMER_ID_LENGTH 4 // 4-digit IDs: 0001-9999
+#define FARMER_PHONE_BYTES 8 // BCD-packed phone slot (up to 16 digits)
+#define FARMER_INDEX_GROW 64 // index capacity step when it fills up
 
 // ---------- DS3231 RTC Module (I2C) ----------
 // Shares I2C bus with LCD: SDA=21, SCL=22 (ESP32 default)
@@ -70,9 +131,73 @@ const char KEYPAD_KEYS[KEYPAD_ROWS][KEYPAD_COLS] = {{'1', '2', '3', 'A'},
 // etc.
 #define SMS_COUNTRY_CODE "+234"
 
+// Sync over the modem's GPRS bearer when there is no WiFi
+#define SYNC_GPRS 1
+#define GPRS_APN "internet" // your carrier's APN
+#define GPRS_USER ""        // APN login, if the carrier needs one
+#define GPRS_PASS ""
+#define GPRS_HTTP_TIMEOUT 60000UL // ms to wait for the server's reply
+#define GPRS_RESPONSE_MAX 1024    // reply bytes kept
+
+// SMS encoding (PDU mode)
+#define SMS_MAX_SEGMENTS 3  // concatenated parts per SMS (each one is billed)
+#define SMS_MAX_UNITS 460   // UTF-16 units kept per SMS (3 x 153 + slack)
+#define SMS_PDU_HEX_MAX 320 // one segment's PDU in hex, with terminator
+#define SMS_TEMPLATE_MAX PIPE_TEXT_MAX // compiled template text
+#define SMS_TEMPLATE_OPS 32            // literal spans + placeholders
+
+// AT command engine
+#define AT_QUEUE_LEN 4                   // commands waiting for the modem
+#define AT_CMD_MAX (SMS_PDU_HEX_MAX + 2) // longest command (PDU + Ctrl+Z)
+#define AT_LINE_MAX 96                 // longest modem line kept
+#define AT_MAX_URCS 6                  // unsolicited result code handlers
+
+// SD-backed outbox for report SMS
+#define OUTBOX_FILE "/outbox.dat"
+#define OUTBOX_MAX_PENDING 16   // unsent SMS kept (more are refused)
+#define OUTBOX_MAX_ATTEMPTS 5   // sends tried before an SMS is marked failed
+#define OUTBOX_RETRY_MS 30000UL // first retry delay, doubled per attempt
+#define OUTBOX_MAX_RECORDS 256  // file is cleared once all are done past this
+
 // ---------- Timing ----------
 #define SENSOR_READ_DELAY 1000 // ms between sensor readings
 #define DEBOUNCE_DELAY 200     // ms keypad debounce
 #define LCD_SCROLL_DELAY 2000  // ms for scrolling messages
+#define LCD_FRAME_MS 40        // shortest time between LCD updates
+
+// ---------- Scheduler ----------
+#define SCHED_MAX_TASKS 8 // cooperative tasks run from loop()
+#define KEYPAD_SCAN_MS 10 // keypad task period
+#define SD_FLUSH_MS 500   // longest a journaled record waits in RAM
+#define SMS_QUEUE_SIZE 4  // SMS waiting while another one is being sent
+
+// ---------- Dual-core pipeline ----------
+// UI stays on the loop task (core 1); the SD, network and GSM workers run
+// on PIPE_IO_CORE. 0 = run every task from loop() on one core (the host
+// build in host/ passes 0).
+#ifndef PIPELINE_DUAL_CORE
+#define PIPELINE_DUAL_CORE 1
+#endif
+#define PIPE_IO_CORE 0
+#define PIPE_IO_STACK 8192  // SD + SMS outbox
+#define PIPE_NET_STACK 8192 // HTTP + JSON + deflate
+#define PIPE_GSM_STACK 4096
+#define PIPE_QUEUE_LEN 8    // messages per queue (power of 2)
+#define PIPE_PHONE_MAX 16   // phone number field, with terminator
+#define PIPE_TEXT_MAX 480   // SMS text in UTF-8 (up to 3 segments)
+
+// ---------- Heap hygiene ----------
+#define LOG_LINE_MAX 128     // longest Serial log line built by logLine()
+#define AT_RESPONSE_MAX 192  // reply text kept by sendATCommand()
+// 1 = log heap allocations per UI state transition (see heap_trace.h)
+#define HEAP_TRACE 0
+
+// ---------- Diagnostics ----------
+#define DIAG_FILE "/diag.csv"
+#define DIAG_OLD_FILE "/diag.old" // previous DIAG_FILE, kept once
+#define DIAG_FILE_MAX 65536UL     // DIAG_FILE is rotated past this size
+#define DIAG_RING_LEN 16          // samples waiting for the io worker
+#define DIAG_LOOP_BUCKETS 8       // loop time histogram: <1, <2, <4 ... ms
+#define DIAG_FLUSH_MS 1000        // how often samples are written to SD
 
 #endif // CONFIG_H
@@ -0,0 +1,306 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "config.h"
+#include "fixed_string.h"
+#include "sd_manager.h"
+#include <SD.h>
+#include <atomic>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+#endif
+
+// ==========================================
+//  DIAGNOSTICS
+// ==========================================
+// A sample is taken on every UI state transition. It records the free
+// heap, the largest free block (fragmentation), the unused stack of the
+// loop task and of the three workers (high-water marks), and how long the
+// loop() passes took since the previous sample.
+//
+// The loop task produces samples into diagRing. The io worker drains it
+// in diagTask(): each sample is folded into diagSummary (minimums, maximum
+// loop time, loop time histogram) and appended to DIAG_FILE. The summary
+// goes up with the first batch of every sync (see wifi_sync.h).
+//
+// A sample is a few heap/RTOS queries per state transition. Loop timing
+// is one micros() call per pass. This is cheap enough to leave on. Only
+// the ESP32 build has the probes; other builds get stubs that read 0.
+//
+// DIAG_FILE lines (CSV):
+//   B,<millis>,<reset reason>                             once per boot
+//   S,<millis>,<from>,<to>,<free>,<largest>,<min free>,<stack ui>,
+//     <stack io>,<stack net>,<stack gsm>,<loop max us>,<hist 0>..<hist N-1>
+// The histogram columns count the loop passes since the previous sample.
+// They add up to the summary's histogram.
+
+enum DiagTask { DIAG_UI, DIAG_IO, DIAG_NET, DIAG_GSM, DIAG_TASKS };
+
+const char *const DIAG_TASK_NAMES[DIAG_TASKS] = {"ui", "io", "net", "gsm"};
+
+struct DiagSample {
+  uint32_t ms;      // millis() when taken
+  const char *from; // state names (string literals)
+  const char *to;
+  uint32_t freeHeap;
+  uint32_t largestBlock;
+  uint32_t minFreeHeap;       // lowest since boot, kept by the heap
+  uint32_t stack[DIAG_TASKS]; // unused stack bytes; 0 = not a task
+  uint32_t loopMaxUs;         // longest loop() pass since the last sample
+  uint16_t loopHist[DIAG_LOOP_BUCKETS];
+};
+
+struct DiagSummary {
+  const char *resetReason;
+  uint32_t samples;
+  uint32_t dropped; // samples lost while diagRing was full
+  uint32_t minFreeHeap;
+  uint32_t minLargestBlock;
+  uint32_t minStack[DIAG_TASKS];
+  uint32_t maxLoopUs;
+  uint32_t loopHist[DIAG_LOOP_BUCKETS];
+};
+
+// Single-producer/single-consumer ring, like PipeQueue (pipeline.h)
+struct DiagRing {
+  DiagSample slots[DIAG_RING_LEN];
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+  std::atomic<uint32_t> dropped{0};
+};
+
+DiagRing diagRing;
+DiagSummary diagSummary;
+
+// Tasks whose stacks are sampled (set by diagSetTask)
+void *diagTaskHandles[DIAG_TASKS] = {nullptr, nullptr, nullptr, nullptr};
+
+// Loop timing since the last sample (loop task only)
+uint32_t diagLoopLast = 0;
+uint32_t diagLoopMaxUs = 0;
+uint16_t diagLoopHist[DIAG_LOOP_BUCKETS];
+
+// ---------- Platform probes ----------
+
+#ifdef ARDUINO_ARCH_ESP32
+uint32_t diagFreeHeap() { return heap_caps_get_free_size(MALLOC_CAP_8BIT); }
+
+uint32_t diagLargestBlock() {
+  return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+uint32_t diagMinFreeHeap() {
+  return heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+}
+
+uint32_t diagStackFree(void *task) {
+  return task ? uxTaskGetStackHighWaterMark((TaskHandle_t)task) : 0;
+}
+
+void *diagCurrentTask() { return xTaskGetCurrentTaskHandle(); }
+
+const char *diagResetReason() {
+  switch (esp_reset_reason()) {
+  case ESP_RST_POWERON:
+    return "poweron";
+  case ESP_RST_EXT:
+    return "external";
+  case ESP_RST_SW:
+    return "software";
+  case ESP_RST_PANIC:
+    return "panic";
+  case ESP_RST_INT_WDT:
+    return "int_wdt";
+  case ESP_RST_TASK_WDT:
+    return "task_wdt";
+  case ESP_RST_WDT:
+    return "wdt";
+  case ESP_RST_DEEPSLEEP:
+    return "deepsleep";
+  case ESP_RST_BROWNOUT:
+    return "brownout";
+  case ESP_RST_SDIO:
+    return "sdio";
+  default:
+    return "unknown";
+  }
+}
+#else
+uint32_t diagFreeHeap() { return 0; }
+uint32_t diagLargestBlock() { return 0; }
+uint32_t diagMinFreeHeap() { return 0; }
+uint32_t diagStackFree(void *) { return 0; }
+void *diagCurrentTask() { return nullptr; }
+const char *diagResetReason() { return "unknown"; }
+#endif
+
+// ---------- Loop task side ----------
+
+// Record a worker task (the loop task is recorded by diagInit)
+void diagSetTask(DiagTask task, void *handle) {
+  diagTaskHandles[task] = handle;
+}
+
+// Called at the top of every loop() pass
+void diagLoopTick() {
+  uint32_t now = micros();
+  if (diagLoopLast != 0) {
+    uint32_t us = now - diagLoopLast;
+    if (us > diagLoopMaxUs)
+      diagLoopMaxUs = us;
+    // Bucket b holds passes under 2^b ms (1 ms taken as 1024 us)
+    uint32_t ms = us >> 10;
+    int b = 0;
+    while (ms > 0 && b < DIAG_LOOP_BUCKETS - 1) {
+      ms >>= 1;
+      b++;
+    }
+    if (diagLoopHist[b] < UINT16_MAX)
+      diagLoopHist[b]++;
+  }
+  diagLoopLast = now;
+}
+
+// Take a sample for a state transition and hand it to the io worker
+void diagSample(const char *from, const char *to) {
+  uint32_t tail = diagRing.tail.load(std::memory_order_relaxed);
+  if (tail - diagRing.head.load(std::memory_order_acquire) >= DIAG_RING_LEN) {
+    diagRing.dropped++;
+    return; // the loop timing carries over into the next sample
+  }
+
+  DiagSample &s = diagRing.slots[tail % DIAG_RING_LEN];
+  s.ms = millis();
+  s.from = from;
+  s.to = to;
+  s.freeHeap = diagFreeHeap();
+  s.largestBlock = diagLargestBlock();
+  s.minFreeHeap = diagMinFreeHeap();
+  for (int t = 0; t < DIAG_TASKS; t++)
+    s.stack[t] = diagStackFree(diagTaskHandles[t]);
+  s.loopMaxUs = diagLoopMaxUs;
+  memcpy(s.loopHist, diagLoopHist, sizeof(s.loopHist));
+  diagRing.tail.store(tail + 1, std::memory_order_release);
+
+  diagLoopMaxUs = 0;
+  memset(diagLoopHist, 0, sizeof(diagLoopHist));
+}
+
+// ---------- io worker side ----------
+
+void diagFold(const DiagSample &s) {
+  DiagSummary &d = diagSummary;
+  d.samples++;
+  if (d.samples == 1 || s.freeHeap < d.minFreeHeap)
+    d.minFreeHeap = s.freeHeap;
+  if (s.minFreeHeap > 0 && s.minFreeHeap < d.minFreeHeap)
+    d.minFreeHeap = s.minFreeHeap;
+  if (d.samples == 1 || s.largestBlock < d.minLargestBlock)
+    d.minLargestBlock = s.largestBlock;
+  for (int t = 0; t < DIAG_TASKS; t++) {
+    if (s.stack[t] > 0 && (d.minStack[t] == 0 || s.stack[t] < d.minStack[t]))
+      d.minStack[t] = s.stack[t];
+  }
+  if (s.loopMaxUs > d.maxLoopUs)
+    d.maxLoopUs = s.loopMaxUs;
+  for (int b = 0; b < DIAG_LOOP_BUCKETS; b++)
+    d.loopHist[b] += s.loopHist[b];
+}
+
+typedef FixedString<SD_LINE_MAX + 32> DiagLine;
+typedef FixedString<384> DiagJson;
+
+// One CSV line for a sample
+DiagLine diagSampleLine(const DiagSample &s) {
+  DiagLine line;
+  line.appendf("S,%lu,%s,%s,%lu,%lu,%lu", (unsigned long)s.ms, s.from, s.to,
+               (unsigned long)s.freeHeap, (unsigned long)s.largestBlock,
+               (unsigned long)s.minFreeHeap);
+  for (int t = 0; t < DIAG_TASKS; t++)
+    line.appendf(",%lu", (unsigned long)s.stack[t]);
+  line.appendf(",%lu", (unsigned long)s.loopMaxUs);
+  for (int b = 0; b < DIAG_LOOP_BUCKETS; b++)
+    line.appendf(",%u", s.loopHist[b]);
+  return line;
+}
+
+// Open DIAG_FILE for appending; once it is large it becomes DIAG_OLD_FILE
+// (one old copy is kept) and a new one is started
+File diagOpen() {
+  File f = SD.open(DIAG_FILE, FILE_APPEND);
+  if (!f || f.size() < DIAG_FILE_MAX)
+    return f;
+  f.close();
+  if (SD.exists(DIAG_OLD_FILE))
+    SD.remove(DIAG_OLD_FILE);
+  SD.rename(DIAG_FILE, DIAG_OLD_FILE);
+  return SD.open(DIAG_FILE, FILE_APPEND);
+}
+
+// Record the boot (setup, before the workers own the SD card)
+void diagInit() {
+  memset(&diagSummary, 0, sizeof(diagSummary));
+  diagSummary.resetReason = diagResetReason();
+  diagTaskHandles[DIAG_UI] = diagCurrentTask();
+
+  File f = diagOpen();
+  if (f) {
+    DiagLine line;
+    line.appendf("B,%lu,%s", (unsigned long)millis(), diagSummary.resetReason);
+    f.println(line);
+    f.close();
+  }
+  logLine("Diag: Reset reason %s", diagSummary.resetReason);
+}
+
+// Scheduler task (io worker): fold waiting samples in and append them to
+// DIAG_FILE with a single open. The card lock also covers diagSummary,
+// which the net worker reads for a sync.
+void diagTask() {
+  uint32_t head = diagRing.head.load(std::memory_order_relaxed);
+  if (head == diagRing.tail.load(std::memory_order_acquire))
+    return;
+
+  SdGuard card;
+  File f = diagOpen();
+  while (head != diagRing.tail.load(std::memory_order_acquire)) {
+    const DiagSample &s = diagRing.slots[head % DIAG_RING_LEN];
+    diagFold(s);
+    if (f)
+      f.println(diagSampleLine(s));
+    head++;
+    diagRing.head.store(head, std::memory_order_release);
+  }
+  diagSummary.dropped = diagRing.dropped.load();
+  if (f)
+    f.close();
+}
+
+// The summary as a JSON member for the sync payload:
+//   "diag":{"reset":..,"uptime_s":..,"samples":..,"dropped":..,
+//   "min_heap":..,"min_block":..,
+//   "min_stack":{"ui":..,"io":..,"net":..,"gsm":..},
+//   "max_loop_us":..,"loop_hist":[..]},
+DiagJson diagSummaryJson(const DiagSummary &d) {
+  DiagJson json;
+  json.appendf("\"diag\":{\"reset\":\"%s\",\"uptime_s\":%lu,\"samples\":%lu,"
+               "\"dropped\":%lu,\"min_heap\":%lu,\"min_block\":%lu,"
+               "\"min_stack\":{",
+               d.resetReason ? d.resetReason : "unknown",
+               (unsigned long)(millis() / 1000), (unsigned long)d.samples,
+               (unsigned long)d.dropped, (unsigned long)d.minFreeHeap,
+               (unsigned long)d.minLargestBlock);
+  for (int t = 0; t < DIAG_TASKS; t++)
+    json.appendf("%s\"%s\":%lu", t ? "," : "", DIAG_TASK_NAMES[t],
+                 (unsigned long)d.minStack[t]);
+  json.appendf("},\"max_loop_us\":%lu,\"loop_hist\":[",
+               (unsigned long)d.maxLoopUs);
+  for (int b = 0; b < DIAG_LOOP_BUCKETS; b++)
+    json.appendf("%s%lu", b ? "," : "", (unsigned long)d.loopHist[b]);
+  json += "]},";
+  return json;
+}
+
+#endif // DIAGNOSTICS_H
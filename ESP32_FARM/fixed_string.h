@@ -0,0 +1,97 @@
+#ifndef FIXED_STRING_H
+#define FIXED_STRING_H
+
+#include "config.h"
+#include <stdarg.h>
+
+// ==========================================
+//  FIXED STRINGS (no heap)
+// ==========================================
+// Arduino String concatenation allocates on every "+", and a device that
+// runs all day fragments its heap that way. The hot paths (keypad, LCD,
+// reading and saving, SMS) build text in a FixedString instead: a char[N]
+// with a length, living on the stack or inside a struct. Anything that
+// does not fit is cut, never allocated; truncated() tells if that happened.
+// A FixedString converts to const char *, so it goes straight into
+// lcd.print(), Serial.println() or any function taking C strings.
+
+template <size_t N> class FixedString {
+public:
+  FixedString() { clear(); }
+  FixedString(const char *text) {
+    clear();
+    append(text);
+  }
+
+  void clear() {
+    len = 0;
+    buf[0] = '\0';
+    cut = false;
+  }
+
+  const char *c_str() const { return buf; }
+  operator const char *() const { return buf; }
+  size_t length() const { return len; }
+  size_t capacity() const { return N - 1; }
+  bool truncated() const { return cut; }
+
+  FixedString &append(const char *text, size_t n) {
+    if (n > N - 1 - len) {
+      n = N - 1 - len;
+      cut = true;
+    }
+    memcpy(buf + len, text, n);
+    len += n;
+    buf[len] = '\0';
+    return *this;
+  }
+  FixedString &append(const char *text) { return append(text, strlen(text)); }
+  FixedString &append(char c) { return append(&c, 1); }
+  FixedString &operator+=(const char *text) { return append(text); }
+  FixedString &operator+=(char c) { return append(c); }
+
+  // printf-style append
+  FixedString &appendf(const char *fmt, ...)
+      __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + len, N - len, fmt, args);
+    va_end(args);
+    if (n < 0)
+      n = 0;
+    if ((size_t)n > N - 1 - len) {
+      n = N - 1 - len;
+      cut = true;
+    }
+    len += n;
+    return *this;
+  }
+
+  // Drop the last character (keypad backspace)
+  void removeLast() {
+    if (len > 0)
+      buf[--len] = '\0';
+  }
+
+  bool operator==(const char *text) const { return strcmp(buf, text) == 0; }
+  bool operator!=(const char *text) const { return strcmp(buf, text) != 0; }
+  bool contains(const char *text) const { return strstr(buf, text) != nullptr; }
+
+private:
+  char buf[N];
+  size_t len;
+  bool cut;
+};
+
+// Format one log line on the stack and print it (cut at LOG_LINE_MAX)
+void logLine(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void logLine(const char *fmt, ...) {
+  char line[LOG_LINE_MAX];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  Serial.println(line);
+}
+
+#endif // FIXED_STRING_H
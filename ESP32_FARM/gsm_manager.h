@@ -2,8 +2,13 @@
 #define GSM_MANAGER_H
 
 #include "config.h"
+#include "fixed_string.h"
+#include "sensor_manager.h"
+#include "sms_pdu.h"
 #include <HardwareSerial.h>
 #include <SD.h>
+#include <atomic>
+#include <math.h>
 
 // Use Serial1 for GSM (Serial2 is used by RS485 soil sensor)
 HardwareSerial gsmSerial(1);
@@ -13,70 +18,305 @@ bool gsmNetworkReady = false;
 
 // SMS config loaded from SD card
 bool smsEnabled = false;
-String smsTemplate = "";
+char smsTemplate[SMS_TEMPLATE_MAX] = ""; // as on the SD card, "\n" escaped
 
 // ==========================================
-//  GSM INITIALIZATION
+//  AT COMMAND ENGINE
 // ==========================================
+// Commands wait in a small queue and are sent one at a time. Modem output
+// is split into lines in a fixed buffer. A line goes to the command in
+// flight when it is that command's final result (its expected result,
+// ERROR, +CME/+CMS ERROR) or starts with its information prefix (e.g.
+// +CREG: for AT+CREG?). Anything else is an unsolicited result code and
+// goes to the handler registered for its prefix (atOnUrc). Binary payloads
+// (AT+HTTPREAD) are passed through byte by byte with atReadRaw(). Nothing
+// here blocks; atPoll() is called from gsmTask.
+
+enum AtResult { AT_OK, AT_ERROR, AT_TIMEOUT };
+
+struct AtCommand {
+  char text[AT_CMD_MAX]; // sent as-is, followed by CR unless raw
+  bool raw;              // SMS body: no CR, no echo
+  const char *expect;    // final result that means success ("OK", ">")
+  const char *prefix;    // information lines for this command, or nullptr
+  unsigned long timeoutMs;
+  void (*onLine)(const char *line); // information lines
+  void (*onDone)(AtResult result);
+};
+
+struct AtUrc {
+  const char *prefix;
+  void (*handler)(const char *line);
+};
+
+AtCommand atQueue[AT_QUEUE_LEN];
+int atQueueHead = 0;
+int atQueueCount = 0;
+bool atActive = false; // atQueue[atQueueHead] has been sent
+unsigned long atSentAt = 0;
 
-// Send an AT command and wait for expected response
-String sendATCommand(const char *cmd, unsigned long timeoutMs = 2000) {
-  // Flush any leftover data
-  while (gsmSerial.available()) gsmSerial.read();
+char atLine[AT_LINE_MAX]; // line being received
+int atLineLen = 0;
 
-  gsmSerial.println(cmd);
+AtUrc atUrcs[AT_MAX_URCS];
+int atUrcCount = 0;
+
+size_t atRawLeft = 0;     // payload bytes still to pass to atRawSink
+bool atRawSkipLf = false; // drop the LF ending the line that announced it
+void (*atRawSink)(char ch) = nullptr;
+
+bool atStartsWith(const char *line, const char *prefix) {
+  return prefix && strncmp(line, prefix, strlen(prefix)) == 0;
+}
+
+// Register a handler for an unsolicited result code
+void atOnUrc(const char *prefix, void (*handler)(const char *line)) {
+  if (atUrcCount < AT_MAX_URCS)
+    atUrcs[atUrcCount++] = {prefix, handler};
+}
 
-  unsigned long start = millis();
-  String response = "";
+// Queue a command; returns false if the queue is full
+bool atSend(const char *text, const char *expect, unsigned long timeoutMs,
+            const char *prefix, void (*onLine)(const char *line),
+            void (*onDone)(AtResult result), bool raw = false) {
+  if (atQueueCount >= AT_QUEUE_LEN) {
+    logLine("GSM: AT queue full, dropped %s", text);
+    return false;
+  }
+  AtCommand &c = atQueue[(atQueueHead + atQueueCount) % AT_QUEUE_LEN];
+  strncpy(c.text, text, sizeof(c.text) - 1);
+  c.text[sizeof(c.text) - 1] = '\0';
+  c.raw = raw;
+  c.expect = expect;
+  c.prefix = prefix;
+  c.timeoutMs = timeoutMs;
+  c.onLine = onLine;
+  c.onDone = onDone;
+  atQueueCount++;
+  return true;
+}
+
+bool atIdle() { return atQueueCount == 0; }
+
+// Pass the next n bytes of modem output to sink instead of splitting them
+// into lines (called from the onLine handler of the line announcing them)
+void atReadRaw(size_t n, void (*sink)(char ch)) {
+  atRawLeft = n;
+  atRawSkipLf = true;
+  atRawSink = sink;
+}
+
+// Complete the command in flight
+void atFinish(AtResult result) {
+  AtCommand &c = atQueue[atQueueHead];
+  void (*onDone)(AtResult) = c.onDone;
+  atQueueHead = (atQueueHead + 1) % AT_QUEUE_LEN;
+  atQueueCount--;
+  atActive = false;
+  if (onDone)
+    onDone(result); // may queue the next step
+}
 
-  while ((millis() - start) < timeoutMs) {
-    while (gsmSerial.available()) {
-      char c = gsmSerial.read();
-      response += c;
+void atHandleLine(const char *line) {
+  if (atActive) {
+    AtCommand &c = atQueue[atQueueHead];
+    if (!c.raw && strcmp(line, c.text) == 0)
+      return; // echo (until ATE0)
+    if (atStartsWith(line, c.expect)) {
+      if (c.onLine && c.prefix && atStartsWith(line, c.prefix))
+        c.onLine(line);
+      atFinish(AT_OK);
+      return;
     }
-    // Early exit if we got a complete response
-    if (response.indexOf("OK") != -1 || response.indexOf("ERROR") != -1 ||
-        response.indexOf(">") != -1) {
-      delay(50); // Grab any trailing chars
-      while (gsmSerial.available()) response += (char)gsmSerial.read();
-      break;
+    if (strcmp(line, "ERROR") == 0 || atStartsWith(line, "+CME ERROR") ||
+        atStartsWith(line, "+CMS ERROR")) {
+      logLine("GSM> %s => %s", c.text, line);
+      atFinish(AT_ERROR);
+      return;
+    }
+    if (atStartsWith(line, c.prefix)) {
+      if (c.onLine)
+        c.onLine(line);
+      return;
+    }
+  }
+
+  for (int i = 0; i < atUrcCount; i++) {
+    if (atStartsWith(line, atUrcs[i].prefix)) {
+      atUrcs[i].handler(line);
+      return;
+    }
+  }
+
+  // Untagged information (e.g. the ATI banner) belongs to the command
+  if (atActive && atQueue[atQueueHead].onLine)
+    atQueue[atQueueHead].onLine(line);
+}
+
+// Send the next command, split modem output into lines, expire timeouts
+void atPoll() {
+  if (!atActive && atQueueCount > 0) {
+    AtCommand &c = atQueue[atQueueHead];
+    atLineLen = 0;
+    gsmSerial.print(c.text);
+    if (!c.raw)
+      gsmSerial.print('\r');
+    atSentAt = millis();
+    atActive = true;
+  }
+
+  while (gsmSerial.available()) {
+    char ch = gsmSerial.read();
+    if (atRawLeft > 0) {
+      if (atRawSkipLf && ch == '\n') {
+        atRawSkipLf = false;
+        continue;
+      }
+      atRawSkipLf = false;
+      atRawLeft--;
+      if (atRawSink)
+        atRawSink(ch);
+      continue;
+    }
+    if (ch == '\r' || ch == '\n') {
+      atLine[atLineLen] = '\0';
+      if (atLineLen > 0)
+        atHandleLine(atLine);
+      atLineLen = 0;
+      continue;
+    }
+    // The SMS prompt "> " has no line ending
+    if (ch == '>' && atLineLen == 0 && atActive &&
+        strcmp(atQueue[atQueueHead].expect, ">") == 0) {
+      atFinish(AT_OK);
+      continue;
     }
-    delay(10);
+    if (ch == ' ' && atLineLen == 0)
+      continue;
+    if (atLineLen < AT_LINE_MAX - 1)
+      atLine[atLineLen++] = ch; // longer lines are cut
+  }
+
+  if (atActive && millis() - atSentAt >= atQueue[atQueueHead].timeoutMs) {
+    logLine("GSM> %s => timeout", atQueue[atQueueHead].text);
+    atFinish(AT_TIMEOUT);
+  }
+}
+
+// Registration status from "+CREG: <n>,<stat>" (reply) or "+CREG: <stat>"
+// (URC); true when registered at home (1) or roaming (5)
+bool atCregRegistered(const char *line) {
+  const char *p = strchr(line, ':');
+  if (!p)
+    return false;
+  const char *comma = strchr(p, ',');
+  int stat = atoi(comma ? comma + 1 : p + 1);
+  return stat == 1 || stat == 5;
+}
+
+// ==========================================
+//  GSM INITIALIZATION
+// ==========================================
+
+FixedString<AT_RESPONSE_MAX> atResponse; // lines collected by sendATCommand
+AtResult atResult;
+bool atWaiting = false;
+
+void atCollectLine(const char *line) {
+  if (atResponse.length() > 0)
+    atResponse += '\n';
+  atResponse += line;
+}
+
+void atCollectDone(AtResult result) {
+  atResult = result;
+  if (result == AT_OK)
+    atCollectLine("OK");
+  else if (result == AT_ERROR)
+    atCollectLine("ERROR");
+  atWaiting = false;
+}
+
+// Queue a command and poll the engine until it completes (blocking; setup
+// and GPRS sync only)
+AtResult atRun(const char *cmd, const char *expect, unsigned long timeoutMs,
+               const char *prefix, void (*onLine)(const char *line),
+               bool raw = false) {
+  atWaiting =
+      atSend(cmd, expect, timeoutMs, prefix, onLine, atCollectDone, raw);
+  if (!atWaiting)
+    return AT_ERROR;
+  while (atWaiting) {
+    atPoll();
+    delay(1);
   }
+  return atResult;
+}
 
-  response.trim();
-  Serial.println("GSM> " + String(cmd) + " => " + response);
-  return response;
+// Send an AT command and wait for its final result (blocking)
+// Returns the information lines plus OK/ERROR, or "" on timeout. Lines
+// starting with prefix are kept even if they look like a URC. The text
+// stays valid until the next call (cut at AT_RESPONSE_MAX).
+const char *sendATCommand(const char *cmd, unsigned long timeoutMs = 2000,
+                          const char *prefix = nullptr) {
+  atResponse.clear();
+  atRun(cmd, "OK", timeoutMs, prefix, atCollectLine);
+  logLine("GSM> %s => %s", cmd, atResponse.c_str());
+  return atResponse;
 }
 
 // Check if SIM800L is registered on the cellular network
 // Returns true if registered (home or roaming)
 bool checkNetworkRegistration() {
-  String resp = sendATCommand("AT+CREG?", 3000);
-  // +CREG: 0,1 = registered home, +CREG: 0,5 = registered roaming
-  if (resp.indexOf(",1") != -1 || resp.indexOf(",5") != -1) {
-    gsmNetworkReady = true;
-    return true;
-  }
-  gsmNetworkReady = false;
-  return false;
+  gsmNetworkReady =
+      atCregRegistered(sendATCommand("AT+CREG?", 3000, "+CREG:"));
+  return gsmNetworkReady;
+}
+
+// Unsolicited result codes
+void gsmOnCreg(const char *line) {
+  gsmNetworkReady = atCregRegistered(line);
+  logLine("GSM: Network %s", gsmNetworkReady ? "registered" : "lost");
 }
 
+void gsmOnCmti(const char *line) {
+  logLine("GSM: Incoming SMS stored (%s)", line);
+}
+
+void gsmOnRing(const char *line) {
+  // Calls are not answered; hang up so the modem stays free for SMS
+  Serial.println("GSM: Incoming call, rejecting");
+  atSend("ATH", "OK", 2000, nullptr, nullptr, nullptr);
+}
+
+void gsmOnCmgs(const char *line) {
+  // Only arrives here once the send it belongs to has timed out
+  logLine("GSM: Late confirmation %s", line);
+}
+
+void gprsOnHttpAction(const char *line);
+
 // Initialize the SIM800L GSM module
 void gsmInit() {
   Serial.println("GSM: Initializing SIM800L on Serial1...");
   gsmSerial.begin(GSM_BAUD, SERIAL_8N1, GSM_RX_PIN, GSM_TX_PIN);
   delay(3000); // SIM800L needs time to boot after power on
 
+  atOnUrc("+CREG:", gsmOnCreg);
+  atOnUrc("+CMTI:", gsmOnCmti);
+  atOnUrc("RING", gsmOnRing);
+  atOnUrc("+CMGS:", gsmOnCmgs);
+  atOnUrc("+HTTPACTION:", gprsOnHttpAction);
+
   // Test communication with AT
-  String resp = sendATCommand("AT");
-  if (resp.indexOf("OK") == -1) {
+  const char *resp = sendATCommand("AT");
+  if (!strstr(resp, "OK")) {
     Serial.println("GSM: SIM800L not responding. Retrying...");
     delay(2000);
     resp = sendATCommand("AT");
   }
 
-  if (resp.indexOf("OK") == -1) {
+  if (!strstr(resp, "OK")) {
     gsmReady = false;
     Serial.println("GSM: SIM800L not found! SMS disabled.");
     return;
@@ -87,17 +327,18 @@ void gsmInit() {
   // Disable echo (cleaner responses)
   sendATCommand("ATE0");
 
-  // Set text mode for SMS
-  sendATCommand("AT+CMGF=1");
+  // PDU mode for SMS (GSM-7 or UCS2, concatenated; see sms_pdu.h)
+  sendATCommand("AT+CMGF=0");
 
-  // Set character set to GSM default
-  sendATCommand("AT+CSCS=\"GSM\"");
+  // Report registration changes (+CREG) and new SMS (+CMTI) unsolicited
+  sendATCommand("AT+CREG=1");
+  sendATCommand("AT+CNMI=2,1,0,0,0");
 
   // Check SIM status
-  String simResp = sendATCommand("AT+CPIN?");
-  if (simResp.indexOf("READY") == -1) {
+  const char *simResp = sendATCommand("AT+CPIN?");
+  if (!strstr(simResp, "READY")) {
     Serial.println("GSM: SIM card NOT ready! Check SIM card.");
-    Serial.println("GSM: Response was: " + simResp);
+    logLine("GSM: Response was: %s", simResp);
     gsmReady = false;
     return;
   }
@@ -123,8 +364,7 @@ void gsmInit() {
   }
 
   // Check signal strength (0-31, 99=unknown; 10+ is usable)
-  String sigResp = sendATCommand("AT+CSQ");
-  Serial.println("GSM: Signal: " + sigResp);
+  logLine("GSM: Signal: %s", sendATCommand("AT+CSQ"));
 
   gsmReady = true;
   Serial.println("GSM: Initialization complete");
@@ -137,144 +377,504 @@ bool gsmIsReady() { return gsmReady; }
 //  SMS SENDING
 // ==========================================
 
+typedef FixedString<PIPE_PHONE_MAX + sizeof(SMS_COUNTRY_CODE)> SmsPhone;
+
 // Format phone number for SIM800L
 // Converts local format (09XXXXXXXXX) to international (+639XXXXXXXXX)
-String formatPhoneNumber(String phone) {
-  phone.trim();
+SmsPhone formatPhoneNumber(const char *phone) {
+  while (isspace((unsigned char)*phone))
+    phone++;
+  size_t length = strlen(phone);
+  while (length > 0 && isspace((unsigned char)phone[length - 1]))
+    length--;
+
+  SmsPhone out;
   // Already international format
-  if (phone.startsWith("+")) {
-    return phone;
-  }
+  if (phone[0] == '+')
+    return out.append(phone, length);
   // Local format starting with 0 — convert using country code from config
-  if (phone.startsWith("0") && phone.length() >= 10) {
-    return String(SMS_COUNTRY_CODE) + phone.substring(1);
-  }
+  out += SMS_COUNTRY_CODE;
+  if (phone[0] == '0' && length >= 10)
+    return out.append(phone + 1, length - 1);
   // Already without leading 0, just add country code
-  return String(SMS_COUNTRY_CODE) + phone;
+  return out.append(phone, length);
 }
 
-// Send an SMS to the specified phone number
-bool sendSMS(String phoneNumber, String message) {
+// One SMS at a time, as a chain of AT commands (each step queues the next
+// from its completion callback):
+//   AT+CREG? -> AT+CMGF=0 -> per segment: AT+CMGS=<len> -> '>' ->
+//   PDU + Ctrl+Z -> OK
+enum SmsState {
+  SMS_IDLE,
+  SMS_WAIT_CREG,   // network registration check
+  SMS_WAIT_CMGF,   // PDU mode
+  SMS_WAIT_PROMPT, // '>' after AT+CMGS
+  SMS_WAIT_SENT    // +CMGS once the network accepts the segment
+};
+
+enum SmsResult { SMS_NONE, SMS_SENT, SMS_FAILED };
+
+struct SmsJob {
+  SmsState state = SMS_IDLE;
+  SmsPhone phone; // international format
+  SmsResult lastResult = SMS_NONE;
+  int32_t ref = -1; // outbox record being sent, -1 = none
+
+  // Encoded form: UTF-16 units split into segments
+  uint16_t units[SMS_MAX_UNITS];
+  int unitCount = 0;
+  bool gsm7 = true;
+  uint16_t bounds[SMS_MAX_SEGMENTS + 1];
+  int segments = 0;
+  int segment = 0; // being sent
+  uint8_t concatRef = 0;
+  SmsPdu pdu;
+};
+
+SmsJob sms;
+
+// Called when a queued SMS with an outbox ref has been sent or given up
+void (*smsDoneHandler)(int32_t ref, bool sent) = nullptr;
+
+// Messages waiting for the modem
+struct SmsQueued {
+  char phone[PIPE_PHONE_MAX];
+  char message[PIPE_TEXT_MAX];
+  int32_t ref;
+};
+
+SmsQueued smsQueue[SMS_QUEUE_SIZE];
+int smsQueueHead = 0;
+int smsQueueCount = 0;
+
+bool smsBusy() { return sms.state != SMS_IDLE; }
+
+void smsFinish(bool ok) {
+  sms.state = SMS_IDLE;
+  sms.lastResult = ok ? SMS_SENT : SMS_FAILED;
+  if (sms.ref >= 0 && smsDoneHandler)
+    smsDoneHandler(sms.ref, ok);
+  sms.ref = -1;
+}
+
+void smsOnCreg(const char *line) { gsmNetworkReady = atCregRegistered(line); }
+
+void smsOnCmgs(const char *line) {
+  logLine("GSM: SMS accepted by network! (%s)", line);
+}
+
+void smsSendSegment();
+
+void smsSentDone(AtResult result) {
+  if (result == AT_ERROR) {
+    Serial.println("GSM: SMS REJECTED by network. Check: phone number, SIM credit, signal.");
+  } else if (result == AT_TIMEOUT) {
+    Serial.println("GSM: SMS send TIMEOUT - no response from network");
+  }
+  if (result == AT_OK && ++sms.segment < sms.segments) {
+    smsSendSegment();
+    return;
+  }
+  smsFinish(result == AT_OK);
+}
+
+void smsPromptDone(AtResult result) {
+  if (result != AT_OK) {
+    Serial.println("GSM: ERROR - Never got '>' prompt!");
+    Serial.println("GSM: This usually means invalid phone number or SIM issue");
+    // Send ESC to cancel
+    gsmSerial.write(0x1B);
+    smsFinish(false);
+    return;
+  }
+
+  logLine("GSM: Got '>' prompt, sending segment %d/%d", sms.segment + 1,
+          sms.segments);
+  // PDU in hex, then Ctrl+Z (0x1A) to finalize and send
+  char body[AT_CMD_MAX];
+  snprintf(body, sizeof(body), "%s\x1A", sms.pdu.hex);
+  sms.state = SMS_WAIT_SENT;
+  // SMS sending can take up to 60 seconds on some networks
+  if (!atSend(body, "OK", 30000, "+CMGS:", smsOnCmgs, smsSentDone, true))
+    smsFinish(false);
+}
+
+// Encode the current segment, send AT+CMGS and wait for '>' (up to 5 s)
+void smsSendSegment() {
+  int k = sms.segment;
+  if (!smsBuildPdu(sms.phone, sms.units, sms.bounds[k],
+                   sms.bounds[k + 1], sms.gsm7, sms.concatRef, sms.segments,
+                   k + 1, sms.pdu)) {
+    logLine("GSM: Cannot encode SMS for %s", sms.phone.c_str());
+    smsFinish(false);
+    return;
+  }
+
+  char cmd[16];
+  snprintf(cmd, sizeof(cmd), "AT+CMGS=%d", (int)sms.pdu.tpduLength);
+  sms.state = SMS_WAIT_PROMPT;
+  if (!atSend(cmd, ">", 5000, nullptr, nullptr, smsPromptDone))
+    smsFinish(false);
+}
+
+void smsCmgfDone(AtResult result) {
+  if (result != AT_OK) {
+    Serial.println("GSM: ERROR - Could not switch to PDU mode");
+    smsFinish(false);
+    return;
+  }
+  sms.segment = 0;
+  smsSendSegment();
+}
+
+void smsCregDone(AtResult result) {
+  if (result != AT_OK || !gsmNetworkReady) {
+    Serial.println("GSM: ERROR - Not registered on network!");
+    smsFinish(false);
+    return;
+  }
+  // Ensure PDU mode
+  sms.state = SMS_WAIT_CMGF;
+  if (!atSend("AT+CMGF=0", "OK", 2000, nullptr, nullptr, smsCmgfDone))
+    smsFinish(false);
+}
+
+// Start sending an SMS; returns false if it cannot be attempted
+bool smsStart(const char *phoneNumber, const char *message,
+              int32_t ref = -1) {
+  if (smsBusy()) {
+    Serial.println("GSM: Cannot send SMS - modem busy");
+    return false;
+  }
+  sms.ref = ref;
   if (!gsmReady) {
     Serial.println("GSM: Cannot send SMS - module not ready");
+    smsFinish(false);
     return false;
   }
 
+  // Format the phone number to international format
+  sms.phone = formatPhoneNumber(phoneNumber);
+  sms.lastResult = SMS_NONE;
+
+  // GSM-7 when the alphabet allows it, else UCS2; fewest segments
+  sms.unitCount = smsDecodeUtf8(message, sms.units, SMS_MAX_UNITS);
+  sms.gsm7 = smsIsGsm7(sms.units, sms.unitCount);
+  sms.segments = smsPlanSegments(sms.units, sms.unitCount, sms.gsm7,
+                                 sms.bounds, SMS_MAX_SEGMENTS);
+  sms.concatRef++;
+
+  logLine("GSM: Sending SMS to %s (was: %s)", sms.phone.c_str(), phoneNumber);
+  logLine("GSM: Message (%u chars, %d x %s): %s", (unsigned)strlen(message),
+          sms.segments, sms.gsm7 ? "GSM-7" : "UCS2", message);
+
   // Re-check network before sending
-  if (!checkNetworkRegistration()) {
-    Serial.println("GSM: ERROR - Not registered on network!");
+  sms.state = SMS_WAIT_CREG;
+  if (!atSend("AT+CREG?", "OK", 3000, "+CREG:", smsOnCreg, smsCregDone)) {
+    smsFinish(false);
     return false;
   }
+  return true;
+}
 
-  // Format the phone number to international format
-  String formattedPhone = formatPhoneNumber(phoneNumber);
-  Serial.println("GSM: Sending SMS to " + formattedPhone + " (was: " + phoneNumber + ")");
-  Serial.println("GSM: Message (" + String(message.length()) + " chars): " + message);
-
-  // Ensure text mode
-  sendATCommand("AT+CMGF=1");
-  delay(100);
-
-  // Send AT+CMGS command and wait for '>' prompt
-  String cmd = "AT+CMGS=\"" + formattedPhone + "\"";
-  
-  // Flush serial
-  while (gsmSerial.available()) gsmSerial.read();
-  
-  gsmSerial.println(cmd);
-
-  // Wait for '>' prompt (up to 5 seconds)
-  unsigned long start = millis();
-  String prompt = "";
-  bool gotPrompt = false;
-  while ((millis() - start) < 5000) {
-    while (gsmSerial.available()) {
-      char c = gsmSerial.read();
-      prompt += c;
-    }
-    if (prompt.indexOf(">") != -1) {
-      gotPrompt = true;
-      break;
-    }
-    if (prompt.indexOf("ERROR") != -1) {
-      break;
-    }
-    delay(50);
+// Queue an SMS for gsmTask; returns false if the queue is full.
+// ref (an outbox record) is passed back through smsDoneHandler.
+bool queueSMS(const char *phoneNumber, const char *message,
+              int32_t ref = -1) {
+  if (smsQueueCount >= SMS_QUEUE_SIZE) {
+    Serial.println("GSM: SMS queue full, message dropped");
+    return false;
+  }
+  SmsQueued &q = smsQueue[(smsQueueHead + smsQueueCount) % SMS_QUEUE_SIZE];
+  strncpy(q.phone, phoneNumber, sizeof(q.phone) - 1);
+  q.phone[sizeof(q.phone) - 1] = '\0';
+  strncpy(q.message, message, sizeof(q.message) - 1);
+  q.message[sizeof(q.message) - 1] = '\0';
+  q.ref = ref;
+  smsQueueCount++;
+  return true;
+}
+
+int smsPendingCount() { return smsQueueCount + (smsBusy() ? 1 : 0); }
+
+// The net worker borrows the modem for a GPRS sync (gprsAcquire). It is
+// handed over between SMS with the AT queue empty, and gsmTask leaves the
+// serial port alone until it comes back. SMS queue up meanwhile.
+enum GsmLease : uint8_t { LEASE_NONE, LEASE_WANTED, LEASE_GRANTED };
+std::atomic<uint8_t> gsmLease{LEASE_NONE};
+
+// Scheduler task: run the AT engine, then start the next queued SMS
+void gsmTask() {
+  uint8_t lease = gsmLease.load();
+  if (lease == LEASE_GRANTED)
+    return;
+  atPoll();
+  if (lease == LEASE_WANTED) {
+    uint8_t wanted = LEASE_WANTED;
+    if (!smsBusy() && atIdle())
+      gsmLease.compare_exchange_strong(wanted, LEASE_GRANTED);
+    return;
   }
+  if (!smsBusy() && smsQueueCount > 0) {
+    // smsStart() keeps only the encoded form, so the slot can be reused
+    // as soon as it returns
+    SmsQueued &q = smsQueue[smsQueueHead];
+    smsQueueHead = (smsQueueHead + 1) % SMS_QUEUE_SIZE;
+    smsQueueCount--;
+    smsStart(q.phone, q.message, q.ref);
+  }
+}
 
-  if (!gotPrompt) {
-    Serial.println("GSM: ERROR - Never got '>' prompt! Response: " + prompt);
-    Serial.println("GSM: This usually means invalid phone number or SIM issue");
-    // Send ESC to cancel
-    gsmSerial.write(0x1B);
-    delay(500);
+// Send an SMS to the specified phone number (blocking)
+bool sendSMS(const char *phoneNumber, const char *message) {
+  if (!smsStart(phoneNumber, message))
     return false;
+  while (smsBusy()) {
+    atPoll();
+    delay(1);
+  }
+  return sms.lastResult == SMS_SENT;
+}
+
+// ==========================================
+//  MESSAGE TEMPLATE
+// ==========================================
+
+// The dashboard's template is compiled once, in loadSmsConfig() and
+// saveSmsConfig(), into literal spans and placeholders. "\n" is already
+// turned into a newline at that point. Each report is then rendered in a
+// single pass into a fixed buffer, counting its SMS segments on the way.
+
+enum SmsField : uint8_t {
+  FIELD_TEXT, // literal span of smsCompiled.text
+  FIELD_FARMER_ID,
+  FIELD_HUMIDITY,
+  FIELD_TEMPERATURE,
+  FIELD_EC,
+  FIELD_PH,
+  FIELD_NITROGEN,
+  FIELD_PHOSPHORUS,
+  FIELD_POTASSIUM,
+  FIELD_TIMESTAMP,
+  FIELD_COUNT
+};
+
+const char *const SMS_FIELD_NAMES[FIELD_COUNT] = {
+    "",   "farmer_id", "humidity",   "temperature", "ec",
+    "ph", "nitrogen",  "phosphorus", "potassium",   "timestamp"};
+
+struct SmsOp {
+  uint8_t field;   // SmsField
+  uint16_t start;  // FIELD_TEXT: span of smsCompiled.text
+  uint16_t length;
+};
+
+struct SmsTemplate {
+  char text[SMS_TEMPLATE_MAX]; // literal text, escapes resolved
+  uint16_t textLength;
+  SmsOp ops[SMS_TEMPLATE_OPS];
+  uint8_t opCount;
+};
+
+SmsTemplate smsCompiled;
+
+// Placeholder for the name between braces, or FIELD_TEXT if unknown
+uint8_t smsFieldId(const char *name, size_t length) {
+  for (uint8_t f = FIELD_FARMER_ID; f < FIELD_COUNT; f++) {
+    if (strlen(SMS_FIELD_NAMES[f]) == length &&
+        strncmp(SMS_FIELD_NAMES[f], name, length) == 0)
+      return f;
   }
+  return FIELD_TEXT;
+}
 
-  Serial.println("GSM: Got '>' prompt, sending message body...");
+bool smsAddOp(SmsTemplate &t, uint8_t field) {
+  if (t.opCount >= SMS_TEMPLATE_OPS)
+    return false;
+  t.ops[t.opCount++] = {field, t.textLength, 0};
+  return true;
+}
 
-  // Send message body
-  gsmSerial.print(message);
-  delay(100);
+// Append a literal byte, extending the last span if it is one
+bool smsAddText(SmsTemplate &t, char c) {
+  if (t.textLength >= SMS_TEMPLATE_MAX)
+    return false;
+  if (t.opCount == 0 || t.ops[t.opCount - 1].field != FIELD_TEXT) {
+    if (!smsAddOp(t, FIELD_TEXT))
+      return false;
+  }
+  t.text[t.textLength++] = c;
+  t.ops[t.opCount - 1].length++;
+  return true;
+}
 
-  // Send Ctrl+Z (0x1A) to finalize and send
-  gsmSerial.write(0x1A);
+// Compile tmpl into smsCompiled (unknown {names} stay as text)
+void compileSmsTemplate(const char *tmpl) {
+  SmsTemplate &t = smsCompiled;
+  t.textLength = 0;
+  t.opCount = 0;
 
-  // Wait for response (SMS sending can take up to 60 seconds on some networks)
-  start = millis();
-  String response = "";
-  while ((millis() - start) < 30000) {
-    while (gsmSerial.available()) {
-      char c = gsmSerial.read();
-      response += c;
+  const char *p = tmpl;
+  while (*p) {
+    if (*p == '{') {
+      const char *close = strchr(p, '}');
+      uint8_t field = close ? smsFieldId(p + 1, close - p - 1) : FIELD_TEXT;
+      if (field != FIELD_TEXT) {
+        if (!smsAddOp(t, field))
+          break;
+        p = close + 1;
+        continue;
+      }
     }
-    if (response.indexOf("+CMGS:") != -1) {
-      break; // Network accepted the message
+    char c = *p++;
+    if (c == '\\' && *p == 'n') { // literal \n from the dashboard
+      c = '\n';
+      p++;
     }
-    if (response.indexOf("ERROR") != -1) {
+    if (!smsAddText(t, c))
       break;
-    }
-    delay(100);
   }
+  if (*p)
+    logLine("GSM: Template too long, cut at %d bytes", (int)(p - tmpl));
+}
 
-  Serial.println("GSM: Raw response: " + response);
+// Decimal text of n; returns its length
+size_t smsFormatInt(long long n, char *out) {
+  char digits[20];
+  size_t len = 0;
+  bool negative = n < 0;
+  unsigned long long u = negative ? 0ULL - n : n;
+  do {
+    digits[len++] = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  size_t pos = 0;
+  if (negative)
+    out[pos++] = '-';
+  while (len)
+    out[pos++] = digits[--len];
+  out[pos] = '\0';
+  return pos;
+}
 
-  if (response.indexOf("+CMGS:") != -1) {
-    Serial.println("GSM: SMS accepted by network!");
-    return true;
-  } else if (response.indexOf("ERROR") != -1) {
-    Serial.println("GSM: SMS REJECTED by network. Check: phone number, SIM credit, signal.");
-    return false;
-  } else {
-    Serial.println("GSM: SMS send TIMEOUT - no response from network");
-    return false;
-  }
+// v with one decimal, as String(v, 1) prints it (ties to even), without
+// printf's float path
+size_t smsFormatTenths(float v, char *out, size_t size) {
+  if (!(fabsf(v) < 1e9f)) // also NaN and infinity
+    return snprintf(out, size, "%.1f", v);
+  double tenths = rint((double)v * 10); // exact: float x 10 fits a double
+  size_t pos = 0;
+  if (signbit(tenths))
+    out[pos++] = '-';
+  long long n = llabs((long long)tenths);
+  pos += smsFormatInt(n / 10, out + pos);
+  out[pos++] = '.';
+  out[pos++] = '0' + n % 10;
+  out[pos] = '\0';
+  return pos;
 }
 
-// ==========================================
-//  MESSAGE TEMPLATE
-// ==========================================
+struct SmsOut {
+  char *buf;
+  size_t size;
+  size_t length;
+  bool full;
+  SmsSizer sizer;
+};
 
-// Build the SMS message by replacing placeholders with actual values
-String buildSmsMessage(String tmpl, String farmerID, float humidity,
-                       float temperature, float ec, float ph, float nitrogen,
-                       float phosphorus, float potassium, String timestamp) {
-  String msg = tmpl;
+// Append UTF-8 text, whole characters only
+void smsAppend(SmsOut &out, const char *src, size_t length) {
+  size_t i = 0;
+  while (i < length && !out.full) {
+    // Runs of plain ASCII in one go
+    size_t run = 0;
+    while (i + run < length && gsm7PlainAscii((uint8_t)src[i + run]))
+      run++;
+    if (run > 0) {
+      if (out.length + run >= out.size) {
+        run = out.size - 1 - out.length;
+        out.full = true;
+      }
+      memcpy(out.buf + out.length, src + i, run);
+      out.length += run;
+      out.sizer.addPlain(run);
+      i += run;
+      continue;
+    }
 
-  msg.replace("{farmer_id}", farmerID);
-  msg.replace("{humidity}", String(humidity, 1));
-  msg.replace("{temperature}", String(temperature, 1));
-  msg.replace("{ec}", String((int)ec));
-  msg.replace("{ph}", String(ph, 1));
-  msg.replace("{nitrogen}", String((int)nitrogen));
-  msg.replace("{phosphorus}", String((int)phosphorus));
-  msg.replace("{potassium}", String((int)potassium));
-  msg.replace("{timestamp}", timestamp);
+    uint8_t lead = src[i];
+    size_t n = (lead & 0xE0) == 0xC0   ? 2
+               : (lead & 0xF0) == 0xE0 ? 3
+               : (lead & 0xF8) == 0xF0 ? 4
+                                       : 1;
+    if (i + n > length)
+      n = length - i;
+    if (out.length + n >= out.size) {
+      out.full = true;
+      break;
+    }
 
-  // Replace literal \n with actual newline for SMS
-  msg.replace("\\n", "\n");
+    uint32_t cp = (n == 1) ? (lead < 0x80 ? lead : '?') : lead & (0x7F >> n);
+    for (size_t k = 1; k < n; k++)
+      cp = (cp << 6) | (src[i + k] & 0x3F);
+    out.sizer.add(cp);
+
+    memcpy(out.buf + out.length, src + i, n);
+    out.length += n;
+    i += n;
+  }
+}
+
+// Render the compiled template for one report into out (NUL-terminated,
+// cut at a character boundary if it does not fit). Returns its length;
+// segments gets the number of SMS it takes.
+size_t renderSmsMessage(const char *farmerId, const SoilData &r,
+                        const char *timestamp, char *out, size_t size,
+                        int &segments) {
+  SmsOut o = {out, size, 0, false};
+  char value[24];
+
+  for (int i = 0; i < smsCompiled.opCount && !o.full; i++) {
+    const SmsOp &op = smsCompiled.ops[i];
+    const char *src = value;
+    switch (op.field) {
+    case FIELD_TEXT:
+      smsAppend(o, smsCompiled.text + op.start, op.length);
+      continue;
+    case FIELD_FARMER_ID:
+      src = farmerId;
+      break;
+    case FIELD_HUMIDITY:
+      smsFormatTenths(r.humidity, value, sizeof(value));
+      break;
+    case FIELD_TEMPERATURE:
+      smsFormatTenths(r.temperature, value, sizeof(value));
+      break;
+    case FIELD_EC:
+      smsFormatInt((int)r.ec, value);
+      break;
+    case FIELD_PH:
+      smsFormatTenths(r.ph, value, sizeof(value));
+      break;
+    case FIELD_NITROGEN:
+      smsFormatInt((int)r.nitrogen, value);
+      break;
+    case FIELD_PHOSPHORUS:
+      smsFormatInt((int)r.phosphorus, value);
+      break;
+    case FIELD_POTASSIUM:
+      smsFormatInt((int)r.potassium, value);
+      break;
+    case FIELD_TIMESTAMP:
+      src = timestamp;
+      break;
+    }
+    smsAppend(o, src, strlen(src));
+  }
 
-  return msg;
+  out[o.length] = '\0';
+  segments = o.sizer.segments();
+  return o.length;
 }
 
 // ==========================================
@@ -286,7 +886,8 @@ void loadSmsConfig() {
   if (!SD.exists(SMS_CONFIG_FILE)) {
     Serial.println("GSM: No SMS config file found. SMS disabled.");
     smsEnabled = false;
-    smsTemplate = "";
+    smsTemplate[0] = '\0';
+    compileSmsTemplate(smsTemplate);
     return;
   }
 
@@ -298,26 +899,34 @@ void loadSmsConfig() {
   }
 
   // First line: enabled (0 or 1)
-  String enabledStr = f.readStringUntil('\n');
-  enabledStr.trim();
-  smsEnabled = (enabledStr == "1");
+  int c = f.read();
+  while (c == ' ' || c == '\t')
+    c = f.read();
+  smsEnabled = (c == '1');
+  while (c >= 0 && c != '\n')
+    c = f.read();
 
-  // Rest of file: template
-  smsTemplate = "";
-  while (f.available()) {
-    smsTemplate += (char)f.read();
-  }
-  smsTemplate.trim();
+  // Rest of file: template, trimmed (cut at SMS_TEMPLATE_MAX - 1 bytes)
+  size_t length = f.read((uint8_t *)smsTemplate, sizeof(smsTemplate) - 1);
+  if (f.available())
+    logLine("GSM: Template too long, cut at %u bytes", (unsigned)length);
+  while (length > 0 && isspace((unsigned char)smsTemplate[length - 1]))
+    length--;
+  smsTemplate[length] = '\0';
+  size_t lead = 0;
+  while (isspace((unsigned char)smsTemplate[lead]))
+    lead++;
+  memmove(smsTemplate, smsTemplate + lead, length - lead + 1);
+  compileSmsTemplate(smsTemplate);
 
   f.close();
 
-  Serial.println("GSM: SMS Config loaded - Enabled: " +
-                 String(smsEnabled ? "YES" : "NO"));
-  Serial.println("GSM: Template: " + smsTemplate);
+  logLine("GSM: SMS Config loaded - Enabled: %s", smsEnabled ? "YES" : "NO");
+  logLine("GSM: Template: %s", smsTemplate);
 }
 
 // Save SMS configuration to SD card
-bool saveSmsConfig(bool enabled, String tmpl) {
+bool saveSmsConfig(bool enabled, const char *tmpl) {
   // Remove old file
   if (SD.exists(SMS_CONFIG_FILE)) {
     SD.remove(SMS_CONFIG_FILE);
@@ -335,7 +944,8 @@ bool saveSmsConfig(bool enabled, String tmpl) {
 
   // Update in-memory values
   smsEnabled = enabled;
-  smsTemplate = tmpl;
+  snprintf(smsTemplate, sizeof(smsTemplate), "%s", tmpl);
+  compileSmsTemplate(smsTemplate);
 
   Serial.println("GSM: SMS config saved to SD");
   return true;
@@ -344,4 +954,368 @@ bool saveSmsConfig(bool enabled, String tmpl) {
 // Check if SMS sending is enabled
 bool isSmsEnabled() { return smsEnabled && gsmReady; }
 
+// ==========================================
+//  SMS OUTBOX (SD)
+// ==========================================
+// Report SMS are appended to OUTBOX_FILE as fixed-size records and sent
+// from there, one at a time. A failed send is retried with a doubling
+// backoff, and an unsent one survives a reboot. Each record keeps its
+// delivery status. These functions touch the SD card, so they run where
+// the SD card is owned; the modem only ever sees the message in flight
+// (outboxNext() -> queueSMS() -> outboxResult()).
+
+enum OutboxStatus : uint8_t { OUTBOX_PENDING, OUTBOX_SENT, OUTBOX_FAILED };
+
+struct OutboxRecord {
+  uint8_t status;   // OutboxStatus
+  uint8_t attempts; // sends tried so far
+  char phone[PIPE_PHONE_MAX];
+  char text[PIPE_TEXT_MAX];
+};
+
+// Pending records kept in RAM, oldest first
+struct OutboxSlot {
+  uint32_t index; // record number in OUTBOX_FILE
+  uint8_t attempts;
+  unsigned long nextTry; // millis() of the next attempt
+};
+
+OutboxSlot outboxSlots[OUTBOX_MAX_PENDING];
+int outboxPendingCount = 0;
+int outboxFailedCount = 0;
+uint32_t outboxRecords = 0;  // whole records in OUTBOX_FILE
+int32_t outboxInFlight = -1; // record with the modem, -1 = none
+
+// Rewrite the status bytes of one record in place
+bool outboxSetStatus(uint32_t index, uint8_t status, uint8_t attempts) {
+  File f = SD.open(OUTBOX_FILE, "r+");
+  if (!f)
+    return false;
+  uint8_t head[2] = {status, attempts};
+  bool ok = f.seek(index * sizeof(OutboxRecord)) && f.write(head, 2) == 2;
+  f.close();
+  return ok;
+}
+
+// Load the pending records and failed count (call once SD is up)
+void outboxInit() {
+  outboxPendingCount = 0;
+  outboxFailedCount = 0;
+  outboxRecords = 0;
+  outboxInFlight = -1;
+
+  File f = SD.open(OUTBOX_FILE, FILE_READ);
+  if (!f)
+    return;
+
+  // A torn tail from a power cut is overwritten by the next outboxAdd()
+  outboxRecords = f.size() / sizeof(OutboxRecord);
+  OutboxRecord rec;
+  for (uint32_t i = 0; i < outboxRecords; i++) {
+    if (f.read((uint8_t *)&rec, sizeof(rec)) != sizeof(rec))
+      break;
+    if (rec.status == OUTBOX_FAILED) {
+      outboxFailedCount++;
+    } else if (rec.status == OUTBOX_PENDING &&
+               outboxPendingCount < OUTBOX_MAX_PENDING) {
+      OutboxSlot &slot = outboxSlots[outboxPendingCount++];
+      slot.index = i;
+      slot.attempts = rec.attempts;
+      slot.nextTry = millis(); // due now
+    }
+  }
+  f.close();
+
+  logLine("GSM: Outbox %d pending, %lu failed", outboxPendingCount,
+          (unsigned long)outboxFailedCount);
+}
+
+// Append an SMS to the outbox (one write); false if it is full or SD fails
+bool outboxAdd(const char *phone, const char *text) {
+  if (outboxPendingCount >= OUTBOX_MAX_PENDING) {
+    Serial.println("GSM: Outbox full, SMS not queued");
+    return false;
+  }
+
+  OutboxRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.status = OUTBOX_PENDING;
+  strncpy(rec.phone, phone, sizeof(rec.phone) - 1);
+  strncpy(rec.text, text, sizeof(rec.text) - 1);
+
+  // Write at the record boundary ("r+" keeps the rest of the file)
+  if (!SD.exists(OUTBOX_FILE)) {
+    File created = SD.open(OUTBOX_FILE, FILE_WRITE);
+    if (!created)
+      return false;
+    created.close();
+  }
+  File f = SD.open(OUTBOX_FILE, "r+");
+  if (!f)
+    return false;
+  bool ok = f.seek(outboxRecords * sizeof(OutboxRecord)) &&
+            f.write((const uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+  f.close();
+  if (!ok) {
+    Serial.println("GSM: Could not write outbox");
+    return false;
+  }
+
+  OutboxSlot &slot = outboxSlots[outboxPendingCount++];
+  slot.index = outboxRecords++;
+  slot.attempts = 0;
+  slot.nextTry = millis();
+  return true;
+}
+
+// The next record due for sending, if the modem is free; it stays in
+// flight until outboxResult()
+bool outboxNext(OutboxRecord &rec, uint32_t &index) {
+  if (outboxInFlight >= 0)
+    return false;
+
+  for (int i = 0; i < outboxPendingCount; i++) {
+    OutboxSlot &slot = outboxSlots[i];
+    if ((long)(millis() - slot.nextTry) < 0)
+      continue;
+
+    File f = SD.open(OUTBOX_FILE, FILE_READ);
+    if (!f)
+      return false;
+    bool ok = f.seek(slot.index * sizeof(OutboxRecord)) &&
+              f.read((uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+    f.close();
+    if (!ok)
+      return false;
+
+    index = slot.index;
+    outboxInFlight = slot.index;
+    return true;
+  }
+  return false;
+}
+
+// Drop every record once nothing is pending and the file has grown large
+void outboxCompact() {
+  if (outboxPendingCount > 0 || outboxRecords < OUTBOX_MAX_RECORDS)
+    return;
+  SD.remove(OUTBOX_FILE);
+  logLine("GSM: Outbox cleared (%lu records, %lu failed)",
+          (unsigned long)outboxRecords, (unsigned long)outboxFailedCount);
+  outboxRecords = 0;
+  outboxFailedCount = 0;
+}
+
+// Record the outcome of the in-flight send
+void outboxResult(uint32_t index, bool sent) {
+  if (outboxInFlight == (int32_t)index)
+    outboxInFlight = -1;
+
+  int i = 0;
+  while (i < outboxPendingCount && outboxSlots[i].index != index)
+    i++;
+  if (i == outboxPendingCount)
+    return;
+
+  OutboxSlot &slot = outboxSlots[i];
+  slot.attempts++;
+  uint8_t status = OUTBOX_PENDING;
+  if (sent) {
+    status = OUTBOX_SENT;
+  } else if (slot.attempts >= OUTBOX_MAX_ATTEMPTS) {
+    status = OUTBOX_FAILED;
+    outboxFailedCount++;
+    logLine("GSM: Outbox record %lu failed after %d attempts",
+            (unsigned long)index, slot.attempts);
+  } else {
+    slot.nextTry = millis() + (OUTBOX_RETRY_MS << (slot.attempts - 1));
+    logLine("GSM: Outbox record %lu retry in %lu s", (unsigned long)index,
+            (unsigned long)((OUTBOX_RETRY_MS << (slot.attempts - 1)) / 1000));
+  }
+  outboxSetStatus(index, status, slot.attempts);
+
+  if (status != OUTBOX_PENDING) {
+    // Keep the remaining slots in file order
+    for (int j = i + 1; j < outboxPendingCount; j++)
+      outboxSlots[j - 1] = outboxSlots[j];
+    outboxPendingCount--;
+    outboxCompact();
+  }
+}
+
+// ==========================================
+//  GPRS HTTP (sync without WiFi)
+// ==========================================
+// HTTP through the SIM800L's own stack: a GPRS bearer (AT+SAPBR) and the
+// AT+HTTP* commands. The body is streamed into AT+HTTPDATA block by block,
+// so it never has to fit in RAM. Like HTTPClient these calls block; they
+// run on the net worker while it holds the modem lease, which makes the AT
+// engine theirs for the duration.
+
+bool gprsBearerUp = false;
+bool gprsActionDone = false; // +HTTPACTION arrived
+int gprsStatus = 0;          // its HTTP status (6xx = modem-side error)
+size_t gprsLength = 0;       // and body length
+FixedString<GPRS_RESPONSE_MAX + 1> gprsResponse;
+
+// GPRS sync is possible: enabled, modem up and registered
+bool gprsAvailable() { return SYNC_GPRS && gsmReady && gsmNetworkReady; }
+
+// Ask for the modem; true once the GSM worker has handed it over (never
+// blocks, call again until it does)
+bool gprsAcquire() {
+  uint8_t none = LEASE_NONE;
+  gsmLease.compare_exchange_strong(none, LEASE_WANTED);
+  return gsmLease.load() == LEASE_GRANTED;
+}
+
+// Close the bearer and give the modem back to the GSM worker
+void gprsRelease() {
+  uint8_t wanted = LEASE_WANTED;
+  if (gsmLease.compare_exchange_strong(wanted, LEASE_NONE))
+    return; // never handed over
+  if (gprsBearerUp) {
+    sendATCommand("AT+SAPBR=0,1", 10000);
+    gprsBearerUp = false;
+  }
+  while (!atIdle()) { // e.g. ATH queued by a RING during the sync
+    atPoll();
+    delay(1);
+  }
+  gsmLease.store(LEASE_NONE);
+}
+
+// "+HTTPACTION: <method>,<status>,<length>" (URC, may take a while)
+void gprsOnHttpAction(const char *line) {
+  const char *p = strchr(line, ',');
+  gprsStatus = p ? atoi(p + 1) : 0;
+  p = p ? strchr(p + 1, ',') : nullptr;
+  gprsLength = p ? atol(p + 1) : 0;
+  gprsActionDone = true;
+}
+
+void gprsResponseByte(char ch) {
+  gprsResponse += ch; // cut at GPRS_RESPONSE_MAX
+}
+
+// "+HTTPREAD: <n>" is followed by n bytes of body
+void gprsOnHttpRead(const char *line) {
+  atReadRaw(atol(strchr(line, ':') + 1), gprsResponseByte);
+}
+
+bool gprsCommand(const char *cmd, unsigned long timeoutMs = 5000) {
+  const char *resp = sendATCommand(cmd, timeoutMs);
+  size_t length = strlen(resp);
+  return length >= 2 && strcmp(resp + length - 2, "OK") == 0;
+}
+
+bool gprsBearerOpen() {
+  if (gprsBearerUp)
+    return true;
+  if (strstr(sendATCommand("AT+SAPBR=2,1", 5000, "+SAPBR:"), "+SAPBR: 1,1")) {
+    gprsBearerUp = true;
+    return true;
+  }
+
+  char cmd[AT_CMD_MAX];
+  gprsCommand("AT+SAPBR=3,1,\"Contype\",\"GPRS\"");
+  snprintf(cmd, sizeof(cmd), "AT+SAPBR=3,1,\"APN\",\"%s\"", GPRS_APN);
+  gprsCommand(cmd);
+  if (strlen(GPRS_USER) > 0) {
+    snprintf(cmd, sizeof(cmd), "AT+SAPBR=3,1,\"USER\",\"%s\"", GPRS_USER);
+    gprsCommand(cmd);
+    snprintf(cmd, sizeof(cmd), "AT+SAPBR=3,1,\"PWD\",\"%s\"", GPRS_PASS);
+    gprsCommand(cmd);
+  }
+
+  // Attaching can take up to 85 s on a weak signal
+  gprsBearerUp = gprsCommand("AT+SAPBR=1,1", 85000);
+  logLine("GSM: GPRS bearer %s", gprsBearerUp ? "open" : "failed");
+  return gprsBearerUp;
+}
+
+// GET (body nullptr) or POST length bytes of body to url
+// Returns the HTTP status (6xx for modem-side errors) or -1; the reply
+// body (up to GPRS_RESPONSE_MAX bytes) goes to response.
+int gprsHttp(const char *url, Stream *body, size_t length, bool deflate,
+             String &response) {
+  response = "";
+  if (!gprsBearerOpen())
+    return -1;
+
+  char cmd[AT_CMD_MAX];
+  if (!gprsCommand("AT+HTTPINIT")) {
+    sendATCommand("AT+HTTPTERM"); // drop a session left by a failed request
+    if (!gprsCommand("AT+HTTPINIT"))
+      return -1;
+  }
+
+  int status = -1;
+  snprintf(cmd, sizeof(cmd), "AT+HTTPPARA=\"URL\",\"%s\"", url);
+  bool ok = gprsCommand("AT+HTTPPARA=\"CID\",1") && gprsCommand(cmd);
+
+  if (ok && body) {
+    ok = gprsCommand("AT+HTTPPARA=\"CONTENT\",\"application/json\"");
+    if (ok && deflate)
+      ok = gprsCommand("AT+HTTPPARA=\"USERDATA\",\"Content-Encoding: "
+                       "deflate\"");
+
+    // Time for the whole body to cross the UART, plus slack (max 120 s)
+    unsigned long window = length * 10000UL / GSM_BAUD + 10000;
+    if (window > 120000)
+      window = 120000;
+    snprintf(cmd, sizeof(cmd), "AT+HTTPDATA=%u,%lu", (unsigned)length, window);
+    ok = ok && atRun(cmd, "DOWNLOAD", 5000, nullptr, nullptr) == AT_OK;
+
+    if (ok) {
+      char block[SYNC_BLOCK_SIZE];
+      size_t sent = 0;
+      while (sent < length) {
+        size_t want = length - sent;
+        if (want > sizeof(block))
+          want = sizeof(block);
+        size_t n = body->readBytes(block, want);
+        if (n == 0)
+          break;
+        gsmSerial.write((const uint8_t *)block, n);
+        sent += n;
+      }
+      // The modem answers OK once it has all length bytes
+      ok = sent == length &&
+           atRun("", "OK", window + 2000, nullptr, nullptr, true) == AT_OK;
+      if (!ok)
+        logLine("GSM: HTTP body not accepted (%u/%u bytes)", (unsigned)sent,
+                (unsigned)length);
+    }
+  }
+
+  if (ok) {
+    gprsActionDone = false;
+    ok = gprsCommand(body ? "AT+HTTPACTION=1" : "AT+HTTPACTION=0");
+    unsigned long start = millis();
+    while (ok && !gprsActionDone && millis() - start < GPRS_HTTP_TIMEOUT) {
+      atPoll();
+      delay(1);
+    }
+    if (ok && gprsActionDone) {
+      status = gprsStatus;
+      logLine("GSM: HTTP %d, %u bytes", status, (unsigned)gprsLength);
+    } else if (ok) {
+      Serial.println("GSM: HTTP request timed out");
+    }
+  }
+
+  if (status > 0 && gprsLength > 0) {
+    gprsResponse.clear();
+    if (atRun("AT+HTTPREAD", "OK", 10000, "+HTTPREAD:", gprsOnHttpRead) ==
+        AT_OK)
+      response = gprsResponse.c_str();
+    atRawLeft = 0;
+    gprsResponse.clear();
+  }
+
+  sendATCommand("AT+HTTPTERM");
+  return status;
+}
+
 #endif // GSM_MANAGER_H
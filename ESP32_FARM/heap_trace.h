@@ -0,0 +1,94 @@
+#ifndef HEAP_TRACE_H
+#define HEAP_TRACE_H
+
+#include "config.h"
+#include "fixed_string.h"
+
+// ==========================================
+//  HEAP TRACE (instrumentation build)
+// ==========================================
+// With HEAP_TRACE 1 every UI state transition logs the heap allocations
+// made since the previous one, on all tasks, e.g.
+//   Heap: READING_SOIL -> SHOW_RESULTS: 0 allocs, 0 frees, free 182344 B
+// The reading-and-save path should show 0 allocs.
+//
+// Exact counts need a core built with CONFIG_HEAP_USE_HOOKS, which calls
+// the two hooks below on every malloc/free. Without it the only thing the
+// heap can tell is how many blocks are allocated, so the log shows the
+// net change instead ("net +N blocks"): a String that is made and freed
+// between two transitions is not seen then.
+// Off the ESP32 the heap cannot be asked, so free bytes and blocks read
+// 0; a host build (see host/) can still define CONFIG_HEAP_USE_HOOKS and
+// call the hooks from its own malloc/free.
+// With HEAP_TRACE 0 the calls compile to nothing.
+
+#if HEAP_TRACE
+
+#include <atomic>
+#ifdef ARDUINO_ARCH_ESP32
+#include <esp_heap_caps.h>
+#endif
+
+size_t heapFreeBytes() {
+#ifdef ARDUINO_ARCH_ESP32
+  return heap_caps_get_free_size(MALLOC_CAP_8BIT);
+#else
+  return 0;
+#endif
+}
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+std::atomic<uint32_t> heapAllocs{0};
+std::atomic<uint32_t> heapFrees{0};
+
+extern "C" void esp_heap_trace_alloc_hook(void *ptr, size_t size,
+                                          uint32_t caps) {
+  heapAllocs++;
+}
+
+extern "C" void esp_heap_trace_free_hook(void *ptr) { heapFrees++; }
+#else
+size_t heapBlocksBefore = 0;
+
+size_t heapAllocatedBlocks() {
+#ifdef ARDUINO_ARCH_ESP32
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+  return info.allocated_blocks;
+#else
+  return 0;
+#endif
+}
+#endif
+
+void heapTraceBegin() {
+#ifdef CONFIG_HEAP_USE_HOOKS
+  Serial.println("Heap: Tracing allocations (heap hooks)");
+#else
+  heapBlocksBefore = heapAllocatedBlocks();
+  Serial.println("Heap: Tracing net allocated blocks (no heap hooks)");
+#endif
+}
+
+// Log the allocations since the last transition and start counting again
+void heapTraceTransition(const char *from, const char *to) {
+  size_t freeBytes = heapFreeBytes();
+#ifdef CONFIG_HEAP_USE_HOOKS
+  uint32_t allocs = heapAllocs.exchange(0);
+  uint32_t frees = heapFrees.exchange(0);
+  logLine("Heap: %s -> %s: %lu allocs, %lu frees, free %u B", from, to,
+          (unsigned long)allocs, (unsigned long)frees, (unsigned)freeBytes);
+#else
+  size_t blocks = heapAllocatedBlocks();
+  logLine("Heap: %s -> %s: net %+ld blocks, free %u B", from, to,
+          (long)blocks - (long)heapBlocksBefore, (unsigned)freeBytes);
+  heapBlocksBefore = blocks;
+#endif
+}
+
+#else
+inline void heapTraceBegin() {}
+inline void heapTraceTransition(const char *, const char *) {}
+#endif
+
+#endif // HEAP_TRACE_H
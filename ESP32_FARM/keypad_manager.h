@@ -2,6 +2,7 @@
 #define KEYPAD_MANAGER_H
 
 #include "config.h"
+#include "fixed_string.h"
 #include <Keypad.h>
 
 
@@ -15,112 +16,97 @@ void keypadInit() {
   keypad.setHoldTime(1000);
 }
 
-// Get a single keypress (blocking with timeout)
-// Returns '\0' if timeout
-char getKey(unsigned long timeoutMs = 0) {
-  unsigned long start = millis();
-  while (true) {
-    char key = keypad.getKey();
-    if (key != NO_KEY) {
-      return key;
-    }
-    if (timeoutMs > 0 && (millis() - start) > timeoutMs) {
-      return '\0'; // timeout
-    }
-    delay(10);
-  }
-}
+// ==========================================
+//  KEY QUEUE
+// ==========================================
+// keypadTask() scans the matrix on its scheduler tick and queues presses;
+// the UI pops them when it is ready, so no key is lost while another task
+// is busy.
+
+#define KEY_QUEUE_SIZE 8
+
+char keyQueue[KEY_QUEUE_SIZE];
+uint8_t keyQueueHead = 0;
+uint8_t keyQueueCount = 0;
 
-// Get a single keypress (non-blocking)
-// Returns '\0' if no key pressed
-char getKeyNonBlocking() {
+void keypadTask() {
   char key = keypad.getKey();
-  return (key != NO_KEY) ? key : '\0';
-}
+  if (key == NO_KEY)
+    return;
 
-// Wait for either * or # key
-// Returns '*' or '#'
-char waitForConfirmOrCancel() {
-  while (true) {
-    char key = keypad.getKey();
-    if (key == '*' || key == '#') {
-      return key;
-    }
-    delay(10);
+  if (keyQueueCount < KEY_QUEUE_SIZE) {
+    keyQueue[(keyQueueHead + keyQueueCount) % KEY_QUEUE_SIZE] = key;
+    keyQueueCount++;
   }
 }
 
-// Collect a numeric string of specified length
-// * = confirm/save, # = cancel/back, A/B/C/D = backspace
-// Returns the collected string (may be shorter than maxLen if confirmed early)
-// Sets 'confirmed' to true if * was pressed, false if # was pressed
-String collectNumericInput(int maxLen, bool &confirmed,
-                           void (*displayCallback)(String)) {
-  String input = "";
-  confirmed = false;
-
-  while (true) {
-    char key = keypad.getKey();
-    if (key == NO_KEY) {
-      delay(10);
-      continue;
-    }
+// Next queued keypress, or '\0' if none
+char keyPop() {
+  if (keyQueueCount == 0)
+    return '\0';
 
-    if (key >= '0' && key <= '9') {
-      // Numeric input
-      if (input.length() < maxLen) {
-        input += key;
-        if (displayCallback)
-          displayCallback(input);
-      }
-    } else if (key == '*') {
-      // Confirm
-      if (input.length() > 0) {
-        confirmed = true;
-        return input;
-      }
-    } else if (key == '#') {
-      // Cancel
-      confirmed = false;
-      return input;
-    } else if (key == 'A' || key == 'B' || key == 'C' || key == 'D') {
-      // Backspace - remove last character
-      if (input.length() > 0) {
-        input.remove(input.length() - 1);
-        if (displayCallback)
-          displayCallback(input);
-      }
-    }
-  }
+  char key = keyQueue[keyQueueHead];
+  keyQueueHead = (keyQueueHead + 1) % KEY_QUEUE_SIZE;
+  keyQueueCount--;
+  return key;
 }
 
-// Collect a farmer ID (exactly 4 digits, zero-padded)
-String collectFarmerID(bool &confirmed, void (*displayCallback)(String)) {
-  String id = collectNumericInput(FARMER_ID_LENGTH, confirmed, displayCallback);
+// ==========================================
+//  NUMERIC INPUT
+// ==========================================
+// Line editor fed one key at a time
+// * = confirm/save, # = cancel/back, A/B/C/D = backspace
 
-  // Zero-pad to 4 digits if confirmed
-  if (confirmed) {
-    while (id.length() < FARMER_ID_LENGTH) {
-      id = "0" + id;
-    }
-  }
-  return id;
-}
+enum InputResult { INPUT_EDITING, INPUT_CONFIRMED, INPUT_CANCELLED };
 
-// Collect phone number (up to 15 digits)
-String collectPhoneNumber(bool &confirmed, void (*displayCallback)(String)) {
-  return collectNumericInput(15, confirmed, displayCallback);
+struct NumericInput {
+  FixedString<PIPE_PHONE_MAX> text; // longest input is a phone number
+  unsigned int maxLen;
+  void (*displayCallback)(const char *text);
+};
+
+void inputBegin(NumericInput &in, int maxLen,
+                void (*displayCallback)(const char *text)) {
+  in.text.clear();
+  in.maxLen = maxLen;
+  in.displayCallback = displayCallback;
 }
 
-// Wait for any key press
-char waitForAnyKey() {
-  while (true) {
-    char key = keypad.getKey();
-    if (key != NO_KEY) {
-      return key;
+InputResult inputFeed(NumericInput &in, char key) {
+  if (key >= '0' && key <= '9') {
+    // Numeric input
+    if (in.text.length() < in.maxLen) {
+      in.text += key;
+      if (in.displayCallback)
+        in.displayCallback(in.text);
+    }
+  } else if (key == '*') {
+    // Confirm (needs at least one digit)
+    if (in.text.length() > 0)
+      return INPUT_CONFIRMED;
+  } else if (key == '#') {
+    // Cancel
+    return INPUT_CANCELLED;
+  } else if (key == 'A' || key == 'B' || key == 'C' || key == 'D') {
+    // Backspace - remove last character
+    if (in.text.length() > 0) {
+      in.text.removeLast();
+      if (in.displayCallback)
+        in.displayCallback(in.text);
     }
-    delay(10);
   }
+  return INPUT_EDITING;
+}
+
+typedef FixedString<FARMER_ID_LENGTH + 1> FarmerId;
+
+// Zero-pad a confirmed farmer ID to FARMER_ID_LENGTH digits
+FarmerId padFarmerID(const char *id) {
+  FarmerId padded;
+  for (size_t n = strlen(id); n < FARMER_ID_LENGTH; n++)
+    padded += '0';
+  padded += id;
+  return padded;
 }
 
 #endif // KEYPAD_MANAGER_H
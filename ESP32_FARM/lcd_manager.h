@@ -2,27 +2,70 @@
 #define LCD_MANAGER_H
 
 #include "config.h"
+#include "fixed_string.h"
 #include <LiquidCrystal_I2C.h>
 #include <Wire.h>
 
 LiquidCrystal_I2C lcd(LCD_ADDR, LCD_COLS, LCD_ROWS);
 
+// ==========================================
+//  FRAME BUFFER
+// ==========================================
+// The screens below draw into lcdFrame, a RAM copy of the display, and
+// never talk to the LCD themselves. lcdFlush() compares it with lcdShown
+// (what the LCD holds) and sends only the cells that changed. The cursor
+// is only moved where a changed cell is not where the last write left it.
+// lcdClear() just blanks the frame, so the LCD's own clear (a full redraw
+// plus a 2 ms wait) is only used once, at boot.
+//
+// The I2C bus is shared with the DS3231, and each character costs the
+// backpack six bus writes (two 4-bit halves, each latched with the enable
+// line high, then low). The UI scheduler runs lcdFlush() every
+// LCD_FRAME_MS, so several screens drawn in a row go out as one update.
+// Code that blocks (setup) calls lcdFlush() itself before waiting.
+
+char lcdFrame[LCD_ROWS][LCD_COLS]; // what the screens asked for
+char lcdShown[LCD_ROWS][LCD_COLS]; // what the LCD displays
+int lcdCursorCol = -1;             // where the next write lands; -1 = unknown
+int lcdCursorRow = -1;
+
 void lcdInit() {
   lcd.init();
   lcd.backlight();
   lcd.clear();
+  memset(lcdFrame, ' ', sizeof(lcdFrame));
+  memset(lcdShown, ' ', sizeof(lcdShown));
+  lcdCursorCol = lcdCursorRow = -1;
 }
 
-void lcdClear() { lcd.clear(); }
-
-void lcdPrint(int col, int row, const char *text) {
-  lcd.setCursor(col, row);
-  lcd.print(text);
+// Send the cells of lcdFrame that differ from the LCD
+void lcdFlush() {
+  for (int row = 0; row < LCD_ROWS; row++) {
+    for (int col = 0; col < LCD_COLS; col++) {
+      char c = lcdFrame[row][col];
+      if (c == lcdShown[row][col])
+        continue;
+      if (col != lcdCursorCol || row != lcdCursorRow)
+        lcd.setCursor(col, row);
+      lcd.write((uint8_t)c);
+      lcdShown[row][col] = c;
+      // Past the last column the address does not wrap to the next row
+      lcdCursorCol = (col + 1 < LCD_COLS) ? col + 1 : -1;
+      lcdCursorRow = row;
+    }
+  }
 }
 
-void lcdPrint(int col, int row, String text) {
-  lcd.setCursor(col, row);
-  lcd.print(text);
+void lcdClear() { memset(lcdFrame, ' ', sizeof(lcdFrame)); }
+
+// Text past the end of the row is cut
+void lcdPrint(int col, int row, const char *text) {
+  if (row < 0 || row >= LCD_ROWS)
+    return;
+  for (; *text && col < LCD_COLS; text++, col++) {
+    if (col >= 0)
+      lcdFrame[row][col] = *text;
+  }
 }
 
 void lcdPrintCentered(int row, const char *text) {
@@ -30,149 +73,203 @@ void lcdPrintCentered(int row, const char *text) {
   int col = (LCD_COLS - len) / 2;
   if (col < 0)
     col = 0;
-  lcd.setCursor(col, row);
-  lcd.print(text);
+  lcdPrint(col, row, text);
 }
 
 void lcdShowBoot() {
-  lcd.clear();
+  lcdClear();
   lcdPrintCentered(0, "FARM SPACE");
   lcdPrintCentered(1, "BY ActionLab v1");
 }
 
 void lcdShowWiFiConnecting() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "Connecting WiFi");
   lcdPrint(0, 1, "Please wait...");
 }
 
 void lcdShowWiFiConnected() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "WiFi Connected!");
   lcdPrint(0, 1, "Sync? *Yes #No");
 }
 
 void lcdShowNoWiFi() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "No WiFi Found");
   lcdPrint(0, 1, "Skipping sync...");
 }
 
+void lcdShowGprsSync() {
+  lcdClear();
+  lcdPrint(0, 0, "No WiFi, GPRS ok");
+  lcdPrint(0, 1, "Sync? *Yes #No");
+}
+
 void lcdShowSyncing() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "Syncing data...");
   lcdPrint(0, 1, "Please wait");
 }
 
 void lcdShowSyncSuccess() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "Sync Success!");
   lcdPrint(0, 1, "Logs cleared.");
 }
 
 void lcdShowSyncFail() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "Sync Failed!");
   lcdPrint(0, 1, "Data kept safe.");
 }
 
 void lcdShowEnterID() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "Enter Farmer ID:");
   lcdPrint(0, 1, "ID: ");
 }
 
-void lcdShowIDInput(String id) {
-  lcdPrint(4, 1, id + "    "); // pad to clear old chars
+// One LCD row of text, built without the heap
+typedef FixedString<LCD_COLS + 1> LcdLine;
+
+void lcdShowIDInput(const char *id) {
+  LcdLine line(id);
+  line += "    "; // pad to clear old chars
+  lcdPrint(4, 1, line);
 }
 
-void lcdShowFarmerFound(String farmerId, String phone) {
-  lcd.clear();
-  lcdPrint(0, 0, "ID:" + farmerId + " Found!");
+void lcdShowFarmerFound(const char *farmerId, const char *phone) {
+  lcdClear();
+  LcdLine line;
+  line.appendf("ID:%s Found!", farmerId);
+  lcdPrint(0, 0, line);
   lcdPrint(0, 1, phone);
 }
 
+// The farmer's last visit on record ("Last DD/MM pH6.4" / "N40 P12 K80")
+void lcdShowLastVisit(const char *date, float ph, float nitrogen,
+                      float phosphorus, float potassium) {
+  lcdClear();
+  LcdLine text;
+  lcdPrint(0, 0, text.appendf("Last %s pH%.1f", date, ph));
+  text.clear();
+  lcdPrint(0, 1,
+           text.appendf("N%d P%d K%d", (int)nitrogen, (int)phosphorus,
+                        (int)potassium));
+}
+
+// Change from the visit before it ("vs DD/MM pH+0.2" / "N+5 P-2 K+10")
+void lcdShowTrend(const char *date, float phDelta, int nitrogenDelta,
+                  int phosphorusDelta, int potassiumDelta) {
+  lcdClear();
+  LcdLine text;
+  lcdPrint(0, 0, text.appendf("vs %s pH%+.1f", date, phDelta));
+  text.clear();
+  lcdPrint(0, 1,
+           text.appendf("N%+d P%+d K%+d", nitrogenDelta, phosphorusDelta,
+                        potassiumDelta));
+}
+
 void lcdShowFarmerOptions() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "*:New Reading");
   lcdPrint(0, 1, "#:Back to Menu");
 }
 
 void lcdShowNewFarmer() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "New! Enter Phone");
   lcdPrint(0, 1, "");
 }
 
-void lcdShowPhoneInput(String phone) {
-  lcdPrint(0, 1, phone + "     "); // pad to clear old chars
+void lcdShowPhoneInput(const char *phone) {
+  LcdLine line(phone);
+  line += "     "; // pad to clear old chars
+  lcdPrint(0, 1, line);
 }
 
-void lcdShowFarmerSaved(String id) {
-  lcd.clear();
+void lcdShowFarmerSaved(const char *id) {
+  lcdClear();
   lcdPrint(0, 0, "Farmer Saved!");
-  lcdPrint(0, 1, "ID: " + id);
+  LcdLine line;
+  line.appendf("ID: %s", id);
+  lcdPrint(0, 1, line);
 }
 
 void lcdShowReadingProgress(int current, int total) {
-  lcd.clear();
-  lcdPrint(0, 0, "Reading soil...");
-  lcdPrint(0, 1, "Sample " + String(current) + "/" + String(total));
+  lcdClear();
+  lcdPrint(0, 0, "Reading... #:Esc");
+  LcdLine line;
+  line.appendf("Sample %d/%d", current, total);
+  lcdPrint(0, 1, line);
 }
 
 void lcdShowSensorError() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "Sensor Error!");
   lcdPrint(0, 1, "Check wiring");
 }
 
 // Show soil reading results - pages through parameters
+// probe > 0 tags the second page with the probe number (multi-probe buses)
 void lcdShowResults(float humidity, float temperature, float ec, float ph,
                     float nitrogen, float phosphorus, float potassium,
-                    int page) {
-  lcd.clear();
+                    int page, int probe = 0) {
+  lcdClear();
+  LcdLine text;
   switch (page) {
   case 0:
-    lcdPrint(0, 0, "H:" + String(humidity, 1) + "%");
-    lcdPrint(9, 0, "T:" + String(temperature, 1) + "C");
-    lcdPrint(0, 1, "pH:" + String(ph, 1));
-    lcdPrint(9, 1, "EC:" + String((int)ec));
+    lcdPrint(0, 0, text.appendf("H:%.1f%%", humidity));
+    text.clear();
+    lcdPrint(9, 0, text.appendf("T:%.1fC", temperature));
+    text.clear();
+    lcdPrint(0, 1, text.appendf("pH:%.1f", ph));
+    text.clear();
+    lcdPrint(9, 1, text.appendf("EC:%d", (int)ec));
     break;
   case 1:
-    lcdPrint(0, 0, "N:" + String((int)nitrogen));
-    lcdPrint(8, 0, "P:" + String((int)phosphorus));
-    lcdPrint(0, 1, "K:" + String((int)potassium));
+    lcdPrint(0, 0, text.appendf("N:%d", (int)nitrogen));
+    text.clear();
+    lcdPrint(8, 0, text.appendf("P:%d", (int)phosphorus));
+    text.clear();
+    lcdPrint(0, 1, text.appendf("K:%d", (int)potassium));
+    if (probe > 0) {
+      text.clear();
+      lcdPrint(6, 1, text.appendf("S%d", probe));
+    }
     lcdPrint(8, 1, "*Sav #Re");
     break;
   }
 }
 
 void lcdShowSavePrompt() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "Save reading?");
   lcdPrint(0, 1, "*:Save  #:Retake");
 }
 
-void lcdShowDataSaved() {
-  lcd.clear();
+// status: the SMS outcome, or the key hint when there is none
+void lcdShowDataSaved(const char *status) {
+  lcdClear();
   lcdPrint(0, 0, "Data Saved!");
-  lcdPrint(0, 1, "Press any key...");
+  lcdPrint(0, 1, status);
 }
 
 void lcdShowSDError() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "SD Card Error!");
   lcdPrint(0, 1, "Check SD card");
 }
 
 void lcdShowMessage(const char *line1, const char *line2) {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, line1);
   lcdPrint(0, 1, line2);
 }
 
 void lcdShowGsmStatus(bool ready) {
-  lcd.clear();
+  lcdClear();
   if (ready) {
     lcdPrint(0, 0, "GSM: Connected");
     lcdPrint(0, 1, "SIM800L OK");
@@ -183,7 +280,7 @@ void lcdShowGsmStatus(bool ready) {
 }
 
 void lcdShowSyncMenu() {
-  lcd.clear();
+  lcdClear();
   lcdPrint(0, 0, "WiFi Sync Menu");
   lcdPrint(0, 1, "*:Sync  #:Back");
 }
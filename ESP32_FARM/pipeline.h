@@ -0,0 +1,202 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "config.h"
+#include "scheduler.h"
+#include "sensor_manager.h"
+#include <atomic>
+
+// ==========================================
+//  DUAL-CORE PIPELINE
+// ==========================================
+// The UI (keypad, LCD, soil sensor) runs on the Arduino loop task, core 1.
+// Storage (SD card, SMS outbox), network (WiFi, sync) and GSM each get a
+// worker task on core 0, so an SD write, an HTTP POST or a slow modem never
+// stall the keypad, and a sync that takes a minute over GPRS never holds up
+// a lookup or a save. Every piece of hardware is owned by exactly one task;
+// the tasks only talk through the queues below:
+//
+//   ui  -> io   uiToIo    lookups, new farmers, readings
+//   io  -> ui   ioToUi    replies, status snapshots
+//   ui  -> net  uiToNet   WiFi/sync requests
+//   net -> ui   netToUi   their outcomes, server time for the RTC
+//   io  -> gsm  ioToGsm   next outbox SMS to send
+//   gsm -> io   gsmToIo   its delivery result
+//
+// Each queue has one producer and one consumer, which is what makes it
+// safe without locks. Two things are shared: the SD card, which the net
+// worker reads for an upload under the card lock (SdGuard in
+// sd_manager.h), and the modem, which the GSM worker lends to the net
+// worker for a GPRS sync (gsmLease in gsm_manager.h). With
+// PIPELINE_DUAL_CORE 0 all four schedulers run from loop() and the same
+// queues connect them.
+
+enum PipeMsgType : uint8_t {
+  MSG_NONE,
+
+  // ui -> io
+  MSG_LOOKUP_FARMER, // farmerId
+  MSG_ADD_FARMER,    // farmerId, phone, timestamp
+  MSG_SAVE_READING,  // farmerId, phone, timestamp, epoch, reading;
+                     // PIPE_FIRST/LAST
+
+  // io -> ui
+  MSG_FARMER_INFO,   // PIPE_OK, PIPE_FOUND + phone, history if registered
+  MSG_FARMER_ADDED,  // PIPE_OK
+  MSG_READING_SAVED, // PIPE_OK, PIPE_SMS_QUEUED / PIPE_SMS_FAILED
+  MSG_STATUS,        // status
+
+  // ui -> net
+  MSG_WIFI_CONNECT,
+  MSG_SYNC_START,
+
+  // net -> ui
+  MSG_WIFI_STATUS, // value = WifiState once connected or failed; PIPE_GPRS
+  MSG_SYNC_RESULT, // PIPE_OK
+  MSG_SYNC_STATE,  // value = 1 while a sync job runs
+  MSG_SET_TIME,    // time (the RTC shares I2C with the LCD)
+
+  // io -> gsm
+  MSG_SEND_SMS, // ref, phone, text
+
+  // gsm -> io
+  MSG_SMS_RESULT // ref, PIPE_OK if the network accepted it
+};
+
+// Message flags
+#define PIPE_FIRST 0x01      // first reading of a save
+#define PIPE_LAST 0x02       // last reading of a save; the reply follows it
+#define PIPE_OK 0x04         // request carried out
+#define PIPE_SMS_QUEUED 0x08 // report SMS stored in the outbox
+#define PIPE_SMS_FAILED 0x10 // SMS enabled but could not be queued
+#define PIPE_FOUND 0x20      // looked-up farmer is registered
+#define PIPE_GPRS 0x40       // no WiFi, but sync can go over GPRS
+
+// A farmer's two newest visits on record (MSG_FARMER_INFO)
+struct PipeHistory {
+  uint8_t count; // visits filled in below: 0-2
+  uint32_t lastEpoch;
+  uint32_t previousEpoch;
+  SoilData last;
+  SoilData previous;
+};
+
+// Fixed-size message; copied by value through the queues
+struct PipeMsg {
+  uint8_t type;
+  uint8_t flags;
+  int32_t ref; // outbox record (MSG_SEND_SMS, MSG_SMS_RESULT)
+  char farmerId[FARMER_ID_LENGTH + 1];
+  char phone[PIPE_PHONE_MAX];
+  char timestamp[20]; // "YYYY-MM-DD HH:MM:SS"
+  uint32_t epoch;     // the same time (MSG_SAVE_READING; the RTC is the UI's)
+  union {
+    SoilData reading;         // MSG_SAVE_READING
+    PipeHistory history;      // MSG_FARMER_INFO
+    char text[PIPE_TEXT_MAX]; // MSG_SEND_SMS
+    struct {
+      uint16_t farmers;
+      uint16_t nextId;
+      uint32_t logs;
+      uint16_t smsPending; // outbox
+      uint16_t smsFailed;
+    } status; // MSG_STATUS
+    struct {
+      uint16_t year;
+      uint8_t month, day, hour, minute, second;
+    } time; // MSG_SET_TIME
+    int32_t value;
+  };
+};
+
+// Bounded single-producer/single-consumer ring. head and tail only ever
+// grow; the producer owns tail, the consumer owns head.
+struct PipeQueue {
+  PipeMsg slots[PIPE_QUEUE_LEN];
+  std::atomic<uint32_t> head{0}; // next message to pop
+  std::atomic<uint32_t> tail{0}; // next free slot
+  uint32_t dropped = 0;          // pushes refused while full (producer side)
+};
+
+PipeQueue uiToIo;
+PipeQueue ioToUi;
+PipeQueue uiToNet;
+PipeQueue netToUi;
+PipeQueue ioToGsm;
+PipeQueue gsmToIo;
+
+// Producer side: returns false (and drops the message) if the queue is full
+bool pipePush(PipeQueue &q, const PipeMsg &msg) {
+  uint32_t tail = q.tail.load(std::memory_order_relaxed);
+  if (tail - q.head.load(std::memory_order_acquire) >= PIPE_QUEUE_LEN) {
+    q.dropped++;
+    return false;
+  }
+  q.slots[tail % PIPE_QUEUE_LEN] = msg;
+  q.tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+// Consumer side: returns false if the queue is empty
+bool pipePop(PipeQueue &q, PipeMsg &msg) {
+  uint32_t head = q.head.load(std::memory_order_relaxed);
+  if (head == q.tail.load(std::memory_order_acquire))
+    return false;
+  msg = q.slots[head % PIPE_QUEUE_LEN];
+  q.head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+// Messages waiting (either side; a snapshot)
+uint32_t pipePending(const PipeQueue &q) {
+  return q.tail.load(std::memory_order_acquire) -
+         q.head.load(std::memory_order_acquire);
+}
+
+// Free slots (producer side; the consumer can only make it larger)
+uint32_t pipeSpace(const PipeQueue &q) {
+  return PIPE_QUEUE_LEN - pipePending(q);
+}
+
+// A zeroed message of the given type
+PipeMsg pipeMsg(uint8_t type, uint8_t flags = 0) {
+  PipeMsg msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.type = type;
+  msg.flags = flags;
+  return msg;
+}
+
+// Copy a C string into a fixed message field (truncates)
+void pipeCopy(char *dst, size_t size, const char *src) {
+  snprintf(dst, size, "%s", src);
+}
+
+// ==========================================
+//  WORKER TASKS
+// ==========================================
+
+#if PIPELINE_DUAL_CORE
+// FreeRTOS task body: run one scheduler forever, yielding a tick per pass
+void pipeWorker(void *arg) {
+  Scheduler *sched = (Scheduler *)arg;
+  for (;;) {
+    schedulerRun(*sched);
+    vTaskDelay(1);
+  }
+}
+
+// Start a worker task running the given scheduler on PIPE_IO_CORE
+bool pipeStartWorker(const char *name, Scheduler &sched, uint32_t stack,
+                     TaskHandle_t *handle = nullptr) {
+  BaseType_t ok = xTaskCreatePinnedToCore(pipeWorker, name, stack, &sched, 1,
+                                          handle, PIPE_IO_CORE);
+  if (ok != pdPASS) {
+    logLine("Pipeline: Could not start worker %s", name);
+    return false;
+  }
+  return true;
+}
+#endif
+
+#endif // PIPELINE_H
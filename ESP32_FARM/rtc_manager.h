@@ -2,6 +2,7 @@
 #define RTC_MANAGER_H
 
 #include "config.h"
+#include "fixed_string.h"
 #include <RTClib.h>
 #include <Wire.h>
 
@@ -27,37 +28,68 @@ void rtcInit() {
 
   // Print current time
   DateTime now = rtc.now();
-  char buf[25];
-  snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d", now.year(),
-           now.month(), now.day(), now.hour(), now.minute(), now.second());
-  Serial.println("RTC: Current time: " + String(buf));
+  logLine("RTC: Current time: %04d-%02d-%02d %02d:%02d:%02d", now.year(),
+          now.month(), now.day(), now.hour(), now.minute(), now.second());
 }
 
 // Check if the RTC module is available and working
 bool rtcIsValid() { return rtcAvailable; }
 
-// Get a formatted timestamp string from the RTC
-// Format: "YYYY-MM-DD HH:MM:SS"
-// Falls back to millis()-based counter if RTC is not available
-String getTimestamp() {
+// Epochs below this (2000-01-01) are uptime seconds from the millis()
+// fallback rather than real dates
+#define RTC_EPOCH_MIN 946684800UL
+
+// Get the current time as Unix epoch seconds
+// Falls back to seconds since boot if RTC is not available
+uint32_t getEpoch() {
   if (rtcAvailable) {
-    DateTime now = rtc.now();
-    char buf[25];
-    snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d", now.year(),
-             now.month(), now.day(), now.hour(), now.minute(), now.second());
-    return String(buf);
+    return rtc.now().unixtime();
+  }
+  return millis() / 1000;
+}
+
+// Format an epoch into buf (at least 20 bytes)
+// Format: "YYYY-MM-DD HH:MM:SS", or "T+HH:MM:SS" for uptime-based epochs
+void formatEpoch(uint32_t epoch, char *buf, size_t len) {
+  if (epoch >= RTC_EPOCH_MIN) {
+    DateTime t(epoch);
+    snprintf(buf, len, "%04d-%02d-%02d %02d:%02d:%02d", t.year(), t.month(),
+             t.day(), t.hour(), t.minute(), t.second());
+    return;
   }
 
   // Fallback: millis()-based counter (no real date/time)
-  unsigned long sec = millis() / 1000;
+  unsigned long sec = epoch;
   unsigned long mn = sec / 60;
   unsigned long hr = mn / 60;
+  snprintf(buf, len, "T+%02lu:%02lu:%02lu", hr, mn % 60, sec % 60);
+}
 
-  char buf[20];
-  snprintf(buf, sizeof(buf), "T+%02lu:%02lu:%02lu", hr, mn % 60, sec % 60);
-  return String(buf);
+// Format an epoch's date as "DD/MM" (6 bytes); "--/--" for uptime epochs,
+// whose date is unknown
+void formatEpochDay(uint32_t epoch, char *buf, size_t len) {
+  if (epoch < RTC_EPOCH_MIN) {
+    snprintf(buf, len, "--/--");
+    return;
+  }
+  DateTime t(epoch);
+  snprintf(buf, len, "%02d/%02d", t.day(), t.month());
+}
+
+typedef FixedString<25> Timestamp;
+
+// An epoch as a timestamp string (see formatEpoch())
+Timestamp epochTimestamp(uint32_t epoch) {
+  char buf[25];
+  formatEpoch(epoch, buf, sizeof(buf));
+  return Timestamp(buf);
 }
 
+// Get a formatted timestamp string from the RTC
+// Format: "YYYY-MM-DD HH:MM:SS"
+// Falls back to millis()-based counter if RTC is not available
+Timestamp getTimestamp() { return epochTimestamp(getEpoch()); }
+
 // Manually set the RTC time
 void rtcSetTime(int year, int month, int day, int hour, int minute,
                 int second) {
@@ -0,0 +1,98 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "config.h"
+#include "fixed_string.h"
+
+// ==========================================
+//  COOPERATIVE SCHEDULER
+// ==========================================
+// Each subsystem registers a step function that does a little work and
+// returns (never waits). A Scheduler is one task table; running it calls
+// every task whose interval has elapsed. Waiting is expressed with
+// SchedTimer and per-subsystem state machines instead of delay(), so the
+// keypad, sensor, GSM and sync all make progress side by side. Each core
+// runs its own table (see pipeline.h).
+
+struct SchedTask {
+  const char *name;
+  void (*step)();
+  unsigned long intervalMs; // 0 = every pass
+  unsigned long lastRun;
+  bool enabled;
+  unsigned long maxStepUs; // longest single step seen (for tuning)
+};
+
+struct Scheduler {
+  SchedTask tasks[SCHED_MAX_TASKS];
+  int count = 0;
+};
+
+// Register a task; returns its id, or -1 if the table is full
+int schedulerAdd(Scheduler &s, const char *name, void (*step)(),
+                 unsigned long intervalMs) {
+  if (s.count >= SCHED_MAX_TASKS) {
+    logLine("Scheduler: No room for task %s", name);
+    return -1;
+  }
+
+  SchedTask &t = s.tasks[s.count];
+  t.name = name;
+  t.step = step;
+  t.intervalMs = intervalMs;
+  t.lastRun = millis();
+  t.enabled = true;
+  t.maxStepUs = 0;
+  return s.count++;
+}
+
+void schedulerEnable(Scheduler &s, int id, bool enabled) {
+  if (id >= 0 && id < s.count)
+    s.tasks[id].enabled = enabled;
+}
+
+// Run every due task once, in registration order
+void schedulerRun(Scheduler &s) {
+  for (int i = 0; i < s.count; i++) {
+    SchedTask &t = s.tasks[i];
+    if (!t.enabled)
+      continue;
+
+    unsigned long now = millis();
+    if (t.intervalMs > 0 && now - t.lastRun < t.intervalMs)
+      continue;
+    t.lastRun = now;
+
+    unsigned long started = micros();
+    t.step();
+    unsigned long took = micros() - started;
+    if (took > t.maxStepUs)
+      t.maxStepUs = took;
+  }
+}
+
+// ==========================================
+//  TIMERS
+// ==========================================
+// One-shot timers for splash screens and timeouts inside state machines
+
+struct SchedTimer {
+  unsigned long start = 0;
+  unsigned long duration = 0;
+  bool running = false;
+};
+
+void timerStart(SchedTimer &t, unsigned long ms) {
+  t.start = millis();
+  t.duration = ms;
+  t.running = true;
+}
+
+void timerStop(SchedTimer &t) { t.running = false; }
+
+// True once a running timer has run its duration
+bool timerExpired(const SchedTimer &t) {
+  return t.running && millis() - t.start >= t.duration;
+}
+
+#endif // SCHEDULER_H
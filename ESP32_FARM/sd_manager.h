@@ -2,149 +2,1392 @@
 #define SD_MANAGER_H
 
 #include "config.h"
+#include "fixed_string.h"
+#include "rtc_manager.h"
 #include "sensor_manager.h"
 #include <SD.h>
 #include <SPI.h>
 
 bool sdInitialized = false;
 
-bool sdInit() {
-  if (!SD.begin(SD_CS_PIN)) {
-    Serial.println("SD Card: Mount failed!");
-    sdInitialized = false;
-    return false;
-  }
-  Serial.println("SD Card: Mounted successfully");
-  sdInitialized = true;
+// ==========================================
+//  CARD LOCK
+// ==========================================
+// The io worker owns the card, but the net worker reads the log and farmer
+// files for an upload and moves the sync offsets. Each side holds the lock
+// for one step of card work, never across a network request, so a save
+// waits at most for one block of an upload. With PIPELINE_DUAL_CORE 0
+// every task runs from loop() and the lock compiles away.
 
-  // Create files with headers if they don't exist
-  if (!SD.exists(FARMERS_FILE)) {
-    File f = SD.open(FARMERS_FILE, FILE_WRITE);
-    if (f) {
-      f.println("farmer_id,phone_number,created_at");
-      f.close();
-      Serial.println("Created " + String(FARMERS_FILE));
-    }
+#if PIPELINE_DUAL_CORE
+SemaphoreHandle_t sdMutex = nullptr; // created by sdInit()
+
+void sdLock() {
+  if (sdMutex)
+    xSemaphoreTakeRecursive(sdMutex, portMAX_DELAY);
+}
+
+void sdUnlock() {
+  if (sdMutex)
+    xSemaphoreGiveRecursive(sdMutex);
+}
+#else
+void sdLock() {}
+void sdUnlock() {}
+#endif
+
+// Holds the card lock until the end of the scope
+struct SdGuard {
+  SdGuard() { sdLock(); }
+  ~SdGuard() { sdUnlock(); }
+  SdGuard(const SdGuard &) = delete;
+  SdGuard &operator=(const SdGuard &) = delete;
+};
+
+// ==========================================
+//  FILE HELPERS
+// ==========================================
+
+const char *FARMERS_CSV_HEADER = "farmer_id,phone_number,created_at";
+const char *DATALOG_CSV_HEADER = "farmer_id,timestamp,humidity,temperature,ec,"
+                                 "ph,nitrogen,phosphorus,potassium,probe,"
+                                 "samples,humidity_sd,temperature_sd,ec_sd,"
+                                 "ph_sd,nitrogen_sd,phosphorus_sd,potassium_sd";
+
+// The single datalog file of older firmware, moved into the first segment
+#if DATALOG_BINARY
+#define DATALOG_LEGACY_FILE DATALOG_BIN_FILE
+#define LOG_SEGMENT_EXT "bin"
+#else
+#define DATALOG_LEGACY_FILE DATALOG_FILE
+#define LOG_SEGMENT_EXT "csv"
+#endif
+
+// CRC-32 (IEEE 802.3, reflected), bitwise to avoid a 1 KB table
+uint32_t sdCrc32(const uint8_t *data, size_t len, uint32_t crc = 0) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (int b = 0; b < 8; b++)
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
   }
+  return ~crc;
+}
 
-  if (!SD.exists(DATALOG_FILE)) {
-    File f = SD.open(DATALOG_FILE, FILE_WRITE);
-    if (f) {
-      f.println("farmer_id,timestamp,humidity,temperature,ec,ph,nitrogen,"
-                "phosphorus,potassium");
-      f.close();
-      Serial.println("Created " + String(DATALOG_FILE));
+uint32_t sdFileSize(const char *path) {
+  File f = SD.open(path, FILE_READ);
+  if (!f)
+    return 0;
+  uint32_t size = f.size();
+  f.close();
+  return size;
+}
+
+// Walk a CSV file line by line, reading SD_SCAN_BLOCK bytes at a time into a
+// stack buffer (no heap Strings). The header line is skipped, trailing
+// whitespace is trimmed and empty lines are ignored. Lines longer than
+// SD_LINE_MAX are truncated.
+bool sdScanLines(const char *path, void (*onLine)(char *line)) {
+  File f = SD.open(path, FILE_READ);
+  if (!f)
+    return false;
+
+  uint8_t block[SD_SCAN_BLOCK];
+  char line[SD_LINE_MAX];
+  int lineLen = 0;
+  bool header = true;
+
+  while (true) {
+    int n = f.read(block, sizeof(block));
+    bool eof = (n <= 0);
+
+    for (int i = 0; i <= n; i++) {
+      bool endOfLine = (i == n) ? (eof && lineLen > 0) : (block[i] == '\n');
+      if (!endOfLine) {
+        if (i < n && lineLen < SD_LINE_MAX - 1)
+          line[lineLen++] = (char)block[i];
+        continue;
+      }
+
+      while (lineLen > 0 && (line[lineLen - 1] == '\r' ||
+                             line[lineLen - 1] == ' ' ||
+                             line[lineLen - 1] == '\t'))
+        lineLen--;
+      line[lineLen] = '\0';
+
+      if (header)
+        header = false;
+      else if (lineLen > 0)
+        onLine(line);
+      lineLen = 0;
     }
+
+    if (eof)
+      break;
   }
 
+  f.close();
   return true;
 }
 
 // ==========================================
-//  FARMER OPERATIONS
+//  FARMER INDEX (RAM)
 // ==========================================
+// Sorted table of registered farmers, built once from farmers.csv in sdInit()
+// so that lookups never touch the SD card. Phone numbers are BCD-packed into
+// fixed-width slots (0xA = '+', 0xF = end) to keep each entry at 10 bytes.
 
-// Check if a farmer ID exists in farmers.csv
-bool farmerExists(String farmerId) {
-  if (!sdInitialized)
+struct FarmerIndexEntry {
+  uint16_t id;
+  uint8_t phone[FARMER_PHONE_BYTES];
+};
+
+FarmerIndexEntry *farmerIndex = nullptr;
+int farmerIndexCount = 0;
+int farmerIndexCapacity = 0;
+int farmerIndexMaxID = 0;
+int farmerIndexRows = 0; // farmers.csv rows at the last build, duplicates too
+
+// Pack a phone number into a fixed-width BCD slot
+void farmerPackPhone(const char *phone, uint8_t *slot) {
+  memset(slot, 0xFF, FARMER_PHONE_BYTES);
+  int nibble = 0;
+  for (const char *p = phone; *p && nibble < FARMER_PHONE_BYTES * 2; p++) {
+    uint8_t v;
+    if (*p >= '0' && *p <= '9')
+      v = *p - '0';
+    else if (*p == '+')
+      v = 0x0A;
+    else
+      continue;
+
+    uint8_t &b = slot[nibble / 2];
+    b = (nibble % 2 == 0) ? (uint8_t)((v << 4) | 0x0F)
+                          : (uint8_t)((b & 0xF0) | v);
+    nibble++;
+  }
+}
+
+// Unpack a BCD phone slot into out (FARMER_PHONE_BYTES * 2 + 1 bytes)
+void farmerUnpackPhone(const uint8_t *slot, char *out) {
+  int len = 0;
+  for (int nibble = 0; nibble < FARMER_PHONE_BYTES * 2; nibble++) {
+    uint8_t b = slot[nibble / 2];
+    uint8_t v = (nibble % 2 == 0) ? (b >> 4) : (b & 0x0F);
+    if (v == 0x0F)
+      break;
+    out[len++] = (v == 0x0A) ? '+' : (char)('0' + v);
+  }
+  out[len] = '\0';
+}
+
+// Position of the first entry with id >= the given id (binary search)
+int farmerIndexLowerBound(uint16_t id) {
+  int lo = 0, hi = farmerIndexCount;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (farmerIndex[mid].id < id)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Find a farmer entry by numeric ID, or nullptr if not registered
+FarmerIndexEntry *farmerIndexFind(uint16_t id) {
+  int pos = farmerIndexLowerBound(id);
+  if (pos < farmerIndexCount && farmerIndex[pos].id == id)
+    return &farmerIndex[pos];
+  return nullptr;
+}
+
+bool farmerIndexReserve(int capacity) {
+  if (capacity <= farmerIndexCapacity)
+    return true;
+  FarmerIndexEntry *grown = (FarmerIndexEntry *)realloc(
+      farmerIndex, capacity * sizeof(FarmerIndexEntry));
+  if (!grown) {
+    Serial.println("SD: Out of memory for farmer index");
+    return false;
+  }
+  farmerIndex = grown;
+  farmerIndexCapacity = capacity;
+  return true;
+}
+
+// Append an entry without keeping the table sorted (used while building)
+bool farmerIndexAppend(uint16_t id, const char *phone) {
+  if (farmerIndexCount == farmerIndexCapacity &&
+      !farmerIndexReserve(farmerIndexCapacity + FARMER_INDEX_GROW))
+    return false;
+  FarmerIndexEntry &e = farmerIndex[farmerIndexCount++];
+  e.id = id;
+  farmerPackPhone(phone, e.phone);
+  if (id > farmerIndexMaxID)
+    farmerIndexMaxID = id;
+  return true;
+}
+
+// Insert (or update) an entry in place, keeping the table sorted
+bool farmerIndexInsert(uint16_t id, const char *phone) {
+  int pos = farmerIndexLowerBound(id);
+  if (pos < farmerIndexCount && farmerIndex[pos].id == id) {
+    farmerPackPhone(phone, farmerIndex[pos].phone);
+    return true;
+  }
+
+  if (farmerIndexCount == farmerIndexCapacity &&
+      !farmerIndexReserve(farmerIndexCapacity + FARMER_INDEX_GROW))
     return false;
 
+  memmove(&farmerIndex[pos + 1], &farmerIndex[pos],
+          (farmerIndexCount - pos) * sizeof(FarmerIndexEntry));
+  farmerIndex[pos].id = id;
+  farmerPackPhone(phone, farmerIndex[pos].phone);
+  farmerIndexCount++;
+  if (id > farmerIndexMaxID)
+    farmerIndexMaxID = id;
+  return true;
+}
+
+void farmerIndexClear() {
+  free(farmerIndex);
+  farmerIndex = nullptr;
+  farmerIndexCount = 0;
+  farmerIndexCapacity = 0;
+  farmerIndexMaxID = 0;
+  farmerIndexRows = 0;
+}
+
+// Parse one farmers.csv line ("id,phone,created_at") into the index
+void farmerIndexAddLine(char *line) {
+  char *comma1 = strchr(line, ',');
+  if (!comma1 || comma1 == line)
+    return;
+  *comma1 = '\0';
+
+  char *end;
+  long id = strtol(line, &end, 10);
+  if (*end != '\0' || id <= 0 || id > 0xFFFF)
+    return;
+
+  char *phone = comma1 + 1;
+  char *comma2 = strchr(phone, ',');
+  if (comma2)
+    *comma2 = '\0';
+
+  farmerIndexAppend((uint16_t)id, phone);
+}
+
+int compareFarmerIndexEntries(const void *a, const void *b) {
+  return (int)((const FarmerIndexEntry *)a)->id -
+         (int)((const FarmerIndexEntry *)b)->id;
+}
+
+// Build the index from farmers.csv (one sequential pass, then one sort)
+bool farmerIndexBuild() {
+  farmerIndexClear();
+
   File f = SD.open(FARMERS_FILE, FILE_READ);
-  if (!f)
+  if (f) {
+    // ~36 bytes per line ("0001,08012345678,2026-01-01 00:00:00")
+    farmerIndexReserve(f.size() / 32 + FARMER_INDEX_GROW);
+    f.close();
+  }
+
+  if (!sdScanLines(FARMERS_FILE, farmerIndexAddLine))
     return false;
 
-  // Skip header line
-  f.readStringUntil('\n');
+  farmerIndexRows = farmerIndexCount;
+  qsort(farmerIndex, farmerIndexCount, sizeof(FarmerIndexEntry),
+        compareFarmerIndexEntries);
+
+  // Collapse duplicate IDs (hand-edited files) to a single entry
+  int unique = 0;
+  for (int i = 0; i < farmerIndexCount; i++) {
+    if (unique == 0 || farmerIndex[unique - 1].id != farmerIndex[i].id)
+      farmerIndex[unique++] = farmerIndex[i];
+  }
+  farmerIndexCount = unique;
+
+  logLine("SD: Farmer index built (%d farmers, max ID %d)", farmerIndexCount,
+          (int)farmerIndexMaxID);
+  return true;
+}
+
+// ==========================================
+//  BINARY DATALOG
+// ==========================================
+// Fixed-width alternative to datalog.csv (DATALOG_BINARY). Each reading is one
+// 44-byte record appended with a single write(), so record N lives at byte
+// N * sizeof(LogRecord). Values are scaled to the precision the CSV keeps
+// (x10 for humidity, temperature and pH). CSV is rendered only when a
+// consumer such as the sync upload asks for it.
+
+struct LogRecord {
+  uint32_t epoch;      // Unix seconds (uptime seconds without RTC)
+  uint16_t farmerId;
+  int16_t temperature; // 0.1 C
+  uint16_t humidity;   // 0.1 %RH
+  uint16_t ec;         // uS/cm
+  uint16_t ph;         // 0.1 pH
+  uint16_t nitrogen;   // mg/kg
+  uint16_t phosphorus; // mg/kg
+  uint16_t potassium;  // mg/kg
+  uint8_t probe;       // Modbus address of the probe
+  uint8_t samples;     // valid samples behind the values
+  uint16_t stddev[7];  // sample spread at 10x the value's scale
+  uint8_t pad[2];      // zero; keeps crc 4-byte aligned
+  uint32_t crc;        // CRC-32 of the fields above
+};
+static_assert(sizeof(LogRecord) == 44, "LogRecord must stay 44 bytes");
+
+// Scale of each value in LogRecord, in SoilData register order
+const float LOG_VALUE_SCALE[7] = {10, 10, 1, 10, 1, 1, 1};
+
+uint16_t logScaleU16(float v, float scale) {
+  long x = lroundf(v * scale);
+  return (uint16_t)(x < 0 ? 0 : (x > 0xFFFF ? 0xFFFF : x));
+}
+
+void packLogRecord(uint16_t farmerId, uint32_t epoch, const SoilData &data,
+                   LogRecord &rec) {
+  long t = lroundf(data.temperature * 10);
+  rec.epoch = epoch;
+  rec.farmerId = farmerId;
+  rec.temperature = (int16_t)(t < -32768 ? -32768 : (t > 32767 ? 32767 : t));
+  rec.humidity = logScaleU16(data.humidity, 10);
+  rec.ec = logScaleU16(data.ec, 1);
+  rec.ph = logScaleU16(data.ph, 10);
+  rec.nitrogen = logScaleU16(data.nitrogen, 1);
+  rec.phosphorus = logScaleU16(data.phosphorus, 1);
+  rec.potassium = logScaleU16(data.potassium, 1);
+  rec.probe = data.probe;
+  rec.samples = data.samples;
+  for (int i = 0; i < 7; i++) {
+    rec.stddev[i] = logScaleU16(data.stddev[i], LOG_VALUE_SCALE[i] * 10);
+  }
+  memset(rec.pad, 0, sizeof(rec.pad));
+  rec.crc = sdCrc32((const uint8_t *)&rec, offsetof(LogRecord, crc));
+}
+
+// The values of a record back in SoilData units
+void unpackLogRecord(const LogRecord &rec, SoilData &data) {
+  memset(&data, 0, sizeof(data));
+  data.humidity = rec.humidity / 10.0f;
+  data.temperature = rec.temperature / 10.0f;
+  data.ec = rec.ec;
+  data.ph = rec.ph / 10.0f;
+  data.nitrogen = rec.nitrogen;
+  data.phosphorus = rec.phosphorus;
+  data.potassium = rec.potassium;
+  data.valid = true;
+  data.probe = rec.probe;
+  data.samples = rec.samples;
+  for (int i = 0; i < 7; i++) {
+    data.stddev[i] = rec.stddev[i] / (LOG_VALUE_SCALE[i] * 10);
+  }
+}
+
+bool logRecordValid(const LogRecord &rec) {
+  return rec.crc == sdCrc32((const uint8_t *)&rec, offsetof(LogRecord, crc));
+}
+
+// Render a record as one datalog.csv line (with CRLF); returns its length
+size_t formatLogRecordCsv(const LogRecord &rec, char *buf, size_t len) {
+  char ts[20];
+  formatEpoch(rec.epoch, ts, sizeof(ts));
+
+  int t = rec.temperature;
+  int n = snprintf(buf, len, "%04u,%s,%u.%u,%s%d.%d,%u,%u.%u,%u,%u,%u,%u,%u",
+                   rec.farmerId, ts, rec.humidity / 10, rec.humidity % 10,
+                   t < 0 ? "-" : "", abs(t) / 10, abs(t) % 10, rec.ec,
+                   rec.ph / 10, rec.ph % 10, rec.nitrogen, rec.phosphorus,
+                   rec.potassium, rec.probe, rec.samples);
 
-  while (f.available()) {
-    String line = f.readStringUntil('\n');
-    line.trim();
-    if (line.length() == 0)
+  // Spread: two decimals for the x10 values, one for the rest
+  for (int i = 0; i < 7 && n > 0 && (size_t)n < len; i++) {
+    uint16_t sd = rec.stddev[i];
+    n += (LOG_VALUE_SCALE[i] > 1)
+             ? snprintf(buf + n, len - n, ",%u.%02u", sd / 100, sd % 100)
+             : snprintf(buf + n, len - n, ",%u.%u", sd / 10, sd % 10);
+  }
+  if (n > 0 && (size_t)n < len)
+    n += snprintf(buf + n, len - n, "\r\n");
+  return (n < 0) ? 0 : ((size_t)n < len ? n : len - 1);
+}
+
+// Pad a torn final record (power loss mid-write) up to the record size so
+// later appends stay aligned; the padded record fails its CRC and is skipped
+void datalogRepairTail(const char *path) {
+  uint32_t size = sdFileSize(path);
+  uint32_t partial = size % sizeof(LogRecord);
+  if (partial == 0)
+    return;
+
+  File f = SD.open(path, FILE_APPEND);
+  if (!f)
+    return;
+  uint8_t pad[sizeof(LogRecord)];
+  memset(pad, 0xFF, sizeof(pad));
+  f.write(pad, sizeof(LogRecord) - partial);
+  f.close();
+  Serial.println("SD: Repaired torn datalog record");
+}
+
+// Order-independent checksum of the registry: the 32-bit sum of
+// CRC-32("id,phone") over all farmers. The server computes the same sum with
+// SUM(CRC32(CONCAT(farmer_id, ',', phone_number))) to detect divergence.
+uint32_t farmerRegistryChecksum() {
+  uint32_t sum = 0;
+  char entry[FARMER_ID_LENGTH + FARMER_PHONE_BYTES * 2 + 3];
+  char phone[FARMER_PHONE_BYTES * 2 + 1];
+  for (int i = 0; i < farmerIndexCount; i++) {
+    farmerUnpackPhone(farmerIndex[i].phone, phone);
+    int n = snprintf(entry, sizeof(entry), "%04u,%s", farmerIndex[i].id, phone);
+    sum += sdCrc32((const uint8_t *)entry, n);
+  }
+  return sum;
+}
+
+// ==========================================
+//  COUNTERS (superblock)
+// ==========================================
+// Running record counts and byte sizes for farmers.csv and the active log
+// segment (see below), so menu redraws never scan the CSVs. The record is
+// written to one of two alternating slots in COUNTERS_FILE, each with a
+// sequence number and CRC; a torn write leaves the other slot intact. At
+// boot the recorded sizes are checked against the real files and the
+// counters are rebuilt on mismatch.
+
+#define COUNTERS_MAGIC 0x46524D43 // "FRMC"
+
+struct SdCounters {
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t farmerCount; // farmers.csv rows, a repeated ID counted each time
+  uint32_t farmerBytes;
+  uint32_t logCount;
+  uint32_t logBytes;
+  uint32_t syncOffset;       // older firmware's datalog sync position
+  uint32_t farmerSyncOffset; // farmers.csv byte offset acknowledged by server
+  uint32_t crc;
+};
+
+SdCounters sdCounters;
+
+uint32_t sdCountersCrc(const SdCounters &c) {
+  return sdCrc32((const uint8_t *)&c, offsetof(SdCounters, crc));
+}
+
+// Load the newest valid slot; returns false if neither slot is valid
+bool sdCountersLoad() {
+  File f = SD.open(COUNTERS_FILE, FILE_READ);
+  if (!f)
+    return false;
+
+  bool found = false;
+  for (int slot = 0; slot < 2; slot++) {
+    SdCounters c;
+    if (f.read((uint8_t *)&c, sizeof(c)) != sizeof(c))
+      break;
+    if (c.magic != COUNTERS_MAGIC || c.crc != sdCountersCrc(c))
       continue;
+    if (!found || c.seq > sdCounters.seq) {
+      sdCounters = c;
+      found = true;
+    }
+  }
+  f.close();
+  return found;
+}
 
-    // Extract farmer_id (first field before comma)
-    int commaIdx = line.indexOf(',');
-    if (commaIdx > 0) {
-      String id = line.substring(0, commaIdx);
-      if (id == farmerId) {
-        f.close();
-        return true;
-      }
+// Persist the counters into the slot not holding the current record
+bool sdCountersSave() {
+  sdCounters.magic = COUNTERS_MAGIC;
+  sdCounters.seq++;
+  sdCounters.crc = sdCountersCrc(sdCounters);
+
+  if (!SD.exists(COUNTERS_FILE)) {
+    File f = SD.open(COUNTERS_FILE, FILE_WRITE);
+    if (!f)
+      return false;
+    SdCounters empty;
+    memset(&empty, 0, sizeof(empty));
+    f.write((const uint8_t *)&empty, sizeof(empty));
+    f.write((const uint8_t *)&empty, sizeof(empty));
+    f.close();
+  }
+
+  // "r+" updates in place without truncating the other slot
+  File f = SD.open(COUNTERS_FILE, "r+");
+  if (!f) {
+    Serial.println("SD: Could not open counters file");
+    return false;
+  }
+  f.seek((sdCounters.seq % 2) * sizeof(SdCounters));
+  size_t written = f.write((const uint8_t *)&sdCounters, sizeof(sdCounters));
+  f.close();
+  return written == sizeof(sdCounters);
+}
+
+// ==========================================
+//  SEGMENTED DATALOG
+// ==========================================
+// Readings are kept in numbered segment files in LOG_DIR
+// (/log/00000001.csv, ...). Only the newest, the active segment, is appended
+// to. Once a journal checkpoint takes it past LOG_SEGMENT_BYTES (by at most
+// one journal's worth) it is sealed and the next one is started, so appends,
+// recounts and sync reads each touch one file of bounded size however long
+// the device goes between syncs. CSV segments
+// start with the header line.
+//
+// LOG_MANIFEST_FILE says what is on the card: the oldest and the active
+// segment, how far the server has acknowledged the oldest one, and the
+// records and bytes of every sealed segment. Like the counters it is kept
+// in two alternating slots with a sequence number and CRC. The counters
+// describe the active segment only.
+//
+// A sync uploads the oldest segment first; a sealed segment is deleted as
+// soon as its last byte is acknowledged. Before a seal the oldest segments
+// are evicted, synced or not, while the log holds LOG_SEGMENTS_MAX segments,
+// would grow past LOG_RETAIN_BYTES (if set), or the card has less than
+// LOG_MIN_FREE_BYTES free.
+
+#define LOG_MANIFEST_MAGIC 0x46524D4C // "FRML"
+
+struct LogManifest {
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t first;      // oldest segment on the card
+  uint32_t active;     // segment being appended; first..active all exist
+  uint32_t syncOffset; // first byte of segment `first` not acknowledged
+  uint32_t evicted;    // records dropped unsynced to make room
+  uint32_t records[LOG_SEGMENTS_MAX]; // sealed segments, slot id % max
+  uint32_t bytes[LOG_SEGMENTS_MAX];
+  uint32_t crc;
+};
+
+LogManifest logManifest;
+
+typedef FixedString<24> LogPath;
+LogPath logActivePath; // file of logManifest.active
+
+LogPath logSegmentPath(uint32_t id) {
+  LogPath path;
+  path.appendf(LOG_DIR "/%08lu." LOG_SEGMENT_EXT, (unsigned long)id);
+  return path;
+}
+
+uint32_t logManifestCrc(const LogManifest &m) {
+  return sdCrc32((const uint8_t *)&m, offsetof(LogManifest, crc));
+}
+
+// Load the newest valid slot; returns false if neither slot is valid
+bool logManifestLoad() {
+  File f = SD.open(LOG_MANIFEST_FILE, FILE_READ);
+  if (!f)
+    return false;
+
+  bool found = false;
+  for (int slot = 0; slot < 2; slot++) {
+    LogManifest m;
+    if (f.read((uint8_t *)&m, sizeof(m)) != sizeof(m))
+      break;
+    if (m.magic != LOG_MANIFEST_MAGIC || m.crc != logManifestCrc(m))
+      continue;
+    if (!found || m.seq > logManifest.seq) {
+      logManifest = m;
+      found = true;
     }
   }
   f.close();
-  return false;
+  return found;
 }
 
-// Get farmer phone number by ID
-String getFarmerPhone(String farmerId) {
-  if (!sdInitialized)
-    return "";
+// Persist the manifest into the slot not holding the current record
+bool logManifestSave() {
+  logManifest.magic = LOG_MANIFEST_MAGIC;
+  logManifest.seq++;
+  logManifest.crc = logManifestCrc(logManifest);
 
-  File f = SD.open(FARMERS_FILE, FILE_READ);
+  if (!SD.exists(LOG_MANIFEST_FILE)) {
+    File f = SD.open(LOG_MANIFEST_FILE, FILE_WRITE);
+    if (!f)
+      return false;
+    LogManifest empty;
+    memset(&empty, 0, sizeof(empty));
+    f.write((const uint8_t *)&empty, sizeof(empty));
+    f.write((const uint8_t *)&empty, sizeof(empty));
+    f.close();
+  }
+
+  File f = SD.open(LOG_MANIFEST_FILE, "r+");
+  if (!f) {
+    Serial.println("SD: Could not open log manifest");
+    return false;
+  }
+  f.seek((logManifest.seq % 2) * sizeof(LogManifest));
+  size_t written = f.write((const uint8_t *)&logManifest, sizeof(logManifest));
+  f.close();
+  return written == sizeof(logManifest);
+}
+
+// Records / bytes in a segment (the active one's come from the counters)
+uint32_t logSegmentRecords(uint32_t id) {
+  return (id == logManifest.active)
+             ? sdCounters.logCount
+             : logManifest.records[id % LOG_SEGMENTS_MAX];
+}
+
+uint32_t logSegmentBytes(uint32_t id) {
+  return (id == logManifest.active) ? sdCounters.logBytes
+                                    : logManifest.bytes[id % LOG_SEGMENTS_MAX];
+}
+
+uint32_t logRetainedBytes() {
+  uint32_t total = 0;
+  for (uint32_t id = logManifest.first; id <= logManifest.active; id++)
+    total += logSegmentBytes(id);
+  return total;
+}
+
+// Create an empty segment file (truncating a leftover one)
+bool logCreateSegment(uint32_t id) {
+  File f = SD.open(logSegmentPath(id), FILE_WRITE);
   if (!f)
-    return "";
+    return false;
+#if !DATALOG_BINARY
+  f.println(DATALOG_CSV_HEADER);
+#endif
+  f.close();
+  return true;
+}
 
-  // Skip header
-  f.readStringUntil('\n');
+// Delete the oldest (sealed) segment; syncing goes on at the next one
+void logDropOldest() {
+  LogPath path = logSegmentPath(logManifest.first);
+  logManifest.first++;
+  logManifest.syncOffset = 0;
+  // Manifest first: a file left by a reset is removed by logInit()
+  logManifestSave();
+  SD.remove(path);
+}
 
-  while (f.available()) {
-    String line = f.readStringUntil('\n');
-    line.trim();
-    if (line.length() == 0)
-      continue;
+// SYNC OFFSETS (below)
+uint32_t datalogBatchEnd(uint32_t segment, uint32_t start, int maxRecords);
 
-    int comma1 = line.indexOf(',');
-    if (comma1 > 0) {
-      String id = line.substring(0, comma1);
-      if (id == farmerId) {
-        int comma2 = line.indexOf(',', comma1 + 1);
-        String phone = (comma2 > 0) ? line.substring(comma1 + 1, comma2)
-                                    : line.substring(comma1 + 1);
-        f.close();
-        return phone;
-      }
+// Delete the sealed segments the server has acknowledged to their end. A
+// torn record at the end of one is never sent, so it does not count.
+void logDropAcked() {
+  while (logManifest.first < logManifest.active &&
+         datalogBatchEnd(logManifest.first, logManifest.syncOffset, 1) <=
+             logManifest.syncOffset) {
+    logLine("SD: Segment %lu synced, deleted",
+            (unsigned long)logManifest.first);
+    logDropOldest();
+  }
+}
+
+// Make room for one more segment by evicting the oldest ones
+void logEvict() {
+  while (logManifest.first < logManifest.active) {
+    uint32_t segments = logManifest.active - logManifest.first + 1;
+    uint64_t freeBytes = SD.totalBytes() - SD.usedBytes();
+    bool full = segments >= LOG_SEGMENTS_MAX ||
+                freeBytes < LOG_MIN_FREE_BYTES ||
+                (LOG_RETAIN_BYTES > 0 &&
+                 logRetainedBytes() + LOG_SEGMENT_BYTES > LOG_RETAIN_BYTES);
+    if (!full)
+      return;
+
+    uint32_t lost = logSegmentRecords(logManifest.first);
+    logManifest.evicted += lost;
+    logLine("SD: Log full, evicted segment %lu (%lu records)",
+            (unsigned long)logManifest.first, (unsigned long)lost);
+    logDropOldest();
+  }
+}
+
+// Seal the active segment and start the next one. Called with an empty
+// journal, so no journaled record belongs to the sealed segment.
+bool logSeal() {
+  logEvict();
+
+  uint32_t next = logManifest.active + 1;
+  if (!logCreateSegment(next)) {
+    Serial.println("SD: Could not start a log segment");
+    return false;
+  }
+  uint32_t slot = logManifest.active % LOG_SEGMENTS_MAX;
+  logManifest.records[slot] = sdCounters.logCount;
+  logManifest.bytes[slot] = sdCounters.logBytes;
+  logManifest.active = next;
+  if (!logManifestSave())
+    return false;
+  logActivePath = logSegmentPath(next);
+
+  // A reset before this save leaves the counters stale, and
+  // sdCountersCheck() recounts the new, nearly empty segment
+  sdCounters.logCount = 0;
+  sdCounters.logBytes = sdFileSize(logActivePath);
+  sdCountersSave();
+
+  logLine("SD: Sealed log segment %lu (%lu records)",
+          (unsigned long)(next - 1), (unsigned long)logManifest.records[slot]);
+  return true;
+}
+
+// Load the manifest, or start one: the single datalog of older firmware
+// becomes segment 1 (setup, before the journal is replayed)
+void logInit() {
+  if (!logManifestLoad()) {
+    SD.mkdir(LOG_DIR);
+    memset(&logManifest, 0, sizeof(logManifest));
+    logManifest.first = logManifest.active = 1;
+
+    LogPath path = logSegmentPath(1);
+    if (!SD.exists(path) && SD.exists(DATALOG_LEGACY_FILE)) {
+      SD.rename(DATALOG_LEGACY_FILE, path);
+      logLine("SD: Moved " DATALOG_LEGACY_FILE " to %s", path.c_str());
     }
+    // The moved file keeps its offsets, and with them the sync position
+    if (SD.exists(path) && sdCountersLoad())
+      logManifest.syncOffset = sdCounters.syncOffset;
+    logManifestSave();
   }
+
+  // Files a reset can leave behind: the segment deleted last, and one
+  // created for a seal the manifest never recorded
+  LogPath dropped = logSegmentPath(logManifest.first - 1);
+  if (logManifest.first > 1 && SD.exists(dropped))
+    SD.remove(dropped);
+  LogPath unsealed = logSegmentPath(logManifest.active + 1);
+  if (SD.exists(unsealed))
+    SD.remove(unsealed);
+
+  logActivePath = logSegmentPath(logManifest.active);
+  if (!SD.exists(logActivePath) && logCreateSegment(logManifest.active))
+    logLine("Created %s", logActivePath.c_str());
+
+  logLine("SD: Log segments %lu-%lu", (unsigned long)logManifest.first,
+          (unsigned long)logManifest.active);
+}
+
+#if DATALOG_BINARY
+// Random access: read record number n, counting from the oldest segment
+// (one seek + one read in the segment holding it)
+bool readLogRecord(uint32_t n, LogRecord &rec) {
+  uint32_t id = logManifest.first;
+  while (id < logManifest.active &&
+         n >= logSegmentBytes(id) / sizeof(LogRecord)) {
+    n -= logSegmentBytes(id) / sizeof(LogRecord);
+    id++;
+  }
+
+  File f = SD.open(logSegmentPath(id), FILE_READ);
+  if (!f)
+    return false;
+  bool ok = f.seek(n * sizeof(LogRecord)) &&
+            f.read((uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
   f.close();
-  return "";
+  return ok && logRecordValid(rec);
 }
 
-// Get the next available farmer ID (auto-increment)
-String getNextFarmerID() {
-  if (!sdInitialized)
-    return "0001";
+// Stream every segment to out as CSV, one block of records at a time
+// Returns the number of records written (corrupt records are skipped)
+uint32_t datalogExportCsv(Print &out) {
+  out.print(DATALOG_CSV_HEADER);
+  out.print("\r\n");
 
-  int maxID = 0;
+  LogRecord block[SD_SCAN_BLOCK / sizeof(LogRecord)];
+  char line[SD_LINE_MAX];
+  uint32_t exported = 0;
 
-  File f = SD.open(FARMERS_FILE, FILE_READ);
-  if (!f)
-    return "0001";
+  for (uint32_t id = logManifest.first; id <= logManifest.active; id++) {
+    File f = SD.open(logSegmentPath(id), FILE_READ);
+    if (!f)
+      continue;
+    while (true) {
+      int n = f.read((uint8_t *)block, sizeof(block)) / sizeof(LogRecord);
+      if (n <= 0)
+        break;
+      for (int i = 0; i < n; i++) {
+        if (!logRecordValid(block[i])) {
+          Serial.println("SD: Skipping corrupt datalog record");
+          continue;
+        }
+        size_t len = formatLogRecordCsv(block[i], line, sizeof(line));
+        out.write((const uint8_t *)line, len);
+        exported++;
+      }
+    }
+    f.close();
+  }
+  return exported;
+}
+#endif
+
+int sdScanCount = 0;
+
+void sdCountLine(char *) { sdScanCount++; }
+
+// Check the counters against the files on the card; rebuild if they differ
+// (a rebuild only recounts the active segment)
+void sdCountersCheck() {
+  uint32_t farmerBytes = sdFileSize(FARMERS_FILE);
+  uint32_t logBytes = sdFileSize(logActivePath);
+
+  bool valid = sdCountersLoad();
+  if (valid && sdCounters.farmerBytes == farmerBytes &&
+      sdCounters.logBytes == logBytes &&
+      sdCounters.farmerCount == (uint32_t)farmerIndexRows) {
+    Serial.println("SD: Counters OK");
+    return;
+  }
+
+  Serial.println("SD: Counters stale or missing, rebuilding...");
+  uint32_t seq = valid ? sdCounters.seq : 0;
+  uint32_t syncOffset = valid ? sdCounters.syncOffset : 0;
+  uint32_t farmerSyncOffset = valid ? sdCounters.farmerSyncOffset : 0;
+
+#if DATALOG_BINARY
+  sdScanCount = logBytes / sizeof(LogRecord);
+#else
+  sdScanCount = 0;
+  sdScanLines(logActivePath, sdCountLine);
+#endif
+
+  memset(&sdCounters, 0, sizeof(sdCounters));
+  sdCounters.seq = seq;
+  sdCounters.farmerCount = farmerIndexRows;
+  sdCounters.farmerBytes = farmerBytes;
+  sdCounters.logCount = sdScanCount;
+  sdCounters.logBytes = logBytes;
+  sdCounters.syncOffset = (syncOffset <= logBytes) ? syncOffset : 0;
+  sdCounters.farmerSyncOffset =
+      (farmerSyncOffset <= farmerBytes) ? farmerSyncOffset : 0;
+  sdCountersSave();
+}
+
+// ==========================================
+//  JOURNAL (write-ahead log)
+// ==========================================
+// New farmers and readings are not appended to their files one by one. Each
+// record becomes an entry in JOURNAL_FILE, which is preallocated once and
+// kept open, so a journal write never allocates a cluster or touches a
+// directory entry:
+//
+//   JournalEntry | payload (the bytes meant for the target file) | CRC-32
+//
+// Entries collect in a one-sector RAM buffer that is written and flushed
+// (fsync) once JOURNAL_FLUSH_RECORDS entries wait, by sdFlush() every
+// SD_FLUSH_MS, after a save with JOURNAL_FLUSH_ON_SAVE, and before a sync.
+// A record is durable once flushed.
+//
+// A checkpoint appends the journaled payloads to farmers.csv and the active
+// log segment with one open per file, puts journaled visits in the reading
+// history, starts a new journal generation and saves the counters. It runs
+// before a sync or clearDataLogs(), and from sdFlush() once the journal
+// holds JOURNAL_CHECKPOINT_BYTES. A full segment is sealed right after a
+// checkpoint, so journaled records always belong to the active segment.
+//
+// Recovery (sdInit): entries are read from the start while magic,
+// generation, sequence number and CRC match; the first bad one ends the
+// journal, so a torn tail is dropped. The counters still hold each file's
+// size from before the journaled payloads, so only bytes a crash kept from
+// reaching the file are appended and replay never duplicates a record.
+//
+// The generation lives in two alternating header slots, like the counters.
+// Entries start on the next sector so that appends never rewrite the header.
+
+#define JOURNAL_MAGIC 0x46524D4A // "FRMJ"
+#define JOURNAL_DATA_START 512   // first entry (the header has sector 0)
+#define JOURNAL_PAYLOAD_MAX (SD_LINE_MAX + 2) // a CSV line with CRLF
+
+enum JournalTarget : uint8_t {
+  JOURNAL_FARMERS,
+  JOURNAL_DATALOG,
+  JOURNAL_HISTORY, // a LogRecord for the farmer's history, not appended
+  JOURNAL_TARGETS
+};
+
+const char *journalTargetPath(int target) {
+  if (target == JOURNAL_HISTORY)
+    return HISTORY_FILE;
+  return (target == JOURNAL_FARMERS) ? FARMERS_FILE : logActivePath.c_str();
+}
 
-  // Skip header
-  f.readStringUntil('\n');
+struct JournalHeader {
+  uint32_t magic;
+  uint32_t generation;
+  uint32_t crc;
+};
 
-  while (f.available()) {
-    String line = f.readStringUntil('\n');
-    line.trim();
-    if (line.length() == 0)
+struct JournalEntry {
+  uint32_t magic;
+  uint32_t generation; // entries of older generations are stale
+  uint32_t seq;        // 0, 1, 2... within a generation
+  uint8_t target;      // JournalTarget
+  uint8_t pad;
+  uint16_t length; // payload bytes; a CRC-32 of entry + payload follows them
+};
+
+static_assert(sizeof(JournalEntry) + JOURNAL_PAYLOAD_MAX + sizeof(uint32_t) <=
+                  JOURNAL_BUFFER,
+              "JOURNAL_BUFFER must hold the largest entry");
+
+struct Journal {
+  File file;
+  uint32_t size;       // bytes in JOURNAL_FILE
+  uint32_t generation;
+  uint32_t nextSeq;    // entries in this generation
+  uint32_t end;        // file offset after the last entry written to the file
+  uint8_t buf[JOURNAL_BUFFER]; // entries not written to the file yet
+  uint16_t bufLen;
+  uint16_t unflushed; // entries not flushed to the card yet
+  uint32_t pending[JOURNAL_TARGETS]; // entries per target since the checkpoint
+  LogRecord history[HISTORY_PENDING_MAX]; // JOURNAL_HISTORY payloads, for
+  uint8_t historyCount;                   // lookups before the checkpoint
+};
+
+Journal journal;
+
+uint32_t journalEntrySize(uint16_t length) {
+  return sizeof(JournalEntry) + length + sizeof(uint32_t);
+}
+
+uint32_t journalHeaderCrc(const JournalHeader &h) {
+  return sdCrc32((const uint8_t *)&h, offsetof(JournalHeader, crc));
+}
+
+// Generation of the newest valid header slot (0 if neither is valid)
+uint32_t journalLoadGeneration() {
+  uint32_t generation = 0;
+  journal.file.seek(0);
+  for (int slot = 0; slot < 2; slot++) {
+    JournalHeader h;
+    if (journal.file.read((uint8_t *)&h, sizeof(h)) != sizeof(h))
+      break;
+    if (h.magic == JOURNAL_MAGIC && h.crc == journalHeaderCrc(h) &&
+        h.generation > generation)
+      generation = h.generation;
+  }
+  return generation;
+}
+
+// Start an empty generation: entries already in the file become stale
+bool journalReset() {
+  JournalHeader h;
+  h.magic = JOURNAL_MAGIC;
+  h.generation = journal.generation + 1;
+  h.crc = journalHeaderCrc(h);
+
+  if (!journal.file.seek((h.generation % 2) * sizeof(h)) ||
+      journal.file.write((const uint8_t *)&h, sizeof(h)) != sizeof(h)) {
+    Serial.println("SD: Could not write journal header");
+    return false;
+  }
+  journal.file.flush();
+
+  journal.generation = h.generation;
+  journal.nextSeq = 0;
+  journal.end = JOURNAL_DATA_START;
+  journal.bufLen = 0;
+  journal.unflushed = 0;
+  memset(journal.pending, 0, sizeof(journal.pending));
+  journal.historyCount = 0;
+  return true;
+}
+
+// Read and check entry seq at offset; payload needs JOURNAL_PAYLOAD_MAX bytes
+bool journalReadEntry(uint32_t offset, uint32_t seq, JournalEntry &e,
+                      uint8_t *payload) {
+  File &f = journal.file;
+  if (offset + journalEntrySize(0) > journal.size || !f.seek(offset) ||
+      f.read((uint8_t *)&e, sizeof(e)) != sizeof(e))
+    return false;
+  if (e.magic != JOURNAL_MAGIC || e.generation != journal.generation ||
+      e.seq != seq || e.target >= JOURNAL_TARGETS ||
+      e.length > JOURNAL_PAYLOAD_MAX)
+    return false;
+
+  uint32_t crc;
+  if (f.read(payload, e.length) != e.length ||
+      f.read((uint8_t *)&crc, sizeof(crc)) != sizeof(crc))
+    return false;
+  return crc == sdCrc32(payload, e.length,
+                        sdCrc32((const uint8_t *)&e, sizeof(e)));
+}
+
+// Write the buffered entries to the file (kept in RAM if that fails)
+bool journalWriteBuffer() {
+  if (journal.bufLen == 0)
+    return true;
+  if (!journal.file.seek(journal.end) ||
+      journal.file.write(journal.buf, journal.bufLen) != journal.bufLen) {
+    Serial.println("SD: Journal write failed");
+    return false;
+  }
+  journal.end += journal.bufLen;
+  journal.bufLen = 0;
+  return true;
+}
+
+// Put every journaled record on the card
+bool journalFlush() {
+  if (!journal.file)
+    return false;
+  if (journal.unflushed == 0)
+    return true;
+  if (!journalWriteBuffer())
+    return false;
+  journal.file.flush();
+  journal.unflushed = 0;
+  return true;
+}
+
+// Called when a save is complete: with JOURNAL_FLUSH_ON_SAVE it is on the
+// card before the UI is told
+bool journalCommit() {
+#if JOURNAL_FLUSH_ON_SAVE
+  return journalFlush();
+#else
+  return true;
+#endif
+}
+
+// READING HISTORY (below)
+File historyOpenFile(const char *path);
+bool historyApply(File &index, File &slots, const LogRecord &rec);
+void historyInit();
+
+// Append every entry of this generation to its file. Bytes the file already
+// has past the size in the counters (an interrupted checkpoint) are skipped.
+// History entries go into their farmer's slot (applying one twice is a
+// no-op). applied[] receives the entries per target.
+bool journalReplay(uint32_t *applied) {
+  File out[JOURNAL_TARGETS];
+  uint32_t skip[JOURNAL_TARGETS];
+  File historyIndex, historySlots; // opened at the first history entry
+  bool ok = true;
+
+  for (int t = 0; t < JOURNAL_TARGETS; t++) {
+    applied[t] = 0;
+    if (t == JOURNAL_HISTORY)
       continue;
+    out[t] = SD.open(journalTargetPath(t), FILE_APPEND);
+    uint32_t before = (t == JOURNAL_FARMERS) ? sdCounters.farmerBytes
+                                             : sdCounters.logBytes;
+    uint32_t size = out[t] ? out[t].size() : 0;
+    skip[t] = (size > before) ? size - before : 0;
+    if (!out[t]) {
+      logLine("SD: Could not open %s", journalTargetPath(t));
+      ok = false;
+    }
+  }
 
-    int commaIdx = line.indexOf(',');
-    if (commaIdx > 0) {
-      String idStr = line.substring(0, commaIdx);
-      int id = idStr.toInt();
-      if (id > maxID)
-        maxID = id;
+  uint32_t offset = JOURNAL_DATA_START;
+  for (uint32_t seq = 0; ok && seq < journal.nextSeq; seq++) {
+    JournalEntry e;
+    uint8_t payload[JOURNAL_PAYLOAD_MAX];
+    if (!journalReadEntry(offset, seq, e, payload)) {
+      Serial.println("SD: Journal entry unreadable");
+      ok = false;
+      break;
     }
+    offset += journalEntrySize(e.length);
+    applied[e.target]++;
+
+    if (e.target == JOURNAL_HISTORY) {
+      // Best effort: the log has the reading whatever happens here
+      LogRecord rec;
+      if (e.length != sizeof(rec))
+        continue;
+      memcpy(&rec, payload, sizeof(rec));
+      if (!historySlots) {
+        historyIndex = historyOpenFile(HISTORY_INDEX_FILE);
+        historySlots = historyOpenFile(HISTORY_FILE);
+      }
+      if (!historyIndex || !historySlots ||
+          !historyApply(historyIndex, historySlots, rec))
+        Serial.println("SD: Could not update reading history");
+    } else if (skip[e.target] >= e.length) {
+      skip[e.target] -= e.length;
+    } else {
+      uint32_t n = e.length - skip[e.target];
+      ok = out[e.target].write(payload + skip[e.target], n) == n;
+      skip[e.target] = 0;
+    }
+  }
+
+  for (int t = 0; t < JOURNAL_TARGETS; t++) {
+    if (out[t])
+      out[t].close();
+  }
+  if (historyIndex)
+    historyIndex.close();
+  if (historySlots)
+    historySlots.close();
+  return ok;
+}
+
+// Move the journaled records into their files and empty the journal
+bool journalCheckpoint() {
+  if (!journal.file)
+    return false;
+  if (journal.nextSeq == 0)
+    return true;
+
+  uint32_t applied[JOURNAL_TARGETS];
+  if (!journalFlush() || !journalReplay(applied)) {
+    Serial.println("SD: Journal checkpoint failed, records kept in journal");
+    return false;
+  }
+
+  // Journal first: a crash before the counters are saved leaves them stale,
+  // which sdCountersCheck() repairs, but never replays a record twice
+  journalReset();
+  sdCounters.farmerCount += applied[JOURNAL_FARMERS];
+  sdCounters.farmerBytes = sdFileSize(FARMERS_FILE);
+  sdCounters.logCount += applied[JOURNAL_DATALOG];
+  sdCounters.logBytes = sdFileSize(logActivePath);
+  sdCountersSave();
+
+  logLine("SD: Journal checkpoint (%lu farmers, %lu readings)",
+          (unsigned long)applied[JOURNAL_FARMERS],
+          (unsigned long)applied[JOURNAL_DATALOG]);
+
+  if (sdCounters.logBytes >= LOG_SEGMENT_BYTES)
+    logSeal();
+  return true;
+}
+
+// Add one record for a target file; durable after the next journalFlush()
+bool journalAppend(JournalTarget target, const uint8_t *data, uint16_t len) {
+  if (!journal.file || len > JOURNAL_PAYLOAD_MAX)
+    return false;
+
+  uint32_t entrySize = journalEntrySize(len);
+  if (journal.end + journal.bufLen + entrySize > journal.size &&
+      !journalCheckpoint())
+    return false; // full and cannot be emptied
+  if (journal.bufLen + entrySize > JOURNAL_BUFFER && !journalWriteBuffer())
+    return false;
+
+  JournalEntry e;
+  e.magic = JOURNAL_MAGIC;
+  e.generation = journal.generation;
+  e.seq = journal.nextSeq;
+  e.target = target;
+  e.pad = 0;
+  e.length = len;
+  uint32_t crc = sdCrc32(data, len, sdCrc32((const uint8_t *)&e, sizeof(e)));
+
+  uint8_t *p = journal.buf + journal.bufLen;
+  memcpy(p, &e, sizeof(e));
+  memcpy(p + sizeof(e), data, len);
+  memcpy(p + sizeof(e) + len, &crc, sizeof(crc));
+  journal.bufLen += entrySize;
+  journal.nextSeq++;
+  journal.pending[target]++;
+
+  if (++journal.unflushed >= JOURNAL_FLUSH_RECORDS)
+    journalFlush();
+  return true;
+}
+
+// Journal one text line (CRLF is added, as println() would)
+bool journalAppendLine(JournalTarget target, const char *line) {
+  uint8_t buf[JOURNAL_PAYLOAD_MAX];
+  size_t len = strlen(line);
+  if (len > SD_LINE_MAX)
+    len = SD_LINE_MAX;
+  memcpy(buf, line, len);
+  buf[len++] = '\r';
+  buf[len++] = '\n';
+  return journalAppend(target, buf, len);
+}
+
+// Preallocate JOURNAL_FILE (zeros are never a valid entry)
+bool journalCreate() {
+  File f = SD.open(JOURNAL_FILE, FILE_WRITE);
+  if (!f)
+    return false;
+  uint8_t block[SD_SCAN_BLOCK];
+  memset(block, 0, sizeof(block));
+  uint32_t written = 0;
+  while (written < JOURNAL_SIZE) {
+    size_t n = f.write(block, sizeof(block));
+    if (n == 0)
+      break;
+    written += n;
   }
   f.close();
+  Serial.println("Created " JOURNAL_FILE);
+  return written >= JOURNAL_SIZE;
+}
+
+// Open the journal and replay what a reset or power loss left in it (setup,
+// after the data files exist and before the counters are checked)
+void journalInit() {
+  if (SD.exists(JOURNAL_FILE)) {
+    journal.file = SD.open(JOURNAL_FILE, "r+");
+  } else if (journalCreate()) {
+    journal.file = SD.open(JOURNAL_FILE, "r+");
+  }
+  if (!journal.file) {
+    Serial.println("SD: Could not open journal, records cannot be saved");
+    return;
+  }
+  journal.size = journal.file.size();
+  journal.generation = journalLoadGeneration();
+
+  // Find the end of the journal: the first entry that does not check out
+  JournalEntry e;
+  uint8_t payload[JOURNAL_PAYLOAD_MAX];
+  journal.nextSeq = 0;
+  journal.end = JOURNAL_DATA_START;
+  while (journalReadEntry(journal.end, journal.nextSeq, e, payload)) {
+    journal.end += journalEntrySize(e.length);
+    journal.nextSeq++;
+  }
+
+  if (journal.nextSeq > 0) {
+    logLine("SD: Replaying %lu journaled records",
+            (unsigned long)journal.nextSeq);
+    // Without counters, assume nothing reached the files yet
+    if (!sdCountersLoad()) {
+      sdCounters.farmerBytes = sdFileSize(FARMERS_FILE);
+      sdCounters.logBytes = sdFileSize(logActivePath);
+    }
+    journalCheckpoint();
+  } else {
+    journalReset(); // stale entries from before the reset stay stale
+  }
+
+  // A journal of another size (JOURNAL_SIZE changed) is remade once empty
+  if (journal.size != JOURNAL_SIZE && journal.nextSeq == 0) {
+    journal.file.close();
+    SD.remove(JOURNAL_FILE);
+    journal.generation = 0;
+    if (journalCreate()) {
+      journal.file = SD.open(JOURNAL_FILE, "r+");
+      journal.size = journal.file.size();
+      journalReset();
+    }
+  }
+}
+
+bool sdInit() {
+#if PIPELINE_DUAL_CORE
+  if (!sdMutex)
+    sdMutex = xSemaphoreCreateRecursiveMutex();
+#endif
+  if (!SD.begin(SD_CS_PIN)) {
+    Serial.println("SD Card: Mount failed!");
+    sdInitialized = false;
+    return false;
+  }
+  Serial.println("SD Card: Mounted successfully");
+  sdInitialized = true;
+
+  // Finish a compaction older firmware was doing: the compacted tail
+  // replaced the log only once it was complete, so a leftover tmp file is
+  // either the finished replacement (log already removed) or a partial copy
+  if (SD.exists(DATALOG_TMP_FILE)) {
+    if (SD.exists(DATALOG_LEGACY_FILE)) {
+      SD.remove(DATALOG_TMP_FILE);
+    } else {
+      SD.rename(DATALOG_TMP_FILE, DATALOG_LEGACY_FILE);
+      // The stored sync offset pointed into the old file
+      sdCountersLoad();
+      sdCounters.syncOffset = 0;
+      sdCountersSave();
+      Serial.println("SD: Recovered compacted datalog");
+    }
+  }
+
+  // Create files with headers if they don't exist
+  if (!SD.exists(FARMERS_FILE)) {
+    File f = SD.open(FARMERS_FILE, FILE_WRITE);
+    if (f) {
+      f.println(FARMERS_CSV_HEADER);
+      f.close();
+      Serial.println("Created " FARMERS_FILE);
+    }
+  }
 
-  // Format next ID with zero padding
-  int nextID = maxID + 1;
-  char idBuf[5];
-  snprintf(idBuf, sizeof(idBuf), "%04d", nextID);
-  return String(idBuf);
+  logInit();
+  historyInit();
+
+  // Records that were journaled but not yet in their files are added first
+  journalInit();
+#if DATALOG_BINARY
+  datalogRepairTail(logActivePath);
+#endif
+
+  // Load the farmer registry into RAM once; lookups use it from now on
+  farmerIndexBuild();
+  sdCountersCheck();
+
+  return true;
+}
+
+// Scheduler task: put journaled records still in RAM on the card, and move
+// them into their files once the journal fills up
+void sdFlush() {
+  if (!sdInitialized)
+    return;
+  SdGuard card;
+  journalFlush();
+  if (journal.end >= JOURNAL_CHECKPOINT_BYTES)
+    journalCheckpoint();
+}
+
+// ==========================================
+//  FARMER OPERATIONS
+// ==========================================
+
+typedef FixedString<FARMER_PHONE_BYTES * 2 + 1> FarmerPhone;
+
+// Check if a farmer ID is registered (index lookup, no SD access)
+bool farmerExists(const char *farmerId) {
+  if (!sdInitialized)
+    return false;
+
+  long id = atol(farmerId);
+  if (id <= 0 || id > 0xFFFF)
+    return false;
+  return farmerIndexFind((uint16_t)id) != nullptr;
+}
+
+// Get farmer phone number by ID (index lookup, no SD access)
+// Empty if the farmer is not registered
+FarmerPhone getFarmerPhone(const char *farmerId) {
+  if (!sdInitialized)
+    return FarmerPhone();
+
+  long id = atol(farmerId);
+  if (id <= 0 || id > 0xFFFF)
+    return FarmerPhone();
+
+  FarmerIndexEntry *e = farmerIndexFind((uint16_t)id);
+  if (!e)
+    return FarmerPhone();
+
+  char phone[FARMER_PHONE_BYTES * 2 + 1];
+  farmerUnpackPhone(e->phone, phone);
+  return FarmerPhone(phone);
+}
+
+// Get the next available farmer ID (auto-increment from cached max ID)
+int getNextFarmerID() {
+  if (!sdInitialized)
+    return 1;
+
+  return farmerIndexMaxID + 1;
 }
 
 // Get total number of registered farmers
@@ -152,40 +1395,264 @@ int getFarmerCount() {
   if (!sdInitialized)
     return 0;
 
-  int count = 0;
-  File f = SD.open(FARMERS_FILE, FILE_READ);
-  if (!f)
-    return 0;
-
-  // Skip header
-  f.readStringUntil('\n');
-
-  while (f.available()) {
-    String line = f.readStringUntil('\n');
-    line.trim();
-    if (line.length() > 0)
-      count++;
-  }
-  f.close();
-  return count;
+  return farmerIndexCount;
 }
 
-// Add a new farmer to farmers.csv
-bool addFarmer(String farmerId, String phoneNumber, String timestamp) {
+// Add a new farmer to the in-RAM index and (through the journal) to
+// farmers.csv
+bool addFarmer(const char *farmerId, const char *phoneNumber,
+               const char *timestamp) {
   if (!sdInitialized)
     return false;
 
-  File f = SD.open(FARMERS_FILE, FILE_APPEND);
-  if (!f) {
-    Serial.println("SD: Could not open farmers file for writing");
+  FixedString<SD_LINE_MAX> line;
+  line.appendf("%s,%s,%s", farmerId, phoneNumber, timestamp);
+  if (!journalAppendLine(JOURNAL_FARMERS, line)) {
+    Serial.println("SD: Could not journal farmer");
     return false;
   }
 
-  String line = farmerId + "," + phoneNumber + "," + timestamp;
-  f.println(line);
-  f.close();
+  long id = atol(farmerId);
+  if (id > 0 && id <= 0xFFFF)
+    farmerIndexInsert((uint16_t)id, phoneNumber);
 
-  Serial.println("SD: Farmer saved - " + line);
+  logLine("SD: Farmer saved - %s", line.c_str());
+  return true;
+}
+
+// ==========================================
+//  READING HISTORY
+// ==========================================
+// HISTORY_FILE keeps each farmer's last HISTORY_DEPTH visits so a lookup
+// can show the previous reading without a log scan. It is a list of
+// HISTORY_SLOT_BYTES slots, one per farmer with a visit, added at the end
+// on the farmer's first visit; a new visit overwrites the slot's oldest
+// entry. HISTORY_INDEX_FILE maps farmer ID N to its slot (a uint16_t at
+// 2 * (N - 1), 0 = none), so a lookup is two small reads and the files only
+// grow by what a new farmer needs (the index at most 20 KB in all).
+// One entry is kept per save (the first probe's row, as in the report
+// SMS). Entries hold a copy of the log record with its CRC, so zeroed or
+// torn entries read as empty.
+//
+// Copies, not log offsets: synced segments leave the card and an offset
+// into one would dangle, so the history outlives the sync and
+// clearDataLogs() leaves it alone.
+//
+// A visit is journaled (JOURNAL_HISTORY) with the rows of its save and put
+// in the files by the checkpoint; until then journal.history has it for
+// lookups. Applying a visit that is already in the slot does nothing, so a
+// checkpoint cut short and replayed never records it twice.
+
+struct HistoryEntry {
+  LogRecord reading; // as saved to the log
+  uint32_t visit;    // the farmer's save count; 0 = empty
+};
+
+#define HISTORY_SLOT_BYTES (HISTORY_DEPTH * sizeof(HistoryEntry))
+
+// Newest visits first
+struct FarmerHistory {
+  int count;
+  HistoryEntry visits[HISTORY_DEPTH];
+};
+
+// Save last journaled for the history; the other probes' rows of it are
+// skipped (the UI stamps every row of a save with the same epoch)
+uint16_t historyLastId = 0;
+uint32_t historyLastEpoch = 0;
+
+uint32_t historySlotOffset(uint16_t slot) {
+  return (uint32_t)(slot - 1) * HISTORY_SLOT_BYTES;
+}
+
+// Open a history file for update, creating it empty if it is missing
+File historyOpenFile(const char *path) {
+  if (!SD.exists(path)) {
+    File created = SD.open(path, FILE_WRITE);
+    if (!created)
+      return created;
+    created.close();
+  }
+  return SD.open(path, "r+");
+}
+
+// Farmer id's slot number (0 = no visit on file)
+uint16_t historyIndexRead(File &index, uint16_t id) {
+  uint16_t slot = 0;
+  uint32_t offset = (uint32_t)(id - 1) * sizeof(slot);
+  if (index.size() >= offset + sizeof(slot) && index.seek(offset))
+    index.read((uint8_t *)&slot, sizeof(slot));
+  return slot;
+}
+
+// Point farmer id at a slot; the index grows (zero-filled) up to its entry
+bool historyIndexWrite(File &index, uint16_t id, uint16_t slot) {
+  uint32_t offset = (uint32_t)(id - 1) * sizeof(slot);
+  uint32_t size = index.size();
+  bool ok = index.seek(size);
+  uint8_t zeros[SD_SCAN_BLOCK];
+  memset(zeros, 0, sizeof(zeros));
+  while (ok && size < offset) {
+    uint32_t n = offset - size;
+    n = index.write(zeros, n < sizeof(zeros) ? n : sizeof(zeros));
+    size += n;
+    ok = n > 0;
+  }
+  return ok && index.seek(offset) &&
+         index.write((const uint8_t *)&slot, sizeof(slot)) == sizeof(slot);
+}
+
+// Read a slot; entries that are not farmer id's read as empty
+void historyReadSlot(File &f, uint16_t slotNo, uint16_t id,
+                     HistoryEntry *slot) {
+  memset(slot, 0, HISTORY_SLOT_BYTES);
+  uint32_t offset = historySlotOffset(slotNo);
+  if (f.size() > offset && f.seek(offset))
+    f.read((uint8_t *)slot, HISTORY_SLOT_BYTES);
+  for (int i = 0; i < HISTORY_DEPTH; i++) {
+    if (!logRecordValid(slot[i].reading) || slot[i].reading.farmerId != id)
+      slot[i].visit = 0;
+  }
+}
+
+// Put a visit in its farmer's slot over the oldest one (checkpoint). A
+// farmer's first visit gets a new slot at the end of the file, which the
+// index points at once it is written.
+bool historyApply(File &index, File &slots, const LogRecord &rec) {
+  HistoryEntry slot[HISTORY_DEPTH];
+  uint16_t slotNo = historyIndexRead(index, rec.farmerId);
+  bool added = (slotNo == 0);
+  if (added) {
+    slotNo = slots.size() / HISTORY_SLOT_BYTES + 1; // over a torn last slot
+    memset(slot, 0, sizeof(slot));
+  } else {
+    historyReadSlot(slots, slotNo, rec.farmerId, slot);
+  }
+
+  int oldest = 0;
+  uint32_t newest = 0;
+  for (int i = 0; i < HISTORY_DEPTH; i++) {
+    if (slot[i].visit > 0 &&
+        memcmp(&slot[i].reading, &rec, sizeof(rec)) == 0)
+      return true; // applied before a checkpoint was cut short
+    if (slot[i].visit < slot[oldest].visit)
+      oldest = i;
+    if (slot[i].visit > newest)
+      newest = slot[i].visit;
+  }
+  slot[oldest].reading = rec;
+  slot[oldest].visit = newest + 1;
+
+  if (added) {
+    return slots.seek(historySlotOffset(slotNo)) &&
+           slots.write((const uint8_t *)slot, HISTORY_SLOT_BYTES) ==
+               HISTORY_SLOT_BYTES &&
+           historyIndexWrite(index, rec.farmerId, slotNo);
+  }
+  uint32_t offset = historySlotOffset(slotNo) + oldest * sizeof(HistoryEntry);
+  return slots.seek(offset) &&
+         slots.write((const uint8_t *)&slot[oldest], sizeof(HistoryEntry)) ==
+             sizeof(HistoryEntry);
+}
+
+// Index a HISTORY_FILE from before HISTORY_INDEX_FILE, where slot N was
+// farmer N's (setup, before the journal is replayed). The index is built
+// under another name, so a reset part way leaves no half index behind.
+void historyInit() {
+  if (!SD.exists(HISTORY_FILE) || SD.exists(HISTORY_INDEX_FILE))
+    return;
+  if (SD.exists(HISTORY_INDEX_TMP))
+    SD.remove(HISTORY_INDEX_TMP);
+
+  File slots = SD.open(HISTORY_FILE, FILE_READ);
+  File index = historyOpenFile(HISTORY_INDEX_TMP);
+  bool ok = slots && index;
+  uint32_t count = ok ? slots.size() / HISTORY_SLOT_BYTES : 0;
+  int farmers = 0;
+  for (uint32_t n = 1; ok && n <= count && n <= 0xFFFF; n++) {
+    HistoryEntry slot[HISTORY_DEPTH];
+    historyReadSlot(slots, n, n, slot);
+    for (int i = 0; i < HISTORY_DEPTH; i++) {
+      if (slot[i].visit > 0) {
+        ok = historyIndexWrite(index, n, n);
+        farmers++;
+        break;
+      }
+    }
+  }
+  if (slots)
+    slots.close();
+  if (index)
+    index.close();
+
+  if (ok && SD.rename(HISTORY_INDEX_TMP, HISTORY_INDEX_FILE))
+    logLine("SD: Indexed reading history (%d farmers)", farmers);
+  else
+    Serial.println("SD: Could not index reading history");
+}
+
+// Load a farmer's visits on record, newest first; returns how many
+int historyLoad(const char *farmerId, FarmerHistory &h) {
+  h.count = 0;
+  long id = atol(farmerId);
+  if (!sdInitialized || id <= 0 || id > 0xFFFF)
+    return 0;
+
+  HistoryEntry slot[HISTORY_DEPTH];
+  memset(slot, 0, sizeof(slot));
+  if (SD.exists(HISTORY_INDEX_FILE)) {
+    File index = SD.open(HISTORY_INDEX_FILE, FILE_READ);
+    uint16_t slotNo = index ? historyIndexRead(index, (uint16_t)id) : 0;
+    if (index)
+      index.close();
+    File f = slotNo ? SD.open(HISTORY_FILE, FILE_READ) : File();
+    if (f) {
+      historyReadSlot(f, slotNo, (uint16_t)id, slot);
+      f.close();
+    }
+  }
+
+  // Insertion sort by visit number, newest first
+  for (int i = 0; i < HISTORY_DEPTH; i++) {
+    if (slot[i].visit == 0)
+      continue;
+    int j = h.count++;
+    while (j > 0 && h.visits[j - 1].visit < slot[i].visit) {
+      h.visits[j] = h.visits[j - 1];
+      j--;
+    }
+    h.visits[j] = slot[i];
+  }
+
+  // Visits still in the journal are newer than any on file
+  for (int i = 0; i < journal.historyCount; i++) {
+    if (journal.history[i].farmerId != id)
+      continue;
+    uint32_t visit = (h.count > 0 ? h.visits[0].visit : 0) + 1;
+    if (h.count < HISTORY_DEPTH)
+      h.count++;
+    for (int j = h.count - 1; j > 0; j--)
+      h.visits[j] = h.visits[j - 1];
+    h.visits[0].reading = journal.history[i];
+    h.visits[0].visit = visit;
+  }
+  return h.count;
+}
+
+// Journal the first row of a save as the farmer's newest visit. Lookups
+// see it at once; the checkpoint puts it in the files, and is run early
+// once HISTORY_PENDING_MAX visits wait.
+bool historyRecord(const LogRecord &rec) {
+  if (rec.farmerId == 0 ||
+      (rec.farmerId == historyLastId && rec.epoch == historyLastEpoch))
+    return true;
+  if (journal.historyCount >= HISTORY_PENDING_MAX && !journalCheckpoint())
+    return false;
+  if (!journalAppend(JOURNAL_HISTORY, (const uint8_t *)&rec, sizeof(rec)))
+    return false;
+  journal.history[journal.historyCount++] = rec;
+  historyLastId = rec.farmerId;
+  historyLastEpoch = rec.epoch;
   return true;
 }
 
@@ -193,86 +1660,190 @@ bool addFarmer(String farmerId, String phoneNumber, String timestamp) {
 //  DATA LOG OPERATIONS
 // ==========================================
 
-// Save a soil reading to datalog.csv
-bool saveReading(String farmerId, String timestamp, SoilData data) {
+// Save a soil reading to the datalog and the farmer's history (both
+// through the journal). epoch is when the UI took the reading: the RTC
+// shares I2C with the LCD, so the io worker never reads it. Binary mode
+// journals one fixed-size record stamped with it; the timestamp string is
+// only used by the CSV format.
+bool saveReading(const char *farmerId, const char *timestamp, uint32_t epoch,
+                 const SoilData &data) {
   if (!sdInitialized)
     return false;
 
-  File f = SD.open(DATALOG_FILE, FILE_APPEND);
-  if (!f) {
-    Serial.println("SD: Could not open datalog file for writing");
+  LogRecord rec;
+  packLogRecord((uint16_t)atol(farmerId), epoch, data, rec);
+#if DATALOG_BINARY
+  if (!journalAppend(JOURNAL_DATALOG, (const uint8_t *)&rec, sizeof(rec))) {
+    Serial.println("SD: Could not journal reading");
     return false;
   }
 
-  String line = farmerId + "," + timestamp + "," + String(data.humidity, 1) +
-                "," + String(data.temperature, 1) + "," + String(data.ec, 0) +
-                "," + String(data.ph, 1) + "," + String(data.nitrogen, 0) +
-                "," + String(data.phosphorus, 0) + "," +
-                String(data.potassium, 0);
-  f.println(line);
-  f.close();
+  logLine("SD: Reading saved - record %lu",
+          (unsigned long)(sdCounters.logCount +
+                          journal.pending[JOURNAL_DATALOG] - 1));
+#else
+  FixedString<SD_LINE_MAX> line;
+  line.appendf("%s,%s,%.1f,%.1f,%.0f,%.1f,%.0f,%.0f,%.0f,%u,%u", farmerId,
+               timestamp, data.humidity, data.temperature, data.ec, data.ph,
+               data.nitrogen, data.phosphorus, data.potassium, data.probe,
+               data.samples);
+  for (int i = 0; i < 7; i++) {
+    line.appendf(",%.*f", LOG_VALUE_SCALE[i] > 1 ? 2 : 1, data.stddev[i]);
+  }
+  if (!journalAppendLine(JOURNAL_DATALOG, line)) {
+    Serial.println("SD: Could not journal reading");
+    return false;
+  }
 
-  Serial.println("SD: Reading saved - " + line);
+  logLine("SD: Reading saved - %s", line.c_str());
+#endif
+  if (!historyRecord(rec)) // the log has it either way
+    Serial.println("SD: Could not journal reading history");
   return true;
 }
 
-// Get number of log entries
+// Get number of log entries (from the manifest, the counters and the
+// journal, no SD access)
 int getLogCount() {
   if (!sdInitialized)
     return 0;
 
-  int count = 0;
-  File f = SD.open(DATALOG_FILE, FILE_READ);
-  if (!f)
-    return 0;
+  uint32_t count = journal.pending[JOURNAL_DATALOG];
+  for (uint32_t id = logManifest.first; id <= logManifest.active; id++)
+    count += logSegmentRecords(id);
+  return count;
+}
 
-  // Skip header
-  f.readStringUntil('\n');
+// ==========================================
+//  SYNC OFFSETS
+// ==========================================
+// logManifest.syncOffset / sdCounters.farmerSyncOffset are the byte offsets
+// of the first record of the oldest segment / farmer row the server has not
+// acknowledged yet (0 = nothing acknowledged). Uploads are byte ranges
+// [start, end) of one segment that always cover whole records.
 
-  while (f.available()) {
-    String line = f.readStringUntil('\n');
-    line.trim();
-    if (line.length() > 0)
-      count++;
+// Byte offset of the first row of a CSV file (just past its header line)
+// (the datalog header is longer than SD_LINE_MAX, so read until the newline)
+uint32_t sdCsvDataStart(const char *path) {
+  File f = SD.open(path, FILE_READ);
+  if (!f)
+    return 0;
+  uint8_t block[SD_SCAN_BLOCK];
+  uint32_t pos = 0;
+  int n;
+  while ((n = f.read(block, sizeof(block))) > 0) {
+    for (int i = 0; i < n; i++) {
+      if (block[i] == '\n') {
+        f.close();
+        return pos + i + 1;
+      }
+    }
+    pos += n;
   }
   f.close();
-  return count;
+  return pos;
 }
 
-// Read entire file content as a string (for sync upload)
-String readFileContent(const char *path) {
-  if (!sdInitialized)
-    return "";
-
+// End offset after up to maxRows complete CSV rows starting at start
+// (a torn final line without its newline is left out)
+uint32_t sdCsvRangeEnd(const char *path, uint32_t start, int maxRows) {
   File f = SD.open(path, FILE_READ);
-  if (!f)
-    return "";
+  if (!f || !f.seek(start))
+    return start;
 
-  String content = "";
-  while (f.available()) {
-    content += (char)f.read();
+  uint8_t block[SD_SCAN_BLOCK];
+  uint32_t pos = start;
+  uint32_t end = start;
+  int rows = 0;
+  int n;
+  while (rows < maxRows && (n = f.read(block, sizeof(block))) > 0) {
+    for (int i = 0; i < n && rows < maxRows; i++) {
+      if (block[i] == '\n') {
+        end = pos + i + 1;
+        rows++;
+      }
+    }
+    pos += n;
   }
   f.close();
-  return content;
+  return end;
 }
 
-// Clear the data log file (keep header only)
-bool clearDataLogs() {
-  if (!sdInitialized)
-    return false;
+// Byte offset of the first record of a segment
+uint32_t datalogDataStart(uint32_t segment) {
+#if DATALOG_BINARY
+  return 0;
+#else
+  return sdCsvDataStart(logSegmentPath(segment));
+#endif
+}
 
-  // Remove and recreate with header
-  SD.remove(DATALOG_FILE);
+// Segment the next upload comes from (the oldest one)
+uint32_t datalogSyncSegment() { return logManifest.first; }
 
-  File f = SD.open(DATALOG_FILE, FILE_WRITE);
-  if (!f)
+// First offset of that segment still to be uploaded
+uint32_t datalogSyncStart() {
+  uint32_t dataStart = datalogDataStart(logManifest.first);
+  return (logManifest.syncOffset > dataStart) ? logManifest.syncOffset
+                                              : dataStart;
+}
+
+// End offset of a batch of up to maxRecords records of a segment from start
+uint32_t datalogBatchEnd(uint32_t segment, uint32_t start, int maxRecords) {
+#if DATALOG_BINARY
+  uint32_t bytes = logSegmentBytes(segment);
+  uint32_t size = bytes - bytes % sizeof(LogRecord);
+  uint32_t end = start + (uint32_t)maxRecords * sizeof(LogRecord);
+  return (end < size) ? end : size;
+#else
+  return sdCsvRangeEnd(logSegmentPath(segment), start, maxRecords);
+#endif
+}
+
+// First farmers.csv offset not yet known to the server (full = resend all)
+uint32_t farmersSyncStart(bool full) {
+  uint32_t dataStart = sdCsvDataStart(FARMERS_FILE);
+  if (full || sdCounters.farmerSyncOffset < dataStart)
+    return dataStart;
+  return sdCounters.farmerSyncOffset;
+}
+
+// End of the complete farmer rows from start
+uint32_t farmersSyncEnd(uint32_t start) {
+  return sdCsvRangeEnd(FARMERS_FILE, start, INT32_MAX);
+}
+
+// Record that the server has every farmer row before offset
+void farmersAcknowledge(uint32_t offset) {
+  sdCounters.farmerSyncOffset = offset;
+  sdCountersSave();
+}
+
+// Record that the server has everything of a segment before offset; a
+// sealed segment acknowledged to its last whole record is deleted
+void datalogAcknowledge(uint32_t segment, uint32_t offset) {
+  if (segment != logManifest.first)
+    return; // evicted meanwhile
+  logManifest.syncOffset = offset;
+  uint32_t first = logManifest.first;
+  logDropAcked();
+  if (logManifest.first == first)
+    logManifestSave(); // logDropOldest() saved it otherwise
+}
+
+// After a sync: the acknowledged part of the log leaves the card. A fully
+// acknowledged active segment is sealed and deleted; records saved while
+// the sync ran stay in their segment for the next one.
+bool clearDataLogs() {
+  if (!sdInitialized || !journalCheckpoint())
     return false;
 
-  f.println("farmer_id,timestamp,humidity,temperature,ec,ph,nitrogen,"
-            "phosphorus,potassium");
-  f.close();
+  if (logManifest.first == logManifest.active &&
+      logManifest.syncOffset > datalogDataStart(logManifest.active))
+    logSeal();
+  logDropAcked();
 
-  Serial.println("SD: Data logs cleared");
+  logLine("SD: Data logs cleared (%d unsynced kept)", getLogCount());
   return true;
 }
 
@@ -2,6 +2,7 @@
 #define SENSOR_MANAGER_H
 
 #include "config.h"
+#include "fixed_string.h"
 #include <HardwareSerial.h>
 
 
@@ -15,18 +16,220 @@ struct SoilData {
   float phosphorus;  // mg/kg
   float potassium;   // mg/kg
   bool valid;        // true if reading was successful
+  uint8_t probe;     // Modbus address of the probe that produced it
+  uint8_t samples;   // valid samples behind an averaged reading
+  float stddev[SENSOR_NUM_REGS]; // sample spread, same order as above
 };
 
-// Modbus RTU request frame to read 7 registers starting at 0x0000
-// Slave=0x01, Function=0x03 (Read Holding Registers), Start=0x0000,
-// Count=0x0007 CRC is pre-calculated for this exact frame
-const byte soilRequest[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x07, 0x04, 0x08};
-const int RESPONSE_LENGTH =
-    19; // 1(addr) + 1(func) + 1(byteCount) + 14(data) + 2(CRC)
+// Index access to the seven values, in register order
+float soilValue(const SoilData &d, int i) {
+  switch (i) {
+  case 0:
+    return d.humidity;
+  case 1:
+    return d.temperature;
+  case 2:
+    return d.ec;
+  case 3:
+    return d.ph;
+  case 4:
+    return d.nitrogen;
+  case 5:
+    return d.phosphorus;
+  default:
+    return d.potassium;
+  }
+}
+
+void soilSetValue(SoilData &d, int i, float v) {
+  switch (i) {
+  case 0:
+    d.humidity = v;
+    break;
+  case 1:
+    d.temperature = v;
+    break;
+  case 2:
+    d.ec = v;
+    break;
+  case 3:
+    d.ph = v;
+    break;
+  case 4:
+    d.nitrogen = v;
+    break;
+  case 5:
+    d.phosphorus = v;
+    break;
+  default:
+    d.potassium = v;
+    break;
+  }
+}
+
+// ==========================================
+//  MODBUS RTU FRAMES
+// ==========================================
+
+#define MODBUS_READ_HOLDING 0x03
+#define MODBUS_REQUEST_LENGTH 8 // addr + func + start(2) + count(2) + CRC(2)
+
+// Reply to a read of count registers: addr + func + byteCount + data + CRC
+#define MODBUS_READ_REPLY_LENGTH(count) (5 + 2 * (count))
+
+// Result of checking a reply frame against the request it answers
+enum ModbusFrameError {
+  MODBUS_FRAME_OK,
+  MODBUS_FRAME_SHORT,     // too short to hold a CRC
+  MODBUS_FRAME_CRC,       // CRC mismatch (line noise, collisions)
+  MODBUS_FRAME_ADDRESS,   // answer from a different slave
+  MODBUS_FRAME_EXCEPTION, // slave returned an exception code
+  MODBUS_FRAME_FUNCTION,  // function code does not match the request
+  MODBUS_FRAME_LENGTH     // byte count / frame length disagree with request
+};
+
+// CRC-16/MODBUS (reflected 0x8005, init 0xFFFF), one byte per lookup
+const uint16_t MODBUS_CRC_TABLE[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+uint16_t modbusCrc16(const byte *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  while (len--) {
+    crc = (crc >> 8) ^ MODBUS_CRC_TABLE[(crc ^ *data++) & 0xFF];
+  }
+  return crc;
+}
+
+// Build a read request (function 0x03/0x04) for any slave and register range
+// frame must hold MODBUS_REQUEST_LENGTH bytes; returns the frame length
+size_t modbusBuildRequest(byte *frame, uint8_t address, uint8_t function,
+                          uint16_t start, uint16_t count) {
+  frame[0] = address;
+  frame[1] = function;
+  frame[2] = start >> 8;
+  frame[3] = start & 0xFF;
+  frame[4] = count >> 8;
+  frame[5] = count & 0xFF;
+  uint16_t crc = modbusCrc16(frame, 6);
+  frame[6] = crc & 0xFF; // CRC goes low byte first
+  frame[7] = crc >> 8;
+  return MODBUS_REQUEST_LENGTH;
+}
+
+// Strictly validate a reply to a read of count registers from address
+ModbusFrameError modbusCheckReply(const byte *frame, size_t len,
+                                  uint8_t address, uint8_t function,
+                                  uint16_t count) {
+  if (len < 5)
+    return MODBUS_FRAME_SHORT;
+
+  uint16_t crc = frame[len - 2] | (frame[len - 1] << 8);
+  if (modbusCrc16(frame, len - 2) != crc)
+    return MODBUS_FRAME_CRC;
+
+  if (frame[0] != address)
+    return MODBUS_FRAME_ADDRESS;
+  if (frame[1] == (function | 0x80))
+    return MODBUS_FRAME_EXCEPTION;
+  if (frame[1] != function)
+    return MODBUS_FRAME_FUNCTION;
+  if (frame[2] != 2 * count || len != (size_t)MODBUS_READ_REPLY_LENGTH(count))
+    return MODBUS_FRAME_LENGTH;
+
+  return MODBUS_FRAME_OK;
+}
+
+const char *modbusFrameErrorName(ModbusFrameError err) {
+  switch (err) {
+  case MODBUS_FRAME_OK:
+    return "ok";
+  case MODBUS_FRAME_SHORT:
+    return "short frame";
+  case MODBUS_FRAME_CRC:
+    return "CRC mismatch";
+  case MODBUS_FRAME_ADDRESS:
+    return "wrong slave address";
+  case MODBUS_FRAME_EXCEPTION:
+    return "exception response";
+  case MODBUS_FRAME_FUNCTION:
+    return "wrong function code";
+  default:
+    return "wrong length";
+  }
+}
+
+// ==========================================
+//  PROBE TABLE
+// ==========================================
+// Soil probes found on the RS485 bus at boot, in address order. Each keeps
+// its own register window and prebuilt request frame, so probes of other
+// models (different base register) can share the bus.
+
+struct SoilProbe {
+  uint8_t address;
+  uint16_t regStart; // first of the SENSOR_NUM_REGS value registers
+  uint8_t regCount;  // always SENSOR_NUM_REGS: soilParseResponse() reads 7
+  byte request[MODBUS_REQUEST_LENGTH];
+};
+
+SoilProbe probes[SENSOR_MAX_PROBES];
+int probeCount = 0;
+
+bool sensorAddProbe(uint8_t address, uint16_t regStart, uint8_t regCount) {
+  if (probeCount >= SENSOR_MAX_PROBES)
+    return false;
+  if (regCount != SENSOR_NUM_REGS) {
+    logLine("Sensor: Probe %d refused, %d registers (need %d)", address,
+            regCount, SENSOR_NUM_REGS);
+    return false;
+  }
+
+  SoilProbe &p = probes[probeCount++];
+  p.address = address;
+  p.regStart = regStart;
+  p.regCount = regCount;
+  modbusBuildRequest(p.request, address, MODBUS_READ_HOLDING, regStart,
+                     regCount);
+  return true;
+}
 
 // Use HardwareSerial (Serial2) on ESP32
 HardwareSerial rs485Serial(2);
 
+void sensorScanBus();
+
 void sensorInit() {
   // Configure direction control pins
   pinMode(RS485_DE_PIN, OUTPUT);
@@ -39,166 +242,486 @@ void sensorInit() {
   // Initialize Serial2 with custom pins
   rs485Serial.begin(RS485_BAUD, SERIAL_8N1, RS485_RX_PIN, RS485_TX_PIN);
   delay(100);
+
+  sensorScanBus();
+}
+
+// ==========================================
+//  MODBUS RTU MASTER (non-blocking)
+// ==========================================
+// One request at a time, advanced by modbusPoll() from the main loop:
+//   IDLE -> TX (driver enabled until the frame has left the UART)
+//        -> WAIT (collect bytes; the frame ends after t3.5 of silence)
+//        -> DONE / TIMEOUT
+// Nothing here blocks, so the keypad and LCD keep running during a reading.
+
+enum ModbusState {
+  MODBUS_IDLE,
+  MODBUS_TX,
+  MODBUS_WAIT,
+  MODBUS_DONE,   // a complete frame is in modbus.rx
+  MODBUS_TIMEOUT // no complete reply within the request's timeout
+};
+
+struct ModbusMaster {
+  ModbusState state = MODBUS_IDLE;
+  byte rx[MODBUS_RX_MAX];
+  uint8_t rxLen = 0;
+  bool overflow = false;      // frame was longer than rx[]
+  unsigned long phaseStart = 0; // micros() when TX/WAIT began
+  unsigned long txTime = 0;     // µs the request takes on the wire
+  unsigned long lastByte = 0;   // micros() of the last received byte
+  unsigned long timeoutMs = SENSOR_TIMEOUT_MS;
+};
+
+ModbusMaster modbus;
+
+// Time for one 11-bit RTU character at RS485_BAUD
+unsigned long modbusCharTime() { return 11000000UL / RS485_BAUD; }
+
+// t3.5 inter-frame silence (fixed 1750 µs above 19200 baud, per the spec)
+unsigned long modbusSilenceTime() {
+  return RS485_BAUD > 19200 ? 1750UL : (modbusCharTime() * 7) / 2;
 }
 
-// Set RS485 to transmit mode
-void rs485Transmit() {
+// Start sending a request frame. The reply is collected by modbusPoll().
+void modbusSend(const byte *frame, size_t len,
+                unsigned long timeoutMs = SENSOR_TIMEOUT_MS) {
+  // Clear any old data in the buffer
+  while (rs485Serial.available()) {
+    rs485Serial.read();
+  }
+
+  modbus.rxLen = 0;
+  modbus.overflow = false;
+
+  // Switch to transmit mode and queue the request
   digitalWrite(RS485_DE_PIN, HIGH);
   digitalWrite(RS485_RE_PIN, HIGH);
-  delay(5);
+  rs485Serial.write(frame, len);
+
+  modbus.timeoutMs = timeoutMs;
+  modbus.txTime = len * modbusCharTime() + MODBUS_TX_GUARD_US;
+  modbus.phaseStart = micros();
+  modbus.state = MODBUS_TX;
 }
 
-// Set RS485 to receive mode
-void rs485Receive() {
+// Advance the current request; returns the state after this step
+ModbusState modbusPoll() {
+  unsigned long now = micros();
+
+  switch (modbus.state) {
+  case MODBUS_TX:
+    // Release the bus once the last stop bit is out
+    if (now - modbus.phaseStart >= modbus.txTime) {
+      digitalWrite(RS485_DE_PIN, LOW);
+      digitalWrite(RS485_RE_PIN, LOW);
+      modbus.phaseStart = now;
+      modbus.state = MODBUS_WAIT;
+    }
+    break;
+
+  case MODBUS_WAIT:
+    while (rs485Serial.available()) {
+      int c = rs485Serial.read();
+      if (c < 0)
+        break;
+      if (modbus.rxLen < MODBUS_RX_MAX)
+        modbus.rx[modbus.rxLen++] = (byte)c;
+      else
+        modbus.overflow = true;
+      modbus.lastByte = now;
+    }
+
+    if (modbus.rxLen > 0 && now - modbus.lastByte >= modbusSilenceTime()) {
+      modbus.state = MODBUS_DONE;
+    } else if (now - modbus.phaseStart >= modbus.timeoutMs * 1000UL) {
+      // No reply at all, or a bus that never goes quiet
+      modbus.state = MODBUS_TIMEOUT;
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  return modbus.state;
+}
+
+bool modbusBusy() {
+  return modbus.state == MODBUS_TX || modbus.state == MODBUS_WAIT;
+}
+
+// Abandon the current request and release the bus
+void modbusCancel() {
   digitalWrite(RS485_DE_PIN, LOW);
   digitalWrite(RS485_RE_PIN, LOW);
-  delay(5);
+  modbus.state = MODBUS_IDLE;
 }
 
-// Read a single soil measurement from the sensor
-SoilData readSoilSensor() {
-  SoilData data;
-  data.valid = false;
+// ==========================================
+//  SOIL SENSOR
+// ==========================================
 
-  byte response[RESPONSE_LENGTH];
+// Decode a reply from probe into data
+// Returns false unless the frame passes modbusCheckReply()
+bool soilParseResponse(const byte *response, size_t len,
+                       const SoilProbe &probe, SoilData &data) {
+  data.valid = false;
+  data.probe = probe.address;
+
+  // Verify CRC, address, function and byte count before trusting the data
+  ModbusFrameError err = modbusCheckReply(response, len, probe.address,
+                                          MODBUS_READ_HOLDING, probe.regCount);
+  if (err != MODBUS_FRAME_OK) {
+    logLine("Sensor: Invalid response, %s (%d bytes)",
+            modbusFrameErrorName(err), (int)len);
+    Serial.print("Got: ");
+    for (size_t i = 0; i < len; i++) {
+      Serial.print(response[i], HEX);
+      Serial.print(" ");
+    }
+    Serial.println();
+    return false;
+  }
 
-  // Clear any old data in the buffer
-  while (rs485Serial.available()) {
-    rs485Serial.read();
+  // Parse the 7 register values (each 2 bytes, big-endian)
+  int rawHumidity = (response[3] << 8) | response[4];
+  int rawTemperature = (response[5] << 8) | response[6];
+  int rawEC = (response[7] << 8) | response[8];
+  int rawPH = (response[9] << 8) | response[10];
+  int rawNitrogen = (response[11] << 8) | response[12];
+  int rawPhosphorus = (response[13] << 8) | response[14];
+  int rawPotassium = (response[15] << 8) | response[16];
+
+  // Convert to real values (divide by 10)
+  data.humidity = rawHumidity / 10.0;
+  data.temperature = rawTemperature / 10.0;
+  data.ec = rawEC; // EC might not need /10, depends on sensor model
+  data.ph = rawPH / 10.0;
+  data.nitrogen = rawNitrogen; // mg/kg, usually integer
+  data.phosphorus = rawPhosphorus;
+  data.potassium = rawPotassium;
+
+  // Handle negative temperature (two's complement)
+  if (rawTemperature > 0x7FFF) {
+    data.temperature = -(0x10000 - rawTemperature) / 10.0;
   }
 
-  // Switch to transmit mode and send request
-  rs485Transmit();
-  rs485Serial.write(soilRequest, sizeof(soilRequest));
-  rs485Serial.flush(); // Wait for transmission to complete
+  data.valid = true;
+
+  // Debug output
+  logLine("--- Soil Sensor Reading (probe %d) ---", probe.address);
+  logLine("Humidity: %.2f %%RH", data.humidity);
+  logLine("Temperature: %.2f °C", data.temperature);
+  logLine("EC: %.2f µS/cm", data.ec);
+  logLine("pH: %.2f", data.ph);
+  logLine("Nitrogen: %.2f mg/kg", data.nitrogen);
+  logLine("Phosphorus: %.2f mg/kg", data.phosphorus);
+  logLine("Potassium: %.2f mg/kg", data.potassium);
+  return true;
+}
+
+int sensorActiveProbe = 0; // index into probes[] of the request in flight
+
+// Send a request to probes[index]; finish it with sensorPollReading()
+void sensorStartReading(int index) {
+  sensorActiveProbe = index;
+  modbusSend(probes[index].request, MODBUS_REQUEST_LENGTH);
+}
 
-  // Switch to receive mode
-  rs485Receive();
+// Advance a reading started with sensorStartReading()
+// Returns true once it has finished; data.valid tells whether it succeeded
+bool sensorPollReading(SoilData &data) {
+  ModbusState state = modbusPoll();
+  if (state == MODBUS_TX || state == MODBUS_WAIT)
+    return false;
 
-  // Wait for response with timeout
-  unsigned long startTime = millis();
-  while (rs485Serial.available() < RESPONSE_LENGTH &&
-         (millis() - startTime) < SENSOR_TIMEOUT_MS) {
+  const SoilProbe &probe = probes[sensorActiveProbe];
+  data.valid = false;
+  data.probe = probe.address;
+  if (state == MODBUS_DONE && modbus.overflow) {
+    Serial.println("Sensor: Oversized frame discarded");
+  } else if (state == MODBUS_DONE) {
+    soilParseResponse(modbus.rx, modbus.rxLen, probe, data);
+  } else if (state == MODBUS_TIMEOUT) {
+    logLine("Sensor: Timeout, no response from probe %d", probe.address);
+  }
+  modbus.state = MODBUS_IDLE;
+  return true;
+}
+
+// Read a single soil measurement from probes[index] (blocking)
+SoilData readSoilSensor(int index = 0) {
+  SoilData data;
+  sensorStartReading(index);
+  while (!sensorPollReading(data)) {
     delay(1);
   }
+  return data;
+}
 
-  if (rs485Serial.available() >= RESPONSE_LENGTH) {
-    // Read the response
-    byte index = 0;
-    while (rs485Serial.available() && index < RESPONSE_LENGTH) {
-      response[index] = rs485Serial.read();
-      index++;
+// Find the probes on the bus by polling each address in the scan range.
+// Any well-formed reply counts, including a Modbus exception. Falls back to
+// SENSOR_ADDR so a probe that was unpowered at boot is still tried later.
+void sensorScanBus() {
+  probeCount = 0;
+  byte request[MODBUS_REQUEST_LENGTH];
+
+  for (int addr = SENSOR_SCAN_FIRST;
+       addr <= SENSOR_SCAN_LAST && probeCount < SENSOR_MAX_PROBES; addr++) {
+    modbusBuildRequest(request, addr, MODBUS_READ_HOLDING, 0x0000,
+                       SENSOR_NUM_REGS);
+    modbusSend(request, MODBUS_REQUEST_LENGTH, SENSOR_SCAN_TIMEOUT_MS);
+    ModbusState state;
+    while ((state = modbusPoll()) == MODBUS_TX || state == MODBUS_WAIT) {
+      delay(1);
     }
-
-    // Verify response header: address=0x01, function=0x03, byteCount=0x0E (14)
-    if (response[0] == SENSOR_ADDR && response[1] == 0x03 &&
-        response[2] == 0x0E) {
-      // Parse the 7 register values (each 2 bytes, big-endian)
-      int rawHumidity = (response[3] << 8) | response[4];
-      int rawTemperature = (response[5] << 8) | response[6];
-      int rawEC = (response[7] << 8) | response[8];
-      int rawPH = (response[9] << 8) | response[10];
-      int rawNitrogen = (response[11] << 8) | response[12];
-      int rawPhosphorus = (response[13] << 8) | response[14];
-      int rawPotassium = (response[15] << 8) | response[16];
-
-      // Convert to real values (divide by 10)
-      data.humidity = rawHumidity / 10.0;
-      data.temperature = rawTemperature / 10.0;
-      data.ec = rawEC; // EC might not need /10, depends on sensor model
-      data.ph = rawPH / 10.0;
-      data.nitrogen = rawNitrogen; // mg/kg, usually integer
-      data.phosphorus = rawPhosphorus;
-      data.potassium = rawPotassium;
-
-      // Handle negative temperature (two's complement)
-      if (rawTemperature > 0x7FFF) {
-        data.temperature = -(0x10000 - rawTemperature) / 10.0;
-      }
-
-      data.valid = true;
-
-      // Debug output
-      Serial.println("--- Soil Sensor Reading ---");
-      Serial.println("Humidity: " + String(data.humidity) + " %RH");
-      Serial.println("Temperature: " + String(data.temperature) + " °C");
-      Serial.println("EC: " + String(data.ec) + " µS/cm");
-      Serial.println("pH: " + String(data.ph));
-      Serial.println("Nitrogen: " + String(data.nitrogen) + " mg/kg");
-      Serial.println("Phosphorus: " + String(data.phosphorus) + " mg/kg");
-      Serial.println("Potassium: " + String(data.potassium) + " mg/kg");
-    } else {
-      Serial.println("Sensor: Invalid response header");
-      Serial.print("Got: ");
-      for (int i = 0; i < index; i++) {
-        Serial.print(response[i], HEX);
-        Serial.print(" ");
-      }
-      Serial.println();
+    modbus.state = MODBUS_IDLE;
+
+    if (state != MODBUS_DONE || modbus.overflow)
+      continue;
+    ModbusFrameError err =
+        modbusCheckReply(modbus.rx, modbus.rxLen, addr, MODBUS_READ_HOLDING,
+                         SENSOR_NUM_REGS);
+    if (err == MODBUS_FRAME_OK || err == MODBUS_FRAME_EXCEPTION) {
+      sensorAddProbe(addr, 0x0000, SENSOR_NUM_REGS);
+      logLine("Sensor: Found probe at address %d", addr);
     }
+  }
+
+  if (probeCount == 0) {
+    sensorAddProbe(SENSOR_ADDR, 0x0000, SENSOR_NUM_REGS);
+    logLine("Sensor: No probe answered, using address %d", SENSOR_ADDR);
   } else {
-    Serial.println("Sensor: Timeout or incomplete frame (" +
-                   String(rs485Serial.available()) + " bytes received)");
+    logLine("Sensor: %d probe(s) on the bus", probeCount);
   }
+}
 
-  return data;
+// ==========================================
+//  SAMPLE STATISTICS
+// ==========================================
+// Per-probe running statistics: Welford mean/variance for the stop rule and
+// the stored spread, plus the raw samples for the median and trimmed mean.
+
+struct SoilStats {
+  int n;
+  float mean[SENSOR_NUM_REGS];
+  float m2[SENSOR_NUM_REGS]; // sum of squared deviations from the mean
+  float values[SENSOR_NUM_REGS][NUM_SAMPLES];
+};
+
+// Two-sided 95% Student t for 1..9 degrees of freedom (normal beyond)
+const float STATS_T95[9] = {12.71, 4.30, 3.18, 2.78, 2.57,
+                            2.45,  2.36, 2.31, 2.26};
+
+int sensorAggregator = SENSOR_AGGREGATOR;
+
+void statsReset(SoilStats &st) {
+  st.n = 0;
+  for (int i = 0; i < SENSOR_NUM_REGS; i++) {
+    st.mean[i] = 0;
+    st.m2[i] = 0;
+  }
 }
 
-// Take multiple samples and return the averaged result
-SoilData takeAveragedReading(int numSamples,
-                             void (*progressCallback)(int, int)) {
-  SoilData averaged;
-  averaged.humidity = 0;
-  averaged.temperature = 0;
-  averaged.ec = 0;
-  averaged.ph = 0;
-  averaged.nitrogen = 0;
-  averaged.phosphorus = 0;
-  averaged.potassium = 0;
-  averaged.valid = false;
-
-  int validCount = 0;
-
-  for (int i = 0; i < numSamples; i++) {
-    if (progressCallback) {
-      progressCallback(i + 1, numSamples);
-    }
+void statsAdd(SoilStats &st, const SoilData &sample) {
+  if (st.n >= NUM_SAMPLES)
+    return;
+
+  st.n++;
+  for (int i = 0; i < SENSOR_NUM_REGS; i++) {
+    float x = soilValue(sample, i);
+    float delta = x - st.mean[i];
+    st.mean[i] += delta / st.n;
+    st.m2[i] += delta * (x - st.mean[i]);
+    st.values[i][st.n - 1] = x;
+  }
+}
+
+float statsVariance(const SoilStats &st, int i) {
+  return st.n > 1 ? st.m2[i] / (st.n - 1) : 0;
+}
+
+// True once every parameter's confidence half-width is under its limit
+bool statsStable(const SoilStats &st) {
+  if (st.n < SENSOR_MIN_SAMPLES || st.n < 2)
+    return false;
 
-    SoilData sample = readSoilSensor();
-
-    if (sample.valid) {
-      averaged.humidity += sample.humidity;
-      averaged.temperature += sample.temperature;
-      averaged.ec += sample.ec;
-      averaged.ph += sample.ph;
-      averaged.nitrogen += sample.nitrogen;
-      averaged.phosphorus += sample.phosphorus;
-      averaged.potassium += sample.potassium;
-      validCount++;
+  float t = st.n - 1 <= 9 ? STATS_T95[st.n - 2] : 1.96;
+  for (int i = 0; i < SENSOR_NUM_REGS; i++) {
+    if (t * sqrtf(statsVariance(st, i) / st.n) > SENSOR_CI_LIMIT[i])
+      return false;
+  }
+  return true;
+}
+
+// Combine the samples of parameter i with the selected aggregator
+float statsAggregate(const SoilStats &st, int i, int method) {
+  if (method == AGG_MEAN || st.n < 3)
+    return st.mean[i];
+
+  // Small n: sort a copy (insertion sort)
+  float v[NUM_SAMPLES];
+  for (int k = 0; k < st.n; k++) {
+    float x = st.values[i][k];
+    int j = k;
+    while (j > 0 && v[j - 1] > x) {
+      v[j] = v[j - 1];
+      j--;
     }
+    v[j] = x;
+  }
 
-    if (i < numSamples - 1) {
-      delay(SENSOR_READ_DELAY);
+  if (method == AGG_MEDIAN) {
+    return (st.n % 2) ? v[st.n / 2] : (v[st.n / 2 - 1] + v[st.n / 2]) / 2;
+  }
+
+  // Trimmed mean: drop a quarter from each end
+  int trim = st.n / 4;
+  float sum = 0;
+  for (int k = trim; k < st.n - trim; k++)
+    sum += v[k];
+  return sum / (st.n - 2 * trim);
+}
+
+// ==========================================
+//  AVERAGED READING (non-blocking)
+// ==========================================
+// Each sample round polls every probe back to back, and rounds start
+// SENSOR_READ_DELAY apart (start to start), so N probes finish in about the
+// time one probe takes. Sampling stops early once every probe that answers
+// is stable (statsStable), otherwise after numSamples rounds. Call
+// samplerPoll() from the loop until it returns true, or samplerCancel() to
+// abandon the reading.
+
+struct SoilSampler {
+  bool active = false;
+  int numSamples = 0;
+  int started = 0;    // sample rounds started so far
+  int probeIndex = 0; // next probe to poll in the current round
+  bool inFlight = false;
+  unsigned long lastStart = 0;
+  SoilStats stats[SENSOR_MAX_PROBES];
+  SoilData result[SENSOR_MAX_PROBES]; // per probe, in probes[] order
+  int resultCount = 0;
+  int validResults = 0; // probes with at least one valid sample
+  void (*progressCallback)(int, int) = nullptr;
+};
+
+SoilSampler sampler;
+
+void samplerStart(int numSamples, void (*progressCallback)(int, int)) {
+  sampler.active = true;
+  sampler.numSamples = numSamples < NUM_SAMPLES ? numSamples : NUM_SAMPLES;
+  sampler.started = 0;
+  sampler.probeIndex = probeCount; // no round in progress
+  sampler.inFlight = false;
+  for (int i = 0; i < probeCount; i++) {
+    statsReset(sampler.stats[i]);
+  }
+  sampler.resultCount = 0;
+  sampler.validResults = 0;
+  sampler.progressCallback = progressCallback;
+}
+
+void samplerCancel() {
+  if (sampler.inFlight)
+    modbusCancel();
+  sampler.active = false;
+  sampler.inFlight = false;
+}
+
+// Every probe is either stable or has not answered at all
+bool samplerSettled() {
+  bool any = false;
+  for (int i = 0; i < probeCount; i++) {
+    const SoilStats &st = sampler.stats[i];
+    if (st.n == 0)
+      continue;
+    if (!statsStable(st))
+      return false;
+    any = true;
+  }
+  return any;
+}
+
+// Advance the averaged reading; returns true once sampler.result is final
+bool samplerPoll() {
+  if (!sampler.active)
+    return true;
+
+  if (sampler.inFlight) {
+    SoilData sample;
+    if (!sensorPollReading(sample))
+      return false;
+
+    sampler.inFlight = false;
+    int i = sampler.probeIndex++;
+    if (sample.valid)
+      statsAdd(sampler.stats[i], sample);
+  }
+
+  // Rest of the current round goes out back to back
+  if (sampler.probeIndex < probeCount) {
+    sampler.inFlight = true;
+    sensorStartReading(sampler.probeIndex);
+    return false;
+  }
+
+  if (sampler.started < sampler.numSamples && !samplerSettled()) {
+    if (sampler.started > 0 && millis() - sampler.lastStart < SENSOR_READ_DELAY)
+      return false;
+
+    sampler.started++;
+    if (sampler.progressCallback) {
+      sampler.progressCallback(sampler.started, sampler.numSamples);
     }
+    sampler.lastStart = millis();
+    sampler.probeIndex = 0;
+    sampler.inFlight = true;
+    sensorStartReading(0);
+    return false;
   }
 
-  if (validCount > 0) {
-    averaged.humidity /= validCount;
-    averaged.temperature /= validCount;
-    averaged.ec /= validCount;
-    averaged.ph /= validCount;
-    averaged.nitrogen /= validCount;
-    averaged.phosphorus /= validCount;
-    averaged.potassium /= validCount;
-    averaged.valid = true;
+  // Done: all rounds are in, or every probe settled early
+  sampler.resultCount = probeCount;
+  for (int p = 0; p < probeCount; p++) {
+    const SoilStats &st = sampler.stats[p];
+    SoilData &averaged = sampler.result[p];
+    averaged = SoilData();
+    averaged.probe = probes[p].address;
+    averaged.samples = st.n;
+    averaged.valid = st.n > 0;
+
+    if (averaged.valid) {
+      for (int i = 0; i < SENSOR_NUM_REGS; i++) {
+        soilSetValue(averaged, i, statsAggregate(st, i, sensorAggregator));
+        averaged.stddev[i] = sqrtf(statsVariance(st, i));
+      }
+      sampler.validResults++;
 
-    Serial.println("=== Averaged Result (" + String(validCount) + "/" +
-                   String(numSamples) + " valid samples) ===");
-  } else {
-    Serial.println("ERROR: No valid sensor readings obtained!");
+      logLine("=== Probe %d result (%d/%d valid samples%s) ===",
+              averaged.probe, st.n, sampler.started,
+              statsStable(st) ? ", stable" : "");
+    } else {
+      logLine("ERROR: No valid readings from probe %d!", averaged.probe);
+    }
   }
 
-  return averaged;
+  sampler.active = false;
+  return true;
+}
+
+// Take multiple samples and return the first probe's averaged result
+// (blocking)
+SoilData takeAveragedReading(int numSamples,
+                             void (*progressCallback)(int, int)) {
+  samplerStart(numSamples, progressCallback);
+  while (!samplerPoll()) {
+    delay(1);
+  }
+  return sampler.result[0];
 }
 
 #endif // SENSOR_MANAGER_H
@@ -0,0 +1,328 @@
+#ifndef SMS_PDU_H
+#define SMS_PDU_H
+
+#include "config.h"
+#include "fixed_string.h"
+
+// ==========================================
+//  SMS PDU ENCODING
+// ==========================================
+// Builds SMS-SUBMIT PDUs for AT+CMGF=0. Text that fits the GSM 03.38
+// alphabet (with its escape table) is sent as packed 7-bit; anything else
+// as UCS2. Messages longer than one SMS are split into the fewest
+// concatenated segments (8-bit reference UDH), never inside an escape
+// sequence or a surrogate pair:
+//
+//            single   per segment when concatenated
+//   GSM-7    160      153 septets
+//   UCS2      70       67 characters
+
+#define SMS_GSM7_SINGLE 160
+#define SMS_GSM7_MULTI 153
+#define SMS_UCS2_SINGLE 70
+#define SMS_UCS2_MULTI 67
+#define SMS_UDH_LENGTH 6 // 05 00 03 ref total seq
+
+// GSM 03.38 default alphabet, indexed by septet
+const uint16_t GSM7_BASIC[128] = {
+    0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC,
+    0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+    0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
+    0x03A3, 0x0398, 0x039E, 0xFFFF, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+    0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+    0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+    0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+    0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+    0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+    0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+    0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+    0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+    0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+    0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0};
+
+// Escape table: sent as 0x1B followed by the septet
+const uint8_t GSM7_EXT_SEPTET[10] = {0x0A, 0x14, 0x28, 0x29, 0x2F,
+                                     0x3C, 0x3D, 0x3E, 0x40, 0x65};
+const uint16_t GSM7_EXT_CHAR[10] = {0x000C, 0x005E, 0x007B, 0x007D, 0x005C,
+                                    0x005B, 0x007E, 0x005D, 0x007C, 0x20AC};
+
+// ASCII characters whose GSM-7 septet is the same code (most of them)
+bool gsm7PlainAscii(uint16_t u) {
+  return (u >= 0x20 && u < 0x7B && u != 0x24 && u != 0x40 && u != 0x5B &&
+          u != 0x5C && u != 0x5D && u != 0x5E && u != 0x5F && u != 0x60) ||
+         u == '\n' || u == '\r';
+}
+
+// Septet for a UTF-16 unit: 0-127, 0x1B00 | septet for the escape table,
+// or -1 if the alphabet does not have it
+int gsm7Lookup(uint16_t u) {
+  if (gsm7PlainAscii(u))
+    return u;
+  for (int i = 0; i < 128; i++) {
+    if (GSM7_BASIC[i] == u)
+      return i;
+  }
+  for (int i = 0; i < 10; i++) {
+    if (GSM7_EXT_CHAR[i] == u)
+      return 0x1B00 | GSM7_EXT_SEPTET[i];
+  }
+  return -1;
+}
+
+// Decode UTF-8 into UTF-16 units (surrogate pairs above U+FFFF).
+// Malformed bytes become '?'; stops at maxUnits. Returns the unit count.
+int smsDecodeUtf8(const char *text, uint16_t *units, int maxUnits) {
+  const uint8_t *p = (const uint8_t *)text;
+  int n = 0;
+  while (*p) {
+    uint32_t cp;
+    int extra;
+    if (*p < 0x80) {
+      cp = *p;
+      extra = 0;
+    } else if ((*p & 0xE0) == 0xC0) {
+      cp = *p & 0x1F;
+      extra = 1;
+    } else if ((*p & 0xF0) == 0xE0) {
+      cp = *p & 0x0F;
+      extra = 2;
+    } else if ((*p & 0xF8) == 0xF0) {
+      cp = *p & 0x07;
+      extra = 3;
+    } else {
+      cp = '?';
+      extra = 0;
+    }
+    p++;
+    for (int i = 0; i < extra; i++) {
+      if ((*p & 0xC0) != 0x80) { // truncated sequence
+        cp = '?';
+        break;
+      }
+      cp = (cp << 6) | (*p++ & 0x3F);
+    }
+
+    if (cp > 0xFFFF) {
+      if (n + 2 > maxUnits)
+        break;
+      cp -= 0x10000;
+      units[n++] = 0xD800 | (cp >> 10);
+      units[n++] = 0xDC00 | (cp & 0x3FF);
+    } else {
+      if (n + 1 > maxUnits)
+        break;
+      units[n++] = cp;
+    }
+  }
+  return n;
+}
+
+// True if every unit is in the GSM 7-bit alphabet
+bool smsIsGsm7(const uint16_t *units, int n) {
+  for (int i = 0; i < n; i++) {
+    if (gsm7Lookup(units[i]) < 0)
+      return false;
+  }
+  return true;
+}
+
+// Size of the character starting at units[i]: septets for GSM-7 (2 for
+// escaped ones), UTF-16 units for UCS2 (2 for a surrogate pair)
+int smsUnitCost(const uint16_t *units, int n, int i, bool gsm7) {
+  if (gsm7)
+    return gsm7Lookup(units[i]) > 0xFF ? 2 : 1;
+  bool pair = (units[i] & 0xFC00) == 0xD800 && i + 1 < n &&
+              (units[i + 1] & 0xFC00) == 0xDC00;
+  return pair ? 2 : 1;
+}
+
+// Split units into the fewest segments. bounds[k]..bounds[k+1] is segment
+// k. Returns the segment count; text beyond maxSegments is dropped.
+int smsPlanSegments(const uint16_t *units, int n, bool gsm7, uint16_t *bounds,
+                    int maxSegments) {
+  int total = 0;
+  for (int i = 0; i < n;) {
+    int cost = smsUnitCost(units, n, i, gsm7);
+    total += cost;
+    i += gsm7 ? 1 : cost;
+  }
+
+  bounds[0] = 0;
+  if (total <= (gsm7 ? SMS_GSM7_SINGLE : SMS_UCS2_SINGLE)) {
+    bounds[1] = n;
+    return 1;
+  }
+
+  // Fixed capacity and indivisible 1-2 unit characters: filling each
+  // segment greedily gives the minimum count
+  int capacity = gsm7 ? SMS_GSM7_MULTI : SMS_UCS2_MULTI;
+  int segments = 0;
+  int used = 0;
+  for (int i = 0; i < n;) {
+    int cost = smsUnitCost(units, n, i, gsm7);
+    if (used + cost > capacity) {
+      if (++segments == maxSegments) {
+        logLine("GSM: Message cut to %d segments", maxSegments);
+        bounds[segments] = i;
+        return segments;
+      }
+      bounds[segments] = i;
+      used = 0;
+    }
+    used += cost;
+    i += gsm7 ? 1 : cost;
+  }
+  bounds[++segments] = n;
+  return segments;
+}
+
+// Segment count kept up to date while text is appended one code point at
+// a time. Both encodings are tracked because a later character may force
+// UCS2; the greedy fill matches smsPlanSegments().
+struct SmsSizer {
+  bool gsm7 = true;
+  uint16_t septets = 0; // GSM-7 size so far
+  uint16_t units = 0;   // UCS2 size so far
+  uint8_t gsmSegments = 1;
+  uint16_t gsmUsed = 0;
+  uint8_t ucsSegments = 1;
+  uint16_t ucsUsed = 0;
+
+  void add(uint32_t cp) {
+    int code = cp > 0xFFFF ? -1 : gsm7Lookup(cp);
+    if (code < 0)
+      gsm7 = false;
+    int cost = code > 0xFF ? 2 : 1;
+    if (gsmUsed + cost > SMS_GSM7_MULTI) {
+      gsmSegments++;
+      gsmUsed = 0;
+    }
+    gsmUsed += cost;
+    septets += cost;
+
+    cost = cp > 0xFFFF ? 2 : 1;
+    if (ucsUsed + cost > SMS_UCS2_MULTI) {
+      ucsSegments++;
+      ucsUsed = 0;
+    }
+    ucsUsed += cost;
+    units += cost;
+  }
+
+  // n characters that cost one unit in both encodings (gsm7PlainAscii)
+  void addPlain(uint16_t n) {
+    gsmUsed += n;
+    while (gsmUsed > SMS_GSM7_MULTI) {
+      gsmSegments++;
+      gsmUsed -= SMS_GSM7_MULTI;
+    }
+    septets += n;
+    ucsUsed += n;
+    while (ucsUsed > SMS_UCS2_MULTI) {
+      ucsSegments++;
+      ucsUsed -= SMS_UCS2_MULTI;
+    }
+    units += n;
+  }
+
+  int segments() const {
+    if (gsm7)
+      return septets <= SMS_GSM7_SINGLE ? 1 : gsmSegments;
+    return units <= SMS_UCS2_SINGLE ? 1 : ucsSegments;
+  }
+};
+
+// Pack septets LSB-first into out, starting fillBits into the first octet.
+// Returns the octets used.
+int smsPackSeptets(const uint8_t *septets, int n, uint8_t *out, int fillBits) {
+  int bit = fillBits;
+  memset(out, 0, (fillBits + n * 7 + 7) / 8);
+  for (int i = 0; i < n; i++) {
+    for (int b = 0; b < 7; b++, bit++) {
+      if (septets[i] & (1 << b))
+        out[bit / 8] |= 1 << (bit % 8);
+    }
+  }
+  return (bit + 7) / 8;
+}
+
+struct SmsPdu {
+  char hex[SMS_PDU_HEX_MAX]; // SMSC + TPDU, hex, NUL-terminated
+  uint8_t tpduLength;        // octets after the SMSC field (AT+CMGS=<n>)
+};
+
+// Build the SMS-SUBMIT PDU for units[from..to). total > 1 adds the
+// concatenation header (ref, total, seq counted from 1).
+bool smsBuildPdu(const char *phone, const uint16_t *units, int from, int to,
+                 bool gsm7, uint8_t ref, int total, int seq, SmsPdu &pdu) {
+  uint8_t buf[SMS_PDU_HEX_MAX / 2];
+  int len = 0;
+  bool udh = total > 1;
+
+  buf[len++] = 0x00;               // SMSC from the SIM
+  buf[len++] = udh ? 0x41 : 0x01;  // SMS-SUBMIT, UDHI if concatenated
+  buf[len++] = 0x00;               // message reference (set by the modem)
+
+  // Destination: digit count, type, swapped BCD padded with F
+  bool international = phone[0] == '+';
+  const char *digits = international ? phone + 1 : phone;
+  int ndigits = strlen(digits);
+  if (ndigits == 0 || ndigits > 20)
+    return false;
+  buf[len++] = ndigits;
+  buf[len++] = international ? 0x91 : 0x81;
+  for (int i = 0; i < ndigits; i += 2) {
+    uint8_t lo = digits[i] - '0';
+    uint8_t hi = i + 1 < ndigits ? digits[i + 1] - '0' : 0x0F;
+    buf[len++] = (hi << 4) | lo;
+  }
+
+  buf[len++] = 0x00;               // protocol identifier
+  buf[len++] = gsm7 ? 0x00 : 0x08; // data coding: GSM-7 or UCS2
+
+  uint8_t header[SMS_UDH_LENGTH] = {0x05, 0x00, 0x03, ref, (uint8_t)total,
+                                    (uint8_t)seq};
+  int udlAt = len++;
+  if (gsm7) {
+    uint8_t septets[SMS_GSM7_SINGLE];
+    int n = 0;
+    for (int i = from; i < to; i++) {
+      int code = gsm7Lookup(units[i]);
+      if (code > 0xFF)
+        septets[n++] = 0x1B;
+      septets[n++] = code & 0x7F;
+    }
+    // The header is padded to a septet boundary (6 octets = 7 septets)
+    int headerSeptets = udh ? (SMS_UDH_LENGTH * 8 + 6) / 7 : 0;
+    if (udh) {
+      memcpy(buf + len, header, SMS_UDH_LENGTH);
+      len += SMS_UDH_LENGTH;
+    }
+    int fillBits = headerSeptets * 7 - (udh ? SMS_UDH_LENGTH * 8 : 0);
+    len += smsPackSeptets(septets, n, buf + len, fillBits);
+    buf[udlAt] = headerSeptets + n; // UDL counts septets, header included
+  } else {
+    if (udh) {
+      memcpy(buf + len, header, SMS_UDH_LENGTH);
+      len += SMS_UDH_LENGTH;
+    }
+    for (int i = from; i < to; i++) {
+      buf[len++] = units[i] >> 8;
+      buf[len++] = units[i] & 0xFF;
+    }
+    buf[udlAt] = (udh ? SMS_UDH_LENGTH : 0) + (to - from) * 2;
+  }
+
+  static const char hexDigits[] = "0123456789ABCDEF";
+  for (int i = 0; i < len; i++) {
+    pdu.hex[i * 2] = hexDigits[buf[i] >> 4];
+    pdu.hex[i * 2 + 1] = hexDigits[buf[i] & 0x0F];
+  }
+  pdu.hex[len * 2] = '\0';
+  pdu.tpduLength = len - 1;
+  return true;
+}
+
+#endif // SMS_PDU_H
@@ -2,37 +2,61 @@
 #define WIFI_SYNC_H
 
 #include "config.h"
+#include "diagnostics.h"
+#include "gsm_manager.h"
+#include "sd_manager.h"
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
 #include <WiFi.h>
 
 bool wifiConnected = false;
 
-// Attempt to connect to WiFi with timeout
-bool connectWiFi() {
-  Serial.println("WiFi: Connecting to " + String(WIFI_SSID) + "...");
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+// Connection attempt, advanced by wifiTask() while WIFI_CONNECTING
+enum WifiState { WIFI_IDLE, WIFI_CONNECTING, WIFI_UP, WIFI_FAILED };
+WifiState wifiState = WIFI_IDLE;
+unsigned long wifiStarted = 0;
 
-  unsigned long startTime = millis();
-  while (WiFi.status() != WL_CONNECTED &&
-         (millis() - startTime) < WIFI_TIMEOUT) {
-    delay(500);
-    Serial.print(".");
+// Start connecting (returns at once; watch wifiState)
+void wifiBegin() {
+  if (WiFi.status() == WL_CONNECTED) {
+    wifiConnected = true;
+    wifiState = WIFI_UP;
+    return;
   }
-  Serial.println();
+  logLine("WiFi: Connecting to %s...", WIFI_SSID);
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  wifiStarted = millis();
+  wifiState = WIFI_CONNECTING;
+}
+
+// Scheduler task: finish or time out a connection attempt
+void wifiTask() {
+  if (wifiState != WIFI_CONNECTING)
+    return;
 
   if (WiFi.status() == WL_CONNECTED) {
     wifiConnected = true;
-    Serial.println("WiFi: Connected! IP: " + WiFi.localIP().toString());
-    return true;
-  } else {
+    wifiState = WIFI_UP;
+    IPAddress ip = WiFi.localIP();
+    logLine("WiFi: Connected! IP: %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  } else if (millis() - wifiStarted >= WIFI_TIMEOUT) {
     wifiConnected = false;
+    wifiState = WIFI_FAILED;
     Serial.println("WiFi: Connection failed");
     WiFi.disconnect();
-    return false;
   }
 }
 
+// Attempt to connect to WiFi with timeout (blocking)
+bool connectWiFi() {
+  wifiBegin();
+  while (wifiState == WIFI_CONNECTING) {
+    delay(100);
+    wifiTask();
+  }
+  return wifiState == WIFI_UP;
+}
+
 // Check if WiFi is still connected
 bool isWiFiConnected() {
   wifiConnected = (WiFi.status() == WL_CONNECTED);
@@ -46,36 +70,756 @@ void disconnectWiFi() {
   Serial.println("WiFi: Disconnected");
 }
 
-// Sync data to server - upload farmers and data logs
-// Returns true if server confirmed success
-bool syncToServer(String farmersData, String datalogData) {
-  if (!isWiFiConnected()) {
-    Serial.println("Sync: No WiFi connection");
+// ==========================================
+//  STREAMING SYNC PAYLOAD
+// ==========================================
+// Generates one sync batch body straight from the SD card:
+//   {"batch":N,"segment":G,"offset":S,"end":E,["farmers_mode":..,
+//    "farmers_count":..,
+//    "farmers_checksum":..,]["diag":{..},]"farmers_csv":"...",
+//    "datalog_csv":"..."}
+// one SYNC_BLOCK_SIZE block at a time, JSON-escaping the CSV on the fly.
+// datalog_csv carries the header plus the records in bytes [S, E) of log
+// segment G;
+// farmers_csv carries the header plus the selected farmers.csv rows.
+// measure() does a dry run to get the exact Content-Length, so HTTPClient can
+// stream the body without ever holding it in RAM. Each read takes the card
+// lock for itself, so the io worker can save between two blocks; the files
+// only grow, so the ranges read stay the same.
+class SyncPayloadStream : public Stream {
+public:
+  // Select the batch number and the log segment byte range of the next body
+  // (no farmer rows unless configureFarmers() is called afterwards)
+  void configure(int batchNo, uint32_t logSegment, uint32_t logStart,
+                 uint32_t logEnd) {
+    batch = batchNo;
+    segment = logSegment;
+    segmentPath = logSegmentPath(logSegment);
+    rangeStart = logStart;
+    rangeEnd = logEnd;
+    includeFarmers = false;
+    farmerStart = farmerEnd = 0;
+    includeDiag = false;
+    rewind();
+  }
+
+  // Include farmers.csv bytes [start, end) plus the registry summary the
+  // server checks its own copy against
+  void configureFarmers(uint32_t start, uint32_t end, bool full,
+                        uint32_t count, uint32_t checksum) {
+    includeFarmers = true;
+    farmerStart = start;
+    farmerEnd = end;
+    farmersFull = full;
+    farmerCount = count;
+    farmerChecksum = checksum;
+    rewind();
+  }
+
+  // Include the diagnostics summary (as it is now; see diagnostics.h)
+  void configureDiag(const DiagSummary &summary) {
+    includeDiag = true;
+    diag = diagSummaryJson(summary);
+    rewind();
+  }
+
+  // Walk the whole payload once and return its length in bytes
+  size_t measure() {
+    rewind();
+    size_t total = 0;
+    char scratch[64];
+    size_t n;
+    while ((n = produce(scratch, sizeof(scratch))) > 0)
+      total += n;
+    totalSize = total;
+    rewind();
+    return total;
+  }
+
+  void rewind() {
+    closeFile();
+    part = PART_OPEN;
+    produced = 0;
+    blockLen = blockPos = 0;
+    escLen = escPos = 0;
+  }
+
+  void end() { closeFile(); }
+
+  int available() override { return (int)(totalSize - produced); }
+
+  int read() override {
+    char c;
+    return produce(&c, 1) == 1 ? (uint8_t)c : -1;
+  }
+
+  int peek() override { return -1; }
+
+  size_t readBytes(char *buffer, size_t length) {
+    return produce(buffer, length);
+  }
+
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  enum Part {
+    PART_OPEN,
+    PART_DIAG,
+    PART_FARMER_HEADER,
+    PART_FARMERS,
+    PART_MIDDLE,
+    PART_LOG_HEADER,
+    PART_DATALOG,
+    PART_CLOSE,
+    PART_DONE
+  };
+
+  int batch = 0;
+  uint32_t segment = 0;
+  LogPath segmentPath;
+  uint32_t rangeStart = 0;
+  uint32_t rangeEnd = 0;
+  bool includeFarmers = false;
+  uint32_t farmerStart = 0;
+  uint32_t farmerEnd = 0;
+  bool farmersFull = false;
+  uint32_t farmerCount = 0;
+  uint32_t farmerChecksum = 0;
+  bool includeDiag = false;
+  DiagJson diag;
+
+  File file;
+  bool fileOpen = false;
+  uint32_t filePos = 0;
+  int part = PART_OPEN;
+  size_t totalSize = 0;
+  size_t produced = 0;
+  uint8_t block[SYNC_BLOCK_SIZE];
+  size_t blockLen = 0;
+  size_t blockPos = 0;
+  bool blockEscaped = false;
+  char esc[7];
+  uint8_t escLen = 0;
+  uint8_t escPos = 0;
+
+  void closeFile() {
+    if (!fileOpen)
+      return;
+    SdGuard card;
+    file.close();
+    fileOpen = false;
+  }
+
+  size_t loadLiteral(const char *text) {
+    blockLen = strlen(text);
+    memcpy(block, text, blockLen);
+    return blockLen;
+  }
+
+  bool openAt(const char *path, uint32_t from) {
+    if (fileOpen)
+      return true;
+    file = SD.open(path, FILE_READ);
+    fileOpen = (bool)file;
+    if (fileOpen && !file.seek(from))
+      closeFile();
+    filePos = from;
+    return fileOpen;
+  }
+
+  // Next block of bytes [from, to) of path
+  size_t loadRange(const char *path, uint32_t from, uint32_t to) {
+    if (!openAt(path, from) || filePos >= to)
+      return 0;
+    size_t want = to - filePos;
+    if (want > sizeof(block))
+      want = sizeof(block);
+    int n = file.read(block, want);
+    blockLen = (n > 0) ? n : 0;
+    filePos += blockLen;
+    return blockLen;
+  }
+
+#if DATALOG_BINARY
+  // Render whole CSV lines from the records in [from, to) of the segment
+  size_t loadRecords(uint32_t from, uint32_t to) {
+    blockLen = 0;
+    if (!openAt(segmentPath, from))
+      return 0;
+
+    LogRecord rec;
+    while (filePos < to && sizeof(block) - blockLen >= SD_LINE_MAX &&
+           file.read((uint8_t *)&rec, sizeof(rec)) == sizeof(rec)) {
+      filePos += sizeof(rec);
+      if (logRecordValid(rec))
+        blockLen += formatLogRecordCsv(rec, (char *)block + blockLen,
+                                       sizeof(block) - blockLen);
+    }
+    return blockLen;
+  }
+#endif
+
+  // Refill the block from the current part, advancing past exhausted parts
+  bool refill() {
+    blockPos = blockLen = 0;
+    while (part != PART_DONE) {
+      int from = part;
+      size_t n = 0;
+      switch (part) {
+      case PART_OPEN:
+        n = snprintf((char *)block, sizeof(block),
+                     "{\"batch\":%d,\"segment\":%lu,\"offset\":%lu,"
+                     "\"end\":%lu,",
+                     batch, (unsigned long)segment, (unsigned long)rangeStart,
+                     (unsigned long)rangeEnd);
+        if (includeFarmers)
+          n += snprintf((char *)block + n, sizeof(block) - n,
+                        "\"farmers_mode\":\"%s\",\"farmers_count\":%lu,"
+                        "\"farmers_checksum\":%lu,",
+                        farmersFull ? "full" : "delta",
+                        (unsigned long)farmerCount,
+                        (unsigned long)farmerChecksum);
+        blockLen = n;
+        break;
+      case PART_DIAG:
+        n = includeDiag ? loadLiteral(diag) : 0;
+        n += snprintf((char *)block + n, sizeof(block) - n,
+                      "\"farmers_csv\":\"");
+        blockLen = n;
+        break;
+      case PART_FARMER_HEADER:
+        n = loadLiteral(FARMERS_CSV_HEADER);
+        block[n++] = '\r';
+        block[n++] = '\n';
+        blockLen = n;
+        break;
+      case PART_FARMERS:
+        if (includeFarmers)
+          n = loadRange(FARMERS_FILE, farmerStart, farmerEnd);
+        break;
+      case PART_MIDDLE:
+        n = loadLiteral("\",\"datalog_csv\":\"");
+        break;
+      case PART_LOG_HEADER:
+        n = loadLiteral(DATALOG_CSV_HEADER);
+        block[n++] = '\r';
+        block[n++] = '\n';
+        blockLen = n;
+        break;
+      case PART_DATALOG:
+#if DATALOG_BINARY
+        n = loadRecords(rangeStart, rangeEnd);
+#else
+        n = loadRange(segmentPath, rangeStart, rangeEnd);
+#endif
+        break;
+      case PART_CLOSE:
+        n = loadLiteral("\"}");
+        break;
+      }
+
+      // Fixed parts are a single block; file parts run until they are empty
+      bool filePart = (from == PART_FARMERS || from == PART_DATALOG);
+      if (!filePart || n == 0) {
+        closeFile();
+        part++;
+      }
+      if (n > 0) {
+        blockEscaped = filePart || from == PART_FARMER_HEADER ||
+                       from == PART_LOG_HEADER;
+        return true;
+      }
+    }
     return false;
   }
 
+  // Copy up to len payload bytes into out
+  size_t produce(char *out, size_t len) {
+    SdGuard card;
+    size_t n = 0;
+    while (n < len) {
+      if (escPos < escLen) {
+        out[n++] = esc[escPos++];
+        continue;
+      }
+      if (blockPos >= blockLen && !refill())
+        break;
+
+      char c = (char)block[blockPos++];
+      if (blockEscaped && escapeChar(c))
+        out[n++] = esc[escPos++];
+      else
+        out[n++] = c;
+    }
+    produced += n;
+    return n;
+  }
+
+  // Queue the JSON escape sequence for c in esc[]; false if c is plain
+  bool escapeChar(char c) {
+    const char *seq = nullptr;
+    switch (c) {
+    case '"':
+      seq = "\\\"";
+      break;
+    case '\\':
+      seq = "\\\\";
+      break;
+    case '\n':
+      seq = "\\n";
+      break;
+    case '\r':
+      seq = "\\r";
+      break;
+    case '\t':
+      seq = "\\t";
+      break;
+    }
+
+    if (seq) {
+      memcpy(esc, seq, 2);
+      escLen = 2;
+    } else if ((uint8_t)c < 0x20) {
+      snprintf(esc, sizeof(esc), "\\u%04x", (uint8_t)c);
+      escLen = 6;
+    } else {
+      return false;
+    }
+    escPos = 0;
+    return true;
+  }
+};
+
+// ==========================================
+//  COMPRESSED SYNC PAYLOAD
+// ==========================================
+// Streaming zlib/deflate encoder between SyncPayloadStream and the HTTP body
+// (sent with "Content-Encoding: deflate"). It uses greedy LZ77 matching over
+// a SYNC_DEFLATE_WINDOW history with hash chains and the fixed Huffman code,
+// so the whole working set is a few KB of fixed buffers and no tables need
+// to be sent. The repetitive sync CSV (same IDs, timestamp prefixes, narrow
+// value ranges) compresses well even with this small window.
+
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_LOOKAHEAD (DEFLATE_MAX_MATCH + DEFLATE_MIN_MATCH + 1)
+#define DEFLATE_HASH_BITS 9
+#define DEFLATE_HASH_SIZE (1 << DEFLATE_HASH_BITS)
+#define DEFLATE_MAX_CHAIN 32
+
+const uint16_t DEFLATE_LEN_BASE[29] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                       11, 13, 15, 17,  19,  23,  27,  31,
+                                       35, 43, 51, 59,  67,  83,  99,  115,
+                                       131, 163, 195, 227, 258};
+const uint8_t DEFLATE_LEN_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                       1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                       4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t DEFLATE_DIST_BASE[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,   97,   129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t DEFLATE_DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                        4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                        9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+class SyncDeflateStream : public Stream {
+public:
+  void begin(SyncPayloadStream *source) {
+    src = source;
+    rewind();
+  }
+
+  // Compress the whole payload once to get the exact body length
+  size_t measure() {
+    rewind();
+    size_t total = 0;
+    char scratch[64];
+    size_t n;
+    while ((n = produce(scratch, sizeof(scratch))) > 0)
+      total += n;
+    totalSize = total;
+    rawSize = totalIn;
+    rewind();
+    return total;
+  }
+
+  // Uncompressed length seen by the last measure()
+  size_t inputSize() const { return rawSize; }
+
+  void rewind() {
+    src->rewind();
+    strstart = lookahead = 0;
+    srcDone = false;
+    memset(head, 0, sizeof(head));
+    memset(prev, 0, sizeof(prev));
+    bitBuf = 0;
+    bitCount = 0;
+    outLen = outPos = 0;
+    adlerA = 1;
+    adlerB = 0;
+    totalIn = 0;
+    produced = 0;
+    stage = STAGE_HEADER;
+  }
+
+  void end() { src->end(); }
+
+  int available() override { return (int)(totalSize - produced); }
+
+  int read() override {
+    char c;
+    return produce(&c, 1) == 1 ? (uint8_t)c : -1;
+  }
+
+  int peek() override { return -1; }
+
+  size_t readBytes(char *buffer, size_t length) {
+    return produce(buffer, length);
+  }
+
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  enum Stage { STAGE_HEADER, STAGE_DATA, STAGE_TRAILER, STAGE_DONE };
+
+  SyncPayloadStream *src = nullptr;
+  uint8_t window[2 * SYNC_DEFLATE_WINDOW];
+  uint16_t head[DEFLATE_HASH_SIZE]; // newest position + 1 per hash, 0 = none
+  uint16_t prev[SYNC_DEFLATE_WINDOW]; // older position + 1 per position
+  size_t strstart = 0;
+  size_t lookahead = 0;
+  bool srcDone = false;
+  uint32_t bitBuf = 0;
+  uint8_t bitCount = 0;
+  uint8_t out[16];
+  uint8_t outLen = 0;
+  uint8_t outPos = 0;
+  uint32_t adlerA = 1;
+  uint32_t adlerB = 0;
+  size_t totalIn = 0;
+  size_t rawSize = 0;
+  size_t totalSize = 0;
+  size_t produced = 0;
+  int stage = STAGE_HEADER;
+
+  // Deflate bit order: values LSB first, Huffman codes MSB first
+  void putBits(uint32_t value, uint8_t bits) {
+    bitBuf |= value << bitCount;
+    bitCount += bits;
+    while (bitCount >= 8) {
+      out[outLen++] = (uint8_t)bitBuf;
+      bitBuf >>= 8;
+      bitCount -= 8;
+    }
+  }
+
+  void putCode(uint16_t code, uint8_t bits) {
+    uint16_t reversed = 0;
+    for (uint8_t i = 0; i < bits; i++) {
+      reversed = (reversed << 1) | (code & 1);
+      code >>= 1;
+    }
+    putBits(reversed, bits);
+  }
+
+  // Fixed Huffman literal/length alphabet (RFC 1951, 3.2.6)
+  void putSymbol(uint16_t sym) {
+    if (sym < 144)
+      putCode(0x30 + sym, 8);
+    else if (sym < 256)
+      putCode(0x190 + (sym - 144), 9);
+    else if (sym < 280)
+      putCode(sym - 256, 7);
+    else
+      putCode(0xC0 + (sym - 280), 8);
+  }
+
+  void putMatch(uint16_t len, uint16_t dist) {
+    int li = 28;
+    while (DEFLATE_LEN_BASE[li] > len)
+      li--;
+    putSymbol(257 + li);
+    putBits(len - DEFLATE_LEN_BASE[li], DEFLATE_LEN_EXTRA[li]);
+
+    int di = 29;
+    while (DEFLATE_DIST_BASE[di] > dist)
+      di--;
+    putCode(di, 5);
+    putBits(dist - DEFLATE_DIST_BASE[di], DEFLATE_DIST_EXTRA[di]);
+  }
+
+  // Keep at least DEFLATE_LOOKAHEAD bytes ahead of strstart when possible
+  void fillWindow() {
+    if (srcDone || lookahead >= DEFLATE_LOOKAHEAD)
+      return;
+
+    if (strstart >= 2 * SYNC_DEFLATE_WINDOW - DEFLATE_LOOKAHEAD) {
+      // Slide the upper half down; positions older than the window expire
+      memmove(window, window + SYNC_DEFLATE_WINDOW,
+              strstart + lookahead - SYNC_DEFLATE_WINDOW);
+      strstart -= SYNC_DEFLATE_WINDOW;
+      for (int i = 0; i < DEFLATE_HASH_SIZE; i++)
+        head[i] = (head[i] > SYNC_DEFLATE_WINDOW) ? head[i] - SYNC_DEFLATE_WINDOW
+                                                  : 0;
+      for (int i = 0; i < SYNC_DEFLATE_WINDOW; i++)
+        prev[i] = (prev[i] > SYNC_DEFLATE_WINDOW) ? prev[i] - SYNC_DEFLATE_WINDOW
+                                                  : 0;
+    }
+
+    while (!srcDone && lookahead < DEFLATE_LOOKAHEAD) {
+      size_t space = 2 * SYNC_DEFLATE_WINDOW - (strstart + lookahead);
+      size_t n = src->readBytes((char *)window + strstart + lookahead, space);
+      if (n == 0) {
+        srcDone = true;
+        break;
+      }
+      updateAdler(window + strstart + lookahead, n);
+      lookahead += n;
+      totalIn += n;
+    }
+  }
+
+  void updateAdler(const uint8_t *data, size_t len) {
+    while (len--) {
+      adlerA = (adlerA + *data++) % 65521;
+      adlerB = (adlerB + adlerA) % 65521;
+    }
+  }
+
+  uint16_t hashAt(size_t pos) const {
+    return ((window[pos] << 6) ^ (window[pos + 1] << 3) ^ window[pos + 2]) &
+           (DEFLATE_HASH_SIZE - 1);
+  }
+
+  // Add pos to its hash chain; returns the previous head (position + 1)
+  uint16_t insertHash(size_t pos) {
+    uint16_t h = hashAt(pos);
+    uint16_t older = head[h];
+    prev[pos & (SYNC_DEFLATE_WINDOW - 1)] = older;
+    head[h] = pos + 1;
+    return older;
+  }
+
+  // Longest match for strstart along the hash chain starting at candidate
+  uint16_t longestMatch(uint16_t candidate, uint16_t &distance) {
+    uint16_t best = 0;
+    size_t maxLen = lookahead < DEFLATE_MAX_MATCH ? lookahead : DEFLATE_MAX_MATCH;
+    int chain = DEFLATE_MAX_CHAIN;
+
+    while (candidate > 0 && chain-- > 0) {
+      size_t pos = candidate - 1;
+      if (pos >= strstart || strstart - pos > SYNC_DEFLATE_WINDOW)
+        break;
+      size_t len = 0;
+      while (len < maxLen && window[pos + len] == window[strstart + len])
+        len++;
+      if (len > best) {
+        best = len;
+        distance = strstart - pos;
+        if (len == maxLen)
+          break;
+      }
+      candidate = prev[pos & (SYNC_DEFLATE_WINDOW - 1)];
+    }
+    return best;
+  }
+
+  // Emit the next token (or the stream header / trailer) into out[]
+  void step() {
+    switch (stage) {
+    case STAGE_HEADER:
+      out[outLen++] = 0x78; // zlib: deflate, 32K window
+      out[outLen++] = 0x01; // no dictionary, fastest level
+      putBits(1, 1);        // BFINAL: single block
+      putBits(1, 2);        // BTYPE 01: fixed Huffman codes
+      stage = STAGE_DATA;
+      return;
+
+    case STAGE_DATA: {
+      fillWindow();
+      if (lookahead == 0) {
+        putSymbol(256); // end of block
+        if (bitCount > 0)
+          putBits(0, 8 - bitCount);
+        stage = STAGE_TRAILER;
+        return;
+      }
+
+      uint16_t len = 0;
+      uint16_t dist = 0;
+      if (lookahead >= DEFLATE_MIN_MATCH)
+        len = longestMatch(insertHash(strstart), dist);
+
+      if (len >= DEFLATE_MIN_MATCH) {
+        putMatch(len, dist);
+        for (uint16_t i = 1; i < len; i++) {
+          if (lookahead - i >= DEFLATE_MIN_MATCH)
+            insertHash(strstart + i);
+        }
+        strstart += len;
+        lookahead -= len;
+      } else {
+        putSymbol(window[strstart]);
+        strstart++;
+        lookahead--;
+      }
+      return;
+    }
+
+    case STAGE_TRAILER: {
+      uint32_t adler = (adlerB << 16) | adlerA;
+      out[outLen++] = adler >> 24;
+      out[outLen++] = adler >> 16;
+      out[outLen++] = adler >> 8;
+      out[outLen++] = adler;
+      stage = STAGE_DONE;
+      return;
+    }
+    }
+  }
+
+  size_t produce(char *dst, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+      if (outPos < outLen) {
+        dst[n++] = (char)out[outPos++];
+        continue;
+      }
+      outLen = outPos = 0;
+      if (stage == STAGE_DONE)
+        break;
+      step();
+    }
+    produced += n;
+    return n;
+  }
+};
+
+// ==========================================
+//  SYNC TRANSPORT
+// ==========================================
+// How sync requests reach the server. syncStart() picks WiFi when it is
+// connected and otherwise the SIM800L's GPRS bearer (gsm_manager.h). Both
+// carry the same requests and bodies.
+
+struct SyncTransport {
+  const char *name;
+  bool (*acquire)(); // true once the link may be used (never blocks)
+  // GET (body nullptr) or POST; returns the HTTP status, <= 0 on failure
+  int (*request)(const char *url, Stream *body, size_t length, bool deflate,
+                 String &response);
+  void (*release)(); // the sync job is done with the link
+};
+
+bool wifiAcquire() { return true; }
+
+int wifiRequest(const char *url, Stream *body, size_t length, bool deflate,
+                String &response) {
   HTTPClient http;
-  http.begin(SERVER_URL);
-  http.addHeader("Content-Type", "application/json");
-  http.setTimeout(15000); // 15 second timeout
+  http.begin(url);
+  int httpCode;
+  if (body) {
+    http.addHeader("Content-Type", "application/json");
+    if (deflate)
+      http.addHeader("Content-Encoding", "deflate");
+    http.setTimeout(15000); // 15 second timeout
+    httpCode = http.sendRequest("POST", body, length);
+  } else {
+    http.setTimeout(5000);
+    httpCode = http.GET();
+  }
+
+  if (httpCode > 0)
+    response = http.getString();
+  else
+    logLine("Sync: HTTP error %d", httpCode); // HTTPC_ERROR_* codes
+  http.end();
+  return httpCode;
+}
+
+void wifiRelease() {}
+
+const SyncTransport wifiTransport = {"WiFi", wifiAcquire, wifiRequest,
+                                     wifiRelease};
+const SyncTransport gprsTransport = {"GPRS", gprsAcquire, gprsHttp,
+                                     gprsRelease};
+const SyncTransport *syncTransport = &wifiTransport;
+
+// Where sync results go. The sketch redirects these when the RTC is owned
+// by another task (see pipeline.h)
+void (*syncTimeHandler)(int year, int month, int day, int hour, int minute,
+                        int second) = rtcSetTime;
+void (*syncDoneHandler)(bool success) = nullptr;
 
-  // Build JSON payload
-  JsonDocument doc;
-  doc["farmers_csv"] = farmersData;
-  doc["datalog_csv"] = datalogData;
+#if SYNC_COMPRESS
+// Compressor state lives in BSS rather than on the worker task's stack
+SyncDeflateStream syncDeflate;
+#endif
 
-  String jsonPayload;
-  serializeJson(doc, jsonPayload);
+// Apply the SMS settings and server time that come back with a sync
+void applySyncResponse(JsonDocument &respDoc) {
+  // Save SMS settings from server if available
+  if (respDoc.containsKey("sms_settings")) {
+    bool smsEn = respDoc["sms_settings"]["enabled"] | false;
+    const char *smsTmpl = respDoc["sms_settings"]["template"] | "";
+    if (*smsTmpl) {
+      SdGuard card; // the io worker renders reports from it
+      saveSmsConfig(smsEn, smsTmpl);
+      loadSmsConfig(); // Reload into memory
+      Serial.println("Sync: SMS settings updated from server");
+    }
+  }
+
+  // Update RTC from server time if available
+  if (respDoc.containsKey("server_time")) {
+    int yr = respDoc["server_time"]["year"] | 0;
+    int mo = respDoc["server_time"]["month"] | 0;
+    int dy = respDoc["server_time"]["day"] | 0;
+    int hr = respDoc["server_time"]["hour"] | 0;
+    int mn = respDoc["server_time"]["minute"] | 0;
+    int sc = respDoc["server_time"]["second"] | 0;
+    if (yr > 2020) {
+      syncTimeHandler(yr, mo, dy, hr, mn, sc);
+      Serial.println("Sync: RTC updated from server time");
+    }
+  }
+}
+
+enum SyncBatchResult {
+  BATCH_ACKED,
+  BATCH_FAILED,
+  BATCH_RESEND_FARMERS // server's registry differs, send it in full
+};
 
-  Serial.println("Sync: Sending " + String(jsonPayload.length()) +
-                 " bytes to server...");
+// Upload one configured batch
+// Returns BATCH_ACKED only if the server acknowledged this batch number
+SyncBatchResult syncBatch(SyncPayloadStream &payload, int batchNo, bool last) {
+  String response;
 
-  int httpCode = http.POST(jsonPayload);
+#if SYNC_COMPRESS
+  syncDeflate.begin(&payload);
+  size_t payloadSize = syncDeflate.measure();
+
+  logLine("Sync: Streaming batch %d over %s (%lu bytes, %lu raw)...",
+          batchNo, syncTransport->name, (unsigned long)payloadSize,
+          (unsigned long)syncDeflate.inputSize());
+
+  int httpCode = syncTransport->request(SERVER_URL, &syncDeflate, payloadSize,
+                                        true, response);
+  syncDeflate.end();
+#else
+  size_t payloadSize = payload.measure();
+
+  logLine("Sync: Streaming batch %d over %s (%lu bytes)...", batchNo,
+          syncTransport->name, (unsigned long)payloadSize);
+
+  int httpCode = syncTransport->request(SERVER_URL, &payload, payloadSize,
+                                        false, response);
+  payload.end();
+#endif
 
   if (httpCode > 0) {
-    String response = http.getString();
-    Serial.println("Sync: Server responded with code " + String(httpCode));
-    Serial.println("Sync: Response: " + response);
+    logLine("Sync: Server responded with code %d", httpCode);
+    logLine("Sync: Response: %s", response.c_str());
 
     if (httpCode == 200) {
       // Parse server response to check for success
@@ -84,50 +828,207 @@ bool syncToServer(String farmersData, String datalogData) {
 
       if (!error) {
         bool success = respDoc["success"] | false;
-        if (success) {
-          Serial.println("Sync: Server confirmed success!");
-
-          // Save SMS settings from server if available
-          if (respDoc.containsKey("sms_settings")) {
-            bool smsEn = respDoc["sms_settings"]["enabled"] | false;
-            String smsTmpl = respDoc["sms_settings"]["template"] | "";
-            if (smsTmpl.length() > 0) {
-              saveSmsConfig(smsEn, smsTmpl);
-              loadSmsConfig(); // Reload into memory
-              Serial.println("Sync: SMS settings updated from server");
-            }
-          }
-
-          // Update RTC from server time if available
-          if (respDoc.containsKey("server_time")) {
-            int yr = respDoc["server_time"]["year"] | 0;
-            int mo = respDoc["server_time"]["month"] | 0;
-            int dy = respDoc["server_time"]["day"] | 0;
-            int hr = respDoc["server_time"]["hour"] | 0;
-            int mn = respDoc["server_time"]["minute"] | 0;
-            int sc = respDoc["server_time"]["second"] | 0;
-            if (yr > 2020) {
-              rtcSetTime(yr, mo, dy, hr, mn, sc);
-              Serial.println("Sync: RTC updated from server time");
-            }
-          }
-
-          http.end();
-          return true;
+        int ackBatch = respDoc["batch"] | -1;
+        if (success && ackBatch == batchNo) {
+          logLine("Sync: Server acknowledged batch %d", batchNo);
+          if (last)
+            applySyncResponse(respDoc);
+          return BATCH_ACKED;
+        } else if (respDoc["farmers_resend"] | false) {
+          Serial.println("Sync: Server asked for the full farmer registry");
+          return BATCH_RESEND_FARMERS;
+        } else if (success) {
+          logLine("Sync: Acknowledgement for wrong batch %d", ackBatch);
         } else {
-          String msg = respDoc["message"] | "Unknown error";
-          Serial.println("Sync: Server reported error: " + msg);
+          const char *msg = respDoc["message"] | "Unknown error";
+          logLine("Sync: Server reported error: %s", msg);
         }
       } else {
         Serial.println("Sync: Could not parse server response");
       }
     }
+  }
+
+  return BATCH_FAILED;
+}
+
+// Sync data to server - upload farmers and data logs
+// The log goes up in batches of SYNC_BATCH_RECORDS records of one segment,
+// oldest segment first, each streamed from SD and acknowledged by the
+// server before the next one. The acknowledged offset is saved on SD, so an
+// interrupted sync resumes at the first unacknowledged batch, and a sealed
+// segment is deleted as soon as all of it is acknowledged.
+// Farmers ride along with the first batch: only rows appended since the last
+// acknowledged sync, plus a checksum of the whole registry. If the server's
+// copy does not match it asks for a full resend of the registry.
+// The job runs one upload attempt per syncStep(), so syncTask() can carry it
+// in the background between other tasks. Without WiFi it goes over GPRS,
+// once the GSM worker has handed over the modem. The card lock is held
+// while a step reads or moves the offsets, never during the request.
+
+enum SyncJobState { SYNC_IDLE, SYNC_RUNNING, SYNC_SUCCEEDED, SYNC_FAILED };
+
+struct SyncJob {
+  SyncJobState state = SYNC_IDLE;
+  uint32_t segment = 0; // log segment of the current batch
+  uint32_t start = 0;   // offset in the segment
+  uint32_t end = 0;
+  int batchNo = 0;
+  int attempt = 0;
+  bool last = false;
+  bool batchReady = false; // start/end/last set for batchNo
+  bool farmersFull = false;
+  uint32_t farmersEnd = 0;
+};
+
+SyncJob syncJob;
+SyncPayloadStream syncPayload;
+
+// Begin a sync job; returns false without WiFi or GPRS, or while one is
+// running
+bool syncStart() {
+  if (syncJob.state == SYNC_RUNNING)
+    return false;
+  if (isWiFiConnected()) {
+    syncTransport = &wifiTransport;
+  } else if (gprsAvailable()) {
+    syncTransport = &gprsTransport;
+  } else {
+    Serial.println("Sync: No WiFi or GPRS connection");
+    syncJob.state = SYNC_FAILED;
+    return false;
+  }
+  logLine("Sync: Using %s", syncTransport->name);
+
+  // Journaled records go into the files the upload reads
+  SdGuard card;
+  journalCheckpoint();
+
+  syncJob = SyncJob();
+  syncJob.segment = datalogSyncSegment();
+  syncJob.start = datalogSyncStart();
+  syncJob.state = SYNC_RUNNING;
+
+  if (syncJob.start > datalogDataStart(syncJob.segment))
+    logLine("Sync: Resuming at segment %lu offset %lu",
+            (unsigned long)syncJob.segment, (unsigned long)syncJob.start);
+  return true;
+}
+
+// Make one upload attempt; returns the job state afterwards
+SyncJobState syncStep() {
+  SyncJob &job = syncJob;
+  if (job.state != SYNC_RUNNING)
+    return job.state;
+  if (!syncTransport->acquire())
+    return job.state; // modem still busy with an SMS
+
+  {
+    SdGuard card;
+    if (!job.batchReady) {
+      job.end = datalogBatchEnd(job.segment, job.start, SYNC_BATCH_RECORDS);
+      // A sealed segment with no whole record left (at most a torn one)
+      // has nothing to send: drop it and go on with the next
+      while (job.segment != logManifest.active && job.end == job.start) {
+        datalogAcknowledge(job.segment, job.start);
+        job.segment = datalogSyncSegment();
+        job.start = datalogSyncStart();
+        job.end = datalogBatchEnd(job.segment, job.start, SYNC_BATCH_RECORDS);
+      }
+      // Sealed segments are complete; the active one may still grow
+      job.last = (job.segment == logManifest.active) &&
+                 (job.end == job.start || job.end >= sdCounters.logBytes);
+      job.attempt = 0;
+      job.batchReady = true;
+    }
+
+    // Re-configure every attempt: readings may have been added meanwhile
+    syncPayload.configure(job.batchNo, job.segment, job.start, job.end);
+    if (job.batchNo == 0) {
+      // The count and checksum come from the RAM index, so farmers
+      // registered since syncStart() must be in the rows sent too
+      journalCheckpoint();
+      uint32_t farmersStart = farmersSyncStart(job.farmersFull);
+      job.farmersEnd = farmersSyncEnd(farmersStart);
+      syncPayload.configureFarmers(farmersStart, job.farmersEnd,
+                                   job.farmersFull, farmerIndexCount,
+                                   farmerRegistryChecksum());
+      syncPayload.configureDiag(diagSummary);
+    }
+  }
+  if (job.attempt > 0)
+    logLine("Sync: Retrying batch %d", job.batchNo);
+
+  SyncBatchResult result = syncBatch(syncPayload, job.batchNo, job.last);
+  if (result == BATCH_RESEND_FARMERS && !job.farmersFull) {
+    job.farmersFull = true; // a registry resend is not a failed attempt
+    return job.state;
+  }
+
+  if (result != BATCH_ACKED) {
+    if (++job.attempt > SYNC_BATCH_RETRIES) {
+      logLine("Sync: Stopped at segment %lu offset %lu, next sync resumes "
+              "there",
+              (unsigned long)job.segment, (unsigned long)job.start);
+      job.state = SYNC_FAILED;
+    }
+    return job.state;
+  }
+
+  SdGuard card;
+  if (job.batchNo == 0)
+    farmersAcknowledge(job.farmersEnd);
+  datalogAcknowledge(job.segment, job.end);
+
+  if (job.last) {
+    Serial.println("Sync: All batches acknowledged");
+    job.state = SYNC_SUCCEEDED;
   } else {
-    Serial.println("Sync: HTTP error: " + http.errorToString(httpCode));
+    // The next batch continues the segment, or starts the next one once
+    // this one has been acknowledged and deleted
+    job.segment = datalogSyncSegment();
+    job.start = datalogSyncStart();
+    job.batchNo++;
+    job.batchReady = false;
   }
+  return job.state;
+}
 
-  http.end();
-  return false;
+bool syncRunning() { return syncJob.state == SYNC_RUNNING; }
+
+bool notifySyncComplete(bool success);
+
+// Finish a job: on success the acknowledged readings leave the SD card
+void syncComplete() {
+  bool success = (syncJob.state == SYNC_SUCCEEDED);
+  if (success) {
+    // Server confirmed - clear data logs (keep farmers!)
+    SdGuard card;
+    clearDataLogs();
+  }
+  notifySyncComplete(success);
+  syncTransport->release();
+  if (syncDoneHandler)
+    syncDoneHandler(success);
+}
+
+// Scheduler task: carry a running sync one upload attempt per tick
+void syncTask() {
+  if (syncJob.state != SYNC_RUNNING)
+    return;
+  if (syncStep() != SYNC_RUNNING)
+    syncComplete();
+}
+
+// Run a whole sync now (blocking); returns true once every batch has been
+// acknowledged. Does not clear the log; see syncComplete(). Over GPRS the
+// GSM worker must be running to hand over the modem.
+bool syncToServer() {
+  if (!syncStart())
+    return false;
+  while (syncStep() == SYNC_RUNNING) {
+  }
+  return syncJob.state == SYNC_SUCCEEDED;
 }
 
 // Check if the dashboard has requested a sync
@@ -158,20 +1059,13 @@ bool checkSyncRequest() {
   return false;
 }
 
-// Notify server that sync is complete
+// Notify server that sync is complete (over the sync's own transport)
 bool notifySyncComplete(bool success) {
-  if (!isWiFiConnected())
-    return false;
-
-  HTTPClient http;
-  String url = String(SYNC_CHECK_URL) +
-               "?action=complete&status=" + (success ? "completed" : "failed");
-  http.begin(url);
-  http.setTimeout(5000);
-
-  int httpCode = http.GET();
-  http.end();
-
+  char url[sizeof(SYNC_CHECK_URL) + 40];
+  snprintf(url, sizeof(url), "%s?action=complete&status=%s", SYNC_CHECK_URL,
+           success ? "completed" : "failed");
+  String response;
+  int httpCode = syncTransport->request(url, nullptr, 0, false, response);
   return (httpCode == 200);
 }
 
@@ -0,0 +1,201 @@
+// Hot paths of a field day at 100, 1000 and 9999 farmers (IDs are four
+// digits, so 9999 is the largest registry): farmer lookup, appending a
+// reading, building a sync body, compressing it and rendering the SMS
+// report (against the old String::replace version).
+#include "ESP32_FARM.ino"
+#include "card.h"
+#include "sms_baseline.h"
+#include <benchmark/benchmark.h>
+#include <random>
+
+namespace {
+
+const SoilData READING = {45.2f, 22.3f, 450, 6.8f, 120, 85, 200, true, 1, 8};
+
+// The card for `farmers`, kept between runs of the same size
+void useRegistry(int farmers) {
+  static int loaded = -1;
+  if (loaded == farmers)
+    return;
+  simSdWithFarmers(farmers);
+  for (int i = 0; i < SYNC_BATCH_RECORDS; i++)
+    saveReading("0001", "2026-01-01 09:00:00", 1767258000, READING);
+  journalCheckpoint();
+  loaded = farmers;
+}
+
+void farmerIdOf(int n, char *id) { snprintf(id, 5, "%04d", n); }
+
+void BM_FarmerLookup(benchmark::State &state) {
+  int farmers = state.range(0);
+  useRegistry(farmers);
+  char id[5];
+  int n = 0;
+  for (auto _ : state) {
+    farmerIdOf(n % farmers + 1, id);
+    FarmerPhone phone = getFarmerPhone(id);
+    benchmark::DoNotOptimize(phone);
+    n += 7919;
+  }
+}
+BENCHMARK(BM_FarmerLookup)->Arg(100)->Arg(1000)->Arg(9999);
+
+void BM_LogAppend(benchmark::State &state) {
+  int farmers = state.range(0);
+  useRegistry(farmers);
+  char id[5];
+  int n = 0;
+  for (auto _ : state) {
+    farmerIdOf(n % farmers + 1, id);
+    benchmark::DoNotOptimize(
+        saveReading(id, "2026-01-01 09:00:00", 1767258000, READING));
+    n += 7919;
+  }
+  // Leave the registry as it was for the next benchmark
+  sdFlush();
+  journalCheckpoint();
+}
+BENCHMARK(BM_LogAppend)->Arg(100)->Arg(1000)->Arg(9999);
+
+// First batch of a full sync: the whole registry plus one batch of log
+void BM_SyncPayloadBuild(benchmark::State &state) {
+  useRegistry(state.range(0));
+  uint32_t segment = datalogSyncSegment();
+  uint32_t start = datalogDataStart(segment);
+  uint32_t end = datalogBatchEnd(segment, start, SYNC_BATCH_RECORDS);
+  uint32_t farmersStart = farmersSyncStart(true);
+  uint32_t farmersEnd = farmersSyncEnd(farmersStart);
+  char block[1460];
+  size_t bytes = 0;
+  for (auto _ : state) {
+    syncPayload.configure(0, segment, start, end);
+    syncPayload.configureFarmers(farmersStart, farmersEnd, true,
+                                 farmerIndexCount, farmerRegistryChecksum());
+    size_t size = syncPayload.measure();
+    size_t n;
+    while ((n = syncPayload.readBytes(block, sizeof(block))) > 0)
+      benchmark::DoNotOptimize(block);
+    syncPayload.end();
+    bytes += size;
+  }
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_SyncPayloadBuild)->Arg(100)->Arg(1000)->Arg(9999);
+
+#if SYNC_COMPRESS
+// A datalog of `rows` readings from 100 farmers over a few weeks, with the
+// jitter a real probe has, written straight to a segment file of its own
+// (the payload stream only reads the file). Returns its size.
+uint32_t writeSyntheticLog(uint32_t segment, int rows) {
+  LogPath path = logSegmentPath(segment);
+  FILE *f = fopen(fakeSdPath(path.c_str()).c_str(), "w");
+  std::mt19937 rng(7);
+  std::normal_distribution<float> jitter(0, 1);
+#if DATALOG_BINARY
+  for (int r = 0; r < rows; r++) {
+    SoilData d = READING;
+    d.humidity += 3 * jitter(rng);
+    d.ph += 0.2f * jitter(rng);
+    LogRecord rec;
+    packLogRecord(rng() % 100 + 1, 1767258000 + r * 97, d, rec);
+    fwrite(&rec, sizeof(rec), 1, f);
+  }
+#else
+  fprintf(f, "%s\r\n", DATALOG_CSV_HEADER);
+  for (int r = 0; r < rows; r++) {
+    Timestamp time = epochTimestamp(1767258000 + r * 97);
+    fprintf(f,
+            "%04u,%s,%.1f,%.1f,%.0f,%.1f,%.0f,%.0f,%.0f,1,8,%.1f,%.1f,%.0f,"
+            "%.2f,%.0f,%.0f,%.0f\r\n",
+            (unsigned)(rng() % 100 + 1), time.c_str(),
+            READING.humidity + 3 * jitter(rng),
+            READING.temperature + jitter(rng),
+            READING.ec + 20 * jitter(rng), READING.ph + 0.2f * jitter(rng),
+            READING.nitrogen + 5 * jitter(rng),
+            READING.phosphorus + 5 * jitter(rng),
+            READING.potassium + 10 * jitter(rng), 0.3f + 0.1f * jitter(rng),
+            0.1f + 0.05f * jitter(rng), 3 + jitter(rng),
+            0.03f + 0.01f * jitter(rng), 1 + jitter(rng), 1 + jitter(rng),
+            2 + jitter(rng));
+  }
+#endif
+  fclose(f);
+  return sdFileSize(path.c_str());
+}
+
+// Deflating a sync body of 1k, 10k and 100k log rows in one pass, as
+// HTTPClient pulls it; bytes are the uncompressed body
+void BM_SyncDeflate(benchmark::State &state) {
+  useRegistry(100);
+  uint32_t segment = logManifest.active + 1; // not in the manifest
+  uint32_t end = writeSyntheticLog(segment, state.range(0));
+  syncPayload.configure(0, segment, datalogDataStart(segment), end);
+  syncDeflate.begin(&syncPayload);
+  size_t packed = syncDeflate.measure();
+  size_t raw = syncDeflate.inputSize();
+
+  char block[1460];
+  for (auto _ : state) {
+    syncDeflate.begin(&syncPayload);
+    while (syncDeflate.readBytes(block, sizeof(block)) > 0)
+      benchmark::DoNotOptimize(block);
+    syncDeflate.end();
+  }
+  state.SetBytesProcessed(state.iterations() * raw);
+  state.counters["ratio"] = (double)raw / packed;
+  SD.remove(logSegmentPath(segment));
+}
+BENCHMARK(BM_SyncDeflate)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(
+    benchmark::kMillisecond);
+#endif
+
+const char SMS_TEMPLATE[] =
+    "Farm Report for ID:{farmer_id}\\nMoisture:{humidity}%\\nTemp:"
+    "{temperature}C\\npH:{ph}\\nEC:{ec}\\nN:{nitrogen} P:{phosphorus} K:"
+    "{potassium}\\nDate:{timestamp}";
+
+// The report a save sends: phone from the registry, then the template
+void BM_SmsRender(benchmark::State &state) {
+  int farmers = state.range(0);
+  useRegistry(farmers);
+  compileSmsTemplate(SMS_TEMPLATE);
+  char id[5];
+  char text[PIPE_TEXT_MAX];
+  int segments;
+  int n = 0;
+  for (auto _ : state) {
+    farmerIdOf(n % farmers + 1, id);
+    FarmerPhone phone = getFarmerPhone(id);
+    benchmark::DoNotOptimize(phone);
+    benchmark::DoNotOptimize(renderSmsMessage(
+        id, READING, "2026-01-01 09:00:00", text, sizeof(text), segments));
+    n += 7919;
+  }
+}
+BENCHMARK(BM_SmsRender)->Arg(100)->Arg(1000)->Arg(9999);
+
+// The same report built with String::replace, as before the template was
+// compiled
+void BM_SmsReplace(benchmark::State &state) {
+  int farmers = state.range(0);
+  useRegistry(farmers);
+  String tmpl = SMS_TEMPLATE;
+  char id[5];
+  int n = 0;
+  for (auto _ : state) {
+    farmerIdOf(n % farmers + 1, id);
+    FarmerPhone phone = getFarmerPhone(id);
+    benchmark::DoNotOptimize(phone);
+    String msg = buildSmsMessage(
+        tmpl, id, READING.humidity, READING.temperature, READING.ec,
+        READING.ph, READING.nitrogen, READING.phosphorus, READING.potassium,
+        "2026-01-01 09:00:00");
+    benchmark::DoNotOptimize(msg);
+    n += 7919;
+  }
+}
+BENCHMARK(BM_SmsReplace)->Arg(100)->Arg(1000)->Arg(9999);
+
+} // namespace
+
+BENCHMARK_MAIN();
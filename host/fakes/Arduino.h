@@ -0,0 +1,251 @@
+#ifndef FAKE_ARDUINO_H
+#define FAKE_ARDUINO_H
+
+// ==========================================
+//  HOST FAKE: Arduino core
+// ==========================================
+// Just enough of the ESP32 Arduino core for the sketch to compile and run
+// on a PC: String, Print/Stream, pins (no-ops) and a virtual clock. Time
+// only moves when the firmware calls delay() or a test advances it, so
+// runs are repeatable and fast.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HEX 16
+#define DEC 10
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+#define F(x) (x)
+#define PROGMEM
+
+// ---------- Virtual clock ----------
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+inline void yield() {}
+
+// Move the clock forward without going through delay()
+void fakeClockAdvance(unsigned long us);
+// Called after every delay(), e.g. to play a peripheral's side of a bus
+extern void (*fakeDelayHook)();
+
+// ---------- Pins ----------
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int digitalRead(int) { return LOW; }
+
+// ---------- String ----------
+
+// Heap-backed like the real one
+class String {
+public:
+  String() {}
+  String(const char *c) : s(c ? c : "") {}
+  String(const std::string &x) : s(x) {}
+  explicit String(char c) : s(1, c) {}
+  String(int v, int base = 10) { format(base == 16 ? "%x" : "%d", v); }
+  String(unsigned v, int base = 10) { format(base == 16 ? "%x" : "%u", v); }
+  String(long v, int base = 10) { format(base == 16 ? "%lx" : "%ld", v); }
+  String(unsigned long v, int base = 10) {
+    format(base == 16 ? "%lx" : "%lu", v);
+  }
+  String(double v, int decimals = 2) { format("%.*f", decimals, v); }
+
+  unsigned length() const { return s.size(); }
+  const char *c_str() const { return s.c_str(); }
+  bool reserve(unsigned n) {
+    s.reserve(n);
+    return true;
+  }
+  bool isEmpty() const { return s.empty(); }
+
+  String &operator+=(const String &o) {
+    s += o.s;
+    return *this;
+  }
+  String &operator+=(const char *o) {
+    s += o;
+    return *this;
+  }
+  String &operator+=(char c) {
+    s += c;
+    return *this;
+  }
+  bool concat(const char *c, unsigned n) {
+    s.append(c, n);
+    return true;
+  }
+  bool concat(const String &o) {
+    s += o.s;
+    return true;
+  }
+  bool concat(char c) {
+    s += c;
+    return true;
+  }
+
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator==(const char *o) const { return s == o; }
+  bool operator!=(const String &o) const { return s != o.s; }
+  bool operator!=(const char *o) const { return s != o; }
+  char operator[](unsigned i) const { return i < s.size() ? s[i] : 0; }
+  char &operator[](unsigned i) { return s[i]; }
+  char charAt(unsigned i) const { return (*this)[i]; }
+
+  int indexOf(char c, unsigned from = 0) const { return pos(s.find(c, from)); }
+  int indexOf(const char *x, unsigned from = 0) const {
+    return pos(s.find(x, from));
+  }
+  int indexOf(const String &x, unsigned from = 0) const {
+    return pos(s.find(x.s, from));
+  }
+  int lastIndexOf(char c) const { return pos(s.rfind(c)); }
+  String substring(unsigned from) const {
+    return from >= s.size() ? String() : String(s.substr(from));
+  }
+  String substring(unsigned from, unsigned to) const {
+    if (from > to)
+      std::swap(from, to);
+    return from >= s.size() ? String() : String(s.substr(from, to - from));
+  }
+  bool startsWith(const char *p) const { return s.rfind(p, 0) == 0; }
+  bool startsWith(const String &p) const { return startsWith(p.c_str()); }
+  bool endsWith(const char *p) const {
+    size_t n = strlen(p);
+    return s.size() >= n && s.compare(s.size() - n, n, p) == 0;
+  }
+  void trim();
+  void replace(const String &from, const String &to);
+  void remove(unsigned i) {
+    if (i < s.size())
+      s.erase(i);
+  }
+  void remove(unsigned i, unsigned n) {
+    if (i < s.size())
+      s.erase(i, n);
+  }
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+  void toCharArray(char *buf, unsigned n) const {
+    snprintf(buf, n, "%s", s.c_str());
+  }
+
+private:
+  std::string s;
+
+  static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  void format(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+inline String operator+(const String &a, const String &b) {
+  String r(a);
+  r += b;
+  return r;
+}
+inline String operator+(const String &a, const char *b) {
+  String r(a);
+  r += b;
+  return r;
+}
+inline String operator+(const char *a, const String &b) {
+  String r(a);
+  r += b;
+  return r;
+}
+inline String operator+(const String &a, char b) {
+  String r(a);
+  r += b;
+  return r;
+}
+
+// ---------- Print / Stream ----------
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t n) {
+    for (size_t i = 0; i < n; i++)
+      write(buf[i]);
+    return n;
+  }
+  size_t write(const char *text) {
+    return write((const uint8_t *)text, strlen(text));
+  }
+  size_t write(const char *buf, size_t n) {
+    return write((const uint8_t *)buf, n);
+  }
+
+  size_t print(const char *text) { return write(text); }
+  size_t print(const String &text) { return write(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned v, int base = DEC) {
+    return print((unsigned long)v, base);
+  }
+  size_t print(long v, int base = DEC);
+  size_t print(unsigned long v, int base = DEC);
+  size_t print(double v, int decimals = 2);
+
+  template <typename T> size_t println(T v) { return print(v) + println(); }
+  template <typename T> size_t println(T v, int arg) {
+    return print(v, arg) + println();
+  }
+  size_t println() { return write("\r\n"); }
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() {}
+  virtual size_t readBytes(char *buf, size_t n) {
+    size_t i = 0;
+    while (i < n && available() > 0)
+      buf[i++] = (char)read();
+    return i;
+  }
+  size_t readBytes(uint8_t *buf, size_t n) { return readBytes((char *)buf, n); }
+  String readStringUntil(char end) {
+    String r;
+    while (available() > 0) {
+      int c = read();
+      if (c < 0 || c == end)
+        break;
+      r += (char)c;
+    }
+    return r;
+  }
+  void setTimeout(unsigned long) {}
+};
+
+// ---------- ESP32 extras ----------
+
+class EspClass {
+public:
+  uint32_t getFreeHeap() { return 0; }
+  void restart() {}
+};
+extern EspClass ESP;
+
+#include "HardwareSerial.h"
+
+#endif // FAKE_ARDUINO_H
@@ -0,0 +1,83 @@
+#ifndef FAKE_ARDUINO_JSON_H
+#define FAKE_ARDUINO_JSON_H
+
+#include "Arduino.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ==========================================
+//  HOST FAKE: ArduinoJson (reading only)
+// ==========================================
+// The firmware only parses server replies and reads members with a
+// default (doc["a"]["b"] | fallback), so that is all this covers.
+
+struct FakeJsonNode {
+  enum Type { NUL, BOOL, NUMBER, STRING, OBJECT, ARRAY } type = NUL;
+  bool boolean = false;
+  double number = 0;
+  std::string text;
+  std::map<std::string, std::shared_ptr<FakeJsonNode>> members;
+  std::vector<std::shared_ptr<FakeJsonNode>> items;
+};
+
+class JsonVariant {
+public:
+  JsonVariant() {}
+  explicit JsonVariant(std::shared_ptr<FakeJsonNode> node) : node(node) {}
+
+  JsonVariant operator[](const char *key) const {
+    if (!node || node->type != FakeJsonNode::OBJECT)
+      return JsonVariant();
+    auto it = node->members.find(key);
+    return it == node->members.end() ? JsonVariant() : JsonVariant(it->second);
+  }
+  JsonVariant operator[](int index) const {
+    if (!node || node->type != FakeJsonNode::ARRAY ||
+        index >= (int)node->items.size())
+      return JsonVariant();
+    return JsonVariant(node->items[index]);
+  }
+
+  bool operator|(bool fallback) const {
+    return is(FakeJsonNode::BOOL) ? node->boolean : fallback;
+  }
+  int operator|(int fallback) const {
+    return is(FakeJsonNode::NUMBER) ? (int)node->number : fallback;
+  }
+  long operator|(long fallback) const {
+    return is(FakeJsonNode::NUMBER) ? (long)node->number : fallback;
+  }
+  unsigned long operator|(unsigned long fallback) const {
+    return is(FakeJsonNode::NUMBER) ? (unsigned long)node->number : fallback;
+  }
+  const char *operator|(const char *fallback) const {
+    return is(FakeJsonNode::STRING) ? node->text.c_str() : fallback;
+  }
+  bool containsKey(const char *key) const { return !(*this)[key].isNull(); }
+  bool isNull() const { return !node || node->type == FakeJsonNode::NUL; }
+
+protected:
+  std::shared_ptr<FakeJsonNode> node;
+
+  bool is(FakeJsonNode::Type type) const { return node && node->type == type; }
+  friend struct DeserializationError
+  deserializeJson(class JsonDocument &doc, const char *json);
+};
+
+class JsonDocument : public JsonVariant {};
+
+struct DeserializationError {
+  bool failed = false;
+  explicit operator bool() const { return failed; }
+  const char *c_str() const { return failed ? "InvalidInput" : "Ok"; }
+};
+
+DeserializationError deserializeJson(JsonDocument &doc, const char *json);
+inline DeserializationError deserializeJson(JsonDocument &doc,
+                                            const String &json) {
+  return deserializeJson(doc, json.c_str());
+}
+
+#endif // FAKE_ARDUINO_JSON_H
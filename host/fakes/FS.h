@@ -0,0 +1,105 @@
+#ifndef FAKE_FS_H
+#define FAKE_FS_H
+
+#include "Arduino.h"
+#include <memory>
+#include <string>
+
+// ==========================================
+//  HOST FAKE: file system
+// ==========================================
+// Files live under a host directory (fakeSdRoot(), a fresh temporary one
+// per process unless a test mounts another). Modes follow the ESP32 VFS:
+// FILE_WRITE truncates, FILE_APPEND always writes at the end, "r+" updates
+// in place.
+//
+// Power cuts: with fakeSdWriteBudget >= 0, the write that would go past
+// that many bytes lands only partly and the process ends at once with
+// FAKE_POWER_CUT_EXIT. Crash tests run the firmware in a fork()ed child
+// and look at the card afterwards.
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+#define FAKE_POWER_CUT_EXIT 3
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+extern long fakeSdWriteBudget;   // bytes until the power cut; -1 = never
+extern uint64_t fakeSdBytesWritten; // all file writes so far
+
+namespace fs {
+
+class File : public Stream {
+public:
+  File() {}
+  File(FILE *fp, const char *path);
+
+  operator bool() const { return handle && handle->fp; }
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t *buf, size_t n);
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  void flush() override;
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  const char *name() const;
+  const char *path() const { return handle ? handle->path.c_str() : ""; }
+  bool isDirectory() const { return false; }
+
+private:
+  // Copies share one open file, as on the device
+  struct Handle {
+    FILE *fp = nullptr;
+    std::string path;
+    ~Handle() {
+      if (fp)
+        fclose(fp);
+    }
+  };
+  std::shared_ptr<Handle> handle;
+};
+
+class FS {
+public:
+  File open(const char *path, const char *mode = FILE_READ,
+            bool create = false);
+  File open(const String &path, const char *mode = FILE_READ) {
+    return open(path.c_str(), mode);
+  }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to);
+  bool rename(const String &from, const String &to) {
+    return rename(from.c_str(), to.c_str());
+  }
+  bool mkdir(const char *path);
+  bool mkdir(const String &path) { return mkdir(path.c_str()); }
+  bool rmdir(const char *path);
+};
+
+} // namespace fs
+
+using fs::File;
+
+// ---------- Test side ----------
+
+// Host directory behind "/" (created on first use)
+const std::string &fakeSdRoot();
+// Use another directory from now on (e.g. one shared with a forked child)
+void fakeSdMount(const std::string &dir);
+// Delete everything on the card
+void fakeSdWipe();
+// Host path of a card path
+std::string fakeSdPath(const char *path);
+
+#endif // FAKE_FS_H
@@ -0,0 +1,69 @@
+#ifndef FAKE_HTTP_CLIENT_H
+#define FAKE_HTTP_CLIENT_H
+
+#include "WiFi.h"
+#include <functional>
+#include <map>
+#include <string>
+
+// ==========================================
+//  HOST FAKE: HTTPClient
+// ==========================================
+// Requests go to fakeHttpServer, which a test installs to play sync.php:
+// it sees the method, URL, headers and the whole body (streamed bodies
+// are read out first, as the real client does) and returns the status
+// code, filling in the response body. Without a server every request
+// fails to connect.
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTP_CODE_OK 200
+
+struct FakeHttpRequest {
+  std::string method;
+  std::string url;
+  std::map<std::string, std::string> headers;
+  std::string body;
+};
+
+extern std::function<int(const FakeHttpRequest &, std::string &)>
+    fakeHttpServer;
+
+class HTTPClient {
+public:
+  bool begin(const String &url) {
+    req = FakeHttpRequest();
+    req.url = url.c_str();
+    return true;
+  }
+  bool begin(const char *url) { return begin(String(url)); }
+  void end() {}
+  void setTimeout(uint16_t ms) {}
+  void addHeader(const String &name, const String &value) {
+    req.headers[name.c_str()] = value.c_str();
+  }
+
+  int GET() { return send("GET"); }
+  int POST(const String &body) {
+    req.body = body.c_str();
+    return send("POST");
+  }
+  int sendRequest(const char *method, Stream *stream, size_t size = 0);
+
+  String getString() { return String(response); }
+  int getSize() { return (int)response.size(); }
+  static String errorToString(int code) { return String("HTTP error ") + String(code); }
+
+private:
+  FakeHttpRequest req;
+  std::string response;
+
+  int send(const char *method) {
+    req.method = method;
+    response.clear();
+    return fakeHttpServer ? fakeHttpServer(req, response)
+                          : HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+};
+
+#endif // FAKE_HTTP_CLIENT_H
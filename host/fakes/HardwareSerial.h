@@ -0,0 +1,59 @@
+#ifndef FAKE_HARDWARE_SERIAL_H
+#define FAKE_HARDWARE_SERIAL_H
+
+#include "Arduino.h"
+#include <deque>
+#include <string>
+
+// ==========================================
+//  HOST FAKE: UARTs
+// ==========================================
+// Each port is a loopback pair: bytes the firmware writes collect in tx,
+// and a test (playing the modem or the soil probe) queues the replies in
+// rx. Serial, the debug port, goes to stdout when echo is set.
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial : public Stream {
+public:
+  explicit HardwareSerial(int port) : port(port), keepTx(port != 0) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int rxPin = -1,
+             int txPin = -1) {}
+  void end() {}
+  operator bool() const { return true; }
+
+  int available() override { return (int)rx.size(); }
+  int read() override {
+    if (rx.empty())
+      return -1;
+    int c = rx.front();
+    rx.pop_front();
+    return c;
+  }
+  int peek() override { return rx.empty() ? -1 : rx.front(); }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override {
+    tx.append((const char *)buf, n);
+    if (echo)
+      fwrite(buf, 1, n, stdout);
+    if (!keepTx)
+      tx.clear();
+    return n;
+  }
+  using Print::write;
+
+  // Test side
+  void feed(const char *text) { feed((const uint8_t *)text, strlen(text)); }
+  void feed(const uint8_t *buf, size_t n) { rx.insert(rx.end(), buf, buf + n); }
+
+  int port;
+  std::deque<uint8_t> rx; // waiting for the firmware to read
+  std::string tx; // written by the firmware (when keepTx)
+  bool keepTx;    // off for Serial, which only echoes
+  bool echo = false;
+};
+
+extern HardwareSerial Serial;
+
+#endif // FAKE_HARDWARE_SERIAL_H
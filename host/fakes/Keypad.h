@@ -0,0 +1,37 @@
+#ifndef FAKE_KEYPAD_H
+#define FAKE_KEYPAD_H
+
+#include "Arduino.h"
+#include <deque>
+
+// ==========================================
+//  HOST FAKE: 4x4 keypad
+// ==========================================
+// A test types keys with fakeKeypadType(); each getKey() scan returns the
+// next one.
+
+#define NO_KEY '\0'
+#define makeKeymap(x) ((char *)x)
+
+extern std::deque<char> fakeKeys;
+
+inline void fakeKeypadType(const char *keys) {
+  while (*keys)
+    fakeKeys.push_back(*keys++);
+}
+
+class Keypad {
+public:
+  Keypad(char *keymap, byte *rowPins, byte *colPins, byte rows, byte cols) {}
+  char getKey() {
+    if (fakeKeys.empty())
+      return NO_KEY;
+    char key = fakeKeys.front();
+    fakeKeys.pop_front();
+    return key;
+  }
+  void setDebounceTime(unsigned ms) {}
+  void setHoldTime(unsigned ms) {}
+};
+
+#endif // FAKE_KEYPAD_H
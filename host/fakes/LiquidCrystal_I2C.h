@@ -0,0 +1,76 @@
+#ifndef FAKE_LIQUID_CRYSTAL_I2C_H
+#define FAKE_LIQUID_CRYSTAL_I2C_H
+
+#include "Arduino.h"
+#include <string>
+
+// ==========================================
+//  HOST FAKE: HD44780 behind a PCF8574 backpack
+// ==========================================
+// Keeps the controller's display RAM, so row() shows what a person would
+// read, including text run off the end of a row (the address goes on
+// into the invisible part of the row, not to the next one).
+//
+// Traffic is counted the way the real library sends it: every command or
+// character is two 4-bit halves, each written to the expander three times
+// (data, enable high, enable low), so 6 I2C data bytes per transfer.
+// clear() also holds the bus for its 2 ms, which moves the virtual clock.
+
+#define LCD_FAKE_I2C_PER_TRANSFER 6
+
+class LiquidCrystal_I2C : public Print {
+public:
+  LiquidCrystal_I2C(uint8_t addr, uint8_t cols, uint8_t rows)
+      : cols(cols), rows(rows) {
+    memset(ram, ' ', sizeof(ram));
+  }
+
+  void init() { transfer(6); }
+  void begin() { init(); }
+  void backlight() { i2cBytes++; }
+  void noBacklight() { i2cBytes++; }
+  void clear() {
+    transfer(1);
+    memset(ram, ' ', sizeof(ram));
+    addr = 0;
+    clears++;
+    fakeClockAdvance(2000);
+  }
+  void home() {
+    transfer(1);
+    addr = 0;
+    fakeClockAdvance(2000);
+  }
+  void setCursor(uint8_t col, uint8_t row) {
+    transfer(1);
+    addr = (row % 2) * ROW_BYTES + (col < ROW_BYTES ? col : ROW_BYTES - 1);
+  }
+  size_t write(uint8_t c) override {
+    transfer(1);
+    ram[addr] = (char)c;
+    addr = (addr + 1) % sizeof(ram); // row 0 runs into row 1 and back
+    return 1;
+  }
+  using Print::write;
+
+  // Test side: the visible text of a row
+  std::string row(int r) const { return std::string(ram + r * ROW_BYTES, cols); }
+  void resetCounters() { transfers = i2cBytes = clears = 0; }
+
+  unsigned long transfers = 0; // commands + characters
+  unsigned long i2cBytes = 0;
+  unsigned long clears = 0;
+
+private:
+  static const int ROW_BYTES = 40; // display RAM per row
+  uint8_t cols, rows;
+  char ram[2 * ROW_BYTES];
+  int addr = 0;
+
+  void transfer(int n) {
+    transfers += n;
+    i2cBytes += n * LCD_FAKE_I2C_PER_TRANSFER;
+  }
+};
+
+#endif // FAKE_LIQUID_CRYSTAL_I2C_H
@@ -0,0 +1,72 @@
+#ifndef FAKE_RTCLIB_H
+#define FAKE_RTCLIB_H
+
+#include "Arduino.h"
+#include <ctime>
+
+// ==========================================
+//  HOST FAKE: DS3231
+// ==========================================
+// The RTC ticks with the virtual clock, starting at fakeRtcStart (2026-01-01
+// 00:00:00 UTC unless a test sets it). now() counts as one I2C read.
+
+class DateTime {
+public:
+  DateTime(uint32_t t = 0) : t(t) {}
+  DateTime(const char *date, const char *time) : t(1767225600UL) {}
+  DateTime(uint16_t y, uint8_t mo, uint8_t d, uint8_t h = 0, uint8_t mi = 0,
+           uint8_t s = 0) {
+    struct tm tm = {};
+    tm.tm_year = y - 1900;
+    tm.tm_mon = mo - 1;
+    tm.tm_mday = d;
+    tm.tm_hour = h;
+    tm.tm_min = mi;
+    tm.tm_sec = s;
+    t = (uint32_t)timegm(&tm);
+  }
+
+  uint16_t year() const { return fields().tm_year + 1900; }
+  uint8_t month() const { return fields().tm_mon + 1; }
+  uint8_t day() const { return fields().tm_mday; }
+  uint8_t hour() const { return fields().tm_hour; }
+  uint8_t minute() const { return fields().tm_min; }
+  uint8_t second() const { return fields().tm_sec; }
+  uint32_t unixtime() const { return t; }
+
+private:
+  uint32_t t;
+
+  struct tm fields() const {
+    time_t x = t;
+    struct tm r;
+    gmtime_r(&x, &r);
+    return r;
+  }
+};
+
+extern uint32_t fakeRtcStart;
+
+class RTC_DS3231 {
+public:
+  bool begin() { return present; }
+  bool lostPower() { return false; }
+  void adjust(const DateTime &dt) {
+    offset = dt.unixtime() - millis() / 1000;
+    adjusted = true;
+  }
+  DateTime now() {
+    reads++;
+    return DateTime((adjusted ? offset : fakeRtcStart) +
+                    (uint32_t)(millis() / 1000));
+  }
+
+  bool present = true;
+  unsigned long reads = 0;
+
+private:
+  uint32_t offset = 0;
+  bool adjusted = false;
+};
+
+#endif // FAKE_RTCLIB_H
@@ -0,0 +1,21 @@
+#ifndef FAKE_SD_H
+#define FAKE_SD_H
+
+#include "FS.h"
+
+// The SD card: a fs::FS with a size (fakeSdCardBytes, default 4 GB). The
+// space used is what the files under fakeSdRoot() take.
+class SDFS : public fs::FS {
+public:
+  bool begin(uint8_t ssPin = 5) { return fakeSdPresent; }
+  void end() {}
+  uint64_t totalBytes() { return fakeSdCardBytes; }
+  uint64_t usedBytes();
+
+  bool fakeSdPresent = true;
+  uint64_t fakeSdCardBytes = 4ULL << 30;
+};
+
+extern SDFS SD;
+
+#endif // FAKE_SD_H
@@ -0,0 +1,13 @@
+#ifndef FAKE_SPI_H
+#define FAKE_SPI_H
+
+#include "Arduino.h"
+
+class SPIClass {
+public:
+  void begin(int sck = -1, int miso = -1, int mosi = -1, int ss = -1) {}
+};
+
+extern SPIClass SPI;
+
+#endif // FAKE_SPI_H
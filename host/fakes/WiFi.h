@@ -0,0 +1,47 @@
+#ifndef FAKE_WIFI_H
+#define FAKE_WIFI_H
+
+#include "Arduino.h"
+
+// ==========================================
+//  HOST FAKE: WiFi
+// ==========================================
+// The station connects at once when fakeWifiAvailable is set.
+
+#define WL_IDLE_STATUS 0
+#define WL_NO_SSID_AVAIL 1
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+extern bool fakeWifiAvailable;
+
+class IPAddress {
+public:
+  String toString() const { return "192.168.1.50"; }
+  uint8_t operator[](int i) const {
+    static const uint8_t octets[4] = {192, 168, 1, 50};
+    return octets[i & 3];
+  }
+};
+
+class WiFiClass {
+public:
+  void begin(const char *ssid, const char *password) {
+    connected = fakeWifiAvailable;
+  }
+  int status() { return connected ? WL_CONNECTED : WL_DISCONNECTED; }
+  IPAddress localIP() { return IPAddress(); }
+  bool disconnect(bool wifiOff = false) {
+    connected = false;
+    return true;
+  }
+
+private:
+  bool connected = false;
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient {};
+
+#endif // FAKE_WIFI_H
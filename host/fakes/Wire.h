@@ -0,0 +1,15 @@
+#ifndef FAKE_WIRE_H
+#define FAKE_WIRE_H
+
+#include "Arduino.h"
+
+// The I2C bus itself is not modelled; the LCD and RTC fakes count their
+// own traffic
+class TwoWire {
+public:
+  bool begin(int sda = -1, int scl = -1) { return true; }
+};
+
+extern TwoWire Wire;
+
+#endif // FAKE_WIRE_H
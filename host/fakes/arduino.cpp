@@ -0,0 +1,92 @@
+// Host fakes: Arduino core, clock, UARTs, keypad, RTC
+#include "Arduino.h"
+#include "Keypad.h"
+#include "RTClib.h"
+#include "SPI.h"
+#include "Wire.h"
+
+// ---------- Virtual clock ----------
+
+static unsigned long clockUs = 0;
+void (*fakeDelayHook)() = nullptr;
+
+unsigned long millis() { return clockUs / 1000; }
+unsigned long micros() { return clockUs; }
+void fakeClockAdvance(unsigned long us) { clockUs += us; }
+
+void delay(unsigned long ms) {
+  clockUs += ms * 1000;
+  if (fakeDelayHook)
+    fakeDelayHook();
+}
+
+void delayMicroseconds(unsigned int us) { clockUs += us; }
+
+// ---------- String ----------
+
+void String::format(const char *fmt, ...) {
+  char buf[64];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  s = buf;
+}
+
+void String::trim() {
+  size_t first = s.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos) {
+    s.clear();
+    return;
+  }
+  size_t last = s.find_last_not_of(" \t\r\n");
+  s = s.substr(first, last - first + 1);
+}
+
+void String::replace(const String &from, const String &to) {
+  if (from.s.empty())
+    return;
+  size_t p = 0;
+  while ((p = s.find(from.s, p)) != std::string::npos) {
+    s.replace(p, from.s.size(), to.s);
+    p += to.s.size();
+  }
+}
+
+// ---------- Print ----------
+
+size_t Print::print(long v, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%ld", v);
+  return write(buf);
+}
+
+size_t Print::print(unsigned long v, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", v);
+  return write(buf);
+}
+
+size_t Print::print(double v, int decimals) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+  return write(buf);
+}
+
+size_t Print::printf(const char *fmt, ...) {
+  char buf[512];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  return write(buf);
+}
+
+// ---------- Devices ----------
+
+HardwareSerial Serial(0);
+EspClass ESP;
+SPIClass SPI;
+TwoWire Wire;
+std::deque<char> fakeKeys;
+uint32_t fakeRtcStart = 1767225600UL; // 2026-01-01 00:00:00 UTC
@@ -0,0 +1,179 @@
+// Host fakes: SD card backed by a directory, with power-cut injection
+#include "SD.h"
+#include <filesystem>
+#include <unistd.h>
+
+namespace stdfs = std::filesystem;
+
+long fakeSdWriteBudget = -1;
+uint64_t fakeSdBytesWritten = 0;
+
+SDFS SD;
+
+static std::string sdRoot;
+static std::string tempRoot; // made here, removed at exit by its owner
+static pid_t tempOwner = 0;
+
+static void removeTempRoot() {
+  if (getpid() == tempOwner)
+    stdfs::remove_all(tempRoot);
+}
+
+const std::string &fakeSdRoot() {
+  if (sdRoot.empty()) {
+    tempRoot = (stdfs::temp_directory_path() /
+                ("esp32farm-sd-" + std::to_string(getpid())))
+                   .string();
+    tempOwner = getpid();
+    stdfs::remove_all(tempRoot);
+    stdfs::create_directories(tempRoot);
+    atexit(removeTempRoot);
+    sdRoot = tempRoot;
+  }
+  return sdRoot;
+}
+
+void fakeSdMount(const std::string &dir) {
+  stdfs::create_directories(dir);
+  sdRoot = dir;
+}
+
+void fakeSdWipe() {
+  const std::string &root = fakeSdRoot();
+  for (auto &entry : stdfs::directory_iterator(root))
+    stdfs::remove_all(entry.path());
+}
+
+std::string fakeSdPath(const char *path) { return fakeSdRoot() + path; }
+
+uint64_t SDFS::usedBytes() {
+  uint64_t used = 0;
+  for (auto &entry : stdfs::recursive_directory_iterator(fakeSdRoot())) {
+    if (entry.is_regular_file())
+      used += entry.file_size();
+  }
+  return used;
+}
+
+namespace fs {
+
+// ---------- File ----------
+
+File::File(FILE *fp, const char *path) : handle(std::make_shared<Handle>()) {
+  handle->fp = fp;
+  handle->path = path;
+}
+
+int File::available() {
+  if (!*this)
+    return 0;
+  return (int)(size() - position());
+}
+
+int File::read() { return *this ? fgetc(handle->fp) : -1; }
+
+int File::peek() {
+  if (!*this)
+    return -1;
+  int c = fgetc(handle->fp);
+  if (c != EOF)
+    ungetc(c, handle->fp);
+  return c;
+}
+
+size_t File::read(uint8_t *buf, size_t n) {
+  return *this ? fread(buf, 1, n, handle->fp) : 0;
+}
+
+size_t File::write(const uint8_t *buf, size_t n) {
+  if (!*this)
+    return 0;
+  if (fakeSdWriteBudget >= 0 && (long)n > fakeSdWriteBudget) {
+    // Power cut: part of this write reaches the card, then nothing
+    fwrite(buf, 1, fakeSdWriteBudget, handle->fp);
+    fflush(handle->fp);
+    _exit(FAKE_POWER_CUT_EXIT);
+  }
+  if (fakeSdWriteBudget >= 0)
+    fakeSdWriteBudget -= n;
+  size_t written = fwrite(buf, 1, n, handle->fp);
+  fakeSdBytesWritten += written;
+  return written;
+}
+
+void File::flush() {
+  if (*this)
+    fflush(handle->fp);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  return *this && fseek(handle->fp, pos, mode) == 0;
+}
+
+size_t File::position() const {
+  return handle && handle->fp ? ftell(handle->fp) : 0;
+}
+
+size_t File::size() const {
+  if (!handle || !handle->fp)
+    return 0;
+  long pos = ftell(handle->fp);
+  fseek(handle->fp, 0, SEEK_END);
+  long end = ftell(handle->fp);
+  fseek(handle->fp, pos, SEEK_SET);
+  return end;
+}
+
+void File::close() {
+  if (handle && handle->fp) {
+    fclose(handle->fp);
+    handle->fp = nullptr;
+  }
+}
+
+const char *File::name() const {
+  if (!handle)
+    return "";
+  size_t slash = handle->path.rfind('/');
+  return handle->path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+// ---------- FS ----------
+
+File FS::open(const char *path, const char *mode, bool create) {
+  const char *hostMode = "rb";
+  if (!strcmp(mode, FILE_WRITE))
+    hostMode = "w+b";
+  else if (!strcmp(mode, FILE_APPEND))
+    hostMode = "a+b";
+  else if (!strcmp(mode, "r+"))
+    hostMode = "r+b";
+  std::string host = fakeSdPath(path);
+  if (stdfs::is_directory(host))
+    return File();
+  FILE *fp = fopen(host.c_str(), hostMode);
+  return fp ? File(fp, path) : File();
+}
+
+bool FS::exists(const char *path) { return stdfs::exists(fakeSdPath(path)); }
+
+bool FS::remove(const char *path) {
+  std::string host = fakeSdPath(path);
+  return stdfs::is_regular_file(host) && ::remove(host.c_str()) == 0;
+}
+
+bool FS::rename(const char *from, const char *to) {
+  return ::rename(fakeSdPath(from).c_str(), fakeSdPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path) {
+  std::error_code err;
+  return stdfs::create_directory(fakeSdPath(path), err);
+}
+
+bool FS::rmdir(const char *path) {
+  std::error_code err;
+  return stdfs::remove(fakeSdPath(path), err);
+}
+
+} // namespace fs
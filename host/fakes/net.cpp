@@ -0,0 +1,164 @@
+// Host fakes: WiFi, HTTPClient and the JSON reader
+#include "ArduinoJson.h"
+#include "HTTPClient.h"
+
+bool fakeWifiAvailable = true;
+WiFiClass WiFi;
+std::function<int(const FakeHttpRequest &, std::string &)> fakeHttpServer;
+
+// ---------- HTTPClient ----------
+
+int HTTPClient::sendRequest(const char *method, Stream *stream, size_t size) {
+  // The real client reads the body out in blocks before the reply
+  req.body.clear();
+  char block[1460];
+  while (size == 0 || req.body.size() < size) {
+    size_t want = sizeof(block);
+    if (size > 0 && size - req.body.size() < want)
+      want = size - req.body.size();
+    size_t got = stream->readBytes(block, want);
+    if (got == 0)
+      break;
+    req.body.append(block, got);
+  }
+  if (size > 0 && req.body.size() != size)
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  return send(method);
+}
+
+// ---------- JSON ----------
+
+namespace {
+
+struct JsonParser {
+  const char *p;
+  bool ok = true;
+
+  void skipSpace() {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+      p++;
+  }
+
+  bool literal(const char *word) {
+    size_t n = strlen(word);
+    if (strncmp(p, word, n) != 0)
+      return false;
+    p += n;
+    return true;
+  }
+
+  std::string string() {
+    std::string out;
+    p++; // opening quote
+    while (*p && *p != '"') {
+      char c = *p++;
+      if (c == '\\') {
+        c = *p++;
+        switch (c) {
+        case 'n':
+          c = '\n';
+          break;
+        case 'r':
+          c = '\r';
+          break;
+        case 't':
+          c = '\t';
+          break;
+        case 'u': {
+          char hex[5] = {p[0], p[1], p[2], p[3], 0};
+          c = (char)strtol(hex, nullptr, 16);
+          p += 4;
+          break;
+        }
+        }
+      }
+      out += c;
+    }
+    if (*p != '"')
+      ok = false;
+    else
+      p++;
+    return out;
+  }
+
+  std::shared_ptr<FakeJsonNode> value() {
+    auto node = std::make_shared<FakeJsonNode>();
+    skipSpace();
+    if (*p == '{') {
+      node->type = FakeJsonNode::OBJECT;
+      p++;
+      skipSpace();
+      if (*p == '}') {
+        p++;
+        return node;
+      }
+      while (ok) {
+        skipSpace();
+        if (*p != '"') {
+          ok = false;
+          break;
+        }
+        std::string key = string();
+        skipSpace();
+        if (*p++ != ':') {
+          ok = false;
+          break;
+        }
+        node->members[key] = value();
+        skipSpace();
+        if (*p == ',') {
+          p++;
+        } else if (*p == '}') {
+          p++;
+          break;
+        } else {
+          ok = false;
+        }
+      }
+    } else if (*p == '[') {
+      node->type = FakeJsonNode::ARRAY;
+      p++;
+      skipSpace();
+      if (*p == ']') {
+        p++;
+        return node;
+      }
+      while (ok) {
+        node->items.push_back(value());
+        skipSpace();
+        if (*p == ',') {
+          p++;
+        } else if (*p == ']') {
+          p++;
+          break;
+        } else {
+          ok = false;
+        }
+      }
+    } else if (*p == '"') {
+      node->type = FakeJsonNode::STRING;
+      node->text = string();
+    } else if (literal("true") || literal("false")) {
+      node->type = FakeJsonNode::BOOL;
+      node->boolean = p[-1] == 'e' && p[-2] == 'u';
+    } else if (!literal("null")) {
+      char *end;
+      node->number = strtod(p, &end);
+      if (end == p)
+        ok = false;
+      node->type = FakeJsonNode::NUMBER;
+      p = end;
+    }
+    return node;
+  }
+};
+
+} // namespace
+
+DeserializationError deserializeJson(JsonDocument &doc, const char *json) {
+  JsonParser parser{json};
+  doc.node = parser.value();
+  DeserializationError error;
+  error.failed = !parser.ok;
+  return error;
+}
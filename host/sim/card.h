@@ -0,0 +1,112 @@
+#ifndef SIM_CARD_H
+#define SIM_CARD_H
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ==========================================
+//  SIM: SD card contents
+// ==========================================
+// Helpers over the fake card for tests that need a given registry or a
+// reboot of the storage layer. They use sd_manager.h's globals, so include
+// the sketch first.
+
+// What a reset does to sd_manager.h: RAM state gone, sdInit() again
+inline void simSdReboot() {
+  journal.file.close();
+  journal = Journal();
+  logManifest = LogManifest();
+  sdCounters = SdCounters();
+  historyLastId = 0;
+  historyLastEpoch = 0;
+  sdInit();
+}
+
+// Empty card, freshly initialised
+inline void simSdFresh() {
+  fakeSdWipe();
+  simSdReboot();
+}
+
+// Phone number of simulated farmer `id`
+inline std::string simPhone(int id) {
+  char phone[16];
+  snprintf(phone, sizeof(phone), "0801%06d", id * 7919 % 1000000);
+  return phone;
+}
+
+// A card whose farmers.csv holds farmers 1..count (written straight to
+// the file, as an older firmware would have left it)
+inline void simSdWithFarmers(int count) {
+  fakeSdWipe();
+  FILE *f = fopen(fakeSdPath(FARMERS_FILE).c_str(), "w");
+  fprintf(f, "%s\r\n", FARMERS_CSV_HEADER);
+  for (int id = 1; id <= count; id++)
+    fprintf(f, "%04d,%s,2026-01-01 08:00:00\r\n", id, simPhone(id).c_str());
+  fclose(f);
+  simSdReboot();
+}
+
+// Contents of a card file ("" if missing)
+inline std::string simSdRead(const char *path) {
+  std::ifstream in(fakeSdPath(path), std::ios::binary);
+  std::stringstream bytes;
+  bytes << in.rdbuf();
+  return bytes.str();
+}
+
+// Lines of a card file without their CRLF; a last line the file does not
+// finish comes back as "TORN:<text>"
+inline std::vector<std::string> simSdRows(const char *path) {
+  std::string all = simSdRead(path);
+  std::vector<std::string> rows;
+  size_t p = 0;
+  while (p < all.size()) {
+    size_t e = all.find("\r\n", p);
+    if (e == std::string::npos) {
+      rows.push_back("TORN:" + all.substr(p));
+      break;
+    }
+    rows.push_back(all.substr(p, e - p));
+    p = e + 2;
+  }
+  return rows;
+}
+
+// Every file on the card, by card path
+typedef std::map<std::string, std::string> SimCardImage;
+
+inline SimCardImage simSdSnapshot() {
+  namespace stdfs = std::filesystem;
+  SimCardImage image;
+  const std::string &root = fakeSdRoot();
+  for (auto &entry : stdfs::recursive_directory_iterator(root)) {
+    std::string path = entry.path().string().substr(root.size());
+    if (entry.is_directory())
+      image[path + "/"] = ""; // a directory, made before its files
+    else
+      image[path] = simSdRead(path.c_str());
+  }
+  return image;
+}
+
+// Put a snapshot back (the RAM side is left alone; see simSdReboot())
+inline void simSdRestore(const SimCardImage &image) {
+  namespace stdfs = std::filesystem;
+  fakeSdWipe();
+  for (auto &file : image) {
+    if (file.first.back() == '/') {
+      stdfs::create_directories(fakeSdPath(file.first.c_str()));
+    } else {
+      std::ofstream out(fakeSdPath(file.first.c_str()), std::ios::binary);
+      out << file.second;
+    }
+  }
+}
+
+#endif // SIM_CARD_H
@@ -0,0 +1,296 @@
+#ifndef SIM_MODEM_H
+#define SIM_MODEM_H
+
+#include <HTTPClient.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ==========================================
+//  SIM: SIM800L on the GSM UART
+// ==========================================
+// Reads the commands the firmware writes to gsmSerial and answers them the
+// way a registered SIM800L does, latencyUs later: echo until ATE0, the
+// information lines, then the final result resultUs after them. Runs from
+// the delay hook (after any hook installed before it), so it needs the
+// firmware's gsmSerial.
+//
+// SMS: AT+CMGS=<n> gives the "> " prompt; the PDU up to Ctrl+Z is kept in
+// pdus and confirmed with +CMGS after sendUs (ESC cancels it).
+//
+// GPRS: AT+SAPBR opens the bearer and AT+HTTP* builds a request that
+// AT+HTTPACTION hands to fakeHttpServer, the same server the WiFi path
+// talks to; +HTTPACTION follows after httpUs and AT+HTTPREAD returns the
+// reply body.
+//
+// Faults: replies overrides the answer to commands starting with a key
+// ("" = never answer, else lines separated by '\n'); urcs are slipped in
+// one per command between its information lines and its final result;
+// urc() sends one right away.
+
+struct SimModem {
+  unsigned long latencyUs = 20000;  // command to first reply byte
+  unsigned long resultUs = 0;       // information lines to final result
+  unsigned long sendUs = 2000000;   // PDU to +CMGS
+  unsigned long httpUs = 1000000;   // AT+HTTPACTION to +HTTPACTION
+  bool echo = true;
+  bool registered = true;
+  std::map<std::string, std::string> replies;
+  std::deque<std::string> urcs;
+
+  std::vector<std::string> commands;      // every command line received
+  std::vector<std::string> pdus;          // SMS sent, hex
+  std::vector<FakeHttpRequest> requests;  // HTTP requests made
+  bool bearer = false;
+
+  void install() {
+    active = this;
+    seen = gsmSerial.tx.size();
+    chained = fakeDelayHook;
+    fakeDelayHook = [] {
+      active->poll();
+      if (chained)
+        chained();
+    };
+  }
+  void remove() {
+    fakeDelayHook = chained;
+    chained = nullptr;
+    active = nullptr;
+  }
+
+  // An unsolicited result code, now
+  void urc(const std::string &line) { feed("\r\n" + line + "\r\n"); }
+
+  void poll() {
+    const std::string &tx = gsmSerial.tx;
+    while (seen < tx.size()) {
+      char ch = tx[seen++];
+      if (mode == SMS_BODY) {
+        if (ch == 0x1A) {
+          pdus.push_back(body);
+          at(sendUs, "\r\n+CMGS: " + std::to_string(++cmgsRef) + "\r\n");
+          at(sendUs + resultUs, final());
+          mode = COMMAND;
+        } else if (ch == 0x1B) {
+          mode = COMMAND;
+        } else {
+          body += ch;
+        }
+      } else if (mode == HTTP_DATA) {
+        http.body += ch;
+        if (http.body.size() == dataLeft) {
+          at(latencyUs, final());
+          mode = COMMAND;
+        }
+      } else if (ch == '\r') {
+        command(line);
+        line.clear();
+      } else if (ch != '\n' && ch != 0x1B) {
+        line += ch;
+      }
+    }
+
+    unsigned long now = micros();
+    while (!pending.empty() && now >= pending.front().first) {
+      feed(pending.front().second);
+      pending.pop_front();
+    }
+  }
+
+private:
+  enum Mode { COMMAND, SMS_BODY, HTTP_DATA };
+
+  static inline SimModem *active = nullptr;
+  static inline void (*chained)() = nullptr;
+  size_t seen = 0;
+  Mode mode = COMMAND;
+  std::string line; // command being received
+  std::string body; // SMS PDU being received
+  size_t dataLeft = 0;
+  std::deque<std::pair<unsigned long, std::string>> pending; // (micros, text)
+  int cmgsRef = 0;
+
+  bool httpInit = false;
+  FakeHttpRequest http;
+  int httpStatus = 0;
+  std::string httpReply;
+
+  static void feed(const std::string &text) {
+    gsmSerial.feed((const uint8_t *)text.data(), text.size());
+  }
+
+  // Queue text delayUs from now, after anything already queued
+  void at(unsigned long delayUs, const std::string &text) {
+    unsigned long when = micros() + delayUs;
+    if (!pending.empty() && pending.back().first > when)
+      when = pending.back().first;
+    pending.push_back({when, text});
+  }
+
+  // The final result, with the next injected URC ahead of it
+  std::string final(const std::string &result = "OK") {
+    std::string text;
+    if (!urcs.empty()) {
+      text = "\r\n" + urcs.front() + "\r\n";
+      urcs.pop_front();
+    }
+    return text + "\r\n" + result + "\r\n";
+  }
+
+  void answer(const std::vector<std::string> &info,
+              const std::string &result = "OK") {
+    std::string text;
+    for (const std::string &l : info)
+      text += "\r\n" + l + "\r\n";
+    if (!urcs.empty()) {
+      text += "\r\n" + urcs.front() + "\r\n";
+      urcs.pop_front();
+    }
+    if (!text.empty())
+      at(latencyUs, text);
+    at(latencyUs + resultUs, "\r\n" + result + "\r\n");
+  }
+
+  static bool starts(const std::string &s, const char *prefix) {
+    return s.compare(0, strlen(prefix), prefix) == 0;
+  }
+
+  // Second quoted field of AT+HTTPPARA="NAME","value"
+  static std::string quoted(const std::string &cmd) {
+    size_t open = cmd.find("\",\"");
+    if (open == std::string::npos)
+      return "";
+    std::string value = cmd.substr(open + 3);
+    if (!value.empty() && value.back() == '"')
+      value.pop_back();
+    return value;
+  }
+
+  void command(const std::string &cmd) {
+    if (cmd.empty())
+      return;
+    commands.push_back(cmd);
+    if (echo)
+      at(0, cmd + "\r");
+
+    for (auto &r : replies) {
+      if (!starts(cmd, r.first.c_str()))
+        continue;
+      if (r.second.empty())
+        return; // never answers
+      std::vector<std::string> lines;
+      size_t from = 0, nl;
+      while ((nl = r.second.find('\n', from)) != std::string::npos) {
+        lines.push_back(r.second.substr(from, nl - from));
+        from = nl + 1;
+      }
+      answer(lines, r.second.substr(from));
+      return;
+    }
+
+    if (cmd == "ATE0" || cmd == "ATE1") {
+      echo = cmd == "ATE1";
+      answer({});
+    } else if (cmd == "AT" || cmd == "ATH" || starts(cmd, "AT+CMGF=") ||
+               starts(cmd, "AT+CREG=") || starts(cmd, "AT+CNMI=")) {
+      answer({});
+    } else if (cmd == "AT+CPIN?") {
+      answer({"+CPIN: READY"});
+    } else if (cmd == "AT+CREG?") {
+      answer({registered ? "+CREG: 1,1" : "+CREG: 1,2"});
+    } else if (cmd == "AT+CSQ") {
+      answer({"+CSQ: 18,0"});
+    } else if (starts(cmd, "AT+CMGS=")) {
+      body.clear();
+      mode = SMS_BODY;
+      at(latencyUs, "\r\n> ");
+    } else if (starts(cmd, "AT+SAPBR=")) {
+      sapbr(cmd);
+    } else if (starts(cmd, "AT+HTTP")) {
+      httpCommand(cmd);
+    } else {
+      answer({}, "ERROR");
+    }
+  }
+
+  void sapbr(const std::string &cmd) {
+    if (cmd == "AT+SAPBR=2,1") {
+      answer({bearer ? "+SAPBR: 1,1,\"10.64.12.7\""
+                     : "+SAPBR: 1,3,\"0.0.0.0\""});
+    } else if (cmd == "AT+SAPBR=1,1") {
+      answer({}, bearer ? "ERROR" : "OK");
+      bearer = true;
+    } else if (cmd == "AT+SAPBR=0,1") {
+      answer({}, bearer ? "OK" : "ERROR");
+      bearer = false;
+    } else {
+      answer({}); // AT+SAPBR=3: bearer settings
+    }
+  }
+
+  void httpCommand(const std::string &cmd) {
+    if (cmd == "AT+HTTPINIT") {
+      answer({}, httpInit || !bearer ? "ERROR" : "OK");
+      if (bearer && !httpInit) {
+        httpInit = true;
+        http = FakeHttpRequest();
+      }
+      return;
+    }
+    if (!httpInit) {
+      answer({}, "ERROR");
+      return;
+    }
+    if (cmd == "AT+HTTPTERM") {
+      httpInit = false;
+      answer({});
+    } else if (starts(cmd, "AT+HTTPPARA=\"URL\"")) {
+      http.url = quoted(cmd);
+      answer({});
+    } else if (starts(cmd, "AT+HTTPPARA=\"CONTENT\"")) {
+      http.headers["Content-Type"] = quoted(cmd);
+      answer({});
+    } else if (starts(cmd, "AT+HTTPPARA=\"USERDATA\"")) {
+      std::string header = quoted(cmd);
+      size_t colon = header.find(": ");
+      if (colon != std::string::npos)
+        http.headers[header.substr(0, colon)] = header.substr(colon + 2);
+      answer({});
+    } else if (starts(cmd, "AT+HTTPPARA=")) {
+      answer({}); // CID and the rest
+    } else if (starts(cmd, "AT+HTTPDATA=")) {
+      http.body.clear();
+      dataLeft = strtoul(cmd.c_str() + strlen("AT+HTTPDATA="), nullptr, 10);
+      mode = HTTP_DATA;
+      at(latencyUs, "\r\nDOWNLOAD\r\n");
+      if (dataLeft == 0) {
+        at(latencyUs, final());
+        mode = COMMAND;
+      }
+    } else if (starts(cmd, "AT+HTTPACTION=")) {
+      int method = atoi(cmd.c_str() + strlen("AT+HTTPACTION="));
+      http.method = method == 1 ? "POST" : "GET";
+      requests.push_back(http);
+      httpReply.clear();
+      // 601: network error
+      httpStatus = fakeHttpServer ? fakeHttpServer(http, httpReply) : 601;
+      if (httpStatus < 0)
+        httpStatus = 601;
+      answer({});
+      at(httpUs, "\r\n+HTTPACTION: " + std::to_string(method) + "," +
+                     std::to_string(httpStatus) + "," +
+                     std::to_string(httpReply.size()) + "\r\n");
+    } else if (cmd == "AT+HTTPREAD") {
+      at(latencyUs, "\r\n+HTTPREAD: " + std::to_string(httpReply.size()) +
+                        "\r\n" + httpReply + "\r\n");
+      at(latencyUs + resultUs, final());
+    } else {
+      answer({}, "ERROR");
+    }
+  }
+};
+
+#endif // SIM_MODEM_H
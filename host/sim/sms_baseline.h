@@ -0,0 +1,34 @@
+#ifndef SIM_SMS_BASELINE_H
+#define SIM_SMS_BASELINE_H
+
+// ==========================================
+//  BASELINE: the SMS report before compileSmsTemplate
+// ==========================================
+// The firmware's old buildSmsMessage, kept for the host only: a copy of the
+// template and one String::replace per placeholder, each rescanning the
+// whole message. bench_firmware times renderSmsMessage against it and
+// test_sms_template checks that both give the same text.
+
+inline String buildSmsMessage(String tmpl, String farmerID, float humidity,
+                              float temperature, float ec, float ph,
+                              float nitrogen, float phosphorus,
+                              float potassium, String timestamp) {
+  String msg = tmpl;
+
+  msg.replace("{farmer_id}", farmerID);
+  msg.replace("{humidity}", String(humidity, 1));
+  msg.replace("{temperature}", String(temperature, 1));
+  msg.replace("{ec}", String((int)ec));
+  msg.replace("{ph}", String(ph, 1));
+  msg.replace("{nitrogen}", String((int)nitrogen));
+  msg.replace("{phosphorus}", String((int)phosphorus));
+  msg.replace("{potassium}", String((int)potassium));
+  msg.replace("{timestamp}", timestamp);
+
+  // Replace literal \n with actual newline for SMS
+  msg.replace("\\n", "\n");
+
+  return msg;
+}
+
+#endif // SIM_SMS_BASELINE_H
@@ -0,0 +1,109 @@
+#ifndef SIM_SOIL_PROBE_H
+#define SIM_SOIL_PROBE_H
+
+#include <deque>
+#include <set>
+#include <utility>
+#include <vector>
+
+// ==========================================
+//  SIM: soil probes on the RS485 bus
+// ==========================================
+// Answers the firmware's 8-byte Modbus reads (function 3, 7 registers) for
+// the addresses in `present`, one byte per character time after a 40 ms
+// turnaround, the way a real probe at 4800 baud does. Runs from the delay
+// hook, so it needs the firmware's modbusCrc16() and rs485Serial.
+//
+// Values (register order): humidity 50.0+a/10, temperature 22.5, EC 450,
+// pH 6.8, N 120, P 85, K 200, where a is the probe address.
+//
+// A bad bus is set up with the fault fields: a reply cut short, a byte
+// flipped, line noise before the reply, a pause inside it, or a bus that
+// never goes quiet.
+
+struct SimSoilProbe {
+  std::set<int> present = {1};
+  unsigned long turnaroundUs = 40000;
+  unsigned long charUs = 2300;
+  unsigned long requests = 0;
+
+  // Faults, applied to every reply
+  int truncateTo = -1;         // send only this many bytes of it
+  int corruptByte = -1;        // flip the low bit of this byte
+  std::vector<uint8_t> noise;  // sent right before it, no gap
+  int gapAfter = -1;           // pause after this many bytes...
+  unsigned long gapUs = 0;     // ...for this long
+  bool babble = false;         // garbage every character time, forever
+
+  unsigned long lastByteUs = 0; // micros() the last byte went on the bus
+
+  void install() {
+    active = this;
+    seen = rs485Serial.tx.size();
+    fakeDelayHook = [] { active->poll(); };
+  }
+  void remove() {
+    fakeDelayHook = nullptr;
+    active = nullptr;
+  }
+
+  void poll() {
+    const std::string &tx = rs485Serial.tx;
+    if (tx.size() >= seen + 8) {
+      int addr = (uint8_t)tx[seen];
+      seen += 8;
+      requests++;
+      nextBabble = micros() + turnaroundUs;
+      if (present.count(addr))
+        schedule(reply(addr));
+    }
+    unsigned long now = micros();
+    while (!pending.empty() && now >= pending.front().first) {
+      rs485Serial.rx.push_back(pending.front().second);
+      lastByteUs = pending.front().first;
+      pending.pop_front();
+    }
+    if (babble) {
+      for (; nextBabble <= now; nextBabble += charUs) {
+        rs485Serial.rx.push_back(0x55);
+        lastByteUs = nextBabble;
+      }
+    }
+  }
+
+  // The reply a probe at addr gives, with the faults applied
+  std::vector<uint8_t> reply(int addr) const {
+    std::vector<uint8_t> f = {(uint8_t)addr, 3,    14,   0x01,
+                              (uint8_t)(0xF4 + addr), 0x00, 0xE1, 0x01,
+                              0xC2, 0x00,  0x44, 0,    120,  0,
+                              85,   0,     200};
+    uint16_t crc = modbusCrc16(f.data(), f.size());
+    f.push_back(crc & 0xFF);
+    f.push_back(crc >> 8);
+    if (corruptByte >= 0 && corruptByte < (int)f.size())
+      f[corruptByte] ^= 0x01;
+    if (truncateTo >= 0 && truncateTo < (int)f.size())
+      f.resize(truncateTo);
+    f.insert(f.begin(), noise.begin(), noise.end());
+    return f;
+  }
+
+private:
+  static inline SimSoilProbe *active = nullptr;
+  size_t seen = 0;
+  std::deque<std::pair<unsigned long, uint8_t>> pending; // (micros, byte)
+  unsigned long nextBabble = 0;
+
+  void schedule(const std::vector<uint8_t> &bytes) {
+    unsigned long at = micros() + turnaroundUs;
+    pending.clear();
+    for (size_t i = 0; i < bytes.size(); i++) {
+      if ((int)i == gapAfter)
+        at += gapUs;
+      pending.push_back({at, bytes[i]});
+      at += charUs;
+    }
+  }
+};
+
+#endif // SIM_SOIL_PROBE_H
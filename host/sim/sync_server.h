@@ -0,0 +1,143 @@
+#ifndef SIM_SYNC_SERVER_H
+#define SIM_SYNC_SERVER_H
+
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// ==========================================
+//  SIM: web/api/sync.php
+// ==========================================
+// Plays the server's side of a sync over the fake HTTPClient: inflates
+// deflate bodies, upserts farmers, checks a delta against the registry
+// checksum (asking for a full resend on mismatch), skips readings it
+// already has and acknowledges the batch number.
+
+struct SimSyncServer {
+  std::map<std::string, std::string> farmers; // id -> phone
+  std::set<std::string> readings;             // "id,timestamp,probe"
+  std::vector<std::string> rows;              // every datalog row received
+  int requests = 0;
+  int resends = 0;    // farmers_resend replies
+  int duplicates = 0; // rows it already had
+  int failRequests = 0; // fail this many upcoming requests with 500
+  std::string lastBody; // inflated JSON of the last request
+
+  void install() {
+    fakeHttpServer = [this](const FakeHttpRequest &req, std::string &resp) {
+      return handle(req, resp);
+    };
+  }
+  static void remove() { fakeHttpServer = nullptr; }
+
+  // The registry checksum of sync.php: sum of CRC32("id,phone")
+  uint32_t checksum() const {
+    uint32_t sum = 0;
+    for (auto &f : farmers) {
+      std::string entry = f.first + "," + f.second;
+      sum += crc32(0, (const Bytef *)entry.data(), entry.size());
+    }
+    return sum;
+  }
+
+  int handle(const FakeHttpRequest &req, std::string &resp) {
+    requests++;
+    if (failRequests > 0) {
+      failRequests--;
+      return 500;
+    }
+    std::string body = req.body;
+    auto enc = req.headers.find("Content-Encoding");
+    if (enc != req.headers.end() && enc->second == "deflate" &&
+        !inflate(req.body, body))
+      return 400;
+    lastBody = body;
+
+    JsonDocument doc;
+    if (deserializeJson(doc, body.c_str()))
+      return 400;
+    int batch = doc["batch"] | 0;
+
+    forEachRow(doc["farmers_csv"] | "", [this](const std::string &line) {
+      std::vector<std::string> f = split(line);
+      if (f.size() >= 3)
+        farmers[f[0]] = f[1];
+    });
+
+    std::string mode = doc["farmers_mode"] | "";
+    if (mode == "delta" && !doc["farmers_checksum"].isNull()) {
+      unsigned long count = doc["farmers_count"] | 0UL;
+      unsigned long sum = doc["farmers_checksum"] | 0UL;
+      if (count != farmers.size() || sum != checksum()) {
+        resends++;
+        resp = "{\"success\":false,\"farmers_resend\":true,\"batch\":" +
+               std::to_string(batch) + "}";
+        return 200;
+      }
+    }
+
+    forEachRow(doc["datalog_csv"] | "", [this](const std::string &line) {
+      std::vector<std::string> f = split(line);
+      if (f.size() < 9)
+        return;
+      rows.push_back(line);
+      std::string key =
+          f[0] + "," + f[1] + "," + (f.size() > 9 ? f[9] : std::string("1"));
+      if (!readings.insert(key).second)
+        duplicates++;
+    });
+
+    resp = "{\"success\":true,\"batch\":" + std::to_string(batch) + "}";
+    return 200;
+  }
+
+private:
+  static bool inflate(const std::string &in, std::string &out) {
+    out.assign(in.size() * 8 + 4096, '\0');
+    for (;;) {
+      uLongf n = out.size();
+      int rc = uncompress((Bytef *)&out[0], &n, (const Bytef *)in.data(),
+                          in.size());
+      if (rc == Z_OK) {
+        out.resize(n);
+        return true;
+      }
+      if (rc != Z_BUF_ERROR)
+        return false;
+      out.resize(out.size() * 2);
+    }
+  }
+
+  // Data rows of a CSV section (the first line is the header)
+  template <typename F> static void forEachRow(const std::string &csv, F onRow) {
+    size_t p = csv.find('\n');
+    while (p != std::string::npos && p + 1 < csv.size()) {
+      size_t q = csv.find('\n', p + 1);
+      std::string line = csv.substr(p + 1, q == std::string::npos
+                                               ? std::string::npos
+                                               : q - p - 1);
+      if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+      if (!line.empty())
+        onRow(line);
+      p = q;
+    }
+  }
+
+  static std::vector<std::string> split(const std::string &line) {
+    std::vector<std::string> out(1);
+    for (char c : line) {
+      if (c == ',')
+        out.emplace_back();
+      else
+        out.back() += c;
+    }
+    return out;
+  }
+};
+
+#endif // SIM_SYNC_SERVER_H
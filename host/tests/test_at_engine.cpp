@@ -0,0 +1,179 @@
+// The AT engine against a simulated SIM800L: URCs (+CREG, +CMTI, RING)
+// arriving in the middle of a command reach their handlers without
+// completing it, the SMS prompt is recognised only where it is expected,
+// commands time out, and a queue of commands costs little more than the
+// modem's own latency.
+#include "gsm_manager.h"
+#include "modem.h"
+#include <chrono>
+#include <gtest/gtest.h>
+
+namespace {
+
+AtResult lastResult;
+int doneCount = 0;
+
+void onDone(AtResult result) {
+  lastResult = result;
+  doneCount++;
+}
+
+class AtEngineTest : public ::testing::Test {
+protected:
+  SimModem modem;
+
+  void SetUp() override {
+    atQueueHead = 0;
+    atQueueCount = 0;
+    atActive = false;
+    atLineLen = 0;
+    atUrcCount = 0;
+    atRawLeft = 0;
+    sms = SmsJob();
+    gsmReady = false;
+    gsmNetworkReady = false;
+    gsmSerial.rx.clear();
+    gsmSerial.tx.clear();
+    doneCount = 0;
+
+    modem.install();
+    gsmInit();
+    ASSERT_TRUE(gsmReady);
+    ASSERT_TRUE(gsmNetworkReady);
+  }
+  void TearDown() override { modem.remove(); }
+
+  // Poll the engine until it has nothing left to do
+  void drain() {
+    while (!atIdle()) {
+      atPoll();
+      delay(1);
+    }
+  }
+};
+
+} // namespace
+
+TEST_F(AtEngineTest, InitTurnsEchoOff) {
+  EXPECT_FALSE(modem.echo);
+  EXPECT_EQ(modem.commands.front(), "AT");
+  EXPECT_STREQ(sendATCommand("AT+CSQ"), "+CSQ: 18,0\nOK");
+}
+
+TEST_F(AtEngineTest, UrcMidCommandGoesToItsHandler) {
+  modem.resultUs = 50000; // OK comes 50 ms after the information line
+  modem.urcs = {"+CREG: 0"};
+  ASSERT_TRUE(atSend("AT+CSQ", "OK", 2000, "+CSQ:", nullptr, onDone));
+
+  while (gsmNetworkReady && doneCount == 0) {
+    atPoll();
+    delay(1);
+  }
+  EXPECT_FALSE(gsmNetworkReady);
+  EXPECT_TRUE(atActive); // the URC did not complete AT+CSQ
+  EXPECT_EQ(doneCount, 0);
+
+  drain();
+  EXPECT_EQ(doneCount, 1);
+  EXPECT_EQ(lastResult, AT_OK);
+  modem.urc("+CREG: 5"); // roaming
+  atPoll();
+  EXPECT_TRUE(gsmNetworkReady);
+}
+
+TEST_F(AtEngineTest, UrcIsNotPartOfTheCommandsAnswer) {
+  modem.urcs = {"+CMTI: \"SM\",3"};
+  EXPECT_STREQ(sendATCommand("AT+CSQ"), "+CSQ: 18,0\nOK");
+  EXPECT_TRUE(modem.urcs.empty());
+}
+
+TEST_F(AtEngineTest, RingMidCommandIsHungUpAfterIt) {
+  modem.urcs = {"RING"};
+  EXPECT_STREQ(sendATCommand("AT+CSQ"), "+CSQ: 18,0\nOK");
+  drain();
+  EXPECT_EQ(modem.commands.back(), "ATH");
+}
+
+TEST_F(AtEngineTest, SmsWaitsForThePrompt) {
+  ASSERT_TRUE(sendSMS("+46708251358", "hellohello"));
+  std::vector<std::string> tail(modem.commands.end() - 3,
+                                modem.commands.end());
+  EXPECT_EQ(tail, (std::vector<std::string>{"AT+CREG?", "AT+CMGF=0",
+                                            "AT+CMGS=22"}));
+  ASSERT_EQ(modem.pdus.size(), 1u);
+  EXPECT_EQ(modem.pdus[0], "0001000B916407281553F800000A" "E8329BFD4697D9EC37");
+}
+
+TEST_F(AtEngineTest, RingDuringAnSmsIsHungUpBetweenSteps) {
+  modem.urcs = {"RING"}; // during AT+CREG?
+  ASSERT_TRUE(sendSMS("+46708251358", "hellohello"));
+  std::vector<std::string> tail(modem.commands.end() - 4,
+                                modem.commands.end());
+  EXPECT_EQ(tail, (std::vector<std::string>{"AT+CREG?", "ATH", "AT+CMGF=0",
+                                            "AT+CMGS=22"}));
+  EXPECT_EQ(modem.pdus.size(), 1u);
+}
+
+TEST_F(AtEngineTest, NoPromptCancelsTheSms) {
+  modem.replies["AT+CMGS="] = ""; // never answers
+  unsigned long start = millis();
+  EXPECT_FALSE(sendSMS("+46708251358", "hellohello"));
+  EXPECT_GE(millis() - start, 5000ul);
+  EXPECT_EQ(gsmSerial.tx.back(), '\x1B'); // ESC, not the PDU
+  EXPECT_TRUE(modem.pdus.empty());
+}
+
+TEST_F(AtEngineTest, NoPduModeFailsTheSms) {
+  modem.replies["AT+CMGF=0"] = "ERROR";
+  EXPECT_FALSE(sendSMS("+46708251358", "hellohello"));
+  EXPECT_EQ(modem.commands.back(), "AT+CMGF=0"); // no AT+CMGS after it
+  EXPECT_TRUE(modem.pdus.empty());
+}
+
+TEST_F(AtEngineTest, PromptCharacterElsewhereIsText) {
+  modem.replies["AT+CUSD=1"] = "> balance 0.00\nOK";
+  EXPECT_STREQ(sendATCommand("AT+CUSD=1"), "> balance 0.00\nOK");
+}
+
+TEST_F(AtEngineTest, SilentModemTimesOut) {
+  modem.replies["AT+CSQ"] = "";
+  unsigned long start = millis();
+  EXPECT_EQ(atRun("AT+CSQ", "OK", 2000, "+CSQ:", nullptr), AT_TIMEOUT);
+  unsigned long took = millis() - start;
+  EXPECT_GE(took, 2000ul);
+  EXPECT_LE(took, 2002ul);
+  EXPECT_STREQ(sendATCommand("AT"), "OK"); // the next command goes through
+}
+
+TEST_F(AtEngineTest, ErrorsEndTheCommand) {
+  modem.replies["AT+CPIN?"] = "+CME ERROR: 10";
+  EXPECT_EQ(atRun("AT+CPIN?", "OK", 2000, "+CPIN:", nullptr), AT_ERROR);
+  EXPECT_EQ(atRun("AT+BOGUS", "OK", 2000, nullptr, nullptr), AT_ERROR);
+}
+
+// Commands kept queued back to back: each should cost the modem's latency
+// plus at most two polls (one to read the result, one to send the next).
+TEST_F(AtEngineTest, GetsThroughAQueueOfCommands) {
+  const int commands = 500;
+  unsigned long start = millis();
+  auto wallStart = std::chrono::steady_clock::now();
+  int queued = 0;
+  while (doneCount < commands) {
+    while (queued < commands && atQueueCount < AT_QUEUE_LEN) {
+      atSend("AT+CSQ", "OK", 2000, "+CSQ:", nullptr, onDone);
+      queued++;
+    }
+    atPoll();
+    delay(1);
+  }
+  auto wall = std::chrono::steady_clock::now() - wallStart;
+  unsigned long took = millis() - start;
+
+  EXPECT_EQ(lastResult, AT_OK);
+  EXPECT_LE(took, commands * (modem.latencyUs / 1000 + 2));
+  RecordProperty(
+      "wall_us_per_command",
+      (int)(std::chrono::duration_cast<std::chrono::microseconds>(wall)
+                .count() /
+            commands));
+}
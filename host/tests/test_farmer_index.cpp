@@ -0,0 +1,118 @@
+// The RAM farmer index against farmers.csv at the largest registry the
+// four-digit IDs allow: every lookup agrees with the file, before and
+// after inserts, and again after a reboot rebuilds it.
+#include "ESP32_FARM.ino"
+#include "card.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <random>
+
+namespace {
+
+const int MAX_ID = 9999;
+
+std::string idOf(int n) {
+  char id[5];
+  snprintf(id, sizeof(id), "%04d", n);
+  return id;
+}
+
+// Some numbers in international form, to cover the '+' nibble
+std::string phoneOf(int id) {
+  return (id % 5 == 0 ? "+234" : "") + simPhone(id);
+}
+
+// id -> phone as farmers.csv has it
+std::map<int, std::string> csvRegistry() {
+  std::map<int, std::string> registry;
+  std::vector<std::string> rows = simSdRows(FARMERS_FILE);
+  for (size_t r = 1; r < rows.size(); r++) {
+    size_t comma = rows[r].find(',');
+    size_t comma2 = rows[r].find(',', comma + 1);
+    registry[atoi(rows[r].c_str())] =
+        rows[r].substr(comma + 1, comma2 - comma - 1);
+  }
+  return registry;
+}
+
+void expectIndexMatches(const std::map<int, std::string> &registry) {
+  ASSERT_EQ(getFarmerCount(), (int)registry.size());
+  ASSERT_EQ(getNextFarmerID(), registry.rbegin()->first + 1);
+  for (int id = 1; id <= MAX_ID; id++) {
+    auto it = registry.find(id);
+    std::string key = idOf(id);
+    ASSERT_EQ(farmerExists(key.c_str()), it != registry.end()) << key;
+    ASSERT_STREQ(getFarmerPhone(key.c_str()).c_str(),
+                 it == registry.end() ? "" : it->second.c_str())
+        << key;
+  }
+}
+
+class FarmerIndexTest : public ::testing::Test {
+protected:
+  std::vector<int> missing; // IDs left out of the file (multiples of 7)
+
+  // farmers.csv with every other ID, in shuffled order
+  void SetUp() override {
+    std::vector<int> ids;
+    for (int id = 1; id <= MAX_ID; id++)
+      (id % 7 == 0 ? missing : ids).push_back(id);
+    std::mt19937 rng(42);
+    std::shuffle(ids.begin(), ids.end(), rng);
+
+    fakeSdWipe();
+    FILE *f = fopen(fakeSdPath(FARMERS_FILE).c_str(), "w");
+    fprintf(f, "%s\r\n", FARMERS_CSV_HEADER);
+    for (int id : ids)
+      fprintf(f, "%s,%s,2026-01-01 08:00:00\r\n", idOf(id).c_str(),
+              phoneOf(id).c_str());
+    fclose(f);
+    simSdReboot();
+  }
+};
+
+} // namespace
+
+TEST_F(FarmerIndexTest, LookupsMatchTheCsv) {
+  std::map<int, std::string> registry = csvRegistry();
+  ASSERT_EQ(registry.size(), (size_t)(MAX_ID - MAX_ID / 7));
+  expectIndexMatches(registry);
+}
+
+TEST_F(FarmerIndexTest, InsertsMatchTheCsvAfterCheckpointAndReboot) {
+  // Fill the gaps newest-first, so most inserts land mid-table
+  std::reverse(missing.begin(), missing.end());
+  for (int id : missing) {
+    ASSERT_TRUE(addFarmer(idOf(id).c_str(), phoneOf(id).c_str(),
+                          "2026-01-02 08:00:00"));
+    ASSERT_TRUE(farmerExists(idOf(id).c_str()));
+  }
+  ASSERT_TRUE(journalCheckpoint());
+
+  std::map<int, std::string> registry = csvRegistry();
+  ASSERT_EQ(registry.size(), (size_t)MAX_ID);
+  expectIndexMatches(registry);
+
+  simSdReboot();
+  expectIndexMatches(registry);
+}
+
+TEST_F(FarmerIndexTest, IdsOutsideTheRangeAreNotFound) {
+  EXPECT_FALSE(farmerExists("0000"));
+  EXPECT_FALSE(farmerExists("70000"));
+  EXPECT_FALSE(farmerExists("-1"));
+  EXPECT_STREQ(getFarmerPhone("0000").c_str(), "");
+}
+
+// Re-registering an ID adds a row but not a farmer; the counters must
+// still agree with the file at the next boot instead of being rebuilt
+TEST_F(FarmerIndexTest, RepeatedIdsKeepTheCountersValid) {
+  ASSERT_TRUE(addFarmer("0001", "0800000001", "2026-01-02 08:00:00"));
+  ASSERT_TRUE(journalCheckpoint());
+  uint32_t seq = sdCounters.seq;
+
+  simSdReboot();
+  EXPECT_EQ(sdCounters.seq, seq); // loaded, not rebuilt and saved
+  EXPECT_EQ(getFarmerCount(), MAX_ID - MAX_ID / 7);
+  EXPECT_EQ(sdCounters.farmerCount, (uint32_t)(MAX_ID - MAX_ID / 7 + 1));
+}
@@ -0,0 +1,129 @@
+// The reading history behind the "previous visit" screens: slots only for
+// farmers with a visit, lookups that see a save before its checkpoint, and
+// a replayed checkpoint that records nothing twice.
+#include "ESP32_FARM.ino"
+#include "card.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+const uint32_t EPOCH = 1767225600; // 2026-01-01 00:00:00
+
+SoilData readingNo(int n) {
+  SoilData d = {};
+  d.humidity = n;
+  d.temperature = 20;
+  d.valid = true;
+  d.probe = 1;
+  d.samples = 1;
+  return d;
+}
+
+// Humidity (the reading number) of each visit, newest first
+std::vector<int> visits(const char *farmerId) {
+  FarmerHistory h;
+  std::vector<int> numbers;
+  for (int i = 0; i < historyLoad(farmerId, h); i++)
+    numbers.push_back(h.visits[i].reading.humidity / 10);
+  return numbers;
+}
+
+size_t logRowCount() {
+  size_t rows = 0;
+  for (uint32_t seg = logManifest.first; seg <= logManifest.active; seg++) {
+    size_t n = simSdRows(logSegmentPath(seg).c_str()).size();
+    rows += n > 0 ? n - 1 : 0; // less the header
+  }
+  return rows;
+}
+
+class HistoryTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    rtcInit();
+    simSdFresh();
+  }
+};
+
+} // namespace
+
+TEST_F(HistoryTest, OnlyVisitedFarmersTakeASlot) {
+  ASSERT_TRUE(saveReading("9999", "2026-01-01", EPOCH, readingNo(1)));
+  ASSERT_TRUE(journalCheckpoint());
+  EXPECT_EQ(simSdRead(HISTORY_FILE).size(), HISTORY_SLOT_BYTES);
+  EXPECT_EQ(simSdRead(HISTORY_INDEX_FILE).size(), 2u * 9999);
+}
+
+TEST_F(HistoryTest, LookupSeesASaveBeforeAndAfterTheCheckpoint) {
+  ASSERT_TRUE(saveReading("0042", "2026-01-01", EPOCH + 60, readingNo(7)));
+  EXPECT_FALSE(SD.exists(HISTORY_FILE)); // still only in the journal
+  EXPECT_EQ(visits("0042"), std::vector<int>{7});
+
+  ASSERT_TRUE(journalCheckpoint());
+  simSdReboot();
+  FarmerHistory h;
+  ASSERT_EQ(historyLoad("0042", h), 1);
+  EXPECT_EQ(h.visits[0].reading.epoch, EPOCH + 60);
+  EXPECT_EQ(h.visits[0].reading.humidity, 70);
+}
+
+TEST_F(HistoryTest, KeepsTheNewestVisits) {
+  for (int n = 1; n <= HISTORY_DEPTH + 1; n++) {
+    ASSERT_TRUE(saveReading("0001", "2026-01-01", EPOCH + n, readingNo(n)));
+    if (n == 2)
+      ASSERT_TRUE(journalCheckpoint()); // some on file, some journaled
+  }
+  std::vector<int> newest;
+  for (int n = HISTORY_DEPTH + 1; n >= 2; n--)
+    newest.push_back(n);
+  EXPECT_EQ(visits("0001"), newest);
+
+  ASSERT_TRUE(journalCheckpoint());
+  simSdReboot();
+  EXPECT_EQ(visits("0001"), newest);
+}
+
+TEST_F(HistoryTest, OtherProbesOfASaveAreOneVisit) {
+  SoilData second = readingNo(2);
+  second.probe = 2;
+  ASSERT_TRUE(saveReading("0005", "2026-01-01", EPOCH, readingNo(1)));
+  ASSERT_TRUE(saveReading("0005", "2026-01-01", EPOCH, second));
+  EXPECT_EQ(visits("0005"), std::vector<int>{1});
+}
+
+TEST_F(HistoryTest, ManyPendingVisitsCheckpointEarly) {
+  for (int n = 1; n <= HISTORY_PENDING_MAX + 1; n++) {
+    char id[5];
+    snprintf(id, sizeof(id), "%04d", n);
+    ASSERT_TRUE(saveReading(id, "2026-01-01", EPOCH + n, readingNo(n)));
+  }
+  EXPECT_EQ(journal.historyCount, 1);
+  for (int n = 1; n <= HISTORY_PENDING_MAX + 1; n++) {
+    char id[5];
+    snprintf(id, sizeof(id), "%04d", n);
+    EXPECT_EQ(visits(id), std::vector<int>{n}) << id;
+  }
+}
+
+// A checkpoint whose files were written but whose new journal generation
+// and counters were not: the next boot replays it all again.
+TEST_F(HistoryTest, ReplayedCheckpointRecordsNothingTwice) {
+  ASSERT_TRUE(saveReading("0003", "2026-01-01", EPOCH, readingNo(1)));
+  ASSERT_TRUE(journalCheckpoint());
+  ASSERT_TRUE(saveReading("0003", "2026-01-02", EPOCH + 86400, readingNo(2)));
+  ASSERT_TRUE(journalCommit());
+  SimCardImage before = simSdSnapshot();
+
+  ASSERT_TRUE(journalCheckpoint());
+  SimCardImage image = simSdSnapshot();
+  image[JOURNAL_FILE] = before[JOURNAL_FILE];
+  image[COUNTERS_FILE] = before[COUNTERS_FILE];
+  simSdRestore(image);
+  simSdReboot();
+
+  EXPECT_EQ(visits("0003"), (std::vector<int>{2, 1}));
+  EXPECT_EQ(logRowCount(), 2u);
+  ASSERT_TRUE(journalCheckpoint());
+  simSdReboot();
+  EXPECT_EQ(visits("0003"), (std::vector<int>{2, 1}));
+}
@@ -0,0 +1,229 @@
+// Crash consistency of the write-ahead journal: whatever byte a power cut
+// stops at, the next boot has every committed farmer and reading exactly
+// once, and nothing torn.
+#include "ESP32_FARM.ino"
+#include "card.h"
+#include <gtest/gtest.h>
+#include <set>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+SoilData readingNo(int n) {
+  SoilData d = {};
+  d.humidity = n;
+  d.temperature = 20;
+  d.valid = true;
+  d.probe = 1;
+  d.samples = 1;
+  return d;
+}
+
+std::string idOf(int n) {
+  char id[5];
+  snprintf(id, sizeof(id), "%04d", n);
+  return id;
+}
+
+// Data rows of every log segment on the card, oldest first
+std::vector<std::string> logRows() {
+  std::vector<std::string> rows;
+  for (uint32_t seg = logManifest.first; seg <= logManifest.active; seg++) {
+    std::vector<std::string> part = simSdRows(logSegmentPath(seg).c_str());
+    EXPECT_FALSE(part.empty()) << "segment " << seg;
+    if (!part.empty())
+      EXPECT_EQ(part[0], DATALOG_CSV_HEADER) << "segment " << seg;
+    rows.insert(rows.end(), part.begin() + (part.empty() ? 0 : 1), part.end());
+  }
+  return rows;
+}
+
+std::vector<std::string> farmerRows() {
+  std::vector<std::string> rows = simSdRows(FARMERS_FILE);
+  if (!rows.empty())
+    rows.erase(rows.begin());
+  return rows;
+}
+
+// Farmer IDs of the rows; fails on torn or repeated rows
+std::vector<int> farmerIds() {
+  std::vector<int> ids;
+  std::set<int> seen;
+  for (const std::string &row : farmerRows()) {
+    EXPECT_NE(row.compare(0, 5, "TORN:"), 0) << row;
+    int id = atoi(row.c_str());
+    EXPECT_TRUE(seen.insert(id).second) << "duplicate farmer " << id;
+    ids.push_back(id);
+  }
+  return ids;
+}
+
+// Reading numbers (the humidity column) of the log rows; fails on torn or
+// repeated rows
+std::vector<int> readingNumbers() {
+  std::vector<int> numbers;
+  std::set<int> seen;
+  for (const std::string &row : logRows()) {
+    EXPECT_NE(row.compare(0, 5, "TORN:"), 0) << row;
+    size_t field = row.find(',', row.find(',') + 1);
+    int n = (int)atof(row.c_str() + field + 1);
+    EXPECT_TRUE(seen.insert(n).second) << "duplicate reading " << n;
+    numbers.push_back(n);
+  }
+  return numbers;
+}
+
+std::vector<int> range(int first, int last) {
+  std::vector<int> v;
+  for (int n = first; n <= last; n++)
+    v.push_back(n);
+  return v;
+}
+
+class JournalTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    rtcInit();
+    simSdFresh();
+  }
+};
+
+} // namespace
+
+// Cut the journal at every byte of a generation: what lies past the cut
+// is the previous generation's stale entries, as after a real torn write.
+// Replay must bring back exactly the entries that were whole.
+TEST_F(JournalTest, ReplaysExactlyTheWholeEntriesBeforeACut) {
+  // Generation 1, moved into the files: farmers 1-3, readings 1-10
+  for (int f = 1; f <= 3; f++)
+    ASSERT_TRUE(addFarmer(idOf(f).c_str(), "0801234567", "2026-01-01"));
+  for (int r = 1; r <= 10; r++)
+    ASSERT_TRUE(
+        saveReading("0001", "2026-01-01", 1767225600 + r, readingNo(r)));
+  ASSERT_TRUE(journalCheckpoint());
+  std::string stale = simSdRead(JOURNAL_FILE);
+
+  // Generation 2, left in the journal: entry i ends at ends[i]
+  struct Entry {
+    bool farmer;
+    int n;
+    uint32_t end;
+  };
+  std::vector<Entry> entries;
+  int farmer = 4, reading = 11;
+  for (int i = 0; i < 12; i++) {
+    bool isFarmer = (i % 4 == 0);
+    uint8_t visits = journal.historyCount;
+    if (isFarmer)
+      ASSERT_TRUE(
+          addFarmer(idOf(farmer).c_str(), "0801234567", "2026-01-02"));
+    else
+      // One visit, so the history adds a single entry and never
+      // checkpoints early
+      ASSERT_TRUE(saveReading("0001", "2026-01-02", 1767312000,
+                              readingNo(reading)));
+    ASSERT_TRUE(journalFlush());
+    // A new visit's history entry follows the reading's own
+    uint32_t entryEnd = journal.end;
+    if (journal.historyCount > visits)
+      entryEnd -= journalEntrySize(sizeof(LogRecord));
+    entries.push_back({isFarmer, isFarmer ? farmer++ : reading++, entryEnd});
+  }
+  uint32_t end = journal.end;
+  ASSERT_LT(end, stale.size());
+  SimCardImage card = simSdSnapshot();
+  std::string written = card[JOURNAL_FILE];
+
+  for (uint32_t cut = JOURNAL_DATA_START; cut <= end; cut++) {
+    SCOPED_TRACE("cut at byte " + std::to_string(cut));
+    SimCardImage torn = card;
+    torn[JOURNAL_FILE] =
+        written.substr(0, cut) + stale.substr(cut, end - cut) +
+        written.substr(end);
+    simSdRestore(torn);
+    simSdReboot();
+
+    int lastFarmer = 3, lastReading = 10;
+    for (const Entry &e : entries) {
+      if (e.end <= cut)
+        (e.farmer ? lastFarmer : lastReading) = e.n;
+    }
+    ASSERT_EQ(farmerIds(), range(1, lastFarmer));
+    ASSERT_EQ(readingNumbers(), range(1, lastReading));
+    ASSERT_EQ(getFarmerCount(), lastFarmer);
+    ASSERT_EQ(getLogCount(), lastReading);
+  }
+}
+
+// Cut the power at every byte the firmware writes to the card while it
+// registers farmers, saves readings, checkpoints and clears synced
+// readings. Afterwards every reading committed before the cut is there
+// once, in order, and the counters match the files.
+TEST_F(JournalTest, SurvivesAPowerCutAtEveryWrittenByte) {
+  const int READINGS = 24;
+  auto workload = [](int reportFd) {
+    for (int i = 1; i <= READINGS; i++) {
+      if (i % 8 == 1) {
+        addFarmer(idOf(i).c_str(), "0801234567", "2026-01-01");
+        journalCommit();
+      }
+      saveReading(idOf(i).c_str(), "2026-01-01", 1767225600 + i, readingNo(i));
+      if (i % 3 == 0 && journalCommit())
+        write(reportFd, &i, sizeof(i));
+      if (i % 10 == 0)
+        journalCheckpoint();
+      if (i == 15) {
+        // A sync acknowledged the first five readings
+        journalCheckpoint();
+        uint32_t seg = datalogSyncSegment();
+        datalogAcknowledge(seg, datalogBatchEnd(seg, datalogSyncStart(), 5));
+        clearDataLogs();
+      }
+    }
+    journalCheckpoint();
+    int all = READINGS;
+    write(reportFd, &all, sizeof(all));
+  };
+
+  SimCardImage fresh = simSdSnapshot();
+  for (long budget = 0;; budget++) {
+    SCOPED_TRACE("power cut after " + std::to_string(budget) + " bytes");
+    simSdRestore(fresh);
+    simSdReboot();
+
+    int report[2];
+    ASSERT_EQ(pipe(report), 0);
+    pid_t child = fork();
+    if (child == 0) {
+      close(report[0]);
+      fakeSdWriteBudget = budget;
+      workload(report[1]);
+      _exit(0);
+    }
+    close(report[1]);
+    int committed = 0, n;
+    while (read(report[0], &n, sizeof(n)) == sizeof(n))
+      committed = n;
+    close(report[0]);
+    int status;
+    waitpid(child, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status));
+    bool cut = WEXITSTATUS(status) == FAKE_POWER_CUT_EXIT;
+    ASSERT_TRUE(cut || WEXITSTATUS(status) == 0);
+
+    simSdReboot();
+    std::vector<int> numbers = readingNumbers();
+    for (size_t k = 1; k < numbers.size(); k++)
+      ASSERT_EQ(numbers[k], numbers[k - 1] + 1) << "gap in the log";
+    int last = numbers.empty() ? 0 : numbers.back();
+    ASSERT_GE(last, committed) << "a committed reading was lost";
+    ASSERT_EQ(getLogCount(), (int)numbers.size());
+    ASSERT_EQ(getFarmerCount(), (int)farmerIds().size());
+
+    if (!cut) {
+      ASSERT_EQ(last, READINGS);
+      break;
+    }
+  }
+}
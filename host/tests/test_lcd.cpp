@@ -0,0 +1,77 @@
+// I2C traffic of the LCD frame buffer: a flush sends only the cells that
+// changed and never clears the LCD, unlike a clear-and-reprint redraw.
+#include "lcd_manager.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+// Bytes a screen costs drawn the old way: clear, then both rows in full
+unsigned long fullRedrawBytes(const char *line1, const char *line2) {
+  lcd.resetCounters();
+  lcd.clear();
+  lcd.setCursor(0, 0);
+  lcd.print(line1);
+  lcd.setCursor(0, 1);
+  lcd.print(line2);
+  return lcd.i2cBytes;
+}
+
+// Bytes lcdFlush() sends for whatever the screens drew since the last one
+unsigned long flushBytes() {
+  lcd.resetCounters();
+  lcdFlush();
+  return lcd.i2cBytes;
+}
+
+class LcdTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    lcdInit();
+    lcdShowEnterID();
+    lcdFlush();
+  }
+};
+
+} // namespace
+
+TEST_F(LcdTest, RedrawingTheSameScreenSendsNothing) {
+  lcdShowEnterID();
+  EXPECT_EQ(flushBytes(), 0u);
+}
+
+TEST_F(LcdTest, AKeystrokeSendsOneCell) {
+  lcdShowIDInput("000");
+  lcdFlush();
+  lcdShowIDInput("0007");
+  // One character: the cursor is already past the "000"
+  EXPECT_EQ(flushBytes(), 1u * LCD_FAKE_I2C_PER_TRANSFER);
+  EXPECT_EQ(lcd.row(1), "ID: 0007        ");
+
+  unsigned long full = fullRedrawBytes("Enter Farmer ID:", "ID: 0007");
+  EXPECT_EQ(full, (1 + 2 + 16 + 8) * LCD_FAKE_I2C_PER_TRANSFER);
+}
+
+// A whole new screen can cost a few bytes more than clear-and-reprint,
+// which skips the blanks, but it never holds the bus for the clear's 2 ms
+TEST_F(LcdTest, ANewScreenNeverClearsTheLcd) {
+  lcdShowDataSaved("SMS queued");
+  unsigned long start = micros();
+  unsigned long sent = flushBytes();
+  EXPECT_EQ(micros(), start);
+  EXPECT_EQ(lcd.clears, 0u);
+  EXPECT_EQ(lcd.row(0), "Data Saved!     ");
+  EXPECT_EQ(lcd.row(1), "SMS queued      ");
+  // At most a cursor move per row and every cell
+  EXPECT_LE(sent, (2 + 2 * LCD_COLS) * LCD_FAKE_I2C_PER_TRANSFER);
+}
+
+TEST_F(LcdTest, ScreensDrawnBetweenFlushesGoOutOnce) {
+  lcdShowSyncing();
+  lcdShowSyncSuccess();
+  unsigned long sent = flushBytes();
+  lcdInit();
+  lcdShowEnterID();
+  lcdFlush();
+  lcdShowSyncSuccess();
+  EXPECT_EQ(sent, flushBytes());
+}
@@ -0,0 +1,117 @@
+// CRC-16/MODBUS, request frames and reply validation against published
+// vectors and a bit-at-a-time reference.
+#include "sensor_manager.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace {
+
+// The polynomial division the table is built from
+uint16_t crcBitwise(const byte *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+
+std::vector<byte> withCrc(std::vector<byte> frame) {
+  uint16_t crc = modbusCrc16(frame.data(), frame.size());
+  frame.push_back(crc & 0xFF);
+  frame.push_back(crc >> 8);
+  return frame;
+}
+
+} // namespace
+
+TEST(ModbusCrc, CheckValue) {
+  // The catalogue check value of CRC-16/MODBUS
+  const char *check = "123456789";
+  EXPECT_EQ(modbusCrc16((const byte *)check, 9), 0x4B37);
+  EXPECT_EQ(modbusCrc16(nullptr, 0), 0xFFFF);
+}
+
+TEST(ModbusCrc, KnownFrames) {
+  // Read 7 / 1 holding registers from slave 1, as in probe manuals
+  const byte read7[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x07};
+  EXPECT_EQ(modbusCrc16(read7, 6), 0x0804); // sent as 04 08
+  const byte read1[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x01};
+  EXPECT_EQ(modbusCrc16(read1, 6), 0x0A84); // sent as 84 0A
+  // Exception 02 (illegal data address) for function 03
+  const byte exception[] = {0x01, 0x83, 0x02};
+  EXPECT_EQ(modbusCrc16(exception, 3), 0xF1C0); // sent as C0 F1
+}
+
+TEST(ModbusCrc, TableMatchesTheBitwiseCrc) {
+  for (int b = 0; b < 256; b++) {
+    byte one = (byte)b;
+    ASSERT_EQ(modbusCrc16(&one, 1), crcBitwise(&one, 1)) << b;
+  }
+  std::mt19937 rng(7);
+  std::vector<byte> data(1024);
+  for (byte &b : data)
+    b = (byte)rng();
+  for (size_t len = 0; len <= data.size(); len += 13)
+    ASSERT_EQ(modbusCrc16(data.data(), len), crcBitwise(data.data(), len))
+        << len;
+}
+
+TEST(ModbusCrc, AFrameWithItsCrcLeavesZero) {
+  std::vector<byte> frame = withCrc({0x11, 0x04, 0x00, 0x08, 0x00, 0x02});
+  EXPECT_EQ(modbusCrc16(frame.data(), frame.size()), 0);
+}
+
+TEST(ModbusRequest, BuildsTheSoilProbeFrame) {
+  byte frame[MODBUS_REQUEST_LENGTH];
+  ASSERT_EQ(modbusBuildRequest(frame, 0x01, 0x03, 0x0000, 7),
+            (size_t)MODBUS_REQUEST_LENGTH);
+  const byte expected[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x07, 0x04, 0x08};
+  EXPECT_EQ(memcmp(frame, expected, sizeof(expected)), 0);
+
+  modbusBuildRequest(frame, 0x11, 0x04, 0x0102, 0x0304);
+  const byte other[] = {0x11, 0x04, 0x01, 0x02, 0x03, 0x04};
+  EXPECT_EQ(memcmp(frame, other, sizeof(other)), 0);
+  EXPECT_EQ(frame[6] | (frame[7] << 8), modbusCrc16(other, 6));
+}
+
+TEST(ModbusReply, AcceptsAGoodReply) {
+  std::vector<byte> reply = withCrc({0x01, 0x03, 0x04, 0x01, 0xF5, 0x00, 0xE1});
+  EXPECT_EQ(modbusCheckReply(reply.data(), reply.size(), 0x01, 0x03, 2),
+            MODBUS_FRAME_OK);
+}
+
+TEST(ModbusReply, RejectsEveryBitFlip) {
+  std::vector<byte> reply = withCrc({0x01, 0x03, 0x04, 0x01, 0xF5, 0x00, 0xE1});
+  for (size_t i = 0; i < reply.size() * 8; i++) {
+    std::vector<byte> noisy = reply;
+    noisy[i / 8] ^= 1 << (i % 8);
+    EXPECT_EQ(modbusCheckReply(noisy.data(), noisy.size(), 0x01, 0x03, 2),
+              MODBUS_FRAME_CRC)
+        << "bit " << i;
+  }
+}
+
+TEST(ModbusReply, NamesWhatIsWrong) {
+  byte shortFrame[] = {0x01, 0x03, 0x00, 0x00};
+  EXPECT_EQ(modbusCheckReply(shortFrame, sizeof(shortFrame), 1, 3, 2),
+            MODBUS_FRAME_SHORT);
+
+  std::vector<byte> other = withCrc({0x02, 0x03, 0x04, 0, 1, 0, 2});
+  EXPECT_EQ(modbusCheckReply(other.data(), other.size(), 1, 3, 2),
+            MODBUS_FRAME_ADDRESS);
+
+  const byte exception[] = {0x01, 0x83, 0x02, 0xC0, 0xF1};
+  EXPECT_EQ(modbusCheckReply(exception, sizeof(exception), 1, 3, 2),
+            MODBUS_FRAME_EXCEPTION);
+
+  std::vector<byte> function = withCrc({0x01, 0x04, 0x04, 0, 1, 0, 2});
+  EXPECT_EQ(modbusCheckReply(function.data(), function.size(), 1, 3, 2),
+            MODBUS_FRAME_FUNCTION);
+
+  std::vector<byte> length = withCrc({0x01, 0x03, 0x02, 0, 1});
+  EXPECT_EQ(modbusCheckReply(length.data(), length.size(), 1, 3, 2),
+            MODBUS_FRAME_LENGTH);
+}
@@ -0,0 +1,135 @@
+// The non-blocking Modbus master against a simulated probe on a bad bus:
+// a frame ends after t3.5 of silence, a reply that never completes times
+// out after SENSOR_TIMEOUT_MS, and short, corrupt or noisy frames are
+// rejected instead of decoded.
+#include "sensor_manager.h"
+#include "soil_probe.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+class ModbusEngineTest : public ::testing::Test {
+protected:
+  SimSoilProbe probe;
+  SoilData data;
+  unsigned long started = 0;  // micros() at the request
+  unsigned long finished = 0; // micros() when the reading ended
+
+  void SetUp() override {
+    probeCount = 0;
+    sensorAddProbe(1, 0x0000, SENSOR_NUM_REGS);
+    modbus = ModbusMaster();
+    rs485Serial.rx.clear();
+    probe.install();
+  }
+  void TearDown() override { probe.remove(); }
+
+  // One reading, polled every millisecond as the sensor task does
+  bool read() {
+    started = micros();
+    sensorStartReading(0);
+    while (!sensorPollReading(data))
+      delay(1);
+    finished = micros();
+    return data.valid;
+  }
+
+  unsigned long elapsedMs() const { return (finished - started) / 1000; }
+};
+
+} // namespace
+
+TEST_F(ModbusEngineTest, DecodesAWholeFrame) {
+  ASSERT_TRUE(read());
+  EXPECT_FLOAT_EQ(data.humidity, 50.1f);
+  EXPECT_FLOAT_EQ(data.ph, 6.8f);
+  EXPECT_EQ(data.potassium, 200);
+  EXPECT_EQ(probe.requests, 1u);
+}
+
+TEST_F(ModbusEngineTest, FrameEndsAfterT35OfSilence) {
+  ASSERT_TRUE(read());
+  unsigned long quiet = finished - probe.lastByteUs;
+  EXPECT_GE(quiet, modbusSilenceTime());
+  EXPECT_LT(quiet, modbusSilenceTime() + 2000); // polled every ms
+}
+
+TEST_F(ModbusEngineTest, PauseShorterThanT35KeepsOneFrame) {
+  probe.gapAfter = 9;
+  probe.gapUs = modbusCharTime(); // two character times quiet: < t3.5
+  EXPECT_TRUE(read());
+}
+
+TEST_F(ModbusEngineTest, PauseLongerThanT35SplitsTheFrame) {
+  probe.gapAfter = 9;
+  probe.gapUs = 5 * modbusSilenceTime();
+  EXPECT_FALSE(read());
+  EXPECT_EQ(modbus.rxLen, 9); // the first half, ended by the silence
+}
+
+TEST_F(ModbusEngineTest, NoReplyTimesOut) {
+  probe.present.clear();
+  EXPECT_FALSE(read());
+  // The timeout runs from the end of the request on the wire
+  EXPECT_GE(elapsedMs(), (unsigned long)SENSOR_TIMEOUT_MS);
+  EXPECT_LE(elapsedMs(), SENSOR_TIMEOUT_MS + 2 + modbus.txTime / 1000);
+}
+
+TEST_F(ModbusEngineTest, BusThatNeverGoesQuietTimesOut) {
+  probe.present.clear();
+  probe.babble = true;
+  EXPECT_FALSE(read());
+  EXPECT_GE(elapsedMs(), (unsigned long)SENSOR_TIMEOUT_MS);
+  EXPECT_LE(elapsedMs(), SENSOR_TIMEOUT_MS + 2 + modbus.txTime / 1000);
+}
+
+TEST_F(ModbusEngineTest, RejectsAShortFrame) {
+  probe.truncateTo = 4;
+  EXPECT_FALSE(read());
+  EXPECT_EQ(modbusCheckReply(modbus.rx, modbus.rxLen, 1, MODBUS_READ_HOLDING,
+                             SENSOR_NUM_REGS),
+            MODBUS_FRAME_SHORT);
+}
+
+TEST_F(ModbusEngineTest, RejectsAFrameCutBeforeItsCrc) {
+  probe.truncateTo = 17;
+  EXPECT_FALSE(read());
+  EXPECT_EQ(modbus.rxLen, 17);
+}
+
+TEST_F(ModbusEngineTest, RejectsAFlippedBit) {
+  for (int i = 0; i < 19; i++) {
+    SCOPED_TRACE("byte " + std::to_string(i));
+    probe.corruptByte = i;
+    EXPECT_FALSE(read());
+    EXPECT_FALSE(data.valid);
+  }
+}
+
+TEST_F(ModbusEngineTest, RejectsNoiseAheadOfTheReply) {
+  probe.noise = {0x00, 0xFF, 0x01};
+  EXPECT_FALSE(read());
+  EXPECT_EQ(modbus.rxLen, 3 + 19);
+}
+
+TEST_F(ModbusEngineTest, DiscardsAnOversizedFrame) {
+  probe.noise.assign(MODBUS_RX_MAX, 0xAA);
+  EXPECT_FALSE(read());
+  EXPECT_TRUE(modbus.overflow);
+}
+
+TEST_F(ModbusEngineTest, RecoversOnTheNextRequest) {
+  probe.noise = {0x13, 0x37};
+  EXPECT_FALSE(read());
+  probe.noise.clear();
+  EXPECT_TRUE(read());
+}
+
+// The parser decodes all seven registers, so a shorter window would pass
+// the length check and then read past its frame
+TEST_F(ModbusEngineTest, RefusesAProbeWithAnotherRegisterCount) {
+  EXPECT_FALSE(sensorAddProbe(2, 0x0000, SENSOR_NUM_REGS - 1));
+  EXPECT_FALSE(sensorAddProbe(2, 0x0000, SENSOR_NUM_REGS + 1));
+  EXPECT_EQ(probeCount, 1);
+  EXPECT_TRUE(sensorAddProbe(2, 0x0010, SENSOR_NUM_REGS));
+}
@@ -0,0 +1,92 @@
+// PipeQueue between two real threads: every message arrives once, in
+// order and whole, however the producer and consumer interleave.
+#include "pipeline.h"
+#include <gtest/gtest.h>
+#include <thread>
+
+namespace {
+
+// A message whose every field can be checked against its number
+PipeMsg numbered(uint32_t n) {
+  PipeMsg msg = pipeMsg(MSG_SAVE_READING, n & 0xFF);
+  msg.ref = (int32_t)n;
+  snprintf(msg.farmerId, sizeof(msg.farmerId), "%04u", n % 10000);
+  snprintf(msg.text, sizeof(msg.text), "message %u", n);
+  return msg;
+}
+
+bool whole(const PipeMsg &msg, uint32_t n) {
+  PipeMsg want = numbered(n);
+  return msg.type == want.type && msg.flags == want.flags &&
+         msg.ref == want.ref && strcmp(msg.farmerId, want.farmerId) == 0 &&
+         strcmp(msg.text, want.text) == 0;
+}
+
+} // namespace
+
+TEST(PipeQueue, RefusesPushesWhileFull) {
+  PipeQueue q;
+  for (uint32_t n = 0; n < PIPE_QUEUE_LEN; n++)
+    ASSERT_TRUE(pipePush(q, numbered(n)));
+  EXPECT_EQ(pipeSpace(q), 0u);
+  EXPECT_FALSE(pipePush(q, numbered(PIPE_QUEUE_LEN)));
+  EXPECT_EQ(q.dropped, 1u);
+
+  PipeMsg msg;
+  ASSERT_TRUE(pipePop(q, msg));
+  EXPECT_TRUE(whole(msg, 0));
+  EXPECT_TRUE(pipePush(q, numbered(PIPE_QUEUE_LEN)));
+  EXPECT_EQ(pipePending(q), (uint32_t)PIPE_QUEUE_LEN);
+}
+
+TEST(PipeQueue, CountersWrapAround) {
+  PipeQueue q;
+  q.head = q.tail = UINT32_MAX - 3;
+  PipeMsg msg;
+  uint32_t pushed = 0;
+  uint32_t popped = 0;
+  while (popped < 4 * PIPE_QUEUE_LEN) {
+    // Two in, one out: runs full, then drains
+    for (int i = 0; i < 2 && pipeSpace(q) > 0; i++)
+      ASSERT_TRUE(pipePush(q, numbered(pushed++)));
+    ASSERT_TRUE(pipePop(q, msg));
+    EXPECT_TRUE(whole(msg, popped++));
+  }
+  while (pipePop(q, msg))
+    EXPECT_TRUE(whole(msg, popped++));
+  EXPECT_EQ(popped, pushed);
+  EXPECT_EQ(q.dropped, 0u);
+}
+
+TEST(PipeQueue, ThreadsLoseNothing) {
+  const uint32_t MESSAGES = 1000000;
+  PipeQueue q;
+  uint32_t refused = 0;
+
+  std::thread producer([&] {
+    for (uint32_t n = 0; n < MESSAGES; n++) {
+      while (!pipePush(q, numbered(n))) {
+        refused++;
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t received = 0;
+  uint32_t bad = 0;
+  PipeMsg msg;
+  while (received < MESSAGES) {
+    if (!pipePop(q, msg)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (!whole(msg, received))
+      bad++;
+    received++;
+  }
+  producer.join();
+
+  EXPECT_EQ(bad, 0u);
+  EXPECT_FALSE(pipePop(q, msg)); // nothing extra
+  EXPECT_EQ(q.dropped, refused);
+}
@@ -0,0 +1,146 @@
+// SMS-SUBMIT PDUs against hand-checked vectors: GSM-7 packing, escapes,
+// UCS2 with surrogate pairs and the fill bit after a concatenation header.
+#include "sms_pdu.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string packed(std::vector<uint8_t> septets, int fillBits = 0) {
+  uint8_t out[SMS_PDU_HEX_MAX / 2];
+  int n = smsPackSeptets(septets.data(), septets.size(), out, fillBits);
+  std::string hex;
+  char byte[3];
+  for (int i = 0; i < n; i++) {
+    snprintf(byte, sizeof(byte), "%02X", out[i]);
+    hex += byte;
+  }
+  return hex;
+}
+
+// Text as the GSM worker sends it: decoded, planned, one PDU per segment
+struct Encoded {
+  bool gsm7;
+  std::vector<uint16_t> bounds;
+  std::vector<SmsPdu> pdus;
+};
+
+Encoded encode(const char *phone, const std::string &text) {
+  static uint16_t units[SMS_MAX_UNITS];
+  uint16_t bounds[SMS_MAX_SEGMENTS + 1];
+  int n = smsDecodeUtf8(text.c_str(), units, SMS_MAX_UNITS);
+  Encoded e;
+  e.gsm7 = smsIsGsm7(units, n);
+  int segments = smsPlanSegments(units, n, e.gsm7, bounds, SMS_MAX_SEGMENTS);
+  e.bounds.assign(bounds, bounds + segments + 1);
+  for (int k = 0; k < segments; k++) {
+    SmsPdu pdu;
+    EXPECT_TRUE(smsBuildPdu(phone, units, bounds[k], bounds[k + 1], e.gsm7,
+                            0x2A, segments, k + 1, pdu));
+    e.pdus.push_back(pdu);
+  }
+  return e;
+}
+
+} // namespace
+
+TEST(SmsPdu, PacksSeptets) {
+  EXPECT_EQ(packed({'h', 'e', 'l', 'l', 'o', 'h', 'e', 'l', 'l', 'o'}),
+            "E8329BFD4697D9EC37");
+  EXPECT_EQ(packed({0x1B, 0x65}), "9B32"); // euro sign
+}
+
+TEST(SmsPdu, PacksAfterTheHeaderFillBit) {
+  EXPECT_EQ(packed({'h', 'e', 'l', 'l', 'o', 'h', 'e', 'l', 'l', 'o'}, 1),
+            "D06536FB8D2EB3D96F");
+}
+
+TEST(SmsPdu, SingleGsm7Message) {
+  Encoded e = encode("+46708251358", "hellohello");
+  ASSERT_TRUE(e.gsm7);
+  ASSERT_EQ(e.pdus.size(), 1u);
+  // SMSC from SIM, SUBMIT, ref, 11 international digits, PID, DCS 0, 10
+  // septets
+  EXPECT_STREQ(e.pdus[0].hex,
+               "0001000B916407281553F800000A" "E8329BFD4697D9EC37");
+  EXPECT_EQ(e.pdus[0].tpduLength, 22);
+}
+
+TEST(SmsPdu, NationalNumberWithOddDigits) {
+  Encoded e = encode("08012345678", "hi");
+  ASSERT_EQ(e.pdus.size(), 1u);
+  EXPECT_STREQ(e.pdus[0].hex, "0001000B818010325476F8000002E834");
+}
+
+TEST(SmsPdu, EscapedCharactersTakeTwoSeptets) {
+  Encoded e = encode("+1", "[1]");
+  ASSERT_TRUE(e.gsm7);
+  ASSERT_EQ(e.pdus.size(), 1u);
+  // UDL 5: ESC '<', '1', ESC '>'
+  EXPECT_STREQ(e.pdus[0].hex, "0001000191F10000051B5E6CE303");
+}
+
+TEST(SmsPdu, SurrogatePairGoesAsUcs2) {
+  Encoded e = encode("+1", "\xF0\x9F\x98\x80"); // U+1F600
+  ASSERT_FALSE(e.gsm7);
+  ASSERT_EQ(e.pdus.size(), 1u);
+  EXPECT_STREQ(e.pdus[0].hex, "0001000191F1000804D83DDE00");
+}
+
+TEST(SmsPdu, ConcatenatedGsm7HeaderAndFillBit) {
+  Encoded e = encode("+1", std::string(161, 'a'));
+  ASSERT_EQ(e.pdus.size(), 2u);
+  EXPECT_EQ(e.bounds, (std::vector<uint16_t>{0, 153, 161}));
+  // UDHI set; UDL 15 = 7 header septets + 8; the text starts one fill bit
+  // into the octet after the header
+  EXPECT_STREQ(e.pdus[1].hex, "0041000191F100000F050003" "2A0202"
+                              "C2E170381C0E8701");
+  // A full segment: 5 octets to the address, PID, DCS, UDL, 6 header
+  // octets, then 153 septets after the fill bit
+  EXPECT_EQ(e.pdus[0].tpduLength, 5 + 3 + 6 + (1 + 153 * 7 + 7) / 8);
+}
+
+TEST(SmsPdu, GsmSingleLimitIs160Septets) {
+  EXPECT_EQ(encode("+1", std::string(160, 'a')).pdus.size(), 1u);
+  EXPECT_EQ(encode("+1", std::string(161, 'a')).pdus.size(), 2u);
+  // 158 plain + an escape = 160 septets
+  EXPECT_EQ(encode("+1", std::string(158, 'a') + "{").pdus.size(), 1u);
+  EXPECT_EQ(encode("+1", std::string(159, 'a') + "{").pdus.size(), 2u);
+}
+
+TEST(SmsPdu, EscapeSequenceIsNeverSplit) {
+  // 152 + 2 would overflow 153: the euro sign starts segment 2
+  Encoded e =
+      encode("+1", std::string(152, 'a') + "\xE2\x82\xAC" + "xxxxxxx");
+  ASSERT_TRUE(e.gsm7);
+  EXPECT_EQ(e.bounds, (std::vector<uint16_t>{0, 152, 160}));
+  // UDL 16 = 7 header septets + ESC 0x65 + 7 'x', after the fill bit
+  EXPECT_STREQ(e.pdus[1].hex, "0041000191F1000010050003" "2A0202"
+                              "36653C1E8FC7E3F1");
+}
+
+TEST(SmsPdu, SurrogatePairIsNeverSplit) {
+  // 66 + 2 would overflow 67 units: the emoji starts segment 2
+  Encoded e =
+      encode("+1", std::string(66, 'a') + "\xF0\x9F\x98\x80" + "bbb");
+  ASSERT_FALSE(e.gsm7);
+  EXPECT_EQ(e.bounds, (std::vector<uint16_t>{0, 66, 71}));
+  EXPECT_STREQ(e.pdus[1].hex, "0041000191F1000810050003" "2A0202"
+                              "D83DDE00" "006200620062");
+}
+
+TEST(SmsPdu, CutsAtMaxSegments) {
+  Encoded e = encode("+1", std::string(SMS_MAX_SEGMENTS * 153 + 10, 'z'));
+  ASSERT_EQ(e.pdus.size(), (size_t)SMS_MAX_SEGMENTS);
+  EXPECT_EQ(e.bounds.back(), SMS_MAX_SEGMENTS * 153);
+}
+
+TEST(SmsPdu, MalformedUtf8BecomesQuestionMark) {
+  uint16_t units[8];
+  int n = smsDecodeUtf8("a\xC3(", units, 8);
+  ASSERT_EQ(n, 3);
+  EXPECT_EQ(units[0], 'a');
+  EXPECT_EQ(units[1], '?');
+  EXPECT_EQ(units[2], '(');
+}
@@ -0,0 +1,107 @@
+// The compiled SMS template against the String::replace version it
+// replaced: the same text for every placeholder, escape and value, with
+// the segment count the PDU encoder would use.
+#include "gsm_manager.h"
+#include "sms_baseline.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char *const TEMPLATES[] = {
+    "Farm Report for ID:{farmer_id}\\nMoisture:{humidity}%\\nTemp:"
+    "{temperature}C\\npH:{ph}\\nEC:{ec}\\nN:{nitrogen} P:{phosphorus} K:"
+    "{potassium}\\nDate:{timestamp}",
+    "{humidity}{humidity}{ph}",          // repeated, back to back
+    "{{humidity}} {unknown} {ph {ec}}",  // braces that are not placeholders
+    "Saka {farmer_id}: tubig {humidity}% \xE2\x80\x94 {timestamp}", // UTF-8
+    "no placeholders\\\\n at all\\",
+    "",
+};
+
+SoilData reading(float humidity, float temperature, float ph, float ec) {
+  SoilData d = {};
+  d.humidity = humidity;
+  d.temperature = temperature;
+  d.ph = ph;
+  d.ec = ec;
+  d.nitrogen = 120.7f;
+  d.phosphorus = 0;
+  d.potassium = 1999.9f;
+  d.valid = true;
+  return d;
+}
+
+const std::vector<SoilData> READINGS = {
+    reading(45.2f, 22.3f, 6.8f, 450),
+    reading(0.25f, -0.05f, 7.45f, 0.9f), // ties and negative zero
+    reading(99.95f, -12.35f, 14.0f, 20000),
+    reading(100.0f, 85.0f, 0.0f, -1),
+};
+
+std::string rendered(const char *farmerId, const SoilData &r,
+                     const char *timestamp, int &segments) {
+  char text[PIPE_TEXT_MAX];
+  renderSmsMessage(farmerId, r, timestamp, text, sizeof(text), segments);
+  return text;
+}
+
+std::string replaced(const char *tmpl, const char *farmerId,
+                     const SoilData &r, const char *timestamp) {
+  return buildSmsMessage(tmpl, farmerId, r.humidity, r.temperature, r.ec,
+                         r.ph, r.nitrogen, r.phosphorus, r.potassium,
+                         timestamp)
+      .c_str();
+}
+
+} // namespace
+
+TEST(SmsTemplate, RendersLikeStringReplace) {
+  for (const char *tmpl : TEMPLATES) {
+    compileSmsTemplate(tmpl);
+    for (const SoilData &r : READINGS) {
+      int segments;
+      std::string text = rendered("0042", r, "2026-01-01 09:00:00", segments);
+      EXPECT_EQ(text, replaced(tmpl, "0042", r, "2026-01-01 09:00:00"))
+          << tmpl << " / " << r.humidity;
+    }
+  }
+}
+
+TEST(SmsTemplate, CountsSegmentsLikeTheEncoder) {
+  for (const char *tmpl : TEMPLATES) {
+    compileSmsTemplate(tmpl);
+    int segments;
+    std::string text = rendered("0042", READINGS[0], "2026-01-01", segments);
+
+    uint16_t units[SMS_MAX_UNITS];
+    uint16_t bounds[SMS_MAX_SEGMENTS + 1];
+    int count = smsDecodeUtf8(text.c_str(), units, SMS_MAX_UNITS);
+    bool gsm7 = smsIsGsm7(units, count);
+    EXPECT_EQ(segments,
+              smsPlanSegments(units, count, gsm7, bounds, SMS_MAX_SEGMENTS))
+        << tmpl;
+  }
+}
+
+TEST(SmsTemplate, ConfigRoundTripsThroughTheCard) {
+  ASSERT_TRUE(saveSmsConfig(true, "  ID {farmer_id}\\n{humidity}%\r\n"));
+  smsEnabled = false;
+  smsTemplate[0] = '\0';
+  loadSmsConfig();
+  EXPECT_TRUE(smsEnabled);
+  EXPECT_STREQ(smsTemplate, "ID {farmer_id}\\n{humidity}%");
+  int segments;
+  EXPECT_EQ(rendered("0042", READINGS[0], "", segments), "ID 0042\n45.2%");
+
+  ASSERT_TRUE(saveSmsConfig(false, "Off"));
+  loadSmsConfig();
+  EXPECT_FALSE(smsEnabled);
+  EXPECT_STREQ(smsTemplate, "Off");
+
+  SD.remove(SMS_CONFIG_FILE);
+  loadSmsConfig();
+  EXPECT_FALSE(smsEnabled);
+  EXPECT_STREQ(smsTemplate, "");
+}
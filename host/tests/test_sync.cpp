@@ -0,0 +1,240 @@
+// Batched sync against the simulated server: every reading arrives once,
+// failed batches are retried, and the farmer registry is kept in step.
+// Upload, retry and resume also run without WiFi, through the simulated
+// SIM800L's GPRS bearer and HTTP stack.
+#include "ESP32_FARM.ino"
+#include "card.h"
+#include "modem.h"
+#include "sync_server.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+const SoilData READING = {45.2f, 22.3f, 450, 6.8f, 120, 85, 200, true, 1, 8};
+
+class SyncTest : public ::testing::Test {
+protected:
+  SimSyncServer server;
+
+  void SetUp() override {
+    rtcInit();
+    fakeWifiAvailable = true;
+    connectWiFi();
+    simSdWithFarmers(20);
+    server.install();
+  }
+  void TearDown() override { SimSyncServer::remove(); }
+
+  // Readings one second apart, so the server keeps each of them
+  void saveReadings(int count) {
+    for (int i = 0; i < count; i++) {
+      char id[5];
+      snprintf(id, sizeof(id), "%04d", i % 20 + 1);
+      ASSERT_TRUE(
+          saveReading(id, getTimestamp().c_str(), getEpoch(), READING));
+      delay(1000);
+    }
+  }
+
+  // A reset cut the active segment's last row short (the boot's recount
+  // keeps its bytes), then the segment was sealed
+  void sealWithATornRow() {
+    ASSERT_TRUE(journalCheckpoint());
+    LogPath path = logSegmentPath(logManifest.active);
+    FILE *f = fopen(fakeSdPath(path.c_str()).c_str(), "a");
+    fputs("0003,2026-01-01 0", f);
+    fclose(f);
+    sdCounters.logBytes = sdFileSize(path.c_str());
+    ASSERT_TRUE(logSeal());
+  }
+
+  void runSync() {
+    ASSERT_TRUE(syncStart());
+    for (int step = 0; step < 20 && syncStep() == SYNC_RUNNING; step++)
+      delay(100);
+    EXPECT_EQ(syncJob.state, SYNC_SUCCEEDED);
+  }
+};
+
+} // namespace
+
+TEST_F(SyncTest, UploadsEveryReadingOnce) {
+  saveReadings(3 * SYNC_BATCH_RECORDS + 7);
+
+  ASSERT_TRUE(syncToServer());
+  EXPECT_EQ(server.requests, 4);
+  EXPECT_EQ(server.readings.size(), 3u * SYNC_BATCH_RECORDS + 7);
+  EXPECT_EQ(server.duplicates, 0);
+  EXPECT_EQ(server.farmers.size(), 20u);
+  EXPECT_EQ(server.resends, 0);
+
+  clearDataLogs();
+  EXPECT_EQ(getLogCount(), 0);
+}
+
+TEST_F(SyncTest, RetriesAFailedBatch) {
+  saveReadings(2 * SYNC_BATCH_RECORDS);
+
+  server.failRequests = SYNC_BATCH_RETRIES;
+  ASSERT_TRUE(syncToServer());
+  EXPECT_EQ(server.readings.size(), 2u * SYNC_BATCH_RECORDS);
+  EXPECT_EQ(server.duplicates, 0);
+}
+
+TEST_F(SyncTest, ResumesAfterAnInterruptedSync) {
+  saveReadings(3 * SYNC_BATCH_RECORDS);
+
+  // Batch 0 goes through, then the server stays down
+  int ok = 1;
+  fakeHttpServer = [&](const FakeHttpRequest &req, std::string &resp) {
+    return ok-- > 0 ? server.handle(req, resp) : 500;
+  };
+  EXPECT_FALSE(syncToServer());
+  EXPECT_EQ(server.readings.size(), (size_t)SYNC_BATCH_RECORDS);
+
+  // After a reboot the next sync starts at the first unacknowledged batch
+  simSdReboot();
+  server.install();
+  ASSERT_TRUE(syncToServer());
+  EXPECT_EQ(server.readings.size(), 3u * SYNC_BATCH_RECORDS);
+  EXPECT_EQ(server.duplicates, 0);
+}
+
+TEST_F(SyncTest, SendsTheWholeRegistryWhenTheServerIsOutOfStep) {
+  saveReadings(5);
+  ASSERT_TRUE(syncToServer());
+  EXPECT_EQ(server.resends, 0);
+
+  // The next sync only sends new rows, but the server's copy has changed
+  server.farmers["0001"] = "0800000000";
+  ASSERT_TRUE(addFarmer("0021", "0801234567", getTimestamp().c_str()));
+  saveReadings(1);
+  ASSERT_TRUE(syncToServer());
+  EXPECT_EQ(server.resends, 1);
+  EXPECT_EQ(server.farmers["0001"], simPhone(1));
+}
+
+TEST_F(SyncTest, CountsOnlyTheFarmersItSends) {
+  saveReadings(5);
+  ASSERT_TRUE(syncToServer());
+
+  // Registered while the sync waits for its first batch: still journaled
+  ASSERT_TRUE(syncStart());
+  ASSERT_TRUE(addFarmer("0021", "0801234567", getTimestamp().c_str()));
+  while (syncStep() == SYNC_RUNNING)
+    delay(100);
+  EXPECT_EQ(syncJob.state, SYNC_SUCCEEDED);
+  EXPECT_EQ(server.resends, 0);
+  EXPECT_EQ(server.farmers.count("0021"), 1u);
+}
+
+TEST_F(SyncTest, DropsASealedSegmentEndingInATornRow) {
+  saveReadings(5);
+  uint32_t sealed = logManifest.active;
+  sealWithATornRow();
+  saveReadings(3);
+
+  runSync();
+  EXPECT_EQ(server.readings.size(), 8u);
+  EXPECT_GT(logManifest.first, sealed);
+}
+
+TEST_F(SyncTest, SkipsASealedSegmentWithOnlyATornRowLeft) {
+  saveReadings(5);
+  ASSERT_TRUE(journalCheckpoint());
+  uint32_t whole = sdCounters.logBytes;
+  sealWithATornRow();
+  saveReadings(3);
+  // The server already has every whole row of the sealed segment
+  logManifest.syncOffset = whole;
+
+  runSync();
+  EXPECT_EQ(server.readings.size(), 3u);
+  EXPECT_EQ(server.requests, 1);
+}
+
+namespace {
+
+class GprsSyncTest : public SyncTest {
+protected:
+  SimModem modem;
+
+  void SetUp() override {
+    SyncTest::SetUp();
+    disconnectWiFi();
+    fakeWifiAvailable = false;
+
+    atQueueHead = 0;
+    atQueueCount = 0;
+    atActive = false;
+    atLineLen = 0;
+    atUrcCount = 0;
+    atRawLeft = 0;
+    gsmLease.store(LEASE_NONE);
+    gprsBearerUp = false;
+    gsmSerial.rx.clear();
+    gsmSerial.tx.clear();
+    modem.install();
+    gsmInit();
+    ASSERT_TRUE(gprsAvailable());
+  }
+  void TearDown() override {
+    modem.remove();
+    SyncTest::TearDown();
+  }
+
+  // syncToServer() with the GSM worker running to hand over the modem
+  bool syncOverGprs() {
+    if (!syncStart())
+      return false;
+    EXPECT_EQ(syncTransport, &gprsTransport);
+    while (syncStep() == SYNC_RUNNING)
+      gsmTask();
+    syncTransport->release();
+    return syncJob.state == SYNC_SUCCEEDED;
+  }
+};
+
+} // namespace
+
+TEST_F(GprsSyncTest, UploadsEveryReadingOnce) {
+  saveReadings(3 * SYNC_BATCH_RECORDS + 7);
+
+  ASSERT_TRUE(syncOverGprs());
+  EXPECT_EQ(server.requests, 4);
+  EXPECT_EQ(server.readings.size(), 3u * SYNC_BATCH_RECORDS + 7);
+  EXPECT_EQ(server.duplicates, 0);
+  EXPECT_EQ(server.farmers.size(), 20u);
+  ASSERT_EQ(modem.requests.size(), 4u);
+  EXPECT_EQ(modem.requests[0].method, "POST");
+  EXPECT_EQ(modem.requests[0].url, SERVER_URL);
+  EXPECT_EQ(modem.requests[0].headers.count("Content-Encoding"),
+            SYNC_COMPRESS ? 1u : 0u);
+  EXPECT_FALSE(modem.bearer); // closed again on release
+}
+
+TEST_F(GprsSyncTest, RetriesAFailedBatch) {
+  saveReadings(2 * SYNC_BATCH_RECORDS);
+
+  server.failRequests = SYNC_BATCH_RETRIES;
+  ASSERT_TRUE(syncOverGprs());
+  EXPECT_EQ(server.readings.size(), 2u * SYNC_BATCH_RECORDS);
+  EXPECT_EQ(server.duplicates, 0);
+}
+
+TEST_F(GprsSyncTest, ResumesAfterAnInterruptedSync) {
+  saveReadings(3 * SYNC_BATCH_RECORDS);
+
+  int ok = 1;
+  fakeHttpServer = [&](const FakeHttpRequest &req, std::string &resp) {
+    return ok-- > 0 ? server.handle(req, resp) : 500;
+  };
+  EXPECT_FALSE(syncOverGprs());
+  EXPECT_EQ(server.readings.size(), (size_t)SYNC_BATCH_RECORDS);
+
+  simSdReboot();
+  server.install();
+  ASSERT_TRUE(syncOverGprs());
+  EXPECT_EQ(server.readings.size(), 3u * SYNC_BATCH_RECORDS);
+  EXPECT_EQ(server.duplicates, 0);
+}
@@ -2,6 +2,11 @@
 // ==========================================
 //  SYNC API - Receives data from ESP32
 //  POST: Upload farmers + datalog CSV data
+//
+//  The ESP32 uploads its log in numbered batches
+//  and only moves on once the batch number is
+//  echoed back. Re-sent batches are harmless:
+//  duplicate readings are skipped below.
 // ==========================================
 
 require_once __DIR__ . '/../config.php';
@@ -10,14 +15,26 @@ if ($_SERVER['REQUEST_METHOD'] !== 'POST') {
     jsonResponse(['success' => false, 'message' => 'POST method required'], 405);
 }
 
-// Read JSON payload
+// Read JSON payload (firmware may deflate it, see SYNC_COMPRESS)
 $rawInput = file_get_contents('php://input');
+$encoding = strtolower(trim($_SERVER['HTTP_CONTENT_ENCODING'] ?? ''));
+if ($encoding === 'deflate') {
+    $rawInput = @gzuncompress($rawInput);
+    if ($rawInput === false) {
+        jsonResponse(['success' => false, 'message' => 'Could not inflate deflate-encoded payload'], 400);
+    }
+} elseif ($encoding !== '' && $encoding !== 'identity') {
+    jsonResponse(['success' => false, 'message' => 'Unsupported Content-Encoding: ' . $encoding], 415);
+}
 $data = json_decode($rawInput, true);
 
 if (!$data || !isset($data['farmers_csv']) || !isset($data['datalog_csv'])) {
     jsonResponse(['success' => false, 'message' => 'Missing farmers_csv or datalog_csv in payload'], 400);
 }
 
+// Batch number to acknowledge (older firmware sends one unnumbered batch)
+$batch = isset($data['batch']) ? (int) $data['batch'] : 0;
+
 $db = getDB();
 
 try {
@@ -28,8 +45,18 @@ try {
     $now = date('Y-m-d H:i:s');
 
     // ---- Process Farmers CSV ----
+    // Newer firmware sends only farmers registered since its last sync
     $farmersLines = explode("\n", trim($data['farmers_csv']));
 
+    // Upsert farmer (insert or update on duplicate)
+    $stmt = $db->prepare(
+        "INSERT INTO farmers (farmer_id, phone_number, created_at, synced_at) 
+         VALUES (:id, :phone, :created, :synced) 
+         ON DUPLICATE KEY UPDATE 
+            phone_number = VALUES(phone_number),
+            synced_at = VALUES(synced_at)"
+    );
+
     // Skip header line
     for ($i = 1; $i < count($farmersLines); $i++) {
         $line = trim($farmersLines[$i]);
@@ -44,14 +71,6 @@ try {
         $phone = trim($fields[1]);
         $createdAt = trim($fields[2]);
 
-        // Upsert farmer (insert or update on duplicate)
-        $stmt = $db->prepare(
-            "INSERT INTO farmers (farmer_id, phone_number, created_at, synced_at) 
-             VALUES (:id, :phone, :created, :synced) 
-             ON DUPLICATE KEY UPDATE 
-                phone_number = VALUES(phone_number),
-                synced_at = VALUES(synced_at)"
-        );
         $stmt->execute([
             ':id' => $farmerId,
             ':phone' => $phone,
@@ -61,6 +80,57 @@ try {
         $farmersImported++;
     }
 
+    // ---- Check the registry against the device's copy ----
+    // The device sends a count and the 32-bit sum of CRC32("id,phone") over
+    // its whole registry. If a delta leaves us out of step, keep what we have
+    // and ask for the full registry before importing readings.
+    if (isset($data['farmers_checksum']) && ($data['farmers_mode'] ?? '') === 'delta') {
+        $sum = $db->query(
+            "SELECT COUNT(*) AS n,
+                    COALESCE(SUM(CRC32(CONCAT(farmer_id, ',', phone_number))), 0) % 4294967296 AS k
+             FROM farmers"
+        )->fetch();
+
+        if ((int) $sum['n'] !== (int) $data['farmers_count'] ||
+            (int) $sum['k'] !== (int) $data['farmers_checksum']) {
+            $db->commit();
+            jsonResponse([
+                'success' => false,
+                'farmers_resend' => true,
+                'batch' => $batch,
+                'message' => 'Farmer registry out of step, full resend needed'
+            ]);
+        }
+    }
+
+    // ---- Device diagnostics (first batch of a sync) ----
+    if (isset($data['diag']) && is_array($data['diag'])) {
+        $diag = $data['diag'];
+        $stack = $diag['min_stack'] ?? [];
+        $stmt = $db->prepare(
+            "INSERT INTO device_diagnostics
+             (received_at, reset_reason, uptime_s, samples, dropped, min_heap, min_block,
+              min_stack_ui, min_stack_io, min_stack_net, min_stack_gsm, max_loop_us, loop_hist)
+             VALUES (:received, :reset, :uptime, :samples, :dropped, :heap, :block,
+                     :stack_ui, :stack_io, :stack_net, :stack_gsm, :loop, :hist)"
+        );
+        $stmt->execute([
+            ':received' => $now,
+            ':reset' => substr((string) ($diag['reset'] ?? 'unknown'), 0, 16),
+            ':uptime' => (int) ($diag['uptime_s'] ?? 0),
+            ':samples' => (int) ($diag['samples'] ?? 0),
+            ':dropped' => (int) ($diag['dropped'] ?? 0),
+            ':heap' => (int) ($diag['min_heap'] ?? 0),
+            ':block' => (int) ($diag['min_block'] ?? 0),
+            ':stack_ui' => (int) ($stack['ui'] ?? 0),
+            ':stack_io' => (int) ($stack['io'] ?? 0),
+            ':stack_net' => (int) ($stack['net'] ?? 0),
+            ':stack_gsm' => (int) ($stack['gsm'] ?? 0),
+            ':loop' => (int) ($diag['max_loop_us'] ?? 0),
+            ':hist' => implode(',', array_map('intval', (array) ($diag['loop_hist'] ?? [])))
+        ]);
+    }
+
     // ---- Process Datalog CSV ----
     $datalogLines = explode("\n", trim($data['datalog_csv']));
 
@@ -83,21 +153,31 @@ try {
         $nitrogen = floatval($fields[6]);
         $phosphorus = floatval($fields[7]);
         $potassium = floatval($fields[8]);
+        // Probe address (older logs have no probe column: single probe at 1)
+        $probe = isset($fields[9]) ? intval($fields[9]) : 1;
+        // Sample count and per-value standard deviation (newer firmware)
+        $samples = isset($fields[10]) ? intval($fields[10]) : null;
+        $sd = [];
+        for ($k = 0; $k < 7; $k++) {
+            $sd[$k] = isset($fields[11 + $k]) ? floatval($fields[11 + $k]) : null;
+        }
 
         // Check if this exact reading already exists (prevent duplicates)
         $checkStmt = $db->prepare(
             "SELECT id FROM soil_readings 
-             WHERE farmer_id = :id AND reading_timestamp = :ts 
+             WHERE farmer_id = :id AND reading_timestamp = :ts AND probe = :probe 
              LIMIT 1"
         );
-        $checkStmt->execute([':id' => $farmerId, ':ts' => $timestamp]);
+        $checkStmt->execute([':id' => $farmerId, ':ts' => $timestamp, ':probe' => $probe]);
 
         if (!$checkStmt->fetch()) {
             // Insert new reading
             $stmt = $db->prepare(
                 "INSERT INTO soil_readings 
-                 (farmer_id, reading_timestamp, humidity, temperature, ec, ph, nitrogen, phosphorus, potassium, synced_at) 
-                 VALUES (:id, :ts, :h, :t, :ec, :ph, :n, :p, :k, :synced)"
+                 (farmer_id, reading_timestamp, humidity, temperature, ec, ph, nitrogen, phosphorus, potassium, probe,
+                  samples, humidity_sd, temperature_sd, ec_sd, ph_sd, nitrogen_sd, phosphorus_sd, potassium_sd, synced_at) 
+                 VALUES (:id, :ts, :h, :t, :ec, :ph, :n, :p, :k, :probe,
+                         :samples, :h_sd, :t_sd, :ec_sd, :ph_sd, :n_sd, :p_sd, :k_sd, :synced)"
             );
             $stmt->execute([
                 ':id' => $farmerId,
@@ -109,6 +189,15 @@ try {
                 ':n' => $nitrogen,
                 ':p' => $phosphorus,
                 ':k' => $potassium,
+                ':probe' => $probe,
+                ':samples' => $samples,
+                ':h_sd' => $sd[0],
+                ':t_sd' => $sd[1],
+                ':ec_sd' => $sd[2],
+                ':ph_sd' => $sd[3],
+                ':n_sd' => $sd[4],
+                ':p_sd' => $sd[5],
+                ':k_sd' => $sd[6],
                 ':synced' => $now
             ]);
             $readingsImported++;
@@ -136,6 +225,7 @@ try {
     jsonResponse([
         'success' => true,
         'message' => "Sync complete. Farmers: $farmersImported, Readings: $readingsImported",
+        'batch' => $batch,
         'farmers_imported' => $farmersImported,
         'readings_imported' => $readingsImported,
         'sms_settings' => $smsData,
@@ -115,7 +115,7 @@ function renderReadingsTable(readings) {
   const tbody = document.getElementById('readings-tbody');
 
   if (readings.length === 0) {
-    tbody.innerHTML = '<tr><td colspan="9" class="loading">No readings yet. Sync data from the ESP32 device.</td></tr>';
+    tbody.innerHTML = '<tr><td colspan="10" class="loading">No readings yet. Sync data from the ESP32 device.</td></tr>';
     return;
   }
 
@@ -123,13 +123,14 @@ function renderReadingsTable(readings) {
     <tr>
       <td><strong>${r.farmer_id}</strong></td>
       <td>${r.reading_timestamp}</td>
-      <td>${fmtVal(r.humidity, '%')}</td>
-      <td>${fmtVal(r.temperature, '°C')}</td>
-      <td>${fmtVal(r.ec, '')}</td>
-      <td class="${phClass(r.ph)}">${fmtVal(r.ph, '')}</td>
-      <td>${fmtVal(r.nitrogen, '')}</td>
-      <td>${fmtVal(r.phosphorus, '')}</td>
-      <td>${fmtVal(r.potassium, '')}</td>
+      <td>${r.probe ?? 1}</td>
+      <td${noiseAttr(r, 'humidity')}>${fmtVal(r.humidity, '%')}</td>
+      <td${noiseAttr(r, 'temperature')}>${fmtVal(r.temperature, '°C')}</td>
+      <td${noiseAttr(r, 'ec')}>${fmtVal(r.ec, '')}</td>
+      <td class="${phClass(r.ph)}"${noiseAttr(r, 'ph', false)}>${fmtVal(r.ph, '')}</td>
+      <td${noiseAttr(r, 'nitrogen')}>${fmtVal(r.nitrogen, '')}</td>
+      <td${noiseAttr(r, 'phosphorus')}>${fmtVal(r.phosphorus, '')}</td>
+      <td${noiseAttr(r, 'potassium')}>${fmtVal(r.potassium, '')}</td>
     </tr>
   `).join('');
 }
@@ -139,6 +140,22 @@ function fmtVal(val, unit) {
   return parseFloat(val).toFixed(1) + unit;
 }
 
+// Standard deviation above which a stored value is flagged as noisy
+const NOISE_LIMITS = {
+  humidity: 2, temperature: 1, ec: 50, ph: 0.3,
+  nitrogen: 10, phosphorus: 10, potassium: 10
+};
+
+// Tooltip with the sample spread, plus the noisy class when it is too wide
+function noiseAttr(r, key, withClass = true) {
+  const sd = r[key + '_sd'];
+  if (sd === null || sd === undefined) return '';
+  const noisy = parseFloat(sd) > NOISE_LIMITS[key];
+  const title = ` title="±${parseFloat(sd).toFixed(2)} over ${r.samples} samples"`;
+  if (!noisy) return title;
+  return withClass ? ` class="val-noisy"${title}` : ` data-noisy="1"${title}`;
+}
+
 function phClass(ph) {
   if (ph === null) return '';
   ph = parseFloat(ph);
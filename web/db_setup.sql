@@ -28,10 +28,31 @@ CREATE TABLE IF NOT EXISTS soil_readings (
     nitrogen FLOAT DEFAULT NULL,
     phosphorus FLOAT DEFAULT NULL,
     potassium FLOAT DEFAULT NULL,
+    probe TINYINT UNSIGNED NOT NULL DEFAULT 1,
+    samples TINYINT UNSIGNED DEFAULT NULL,
+    humidity_sd FLOAT DEFAULT NULL,
+    temperature_sd FLOAT DEFAULT NULL,
+    ec_sd FLOAT DEFAULT NULL,
+    ph_sd FLOAT DEFAULT NULL,
+    nitrogen_sd FLOAT DEFAULT NULL,
+    phosphorus_sd FLOAT DEFAULT NULL,
+    potassium_sd FLOAT DEFAULT NULL,
     synced_at DATETIME DEFAULT NULL,
     FOREIGN KEY (farmer_id) REFERENCES farmers(farmer_id) ON DELETE CASCADE
 );
 
+-- Databases created before multi-probe support and sample statistics
+ALTER TABLE soil_readings ADD COLUMN IF NOT EXISTS probe TINYINT UNSIGNED NOT NULL DEFAULT 1 AFTER potassium;
+ALTER TABLE soil_readings
+    ADD COLUMN IF NOT EXISTS samples TINYINT UNSIGNED DEFAULT NULL AFTER probe,
+    ADD COLUMN IF NOT EXISTS humidity_sd FLOAT DEFAULT NULL AFTER samples,
+    ADD COLUMN IF NOT EXISTS temperature_sd FLOAT DEFAULT NULL AFTER humidity_sd,
+    ADD COLUMN IF NOT EXISTS ec_sd FLOAT DEFAULT NULL AFTER temperature_sd,
+    ADD COLUMN IF NOT EXISTS ph_sd FLOAT DEFAULT NULL AFTER ec_sd,
+    ADD COLUMN IF NOT EXISTS nitrogen_sd FLOAT DEFAULT NULL AFTER ph_sd,
+    ADD COLUMN IF NOT EXISTS phosphorus_sd FLOAT DEFAULT NULL AFTER nitrogen_sd,
+    ADD COLUMN IF NOT EXISTS potassium_sd FLOAT DEFAULT NULL AFTER phosphorus_sd;
+
 -- Sync requests (dashboard triggers, ESP32 polls)
 CREATE TABLE IF NOT EXISTS sync_requests (
     id INT AUTO_INCREMENT PRIMARY KEY,
@@ -40,6 +61,27 @@ CREATE TABLE IF NOT EXISTS sync_requests (
     status ENUM('pending', 'completed', 'failed') DEFAULT 'pending'
 );
 
+-- Device diagnostics (summary sent with the first batch of each sync)
+CREATE TABLE IF NOT EXISTS device_diagnostics (
+    id INT AUTO_INCREMENT PRIMARY KEY,
+    received_at DATETIME NOT NULL,
+    reset_reason VARCHAR(16) NOT NULL,
+    uptime_s INT UNSIGNED NOT NULL,
+    samples INT UNSIGNED NOT NULL,
+    dropped INT UNSIGNED NOT NULL,
+    min_heap INT UNSIGNED NOT NULL,
+    min_block INT UNSIGNED NOT NULL,
+    min_stack_ui INT UNSIGNED NOT NULL,
+    min_stack_io INT UNSIGNED NOT NULL,
+    min_stack_net INT UNSIGNED NOT NULL DEFAULT 0,
+    min_stack_gsm INT UNSIGNED NOT NULL,
+    max_loop_us INT UNSIGNED NOT NULL,
+    loop_hist VARCHAR(255) NOT NULL
+);
+
+-- Databases created before the network worker had its own stack
+ALTER TABLE device_diagnostics ADD COLUMN IF NOT EXISTS min_stack_net INT UNSIGNED NOT NULL DEFAULT 0 AFTER min_stack_io;
+
 -- SMS settings (configurable from dashboard, synced to ESP32 SD card)
 CREATE TABLE IF NOT EXISTS sms_settings (
     id INT PRIMARY KEY DEFAULT 1,